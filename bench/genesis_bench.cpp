@@ -0,0 +1,362 @@
+#include "genesis.hpp"
+#include "mixer_node.hpp"
+#include "os.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+// Renders synthetic graphs offline and prints, as JSON on stdout, how fast
+// each one ran at a range of thread counts and quanta:
+//
+//   mixer  N source nodes into one mixer, like N clips
+//   chain  a source through N resample/delay pairs in series
+//   tree   N source nodes summed pairwise by a tree of 2 input mixers
+//
+// ns_per_node_run is the average time spent in run callbacks.
+// overhead_ns_per_node_run is the rest of the workers' time, idle time
+// included, spread over the same runs; it is what the scheduler costs plus
+// whatever parallelism the graph fails to offer. Progress goes to stderr.
+
+static int usage(char *exe) {
+    fprintf(stderr, "Usage: %s [options]\n"
+            "Options:\n"
+            "  [--graph all]       mixer, chain, tree or all\n"
+            "  [--nodes 64]        number of source nodes, or chain links\n"
+            "  [--load 16]         work per sample in each source node\n"
+            "  [--seconds 2]       seconds of audio to render per run\n"
+            "  [--max-threads N]   defaults to the number of cores\n"
+            "  [--quantum N]       only this quantum instead of 0, 64, 256 and 1024\n"
+            , exe);
+    return 1;
+}
+
+enum BenchGraph {
+    BenchGraphMixer,
+    BenchGraphChain,
+    BenchGraphTree,
+
+    BenchGraphCount,
+};
+
+static const char *bench_graph_names[] = {
+    "mixer",
+    "chain",
+    "tree",
+};
+static_assert(array_length(bench_graph_names) == BenchGraphCount, "");
+
+static const int default_quanta[] = {0, 64, 256, 1024};
+
+struct BenchSourceContext {
+    float phase;
+    float state;
+};
+
+struct BenchResult {
+    double frames_per_second;
+    double realtime_factor;
+    long node_run_count;
+    double ns_per_node_run;
+    double overhead_ns_per_node_run;
+};
+
+static int bench_load = 16;
+
+static int bench_source_create(struct GenesisNode *node) {
+    BenchSourceContext *context = create_zero<BenchSourceContext>();
+    if (!context)
+        return GenesisErrorNoMem;
+    node->userdata = context;
+    return 0;
+}
+
+static void bench_source_destroy(struct GenesisNode *node) {
+    BenchSourceContext *context = (BenchSourceContext *)node->userdata;
+    destroy(context, 1);
+}
+
+static void bench_source_seek(struct GenesisNode *node) {
+    BenchSourceContext *context = (BenchSourceContext *)node->userdata;
+    context->phase = 0.0f;
+    context->state = 0.0f;
+}
+
+static void bench_source_run(struct GenesisNode *node) {
+    BenchSourceContext *context = (BenchSourceContext *)node->userdata;
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+
+    float phase = context->phase;
+    float state = context->state;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        float sample = sinf(phase);
+        // stand-in for real DSP work: a chain of one-pole filters
+        for (int i = 0; i < bench_load; i += 1)
+            state += 0.01f * (sample - state);
+        phase += 0.01f;
+        if (phase > 6.2831853f)
+            phase -= 6.2831853f;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            *out_buf = state * 0.01f;
+            out_buf += 1;
+        }
+    }
+    context->phase = phase;
+    context->state = state;
+
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void bench_sink_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+static GenesisNodeDescriptor *create_source_descriptor(GenesisPipeline *pipeline) {
+    GenesisNodeDescriptor *node_descr = ok_mem(genesis_create_node_descriptor(pipeline, 1,
+                "bench_source", "Synthetic load."));
+    genesis_node_descriptor_set_create_callback(node_descr, bench_source_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, bench_source_destroy);
+    genesis_node_descriptor_set_seek_callback(node_descr, bench_source_seek);
+    genesis_node_descriptor_set_run_callback(node_descr, bench_source_run);
+    GenesisPortDescriptor *port_descr = ok_mem(genesis_node_descriptor_create_port(
+                node_descr, 0, GenesisPortTypeAudioOut, "audio_out"));
+    genesis_audio_port_descriptor_set_channel_layout(port_descr,
+            genesis_pipeline_get_channel_layout(pipeline), true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(port_descr,
+            genesis_pipeline_get_sample_rate(pipeline), true, -1);
+    return node_descr;
+}
+
+static GenesisNodeDescriptor *create_sink_descriptor(GenesisPipeline *pipeline) {
+    GenesisNodeDescriptor *node_descr = ok_mem(genesis_create_node_descriptor(pipeline, 1,
+                "bench_sink", "Consumes frames as fast as possible."));
+    genesis_node_descriptor_set_run_callback(node_descr, bench_sink_run);
+    GenesisPortDescriptor *port_descr = ok_mem(genesis_node_descriptor_create_port(
+                node_descr, 0, GenesisPortTypeAudioIn, "audio_in"));
+    genesis_audio_port_descriptor_set_channel_layout(port_descr,
+            genesis_pipeline_get_channel_layout(pipeline), true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(port_descr,
+            genesis_pipeline_get_sample_rate(pipeline), true, -1);
+    genesis_audio_port_descriptor_set_is_sink(port_descr, true);
+    return node_descr;
+}
+
+static void connect_or_panic(GenesisNode *source, int source_port, GenesisNode *dest, int dest_port) {
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source, source_port),
+                genesis_node_port(dest, dest_port)));
+}
+
+// returns the node that feeds the sink
+static GenesisNode *create_mixer_graph(GenesisPipeline *pipeline, int node_count) {
+    GenesisNodeDescriptor *source_descr = create_source_descriptor(pipeline);
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, node_count, &mixer_descr));
+
+    GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+    for (int i = 0; i < node_count; i += 1) {
+        GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+        connect_or_panic(source_node, 0, mixer_node, i + 1);
+    }
+    return mixer_node;
+}
+
+static GenesisNode *create_chain_graph(GenesisPipeline *pipeline, int node_count) {
+    GenesisNodeDescriptor *source_descr = create_source_descriptor(pipeline);
+    GenesisNodeDescriptor *resample_descr = genesis_node_descriptor_find(pipeline, "resample");
+    GenesisNodeDescriptor *delay_descr = genesis_node_descriptor_find(pipeline, "delay");
+    if (!resample_descr || !delay_descr)
+        panic("missing built-in node descriptors");
+
+    // the delay is mono; the resamplers convert to and from it
+    GenesisNode *tail = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    for (int i = 0; i < node_count; i += 1) {
+        GenesisNode *resample_node = ok_mem(genesis_node_descriptor_create_node(resample_descr));
+        GenesisNode *delay_node = ok_mem(genesis_node_descriptor_create_node(delay_descr));
+        connect_or_panic(tail, (tail->descriptor == source_descr) ? 0 : 1, resample_node, 0);
+        connect_or_panic(resample_node, 1, delay_node, 0);
+        tail = delay_node;
+    }
+    GenesisNode *resample_node = ok_mem(genesis_node_descriptor_create_node(resample_descr));
+    connect_or_panic(tail, (tail->descriptor == source_descr) ? 0 : 1, resample_node, 0);
+    return resample_node;
+}
+
+static GenesisNode *create_tree_graph(GenesisPipeline *pipeline, int node_count) {
+    GenesisNodeDescriptor *source_descr = create_source_descriptor(pipeline);
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 2, &mixer_descr));
+
+    List<GenesisNode *> level;
+    for (int i = 0; i < node_count; i += 1)
+        ok_or_panic(level.append(ok_mem(genesis_node_descriptor_create_node(source_descr))));
+    // each pass sums pairs into the front of the list
+    int level_count = level.length();
+    while (level_count > 1) {
+        int next_count = 0;
+        for (int i = 0; i + 1 < level_count; i += 2) {
+            GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+            connect_or_panic(level.at(i), 0, mixer_node, 1);
+            connect_or_panic(level.at(i + 1), 0, mixer_node, 2);
+            level.at(next_count++) = mixer_node;
+        }
+        // an odd one out joins the next level as is
+        if (level_count % 2 == 1)
+            level.at(next_count++) = level.at(level_count - 1);
+        level_count = next_count;
+    }
+    return level.at(0);
+}
+
+static BenchResult bench_run(GenesisContext *context, BenchGraph graph, int thread_count,
+        int quantum, int node_count, double seconds)
+{
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, thread_count));
+    ok_or_panic(genesis_pipeline_set_quantum(pipeline, quantum));
+
+    GenesisNode *output_node;
+    switch (graph) {
+        case BenchGraphMixer:
+            output_node = create_mixer_graph(pipeline, node_count);
+            break;
+        case BenchGraphChain:
+            output_node = create_chain_graph(pipeline, node_count);
+            break;
+        case BenchGraphTree:
+            output_node = create_tree_graph(pipeline, node_count);
+            break;
+        case BenchGraphCount:
+            panic("invalid graph");
+    }
+    GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(create_sink_descriptor(pipeline)));
+    ok_or_panic(genesis_connect_audio_nodes(output_node, sink_node));
+
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    long frame_count = seconds * sample_rate;
+
+    // warm up caches and page in the buffers before measuring
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, sample_rate / 10));
+    genesis_pipeline_set_stats_enabled(pipeline, true);
+    genesis_pipeline_reset_stats(pipeline);
+
+    uint64_t start_ns = os_get_time_ns();
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, frame_count));
+    uint64_t elapsed_ns = os_get_time_ns() - start_ns;
+
+    long run_count = 0;
+    long run_ns = 0;
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNodeStats stats;
+        genesis_node_get_stats(pipeline->nodes.at(i), &stats);
+        run_count += stats.call_count;
+        run_ns += stats.total_ns;
+    }
+
+    BenchResult result;
+    result.frames_per_second = frame_count / (elapsed_ns / 1000000000.0);
+    result.realtime_factor = result.frames_per_second / sample_rate;
+    result.node_run_count = run_count;
+    if (run_count > 0) {
+        result.ns_per_node_run = run_ns / (double)run_count;
+        double worker_ns = (double)elapsed_ns * thread_count;
+        result.overhead_ns_per_node_run = max(0.0, worker_ns - run_ns) / run_count;
+    } else {
+        result.ns_per_node_run = 0.0;
+        result.overhead_ns_per_node_run = 0.0;
+    }
+
+    genesis_pipeline_destroy(pipeline);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int node_count = 64;
+    double seconds = 2.0;
+    int max_threads = os_concurrency();
+    int only_graph = -1;
+    int only_quantum = -1;
+
+    for (int i = 1; i < argc; i += 1) {
+        char *arg = argv[i];
+        if (arg[0] == '-' && arg[1] == '-' && i + 1 < argc) {
+            char *value = argv[++i];
+            if (strcmp(arg, "--graph") == 0) {
+                if (strcmp(value, "all") != 0) {
+                    for (int graph = 0; graph < BenchGraphCount; graph += 1) {
+                        if (strcmp(value, bench_graph_names[graph]) == 0)
+                            only_graph = graph;
+                    }
+                    if (only_graph == -1)
+                        return usage(argv[0]);
+                }
+            } else if (strcmp(arg, "--nodes") == 0) {
+                node_count = atoi(value);
+            } else if (strcmp(arg, "--load") == 0) {
+                bench_load = atoi(value);
+            } else if (strcmp(arg, "--seconds") == 0) {
+                seconds = atof(value);
+            } else if (strcmp(arg, "--max-threads") == 0) {
+                max_threads = atoi(value);
+            } else if (strcmp(arg, "--quantum") == 0) {
+                only_quantum = atoi(value);
+            } else {
+                return usage(argv[0]);
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (node_count < 1 || max_threads < 1 || seconds <= 0.0 ||
+        (only_quantum != -1 && (only_quantum < 0 || (only_quantum & (only_quantum - 1)) != 0)))
+    {
+        return usage(argv[0]);
+    }
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    fprintf(stdout, "{\n");
+    fprintf(stdout, "  \"version\": \"%s\",\n", genesis_version_string());
+    fprintf(stdout, "  \"nodes\": %d,\n", node_count);
+    fprintf(stdout, "  \"load\": %d,\n", bench_load);
+    fprintf(stdout, "  \"seconds\": %g,\n", seconds);
+    fprintf(stdout, "  \"results\": [");
+
+    const char *separator = "\n";
+    for (int graph = 0; graph < BenchGraphCount; graph += 1) {
+        if (only_graph != -1 && graph != only_graph)
+            continue;
+        for (int quantum_i = 0; quantum_i < array_length(default_quanta); quantum_i += 1) {
+            int quantum = (only_quantum == -1) ? default_quanta[quantum_i] : only_quantum;
+            if (only_quantum != -1 && quantum_i > 0)
+                break;
+            // 1, 2, 4, ... and the maximum itself
+            for (int thread_count = 1;; thread_count = min(thread_count * 2, max_threads)) {
+                fprintf(stderr, "%s graph, quantum %d, %d threads\n",
+                        bench_graph_names[graph], quantum, thread_count);
+                BenchResult result = bench_run(context, (BenchGraph)graph, thread_count,
+                        quantum, node_count, seconds);
+                fprintf(stdout, "%s    {\"graph\": \"%s\", \"threads\": %d, \"quantum\": %d, "
+                        "\"frames_per_second\": %.1f, \"realtime_factor\": %.2f, "
+                        "\"node_runs\": %ld, \"ns_per_node_run\": %.1f, "
+                        "\"overhead_ns_per_node_run\": %.1f}",
+                        separator, bench_graph_names[graph], thread_count, quantum,
+                        result.frames_per_second, result.realtime_factor, result.node_run_count,
+                        result.ns_per_node_run, result.overhead_ns_per_node_run);
+                separator = ",\n";
+                if (thread_count == max_threads)
+                    break;
+            }
+        }
+    }
+    fprintf(stdout, "\n  ]\n}\n");
+
+    genesis_context_destroy(context);
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include "asset_variant_cache.hpp"
+#include "resample.hpp"
+#include "os.hpp"
+#include "util.hpp"
+#include "warning.hpp"
+
+static void get_variant_path(AssetVariantCache *cache, AssetVariant *variant, ByteBuffer &out_path) {
+    ByteBuffer file_name;
+    file_name.format("%s-%d.flac", variant->sha256sum.to_string().raw(), variant->sample_rate);
+    os_path_join(out_path, cache->dir, file_name);
+}
+
+// Written next to the variant and renamed once complete, so that a variant
+// that exists is always whole.
+static void get_variant_tmp_path(AssetVariantCache *cache, AssetVariant *variant, ByteBuffer &out_path) {
+    ByteBuffer file_name;
+    file_name.format("%s-%d.tmp.flac", variant->sha256sum.to_string().raw(), variant->sample_rate);
+    os_path_join(out_path, cache->dir, file_name);
+}
+
+static int save_variant(AssetVariantCache *cache, AssetVariant *variant) {
+    int err;
+    if ((err = os_mkdirp(cache->dir)))
+        return err;
+
+    ByteBuffer path;
+    get_variant_path(cache, variant, path);
+    ByteBuffer tmp_path;
+    get_variant_tmp_path(cache, variant, tmp_path);
+
+    GenesisExportFormat export_format;
+    export_format.codec = genesis_guess_audio_file_codec(cache->genesis_context, path.raw(),
+            nullptr, nullptr);
+    if (!export_format.codec)
+        return GenesisErrorInvalidFormat;
+    int sample_format_index = genesis_audio_file_codec_best_sample_format(export_format.codec);
+    export_format.sample_format = genesis_audio_file_codec_sample_format_index(
+            export_format.codec, sample_format_index);
+    export_format.bit_rate = 0;
+    export_format.sample_rate = variant->sample_rate;
+
+    if ((err = genesis_audio_file_export(variant->audio_file, tmp_path.raw(), -1, &export_format))) {
+        os_delete(tmp_path.raw());
+        return err;
+    }
+    return os_rename_clobber(tmp_path.raw(), path.raw());
+}
+
+static void make_variant(AssetVariantCache *cache, AssetVariant *variant) {
+    ByteBuffer path;
+    get_variant_path(cache, variant, path);
+    GenesisAudioFile *audio_file;
+    if (!genesis_audio_file_load(cache->genesis_context, path.raw(), &audio_file)) {
+        if (genesis_audio_file_sample_rate(audio_file) == variant->sample_rate) {
+            variant->audio_file = audio_file;
+            variant->from_cache = true;
+            return;
+        }
+        genesis_audio_file_destroy(audio_file);
+    }
+
+    GenesisAudioFile *asset_file;
+    if ((variant->err = genesis_audio_file_load(cache->genesis_context, variant->asset_path.raw(),
+                    &asset_file)))
+    {
+        return;
+    }
+    variant->err = resample_audio_file(asset_file, variant->sample_rate, &variant->audio_file);
+    genesis_audio_file_destroy(asset_file);
+    if (variant->err)
+        return;
+
+    // still good to play from memory
+    if (save_variant(cache, variant))
+        emit_warning(WarningAssetVariantSave);
+}
+
+static void cache_thread_run(void *userdata) {
+    AssetVariantCache *cache = (AssetVariantCache *)userdata;
+    os_mutex_lock(cache->mutex);
+    for (;;) {
+        if (cache->quit)
+            break;
+        if (cache->queue.length() == 0) {
+            os_cond_wait(cache->cond, cache->mutex);
+            continue;
+        }
+        // in the order they were asked for
+        AssetVariant *variant = cache->queue.at(0);
+        cache->queue.remove_range(0, 1);
+        os_mutex_unlock(cache->mutex);
+
+        make_variant(cache, variant);
+
+        os_mutex_lock(cache->mutex);
+        ok_or_panic(cache->done.append(variant));
+    }
+    os_mutex_unlock(cache->mutex);
+}
+
+int asset_variant_cache_create(GenesisContext *genesis_context, const ByteBuffer &dir,
+        AssetVariantCache **out_cache)
+{
+    *out_cache = nullptr;
+    AssetVariantCache *cache = create_zero<AssetVariantCache>();
+    if (!cache)
+        return GenesisErrorNoMem;
+
+    cache->genesis_context = genesis_context;
+    cache->dir = dir;
+    cache->mutex = os_mutex_create();
+    cache->cond = os_cond_create();
+    if (!cache->mutex || !cache->cond) {
+        asset_variant_cache_destroy(cache);
+        return GenesisErrorNoMem;
+    }
+
+    int err;
+    if ((err = os_thread_create(cache_thread_run, cache, false, &cache->thread))) {
+        asset_variant_cache_destroy(cache);
+        return err;
+    }
+
+    *out_cache = cache;
+    return 0;
+}
+
+void asset_variant_cache_destroy(AssetVariantCache *cache) {
+    if (!cache)
+        return;
+
+    if (cache->thread) {
+        os_mutex_lock(cache->mutex);
+        cache->quit = true;
+        os_cond_signal(cache->cond, cache->mutex);
+        os_mutex_unlock(cache->mutex);
+        os_thread_destroy(cache->thread);
+    }
+
+    for (int i = 0; i < cache->queue.length(); i += 1)
+        asset_variant_destroy(cache->queue.at(i));
+    for (int i = 0; i < cache->done.length(); i += 1) {
+        AssetVariant *variant = cache->done.at(i);
+        genesis_audio_file_destroy(variant->audio_file);
+        asset_variant_destroy(variant);
+    }
+
+    os_cond_destroy(cache->cond);
+    os_mutex_destroy(cache->mutex);
+    destroy(cache, 1);
+}
+
+int asset_variant_cache_request(AssetVariantCache *cache, const ByteBuffer &sha256sum,
+        const ByteBuffer &asset_path, int sample_rate)
+{
+    AssetVariant *variant = create_zero<AssetVariant>();
+    if (!variant)
+        return GenesisErrorNoMem;
+    variant->sha256sum = sha256sum;
+    variant->asset_path = asset_path;
+    variant->sample_rate = sample_rate;
+
+    OsMutexLocker locker(cache->mutex);
+    int err;
+    if ((err = cache->queue.append(variant))) {
+        asset_variant_destroy(variant);
+        return err;
+    }
+    os_cond_signal(cache->cond, cache->mutex);
+    return 0;
+}
+
+AssetVariant *asset_variant_cache_take_done(AssetVariantCache *cache) {
+    OsMutexLocker locker(cache->mutex);
+    if (cache->done.length() == 0)
+        return nullptr;
+    AssetVariant *variant = cache->done.at(0);
+    cache->done.remove_range(0, 1);
+    return variant;
+}
+
+void asset_variant_destroy(AssetVariant *variant) {
+    destroy(variant, 1);
+}
@@ -0,0 +1,56 @@
+#ifndef GENESIS_ASSET_VARIANT_CACHE_HPP
+#define GENESIS_ASSET_VARIANT_CACHE_HPP
+
+#include "genesis.h"
+#include "byte_buffer.hpp"
+#include "list.hpp"
+
+struct OsThread;
+struct OsMutex;
+struct OsCond;
+
+// An audio asset resampled to another sample rate.
+struct AssetVariant {
+    ByteBuffer sha256sum;
+    int sample_rate;
+    ByteBuffer asset_path;
+    // null if the variant could not be made; err says why
+    GenesisAudioFile *audio_file;
+    int err;
+    // loaded from a file made before rather than resampled
+    bool from_cache;
+};
+
+// Makes asset variants on a thread of its own, so that playback can read
+// audio at the project sample rate instead of resampling it in realtime.
+// Each variant is saved in dir, named by the sha256sum of the asset and the
+// sample rate, so that it is made only once. Variants are made in the order
+// they are asked for.
+struct AssetVariantCache {
+    GenesisContext *genesis_context;
+    ByteBuffer dir;
+    OsThread *thread;
+    OsMutex *mutex;
+    OsCond *cond;
+    // the rest is guarded by mutex
+    List<AssetVariant *> queue;
+    List<AssetVariant *> done;
+    bool quit;
+};
+
+int asset_variant_cache_create(GenesisContext *genesis_context, const ByteBuffer &dir,
+        AssetVariantCache **out_cache);
+// Waits for the variant being made, if any, and drops the rest.
+void asset_variant_cache_destroy(AssetVariantCache *cache);
+
+// asset_path is the full path of the asset file.
+int asset_variant_cache_request(AssetVariantCache *cache, const ByteBuffer &sha256sum,
+        const ByteBuffer &asset_path, int sample_rate);
+// Returns the variant that was done first, or null if there are none. The
+// caller owns it.
+AssetVariant *asset_variant_cache_take_done(AssetVariantCache *cache);
+
+// Does not destroy audio_file.
+void asset_variant_destroy(AssetVariant *variant);
+
+#endif
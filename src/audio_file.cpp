@@ -1183,6 +1183,7 @@ struct GenesisAudioFile *genesis_audio_file_create(struct GenesisContext *contex
         return nullptr;
     }
 
+    audio_file->genesis_context = context;
     audio_file->sample_rate = sample_rate;
     audio_file->channel_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
     if (audio_file->channels.resize(1)) {
@@ -1202,7 +1203,7 @@ void genesis_audio_file_set_sample_rate(struct GenesisAudioFile *audio_file,
 int genesis_audio_file_set_channel_layout(struct GenesisAudioFile *audio_file,
         const SoundIoChannelLayout *channel_layout)
 {
-    int err = audio_file->channels.resize(audio_file->channel_layout.channel_count);
+    int err = audio_file->channels.resize(channel_layout->channel_count);
     if (err)
         return err;
     audio_file->channel_layout = *channel_layout;
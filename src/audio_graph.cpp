@@ -2,170 +2,201 @@
 #include "mixer_node.hpp"
 #include "settings_file.hpp"
 
-static const int AUDIO_CLIP_POLYPHONY = 32;
+static const int TRACK_POLYPHONY = 32;
+// nothing waits on a render, so use big blocks
+static const double RENDER_LATENCY = 1.0;
 
 static_assert(sizeof(long) == 8, "require long to be 8 bytes");
 
-struct AudioClipNodeChannel {
+struct TrackNodeChannel {
     struct GenesisAudioFileIterator iter;
     long offset;
 };
 
-struct AudioClipVoice {
+struct TrackVoice {
     bool active;
-    AudioClipNodeChannel channels[GENESIS_MAX_CHANNELS];
+    TrackNodeChannel channels[GENESIS_MAX_CHANNELS];
     int frames_until_start;
     long frame_index;
     long frame_end;
 };
 
-struct AudioClipNodeContext {
-    AudioGraphClip *clip;
-    GenesisAudioFile *audio_file;
-    int frame_pos;
-
-    AudioClipVoice voices[AUDIO_CLIP_POLYPHONY];
-    int next_note_index;
-};
-
-struct AudioClipEventNodeContext {
-    AudioGraphClip *clip;
-    double pos;
-    bool detect_ongoing_notes;
+struct TrackNodeContext {
+    AudioGraphTrack *track;
+    long frame_pos;
+    // the index that cursor points into, or NULL to find the place again
+    SegmentIndex *segment_index;
+    // the first segment that has not been started
+    int cursor;
+    bool detect_ongoing_segments;
+
+    TrackVoice voices[TRACK_POLYPHONY];
+    int next_voice_index;
 };
 
-static AudioClipVoice *find_next_voice(AudioClipNodeContext *context) {
+static TrackVoice *find_next_voice(TrackNodeContext *context) {
     for (int i = 0;; i += 1) {
-        AudioClipVoice *voice = &context->voices[context->next_note_index];
-        context->next_note_index = (context->next_note_index + 1) % AUDIO_CLIP_POLYPHONY;
-        if (!voice->active || i == AUDIO_CLIP_POLYPHONY)
+        TrackVoice *voice = &context->voices[context->next_voice_index];
+        context->next_voice_index = (context->next_voice_index + 1) % TRACK_POLYPHONY;
+        if (!voice->active || i == TRACK_POLYPHONY)
             return voice;
     }
 }
 
-static void audio_clip_node_destroy(struct GenesisNode *node) {
-    AudioClipNodeContext *audio_clip_context = (AudioClipNodeContext*)node->userdata;
-    destroy(audio_clip_context, 1);
+static void track_node_destroy(struct GenesisNode *node) {
+    TrackNodeContext *track_context = (TrackNodeContext*)node->userdata;
+    destroy(track_context, 1);
 }
 
-static int audio_clip_node_create(struct GenesisNode *node) {
+static int track_node_create(struct GenesisNode *node) {
     const GenesisNodeDescriptor *node_descr = genesis_node_descriptor(node);
-    AudioClipNodeContext *audio_clip_context = create_zero<AudioClipNodeContext>();
-    node->userdata = audio_clip_context;
+    TrackNodeContext *track_context = create_zero<TrackNodeContext>();
+    node->userdata = track_context;
     if (!node->userdata) {
-        audio_clip_node_destroy(node);
+        track_node_destroy(node);
         return GenesisErrorNoMem;
     }
-    audio_clip_context->clip = (AudioGraphClip*)genesis_node_descriptor_userdata(node_descr);
-    audio_clip_context->audio_file = audio_clip_context->clip->audio_clip->audio_asset->audio_file;
+    genesis_node_set_userdata_size(node, sizeof(TrackNodeContext));
+    track_context->track = (AudioGraphTrack*)genesis_node_descriptor_userdata(node_descr);
     return 0;
 }
 
-static void audio_clip_node_seek(struct GenesisNode *node) {
-    struct AudioClipNodeContext *context = (struct AudioClipNodeContext*)node->userdata;
+static void track_node_seek(struct GenesisNode *node) {
+    struct TrackNodeContext *context = (struct TrackNodeContext*)node->userdata;
     struct GenesisPipeline *pipeline = genesis_node_pipeline(node);
     struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
     int frame_rate = genesis_audio_port_sample_rate(audio_out_port);
-    context->frame_pos = genesis_whole_notes_to_frames(pipeline, node->timestamp, frame_rate);
-    for (int voice_i = 0; voice_i < AUDIO_CLIP_POLYPHONY; voice_i += 1) {
+    context->frame_pos = genesis_whole_notes_to_sample_pos(pipeline, node->timestamp, frame_rate);
+    context->segment_index = nullptr;
+    context->detect_ongoing_segments = true;
+    for (int voice_i = 0; voice_i < TRACK_POLYPHONY; voice_i += 1) {
         context->voices[voice_i].active = false;
     }
 }
 
-static void audio_clip_node_run(struct GenesisNode *node) {
-    struct AudioClipNodeContext *context = (struct AudioClipNodeContext*)node->userdata;
-    struct GenesisPipeline *pipeline = genesis_node_pipeline(node);
-    AudioGraph *ag = context->clip->audio_graph;
+// index of the first segment that starts at or after pos
+static int find_segment_at(SegmentIndex *segment_index, long pos) {
+    int low = 0;
+    int high = segment_index->segments.length();
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (segment_index->segments.at(mid).pos < pos)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// index of the first segment that could still be sounding at pos; none of
+// the segments before it are
+static int find_first_ongoing_segment(SegmentIndex *segment_index, long pos) {
+    int low = 0;
+    int high = segment_index->max_end_pos.length();
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (segment_index->max_end_pos.at(mid) <= pos)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// Starts a voice for the part of the segment from frame_at_start on. Returns
+// false if the segment does not start within frame_count frames.
+static bool start_segment_voice(TrackNodeContext *context, const TrackSegment *segment,
+        int channel_count, long frame_at_start, int frame_count)
+{
+    long frames_until_start = segment->pos - frame_at_start;
+    if (frames_until_start >= frame_count)
+        return false;
+    long frame_index = segment->start;
+    if (frames_until_start < 0) {
+        frame_index -= frames_until_start;
+        frames_until_start = 0;
+    }
+    if (frame_index >= segment->end)
+        return true;
+
+    TrackVoice *voice = find_next_voice(context);
+    voice->active = true;
+    voice->frames_until_start = frames_until_start;
+    voice->frame_index = frame_index;
+    voice->frame_end = segment->end;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        struct TrackNodeChannel *channel = &voice->channels[ch];
+        channel->iter = genesis_audio_file_iterator(segment->audio_file, ch, frame_index);
+        channel->offset = 0;
+    }
+    return true;
+}
+
+static void track_node_run(struct GenesisNode *node) {
+    struct TrackNodeContext *context = (struct TrackNodeContext*)node->userdata;
+    AudioGraph *ag = context->track->audio_graph;
     struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
-    struct GenesisPort *events_in_port = genesis_node_port(node, 1);
 
-    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
     const struct SoundIoChannelLayout *channel_layout =
         genesis_audio_port_channel_layout(audio_out_port);
-    int frame_rate = genesis_audio_port_sample_rate(audio_out_port);
     int channel_count = channel_layout->channel_count;
-    int bytes_per_frame = genesis_audio_port_bytes_per_frame(audio_out_port);
-    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    // the port is planar, so each channel is a contiguous run of samples,
+    // just like the audio file channels we copy from.
+    float *out_bufs[GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        out_bufs[ch] = genesis_audio_out_port_channel_write_ptr(audio_out_port, ch);
+        memset(out_bufs[ch], 0, frame_count * sizeof(float));
+    }
     bool is_playing = ag->is_playing.load();
     if (!is_playing) {
-        memset(out_buf, 0, output_frame_count * bytes_per_frame);
-        genesis_audio_out_port_advance_write_ptr(audio_out_port, output_frame_count);
+        genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
         return;
     }
 
-    int frame_at_start = context->frame_pos;
-    double whole_note_at_start = genesis_frames_to_whole_notes(pipeline, frame_at_start, frame_rate);
-    int wanted_frame_at_end = frame_at_start + output_frame_count;
-    double wanted_whole_note_at_end = genesis_frames_to_whole_notes(pipeline, wanted_frame_at_end, frame_rate);
-    double event_time_requested = wanted_whole_note_at_end - whole_note_at_start;
-    assert(event_time_requested >= 0.0);
-
-    int event_count;
-    double event_buf_size;
-    genesis_events_in_port_fill_count(events_in_port, event_time_requested, &event_count, &event_buf_size);
-
-    double whole_note_at_end = whole_note_at_start + event_buf_size;
-    int frame_at_event_end = genesis_whole_notes_to_frames(pipeline, whole_note_at_end, frame_rate);
-    int input_frame_count = max(0, frame_at_event_end - frame_at_start);
-    int frame_count = min(output_frame_count, input_frame_count);
-    int frame_at_consume_end = frame_at_start + frame_count;
-    double whole_note_at_consume_end = genesis_frames_to_whole_notes(pipeline, frame_at_consume_end, frame_rate);
-    double event_whole_notes_consumed = whole_note_at_consume_end - whole_note_at_start;
-
-    GenesisMidiEvent *event = genesis_events_in_port_read_ptr(events_in_port);
-    int event_index;
-    for (event_index = 0; event_index < event_count; event_index += 1, event += 1) {
-        int frame_at_this_event_start = genesis_whole_notes_to_frames(pipeline, event->start, frame_rate);
-        int frames_until_start = frame_at_this_event_start - frame_at_start;
-        int frame_index_offset = 0;
-        if (frames_until_start < 0) {
-            frame_index_offset = -frames_until_start;
-            frames_until_start = 0;
-        }
-        if (frames_until_start >= frame_count ||
-            event->data.segment_data.start + frame_index_offset >= event->data.segment_data.end)
-        {
-            break;
-        }
-        if (event->event_type == GenesisMidiEventTypeSegment) {
-            AudioClipVoice *voice = find_next_voice(context);
-
-            voice->active = true;
-            voice->frames_until_start = frames_until_start;
-            voice->frame_index = event->data.segment_data.start;
-            voice->frame_end = event->data.segment_data.end;
-            for (int ch = 0; ch < channel_count; ch += 1) {
-                struct AudioClipNodeChannel *channel = &voice->channels[ch];
-                channel->iter = genesis_audio_file_iterator(context->audio_file, ch,
-                        frame_index_offset);
-                channel->offset = 0;
-            }
+    long frame_at_start = context->frame_pos;
+
+    // the cursor only means something in the index it was found in
+    SegmentIndex *segment_index = context->track->segments.get_read_ptr();
+    if (segment_index != context->segment_index) {
+        context->segment_index = segment_index;
+        context->cursor = find_segment_at(segment_index, frame_at_start);
+    }
+
+    if (context->detect_ongoing_segments) {
+        int first = find_first_ongoing_segment(segment_index, frame_at_start);
+        for (int i = first; i < context->cursor; i += 1) {
+            TrackSegment *segment = &segment_index->segments.at(i);
+            if (segment->end_pos > frame_at_start)
+                start_segment_voice(context, segment, channel_count, frame_at_start, frame_count);
         }
+        context->detect_ongoing_segments = false;
     }
-    genesis_events_in_port_advance_read_ptr(events_in_port, event_index, event_whole_notes_consumed);
 
-    // set everything to silence and then we'll add samples in
-    memset(out_buf, 0, frame_count * bytes_per_frame);
+    for (; context->cursor < segment_index->segments.length(); context->cursor += 1) {
+        TrackSegment *segment = &segment_index->segments.at(context->cursor);
+        if (!start_segment_voice(context, segment, channel_count, frame_at_start, frame_count))
+            break;
+    }
 
-    for (int voice_i = 0; voice_i < AUDIO_CLIP_POLYPHONY; voice_i += 1) {
-        AudioClipVoice *voice = &context->voices[voice_i];
+    for (int voice_i = 0; voice_i < TRACK_POLYPHONY; voice_i += 1) {
+        TrackVoice *voice = &context->voices[voice_i];
         if (!voice->active)
             continue;
 
-        int out_frame_count = min(frame_count, frame_count - voice->frames_until_start);
-        int audio_file_frames_left = voice->frame_end - voice->frame_index;
-        int frames_to_advance = min(out_frame_count, audio_file_frames_left);
+        int out_frame_count = frame_count - voice->frames_until_start;
+        long audio_file_frames_left = voice->frame_end - voice->frame_index;
+        int frames_to_advance = min((long)out_frame_count, audio_file_frames_left);
         for (int ch = 0; ch < channel_count; ch += 1) {
-            struct AudioClipNodeChannel *channel = &voice->channels[ch];
+            struct TrackNodeChannel *channel = &voice->channels[ch];
+            float *out_buf = out_bufs[ch] + voice->frames_until_start;
             for (int frame_offset = 0; frame_offset < frames_to_advance; frame_offset += 1) {
                 if (channel->offset >= channel->iter.end) {
                     genesis_audio_file_iterator_next(&channel->iter);
                     channel->offset = 0;
                 }
 
-                int out_frame_index = voice->frames_until_start + frame_offset;
-                int out_sample_index = out_frame_index * channel_count + ch;
-                out_buf[out_sample_index] += channel->iter.ptr[channel->offset];
+                out_buf[frame_offset] += channel->iter.ptr[channel->offset];
                 channel->offset += 1;
             }
         }
@@ -179,64 +210,6 @@ static void audio_clip_node_run(struct GenesisNode *node) {
     genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
 }
 
-static void audio_clip_event_node_destroy(struct GenesisNode *node) {
-    AudioClipEventNodeContext *audio_clip_event_node_context = (AudioClipEventNodeContext*)node->userdata;
-    destroy(audio_clip_event_node_context, 1);
-}
-
-static int audio_clip_event_node_create(struct GenesisNode *node) {
-    const GenesisNodeDescriptor *node_descr = genesis_node_descriptor(node);
-    AudioClipEventNodeContext *audio_clip_event_node_context = create_zero<AudioClipEventNodeContext>();
-    node->userdata = audio_clip_event_node_context;
-    if (!node->userdata) {
-        audio_clip_node_destroy(node);
-        return GenesisErrorNoMem;
-    }
-    audio_clip_event_node_context->clip =
-        (AudioGraphClip*) genesis_node_descriptor_userdata(node_descr);
-    return 0;
-}
-
-static void audio_clip_event_node_seek(struct GenesisNode *node) {
-    AudioClipEventNodeContext *audio_clip_event_node_context = (AudioClipEventNodeContext*)node->userdata;
-    audio_clip_event_node_context->pos = node->timestamp;
-    audio_clip_event_node_context->detect_ongoing_notes = true;
-}
-
-static void audio_clip_event_node_run(struct GenesisNode *node) {
-    AudioClipEventNodeContext *context = (AudioClipEventNodeContext*)node->userdata;
-    AudioGraphClip *clip = context->clip;
-    struct GenesisPort *events_out_port = genesis_node_port(node, 0);
-
-    int event_count;
-    double event_time_requested;
-    genesis_events_out_port_free_count(events_out_port, &event_count, &event_time_requested);
-    GenesisMidiEvent *event_buf = genesis_events_out_port_write_ptr(events_out_port);
-
-    double end_pos = context->pos + event_time_requested;
-
-    int event_index = 0;
-    List<GenesisMidiEvent> *event_list = clip->events.get_read_ptr();
-    for (int i = 0; i < event_list->length(); i += 1) {
-        GenesisMidiEvent *event = &event_list->at(i);
-        if ((event->start >= context->pos || context->detect_ongoing_notes) &&
-                event->start < end_pos)
-        {
-            *event_buf = *event;
-            event_buf += 1;
-            event_index += 1;
-
-            if (event_index >= event_count) {
-                event_time_requested = event->start - context->pos;
-                break;
-            }
-        }
-    }
-    context->detect_ongoing_notes = false;
-    context->pos += event_time_requested;
-    genesis_events_out_port_advance_write_ptr(events_out_port, event_index, event_time_requested);
-}
-
 static void audio_file_node_run(struct GenesisNode *node) {
     const struct GenesisNodeDescriptor *node_descriptor = genesis_node_descriptor(node);
     struct AudioGraph *ag = (struct AudioGraph *)genesis_node_descriptor_userdata(node_descriptor);
@@ -280,6 +253,9 @@ static void render_node_run(struct GenesisNode *node) {
     float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
     GenesisAudioFileStream *afs = ag->render_stream;
 
+    // stop consuming so that the offline render runs out of progress and returns
+    if (ag->render_cancel.load())
+        return;
 
     int frames_left = ag->render_frame_count - ag->render_frame_index;
     int write_count = min(input_frame_count, frames_left);
@@ -324,61 +300,108 @@ static void stop_pipeline(AudioGraph *ag) {
     genesis_node_descriptor_destroy(ag->mixer_descr);
     ag->mixer_descr = nullptr;
 
-    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
-        AudioGraphClip *clip = ag->audio_clip_list.at(i);
-        genesis_node_disconnect_all_ports(clip->node);
+    for (int i = 0; i < ag->track_list.length(); i += 1) {
+        AudioGraphTrack *track = ag->track_list.at(i);
+        track->mixer_input_index = -1;
+        genesis_node_disconnect_all_ports(track->node);
 
-        genesis_node_destroy(clip->resample_node);
-        clip->resample_node = nullptr;
+        genesis_node_destroy(track->resample_node);
+        track->resample_node = nullptr;
     }
 }
 
-void audio_graph_start_pipeline(AudioGraph *ag) {
+// Replaces the sample file preview node with one for the current preview
+// file, and connects it to audio_in_port through a resampler if needed.
+static void connect_audio_file_node(AudioGraph *ag, GenesisPort *audio_in_port) {
     int err;
 
-    ag->start_play_head_pos = ag->play_head_pos;
-
-    if (genesis_pipeline_is_running(ag->pipeline))
-        return;
-
-    int target_sample_rate = genesis_pipeline_get_sample_rate(ag->pipeline);
-    SoundIoChannelLayout *target_channel_layout = genesis_pipeline_get_channel_layout(ag->pipeline);
+    genesis_node_destroy(ag->resample_node);
+    ag->resample_node = nullptr;
+    genesis_node_destroy(ag->audio_file_node);
+    ag->audio_file_node = nullptr;
 
-    int audio_file_node_count = ag->audio_file_port_descr ? 1 : 0;
+    if (ag->preview_audio_file) {
+        // Set channel layout
+        const struct SoundIoChannelLayout *channel_layout =
+            genesis_audio_file_channel_layout(ag->preview_audio_file);
+        genesis_audio_port_descriptor_set_channel_layout(
+                ag->audio_file_port_descr, channel_layout, true, -1);
+
+        // Set sample rate
+        int sample_rate = genesis_audio_file_sample_rate(ag->preview_audio_file);
+        genesis_audio_port_descriptor_set_sample_rate(ag->audio_file_port_descr, sample_rate, true, -1);
+
+    } else {
+        int target_sample_rate = genesis_pipeline_get_sample_rate(ag->pipeline);
+        SoundIoChannelLayout *target_channel_layout = genesis_pipeline_get_channel_layout(ag->pipeline);
+        genesis_audio_port_descriptor_set_channel_layout(
+                ag->audio_file_port_descr, target_channel_layout, true, -1);
+        genesis_audio_port_descriptor_set_sample_rate(
+                ag->audio_file_port_descr, target_sample_rate, true, -1);
+    }
+    ag->audio_file_node = ok_mem(genesis_node_descriptor_create_node(ag->audio_file_descr));
 
-    if (audio_file_node_count >= 1) {
+    int audio_out_port_index = genesis_node_descriptor_find_port_index(ag->audio_file_descr, "audio_out");
+    if (audio_out_port_index < 0)
+        panic("port not found");
 
-        if (ag->audio_file_node) {
-            genesis_node_destroy(ag->audio_file_node);
-            ag->audio_file_node = nullptr;
-        }
+    GenesisPort *audio_out_port = genesis_node_port(ag->audio_file_node, audio_out_port_index);
 
-        if (ag->preview_audio_file) {
-            // Set channel layout
-            const struct SoundIoChannelLayout *channel_layout =
-                genesis_audio_file_channel_layout(ag->preview_audio_file);
-            genesis_audio_port_descriptor_set_channel_layout(
-                    ag->audio_file_port_descr, channel_layout, true, -1);
+    if ((err = genesis_connect_ports(audio_out_port, audio_in_port))) {
+        if (err == GenesisErrorIncompatibleChannelLayouts ||
+            err == GenesisErrorIncompatibleSampleRates)
+        {
+            int resample_audio_out_index = genesis_node_descriptor_find_port_index(
+                    ag->preview_resample_descr, "audio_out");
+            assert(resample_audio_out_index >= 0);
 
-            // Set sample rate
-            int sample_rate = genesis_audio_file_sample_rate(ag->preview_audio_file);
-            genesis_audio_port_descriptor_set_sample_rate(ag->audio_file_port_descr, sample_rate, true, -1);
+            ag->resample_node = ok_mem(genesis_node_descriptor_create_node(ag->preview_resample_descr));
+            ok_or_panic(genesis_connect_audio_nodes(ag->audio_file_node, ag->resample_node));
 
+            GenesisPort *audio_out_port = genesis_node_port(ag->resample_node, resample_audio_out_index);
+            ok_or_panic(genesis_connect_ports(audio_out_port, audio_in_port));
         } else {
-            genesis_audio_port_descriptor_set_channel_layout(
-                    ag->audio_file_port_descr, target_channel_layout, true, -1);
-            genesis_audio_port_descriptor_set_sample_rate(
-                    ag->audio_file_port_descr, target_sample_rate, true, -1);
+            ok_or_panic(err);
         }
-        ag->audio_file_node = ok_mem(genesis_node_descriptor_create_node(ag->audio_file_descr));
     }
+}
 
+// Tracks all play into the master mixer line, so its volume is the gain of
+// every track input of the mixer. The preview input stays at unity.
+static void set_track_gains(AudioGraph *ag, int ramp_frame_count) {
+    float volume = ag->project->mixer_line_list.at(0)->volume;
+    for (int i = 0; i < ag->track_list.length(); i += 1) {
+        AudioGraphTrack *track = ag->track_list.at(i);
+        if (track->mixer_input_index < 0)
+            continue;
+        GenesisPort *gain_port = mixer_gain_port(ag->mixer_node, track->mixer_input_index);
+        long frame_index = genesis_param_port_frame_index(gain_port);
+        int err = genesis_param_port_schedule(gain_port, frame_index, volume, ramp_frame_count);
+        // With the queue full the mixer is behind on earlier changes; the
+        // next volume change brings the gain up to date.
+        if (err && err != GenesisErrorQueueFull)
+            ok_or_panic(err);
+    }
+}
+
+static void on_project_mixer_lines_changed(Event, void *userdata) {
+    AudioGraph *ag = (AudioGraph *)userdata;
+    if (!ag->mixer_node)
+        return;
+    // ramp over about 10ms so that the change does not click
+    set_track_gains(ag, genesis_pipeline_get_sample_rate(ag->pipeline) / 100);
+}
+
+static void connect_pipeline(AudioGraph *ag) {
+    int err;
+
+    int audio_file_node_count = ag->audio_file_port_descr ? 1 : 0;
 
     int resample_audio_out_index = genesis_node_descriptor_find_port_index(ag->resample_descr, "audio_out");
     assert(resample_audio_out_index >= 0);
 
-    // one for each of the audio clips and one for the sample file preview node
-    int mix_port_count = audio_file_node_count + ag->audio_clip_list.length();
+    // one for each of the track nodes and one for the sample file preview node
+    int mix_port_count = audio_file_node_count + ag->track_list.length();
 
     ok_or_panic(create_mixer_descriptor(ag->pipeline, mix_port_count, &ag->mixer_descr));
     ag->mixer_node = ok_mem(genesis_node_descriptor_create_node(ag->mixer_descr));
@@ -388,22 +411,29 @@ void audio_graph_start_pipeline(AudioGraph *ag) {
     // We start on mixer port index 1 because index 0 is the audio out. Index 1 is
     // the first audio in.
     int next_mixer_port = 1;
-    if (audio_file_node_count >= 1) {
-        int audio_out_port_index = genesis_node_descriptor_find_port_index(ag->audio_file_descr, "audio_out");
+    if (audio_file_node_count >= 1)
+        connect_audio_file_node(ag, genesis_node_port(ag->mixer_node, next_mixer_port++));
+
+    for (int i = 0; i < ag->track_list.length(); i += 1) {
+        AudioGraphTrack *track = ag->track_list.at(i);
+
+        int audio_out_port_index = genesis_node_descriptor_find_port_index(track->node_descr, "audio_out");
         if (audio_out_port_index < 0)
             panic("port not found");
 
-        GenesisPort *audio_out_port = genesis_node_port(ag->audio_file_node, audio_out_port_index);
+        GenesisPort *audio_out_port = genesis_node_port(track->node, audio_out_port_index);
+        track->mixer_input_index = next_mixer_port - 1;
         GenesisPort *audio_in_port = genesis_node_port(ag->mixer_node, next_mixer_port++);
 
         if ((err = genesis_connect_ports(audio_out_port, audio_in_port))) {
             if (err == GenesisErrorIncompatibleChannelLayouts ||
                 err == GenesisErrorIncompatibleSampleRates)
             {
-                ag->resample_node = ok_mem(genesis_node_descriptor_create_node(ag->resample_descr));
-                ok_or_panic(genesis_connect_audio_nodes(ag->audio_file_node, ag->resample_node));
+                track->resample_node = ok_mem(genesis_node_descriptor_create_node(ag->resample_descr));
+                ok_or_panic(genesis_connect_audio_nodes(track->node, track->resample_node));
 
-                GenesisPort *audio_out_port = genesis_node_port(ag->resample_node, resample_audio_out_index);
+                GenesisPort *audio_out_port = genesis_node_port(track->resample_node,
+                        resample_audio_out_index);
                 ok_or_panic(genesis_connect_ports(audio_out_port, audio_in_port));
             } else {
                 ok_or_panic(err);
@@ -411,51 +441,63 @@ void audio_graph_start_pipeline(AudioGraph *ag) {
         }
     }
 
-    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
-        AudioGraphClip *clip = ag->audio_clip_list.at(i);
-
-        int audio_out_port_index = genesis_node_descriptor_find_port_index(clip->node_descr, "audio_out");
-        if (audio_out_port_index < 0)
-            panic("port not found");
-
-        GenesisPort *audio_out_port = genesis_node_port(clip->node, audio_out_port_index);
-        GenesisPort *audio_in_port = genesis_node_port(ag->mixer_node, next_mixer_port++);
+    assert(next_mixer_port == mix_port_count + 1);
 
-        if ((err = genesis_connect_ports(audio_out_port, audio_in_port))) {
-            if (err == GenesisErrorIncompatibleChannelLayouts ||
-                err == GenesisErrorIncompatibleSampleRates)
-            {
-                clip->resample_node = ok_mem(genesis_node_descriptor_create_node(ag->resample_descr));
-                ok_or_panic(genesis_connect_audio_nodes(clip->node, clip->resample_node));
+    set_track_gains(ag, 0);
+}
 
-                GenesisPort *audio_out_port = genesis_node_port(clip->resample_node,
-                        resample_audio_out_index);
-                ok_or_panic(genesis_connect_ports(audio_out_port, audio_in_port));
-            } else {
-                ok_or_panic(err);
-            }
-        }
+void audio_graph_start_pipeline(AudioGraph *ag) {
+    int err;
 
-        GenesisPort *events_in_port = genesis_node_port(clip->node, 1);
-        GenesisPort *events_out_port = genesis_node_port(clip->event_node, 0);
+    ag->start_play_head_pos = ag->play_head_pos;
 
-        ok_or_panic(genesis_connect_ports(events_out_port, events_in_port));
-    }
+    if (genesis_pipeline_is_running(ag->pipeline))
+        return;
 
+    connect_pipeline(ag);
 
     fprintf(stderr, "\nStarting pipeline...\n");
     genesis_debug_print_pipeline(ag->pipeline);
 
     double start_time = ag->play_head_pos;
 
-    assert(next_mixer_port == mix_port_count + 1);
     if ((err = genesis_pipeline_start(ag->pipeline, start_time)))
         panic("unable to start pipeline: %s", genesis_strerror(err));
 }
 
+static void render_thread_run(void *userdata) {
+    AudioGraph *ag = (AudioGraph *)userdata;
+    int err;
+    if ((err = genesis_pipeline_render_offline(ag->pipeline, ag->master_node, ag->render_frame_count))) {
+        if (!ag->render_cancel.load())
+            panic("unable to render: %s", genesis_strerror(err));
+    }
+}
+
+void audio_graph_start_render(AudioGraph *ag) {
+    assert(ag->render_stream);
+    assert(!ag->render_thread);
+
+    connect_pipeline(ag);
+
+    fprintf(stderr, "\nStarting render...\n");
+    genesis_debug_print_pipeline(ag->pipeline);
+
+    ag->start_play_head_pos = ag->play_head_pos;
+    genesis_pipeline_seek(ag->pipeline, ag->play_head_pos);
+
+    ag->render_cancel.store(false);
+    ok_or_panic(os_thread_create(render_thread_run, ag, false, &ag->render_thread));
+}
+
 static void play_audio_file(AudioGraph *ag, GenesisAudioFile *audio_file, bool is_asset) {
-    // TODO atomically modify the pipeline instead of stopping and starting
-    stop_pipeline(ag);
+    // Only the preview node changes, so swap it into the running graph
+    // rather than restarting, which would drop out whatever is playing.
+    bool live_edit = genesis_pipeline_is_running(ag->pipeline) && ag->audio_file_port_descr;
+    if (live_edit)
+        genesis_pipeline_begin_edit(ag->pipeline);
+    else
+        stop_pipeline(ag);
 
     if (ag->preview_audio_file && !ag->preview_audio_file_is_asset) {
         genesis_audio_file_destroy(ag->preview_audio_file);
@@ -482,6 +524,18 @@ static void play_audio_file(AudioGraph *ag, GenesisAudioFile *audio_file, bool i
         }
     }
 
+    if (live_edit) {
+        // the preview node is always on the first mixer input
+        connect_audio_file_node(ag, genesis_node_port(ag->mixer_node, 1));
+        genesis_node_seek(ag->audio_file_node, ag->play_head_pos);
+        if (ag->resample_node)
+            genesis_node_seek(ag->resample_node, ag->play_head_pos);
+        if (!genesis_pipeline_commit_edit(ag->pipeline))
+            return;
+        // the commit stopped the pipeline; fall back to a restart
+        stop_pipeline(ag);
+    }
+
     audio_graph_start_pipeline(ag);
 }
 
@@ -507,6 +561,29 @@ static SoundIoDevice *get_device_for_id(AudioGraph *ag, DeviceId device_id) {
     return genesis_get_default_output_device(ag->pipeline->context);
 }
 
+// Headless stand-in for a playback device. Takes a period of a quarter of
+// the latency, same as the device buffer of a real device.
+static int init_virtual_playback_node(AudioGraph *ag, const SettingsFileDeviceId *sf_device_id) {
+    GenesisVirtualClock clock = (ByteBuffer::compare(sf_device_id->device_id, "free-running") == 0) ?
+        GenesisVirtualClockFreeRunning : GenesisVirtualClockWallTime;
+    int sample_rate = genesis_pipeline_get_sample_rate(ag->pipeline);
+    int period_frame_count = max(1, (int)(genesis_pipeline_get_latency(ag->pipeline) * 0.25 * sample_rate));
+
+    GenesisNodeDescriptor *playback_node_descr;
+    int err;
+    if ((err = genesis_virtual_device_create_node_descriptor(ag->pipeline, clock, sample_rate,
+                    genesis_pipeline_get_channel_layout(ag->pipeline), period_frame_count,
+                    &playback_node_descr)))
+    {
+        return err;
+    }
+
+    assert(!ag->master_node);
+    ag->master_node = ok_mem(genesis_node_descriptor_create_node(playback_node_descr));
+
+    return 0;
+}
+
 static int init_playback_node(AudioGraph *ag) {
     MixerLine *master_mixer_line = ag->project->mixer_line_list.at(0);
     Effect *first_effect = master_mixer_line->effects.at(0);
@@ -517,6 +594,10 @@ static int init_playback_node(AudioGraph *ag) {
     assert(effect_send->send_type == EffectSendTypeDevice);
     EffectSendDevice *send_device = &effect_send->send.device;
 
+    SettingsFileDeviceId *sf_device_id = &ag->settings_file->device_designations.at(send_device->device_id);
+    if (sf_device_id->is_virtual)
+        return init_virtual_playback_node(ag, sf_device_id);
+
     SoundIoDevice *audio_device = get_device_for_id(ag, (DeviceId)send_device->device_id);
     if (!audio_device) {
         return GenesisErrorDeviceNotFound;
@@ -543,154 +624,212 @@ static void underrun_callback(void *userdata) {
     ag->events.trigger(EventBufferUnderrun);
 }
 
-static void add_audio_node_to_audio_clip(AudioGraph *ag, AudioGraphClip *clip) {
-    assert(!clip->node_descr);
-    assert(!clip->node);
+static void audio_graph_track_destroy(AudioGraphTrack *track) {
+    if (!track)
+        return;
+
+    if (track->node)
+        genesis_node_destroy(track->node);
 
-    ok_or_panic(project_ensure_audio_asset_loaded(ag->project, clip->audio_clip->audio_asset));
-    GenesisAudioFile *audio_file = clip->audio_clip->audio_asset->audio_file;
+    if (track->node_descr)
+        genesis_node_descriptor_destroy(track->node_descr);
 
-    const struct SoundIoChannelLayout *channel_layout =
-        genesis_audio_file_channel_layout(audio_file);
-    int sample_rate = genesis_audio_file_sample_rate(audio_file);
+    destroy(track, 1);
+}
 
-    const char *name = "audio_clip";
-    char *description = create_formatted_str("Audio Clip: %s",
-            clip->audio_clip->name.encode().raw());
-    GenesisNodeDescriptor *node_descr = ok_mem(genesis_create_node_descriptor(ag->pipeline, 2, name, description));
+static void add_track_node(AudioGraph *ag, AudioGraphTrack *track, Track *project_track) {
+    assert(!track->node_descr);
+    assert(!track->node);
+
+    const char *name = "track";
+    char *description = create_formatted_str("Track: %s", project_track->name.encode().raw());
+    GenesisNodeDescriptor *node_descr = ok_mem(genesis_create_node_descriptor(ag->pipeline, 1, name, description));
     free(description); description = nullptr;
 
-    genesis_node_descriptor_set_userdata(node_descr, clip);
+    genesis_node_descriptor_set_userdata(node_descr, track);
 
     struct GenesisPortDescriptor *audio_out_port = genesis_node_descriptor_create_port(
             node_descr, 0, GenesisPortTypeAudioOut, "audio_out");
 
-    struct GenesisPortDescriptor *events_in_port = genesis_node_descriptor_create_port(
-            node_descr, 1, GenesisPortTypeEventsIn, "events_in");
-
-    if (!audio_out_port || !events_in_port)
+    if (!audio_out_port)
         panic("unable to create ports");
 
-    genesis_audio_port_descriptor_set_channel_layout(audio_out_port, channel_layout, true, -1);
-    genesis_audio_port_descriptor_set_sample_rate(audio_out_port, sample_rate, true, -1);
+    genesis_audio_port_descriptor_set_channel_layout(audio_out_port, &track->channel_layout, true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(audio_out_port, track->sample_rate, true, -1);
+    genesis_audio_port_descriptor_set_format(audio_out_port, GenesisAudioPortFormatPlanar, true, -1);
 
-    genesis_node_descriptor_set_run_callback(node_descr, audio_clip_node_run);
-    genesis_node_descriptor_set_seek_callback(node_descr, audio_clip_node_seek);
-    genesis_node_descriptor_set_create_callback(node_descr, audio_clip_node_create);
-    genesis_node_descriptor_set_destroy_callback(node_descr, audio_clip_node_destroy);
+    genesis_node_descriptor_set_run_callback(node_descr, track_node_run);
+    genesis_node_descriptor_set_seek_callback(node_descr, track_node_seek);
+    genesis_node_descriptor_set_create_callback(node_descr, track_node_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, track_node_destroy);
 
-    clip->node_descr = node_descr;
-    clip->node = ok_mem(genesis_node_descriptor_create_node(node_descr));
+    track->node_descr = node_descr;
+    track->node = ok_mem(genesis_node_descriptor_create_node(node_descr));
 }
 
-static void add_event_node_to_audio_clip(AudioGraph *ag, AudioGraphClip *clip) {
-    assert(!clip->event_node_descr);
-    assert(!clip->event_node);
+// Finds the track node that plays audio_file on project_track, and makes one
+// if there is none yet. New ones are only heard once the pipeline restarts.
+static AudioGraphTrack *get_audio_graph_track(AudioGraph *ag, Track *project_track,
+        GenesisAudioFile *audio_file)
+{
+    const struct SoundIoChannelLayout *channel_layout = genesis_audio_file_channel_layout(audio_file);
+    int sample_rate = genesis_audio_file_sample_rate(audio_file);
+    for (int i = 0; i < ag->track_list.length(); i += 1) {
+        AudioGraphTrack *track = ag->track_list.at(i);
+        if (track->track_id == project_track->id && track->sample_rate == sample_rate &&
+            soundio_channel_layout_equal(&track->channel_layout, channel_layout))
+        {
+            return track;
+        }
+    }
 
-    const char *name = "audio_clip_events";
-    char *description = create_formatted_str("Events for Audio Clip: %s",
-            clip->audio_clip->name.encode().raw());
-    GenesisNodeDescriptor *node_descr =
-        ok_mem(genesis_create_node_descriptor(ag->pipeline, 1, name, description));
-    free(description);
-    description = nullptr;
+    AudioGraphTrack *track = ok_mem(create_zero<AudioGraphTrack>());
+    track->audio_graph = ag;
+    track->track_id = project_track->id;
+    track->sample_rate = sample_rate;
+    track->channel_layout = *channel_layout;
+    track->mixer_input_index = -1;
+    add_track_node(ag, track, project_track);
+    ok_or_panic(ag->track_list.append(track));
+    track->segments_write_ptr = track->segments.write_begin();
+    track->segments_write_ptr->segments.clear();
+    return track;
+}
 
-    genesis_node_descriptor_set_userdata(node_descr, clip);
+// Works out where each segment of an index that refresh_audio_clip_segments
+// filled stops sounding.
+static void index_track_segments(AudioGraphTrack *track) {
+    SegmentIndex *segment_index = track->segments_write_ptr;
+    int segment_count = segment_index->segments.length();
+    ok_or_panic(segment_index->max_end_pos.resize(segment_count));
+    long max_end_pos = 0;
+    for (int i = 0; i < segment_count; i += 1) {
+        TrackSegment *segment = &segment_index->segments.at(i);
+        segment->end_pos = segment->pos + (segment->end - segment->start);
+        max_end_pos = max(max_end_pos, segment->end_pos);
+        segment_index->max_end_pos.at(i) = max_end_pos;
+    }
+}
 
-    struct GenesisPortDescriptor *events_out_port = genesis_node_descriptor_create_port(
-            node_descr, 0, GenesisPortTypeEventsOut, "events_out");
+static long convert_frame_count(long frame_count, int from_sample_rate, int to_sample_rate) {
+    if (from_sample_rate == to_sample_rate)
+        return frame_count;
+    return lround(frame_count * (double)to_sample_rate / (double)from_sample_rate);
+}
 
-    if (!events_out_port)
-        panic("unable to create ports");
+static void refresh_audio_clip_segments(AudioGraph *ag) {
+    for (int i = 0; i < ag->track_list.length(); i += 1) {
+        AudioGraphTrack *track = ag->track_list.at(i);
+        track->segments_write_ptr = track->segments.write_begin();
+        track->segments_write_ptr->segments.clear();
+    }
 
-    genesis_node_descriptor_set_run_callback(node_descr, audio_clip_event_node_run);
-    genesis_node_descriptor_set_seek_callback(node_descr, audio_clip_event_node_seek);
-    genesis_node_descriptor_set_create_callback(node_descr, audio_clip_event_node_create);
-    genesis_node_descriptor_set_destroy_callback(node_descr, audio_clip_event_node_destroy);
+    // the segments of each track are sorted by pos already
+    Project *project = ag->project;
+    for (int track_i = 0; track_i < project->track_list.length(); track_i += 1) {
+        Track *project_track = project->track_list.at(track_i);
+        for (int i = 0; i < project_track->audio_clip_segments.length(); i += 1) {
+            AudioClipSegment *segment = project_track->audio_clip_segments.at(i);
+            AudioAsset *audio_asset = segment->audio_clip->audio_asset;
+            ok_or_panic(project_ensure_audio_asset_loaded(project, audio_asset));
+            GenesisAudioFile *audio_file = project_audio_asset_playback_file(project, audio_asset);
+            AudioGraphTrack *track = get_audio_graph_track(ag, project_track, audio_file);
+
+            // segment frames are frames of the asset, which a variant has
+            // at another sample rate
+            int asset_sample_rate = genesis_audio_file_sample_rate(audio_asset->audio_file);
+            long frame_count = genesis_audio_file_frame_count(audio_file);
+
+            ok_or_panic(track->segments_write_ptr->segments.add_one());
+            TrackSegment *track_segment = &track->segments_write_ptr->segments.last();
+            track_segment->audio_file = audio_file;
+            track_segment->pos = genesis_whole_notes_to_sample_pos(ag->pipeline, segment->pos,
+                    track->sample_rate);
+            track_segment->start = min(frame_count,
+                    convert_frame_count(segment->start, asset_sample_rate, track->sample_rate));
+            track_segment->end = min(frame_count,
+                    convert_frame_count(segment->end, asset_sample_rate, track->sample_rate));
+        }
+    }
 
-    clip->event_node_descr = node_descr;
-    clip->event_node = ok_mem(genesis_node_descriptor_create_node(node_descr));
+    for (int i = 0; i < ag->track_list.length(); i += 1) {
+        AudioGraphTrack *track = ag->track_list.at(i);
+        index_track_segments(track);
+        track->segments.write_end();
+        track->segments_write_ptr = nullptr;
+    }
 }
 
-static void add_nodes_to_audio_clip(AudioGraph *ag, AudioGraphClip *clip) {
-    add_audio_node_to_audio_clip(ag, clip);
-    add_event_node_to_audio_clip(ag, clip);
+static void on_project_audio_clip_segments_changed(Event, void *userdata) {
+    AudioGraph *ag = (AudioGraph *) userdata;
+    refresh_audio_clip_segments(ag);
 }
 
-static void refresh_audio_clips(AudioGraph *ag) {
-    Project *project = ag->project;
-    int ag_i = 0;
-    int project_i = 0;
-    for (;;) {
-        AudioGraphClip *ag_clip = nullptr;
-        AudioClip *project_clip = nullptr;
-        if (ag_i < ag->audio_clip_list.length())
-            ag_clip = ag->audio_clip_list.at(ag_i);
-        if (project_i < project->audio_clip_list.length())
-            project_clip = project->audio_clip_list.at(project_i);
-        if (ag_clip && project_clip && ag_clip->audio_clip == project_clip) {
-            ag_i += 1;
-            project_i += 1;
-        } else if (project_clip && !ag_clip) {
-            ag_clip = ok_mem(create_zero<AudioGraphClip>());
-            ag_clip->audio_clip = project_clip;
-            ag_clip->audio_graph = ag;
-            add_nodes_to_audio_clip(ag, ag_clip);
-            ok_or_panic(ag->audio_clip_list.append(ag_clip));
-            ag_i += 1;
-            project_i += 1;
-        } else if (!project_clip && ag_clip) {
-            panic("TODO destroy audio graph clip");
-            ag->audio_clip_list.swap_remove(ag_i);
-        } else if (!project_clip && !ag_clip) {
-            break;
-        } else {
-            panic("TODO replace nodes");
+// Only while the pipeline is stopped.
+static void remove_empty_tracks(AudioGraph *ag) {
+    for (int i = ag->track_list.length() - 1; i >= 0; i -= 1) {
+        AudioGraphTrack *track = ag->track_list.at(i);
+        if (track->segments.get_read_ptr()->segments.length() == 0) {
+            ag->track_list.swap_remove(i);
+            audio_graph_track_destroy(track);
         }
     }
 }
 
-static void refresh_audio_clip_segments(AudioGraph *ag) {
-    for (int clip_i = 0; clip_i < ag->audio_clip_list.length(); clip_i += 1) {
-        AudioGraphClip *clip = ag->audio_clip_list.at(clip_i);
-        clip->audio_clip->userdata = clip;
-        clip->events_write_ptr = clip->events.write_begin();
-        clip->events_write_ptr->clear();
-    }
-
-    auto it = ag->project->audio_clip_segments.entry_iterator();
-    for (;;) {
-        auto *entry = it.next();
-        if (!entry)
-            break;
+static void on_project_audio_asset_variants_changed(Event, void *userdata) {
+    AudioGraph *ag = (AudioGraph *) userdata;
+    // a render keeps the audio it started with
+    if (ag->render_stream)
+        return;
 
-        AudioClipSegment *segment = entry->value;
-        AudioClip *audio_clip = segment->audio_clip;
-        AudioGraphClip *clip = (AudioGraphClip *)audio_clip->userdata;
-        assert(clip);
-        ok_or_panic(clip->events_write_ptr->add_one());
-        GenesisMidiEvent *event = &clip->events_write_ptr->last();
-        event->event_type = GenesisMidiEventTypeSegment;
-        event->start = segment->pos;
-        event->data.segment_data.start = segment->start;
-        event->data.segment_data.end = segment->end;
+    // Segments move to tracks at the project sample rate, which are only
+    // heard once the pipeline restarts, and the tracks they leave with their
+    // resamplers go away.
+    bool was_running = genesis_pipeline_is_running(ag->pipeline);
+    if (was_running) {
+        ag->play_head_pos = audio_graph_play_head_pos(ag);
+        stop_pipeline(ag);
     }
 
-    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
-        AudioGraphClip *clip = ag->audio_clip_list.at(i);
-        clip->events.write_end();
-        clip->events_write_ptr = nullptr;
+    // a preview of a replaced variant stops, since the variant is about to go
+    if (ag->preview_audio_file_is_asset && ag->preview_audio_file &&
+        project_asset_variant_is_retired(ag->project, ag->preview_audio_file))
+    {
+        ag->preview_audio_file = nullptr;
+        ag->audio_file_frame_count = 0;
+        ag->audio_file_frame_index = 0;
     }
+
+    refresh_audio_clip_segments(ag);
+    remove_empty_tracks(ag);
+
+    if (was_running)
+        audio_graph_start_pipeline(ag);
 }
 
-static void on_project_audio_clips_changed(Event, void *userdata) {
-    AudioGraph *ag = (AudioGraph *) userdata;
-    refresh_audio_clips(ag);
+static void set_pipeline_tempo_map(AudioGraph *ag) {
+    List<GenesisTempoChange> *changes = &ag->project->tempo_map_changes;
+    ok_or_panic(genesis_pipeline_set_tempo_map(ag->pipeline, changes->raw(), changes->length()));
 }
 
-static void on_project_audio_clip_segments_changed(Event, void *userdata) {
+static void on_project_tempo_changed(Event, void *userdata) {
     AudioGraph *ag = (AudioGraph *) userdata;
+    // a render keeps the tempo it started with
+    if (ag->render_stream)
+        return;
+
+    // buffered audio and segment positions follow the old tempo
+    bool was_running = genesis_pipeline_is_running(ag->pipeline);
+    if (was_running) {
+        ag->play_head_pos = audio_graph_play_head_pos(ag);
+        stop_pipeline(ag);
+    }
+
+    set_pipeline_tempo_map(ag);
     refresh_audio_clip_segments(ag);
+
+    if (was_running)
+        audio_graph_start_pipeline(ag);
 }
 
 static AudioGraph *audio_graph_create_common(Project *project, GenesisContext *genesis_context,
@@ -711,18 +850,20 @@ static AudioGraph *audio_graph_create_common(Project *project, GenesisContext *g
     ag->play_head_changed_flag.clear();
 
     ag->resample_descr = genesis_node_descriptor_find(ag->pipeline, "resample");
-    if (!ag->resample_descr)
+    ag->preview_resample_descr = genesis_node_descriptor_find(ag->pipeline, "resample_linear");
+    if (!ag->resample_descr || !ag->preview_resample_descr)
         panic("unable to find resampler");
 
     genesis_pipeline_set_underrun_callback(pipeline, underrun_callback, ag);
 
-    project->events.attach_handler(EventProjectAudioClipsChanged,
-            on_project_audio_clips_changed, ag);
     project->events.attach_handler(EventProjectAudioClipSegmentsChanged,
             on_project_audio_clip_segments_changed, ag);
+    project->events.attach_handler(EventProjectTempoChanged, on_project_tempo_changed, ag);
+    project->events.attach_handler(EventProjectMixerLinesChanged, on_project_mixer_lines_changed, ag);
+    project->events.attach_handler(EventProjectAudioAssetVariantsChanged,
+            on_project_audio_asset_variants_changed, ag);
 
-
-    refresh_audio_clips(ag);
+    set_pipeline_tempo_map(ag);
     refresh_audio_clip_segments(ag);
 
     return ag;
@@ -763,7 +904,7 @@ int audio_graph_create_render(Project *project, GenesisContext *genesis_context,
         const GenesisExportFormat *export_format, const ByteBuffer &out_path,
         AudioGraph **out_audio_graph)
 {
-    AudioGraph *ag = audio_graph_create_common(project, genesis_context, 0.10);
+    AudioGraph *ag = audio_graph_create_common(project, genesis_context, RENDER_LATENCY);
 
     ag->render_export_format = *export_format;
     ag->render_out_path = out_path;
@@ -793,6 +934,7 @@ int audio_graph_create_render(Project *project, GenesisContext *genesis_context,
     ag->master_node = ok_mem(genesis_node_descriptor_create_node(ag->render_descr));
 
     ag->render_stream = ok_mem(genesis_audio_file_stream_create(ag->pipeline->context));
+    project_hold_asset_variants(project);
 
     int render_sample_rate = genesis_audio_file_codec_best_sample_rate(export_format->codec,
             export_format->sample_rate);
@@ -830,43 +972,35 @@ int audio_graph_create_render(Project *project, GenesisContext *genesis_context,
     return 0;
 }
 
-static void audio_graph_clip_destroy(AudioGraphClip *clip) {
-    if (!clip)
-        return;
-
-    if (clip->event_node)
-        genesis_node_destroy(clip->event_node);
-
-    if (clip->event_node_descr)
-        genesis_node_descriptor_destroy(clip->event_node_descr);
-
-    if (clip->node)
-        genesis_node_destroy(clip->node);
-
-    if (clip->node_descr)
-        genesis_node_descriptor_destroy(clip->node_descr);
-
-    destroy(clip, 1);
-}
-
 void audio_graph_destroy(AudioGraph *ag) {
     if (!ag)
         return;
 
+    if (ag->render_thread) {
+        ag->render_cancel.store(true);
+        os_thread_destroy(ag->render_thread);
+        ag->render_thread = nullptr;
+    }
+
     if (ag->pipeline) {
         genesis_pipeline_stop(ag->pipeline);
         genesis_node_destroy(ag->master_node);
         ag->master_node = nullptr;
     }
 
-    ag->project->events.detach_handler(EventProjectAudioClipsChanged,
-            on_project_audio_clips_changed);
     ag->project->events.detach_handler(EventProjectAudioClipSegmentsChanged,
             on_project_audio_clip_segments_changed);
+    ag->project->events.detach_handler(EventProjectTempoChanged, on_project_tempo_changed);
+    ag->project->events.detach_handler(EventProjectMixerLinesChanged, on_project_mixer_lines_changed);
+    ag->project->events.detach_handler(EventProjectAudioAssetVariantsChanged,
+            on_project_audio_asset_variants_changed);
+
+    if (ag->render_stream)
+        project_release_asset_variants(ag->project);
 
-    while (ag->audio_clip_list.length()) {
-        AudioGraphClip *clip = ag->audio_clip_list.pop();
-        audio_graph_clip_destroy(clip);
+    while (ag->track_list.length()) {
+        AudioGraphTrack *track = ag->track_list.pop();
+        audio_graph_track_destroy(track);
     }
 
     os_cond_destroy(ag->render_cond);
@@ -894,7 +1028,7 @@ void audio_graph_play_audio_asset(AudioGraph *ag, AudioAsset *audio_asset) {
         }
     }
 
-    play_audio_file(ag, audio_asset->audio_file, true);
+    play_audio_file(ag, project_audio_asset_playback_file(ag->project, audio_asset), true);
 }
 
 bool audio_graph_is_playing(AudioGraph *ag) {
@@ -979,6 +1113,11 @@ void audio_graph_change_sample_rate(AudioGraph *ag, int new_sample_rate) {
 
     genesis_pipeline_set_sample_rate(ag->pipeline, new_sample_rate);
 
+    // variants at the old sample rate give way to the assets until there
+    // are variants at the new one
+    refresh_audio_clip_segments(ag);
+    remove_empty_tracks(ag);
+
     init_playback_node(ag);
 
     audio_graph_start_pipeline(ag);
@@ -1033,3 +1172,11 @@ double audio_graph_play_head_pos(AudioGraph *ag) {
 double audio_graph_get_latency(AudioGraph *audio_graph) {
     return genesis_pipeline_get_latency(audio_graph->pipeline);
 }
+
+void audio_graph_get_dsp_load(AudioGraph *audio_graph, double *average, double *peak) {
+    genesis_pipeline_get_dsp_load(audio_graph->pipeline, average, peak);
+}
+
+int audio_graph_get_underruns(AudioGraph *audio_graph, GenesisUnderrun *out_underruns, int max_count) {
+    return genesis_pipeline_get_underruns(audio_graph->pipeline, out_underruns, max_count);
+}
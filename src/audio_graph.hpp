@@ -9,33 +9,57 @@
 #include "settings_file.hpp"
 #include "event_dispatcher.hpp"
 
-struct EventList {
-    List<GenesisMidiEvent> events;
+// Positions are sample positions at the sample rate of the track node, so
+// that playback only compares integers.
+struct TrackSegment {
+    GenesisAudioFile *audio_file;
+    long pos;
+    // where the segment stops sounding
+    long end_pos;
+    // frames of audio_file
+    long start;
+    long end;
+};
+
+// A track's segments sorted by pos, so that the track node can keep its
+// place in them and only look at the segments it starts.
+struct SegmentIndex {
+    List<TrackSegment> segments;
+    // the latest end_pos of segments 0 through i, so that the segments still
+    // sounding at a position can be found with a binary search
+    List<long> max_end_pos;
 };
 
 struct AudioGraph;
 
-struct AudioGraphClip {
+// Plays the segments of one track whose audio has the same sample rate and
+// channel layout. Most tracks need only one.
+struct AudioGraphTrack {
     AudioGraph *audio_graph;
-    AudioClip *audio_clip;
+    uint256 track_id;
+    int sample_rate;
+    SoundIoChannelLayout channel_layout;
     GenesisNodeDescriptor *node_descr;
     GenesisNode *node;
-    GenesisNodeDescriptor *event_node_descr;
-    GenesisNode *event_node;
     GenesisNode *resample_node;
-    AtomicValue<List<GenesisMidiEvent>> events;
-    List<GenesisMidiEvent> *events_write_ptr;
+    // the mixer input this track plays into, or -1 if the track was added
+    // while the pipeline was running and is not connected yet
+    int mixer_input_index;
+    AtomicValue<SegmentIndex> segments;
+    SegmentIndex *segments_write_ptr;
 };
 
 struct AudioGraph {
     Project *project;
     EventDispatcher events;
 
-    List<AudioGraphClip*> audio_clip_list;
+    List<AudioGraphTrack*> track_list;
 
     GenesisPipeline *pipeline;
     SettingsFile *settings_file;
     GenesisNodeDescriptor *resample_descr;
+    // sample file previews favor latency and CPU over quality
+    GenesisNodeDescriptor *preview_resample_descr;
     GenesisNodeDescriptor *mixer_descr;
     GenesisNode *resample_node;
     GenesisNode *mixer_node;
@@ -59,6 +83,8 @@ struct AudioGraph {
     atomic_long render_frame_index;
     long render_frame_count;
     OsCond *render_cond;
+    OsThread *render_thread;
+    atomic_bool render_cancel;
 
     double start_play_head_pos;
     double play_head_pos;
@@ -74,8 +100,14 @@ int audio_graph_create_render(Project *project, GenesisContext *genesis_context,
 void audio_graph_destroy(AudioGraph *audio_graph);
 
 void audio_graph_start_pipeline(AudioGraph *audio_graph);
+// renders the project to the out path on a separate thread, as fast as possible
+void audio_graph_start_render(AudioGraph *audio_graph);
 
 double audio_graph_get_latency(AudioGraph *audio_graph);
+// safe to call from the GUI thread while playing
+void audio_graph_get_dsp_load(AudioGraph *audio_graph, double *average, double *peak);
+// most recent first
+int audio_graph_get_underruns(AudioGraph *audio_graph, GenesisUnderrun *out_underruns, int max_count);
 
 void audio_graph_play_sample_file(AudioGraph *audio_graph, const ByteBuffer &path);
 void audio_graph_play_audio_asset(AudioGraph *audio_graph, AudioAsset *audio_asset);
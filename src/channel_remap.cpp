@@ -0,0 +1,271 @@
+#include "channel_remap.hpp"
+#include "mix_kernels.hpp"
+#include "util.hpp"
+
+#include <string.h>
+
+// The matrix path deinterleaves this many frames at a time onto the stack,
+// so that it can add whole channels together with the mixing kernels.
+static const int MATRIX_BLOCK_FRAMES = 128;
+
+void channel_remap_init(ChannelRemap *remap, const float matrix[][GENESIS_CHANNEL_ID_COUNT],
+        int in_channel_count, int out_channel_count)
+{
+    remap->in_channel_count = in_channel_count;
+    remap->out_channel_count = out_channel_count;
+
+    bool identity = (in_channel_count == out_channel_count);
+    bool sparse = true;
+    for (int out_ch = 0; out_ch < out_channel_count; out_ch += 1) {
+        remap->sources[out_ch] = -1;
+        remap->gains[out_ch] = 0.0f;
+        for (int in_ch = 0; in_ch < in_channel_count; in_ch += 1) {
+            float gain = matrix[out_ch][in_ch];
+            remap->matrix[out_ch][in_ch] = gain;
+            if (gain != ((out_ch == in_ch) ? 1.0f : 0.0f))
+                identity = false;
+            if (gain == 0.0f)
+                continue;
+            if (remap->sources[out_ch] >= 0)
+                sparse = false;
+            remap->sources[out_ch] = in_ch;
+            remap->gains[out_ch] = gain;
+        }
+    }
+
+    bool average = (out_channel_count == 1 && in_channel_count > 1);
+    for (int in_ch = 0; in_ch < in_channel_count && average; in_ch += 1)
+        average = (matrix[0][in_ch] != 0.0f && matrix[0][in_ch] == matrix[0][0]);
+
+    if (identity) {
+        remap->kind = ChannelRemapKindIdentity;
+    } else if (in_channel_count == 1) {
+        remap->kind = ChannelRemapKindDuplicate;
+    } else if (average) {
+        remap->kind = ChannelRemapKindAverage;
+        remap->gains[0] = matrix[0][0];
+    } else if (sparse) {
+        remap->kind = ChannelRemapKindSparse;
+    } else {
+        remap->kind = ChannelRemapKindMatrix;
+    }
+}
+
+// A stride given as a template argument is fixed at compile time, so that
+// the compiler can unroll and vectorize the loop; 0 means the stride is only
+// known at run time.
+template <int IN_STRIDE, int OUT_STRIDE>
+static void scale_channel_strided(const float *in, int in_stride, float *out, int out_stride,
+        float gain, int frame_count)
+{
+    if (IN_STRIDE)
+        in_stride = IN_STRIDE;
+    if (OUT_STRIDE)
+        out_stride = OUT_STRIDE;
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out[frame * out_stride] = in[frame * in_stride] * gain;
+}
+
+template <int IN_STRIDE, int OUT_STRIDE>
+static void add_channel_strided(const float *in, int in_stride, float *out, int out_stride,
+        float gain, int frame_count)
+{
+    if (IN_STRIDE)
+        in_stride = IN_STRIDE;
+    if (OUT_STRIDE)
+        out_stride = OUT_STRIDE;
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out[frame * out_stride] += in[frame * in_stride] * gain;
+}
+
+// out = in * gain
+static void scale_channel(const float *in, int in_stride, float *out, int out_stride,
+        float gain, int frame_count)
+{
+    if (in_stride == 1 && out_stride == 1) {
+        if (gain == 1.0f)
+            memcpy(out, in, frame_count * sizeof(float));
+        else
+            scale_channel_strided<1, 1>(in, in_stride, out, out_stride, gain, frame_count);
+    } else if (in_stride == 2 && out_stride == 1) {
+        scale_channel_strided<2, 1>(in, in_stride, out, out_stride, gain, frame_count);
+    } else if (in_stride == 1 && out_stride == 2) {
+        scale_channel_strided<1, 2>(in, in_stride, out, out_stride, gain, frame_count);
+    } else if (in_stride == 2 && out_stride == 2) {
+        scale_channel_strided<2, 2>(in, in_stride, out, out_stride, gain, frame_count);
+    } else {
+        scale_channel_strided<0, 0>(in, in_stride, out, out_stride, gain, frame_count);
+    }
+}
+
+// out += in * gain
+static void add_channel(const float *in, int in_stride, float *out, int out_stride,
+        float gain, int frame_count)
+{
+    if (in_stride == 1 && out_stride == 1)
+        mix_add_scaled(out, in, gain, frame_count);
+    else if (in_stride == 2 && out_stride == 1)
+        add_channel_strided<2, 1>(in, in_stride, out, out_stride, gain, frame_count);
+    else
+        add_channel_strided<0, 0>(in, in_stride, out, out_stride, gain, frame_count);
+}
+
+static void zero_channel(float *out, int out_stride, int frame_count) {
+    if (out_stride == 1) {
+        memset(out, 0, frame_count * sizeof(float));
+    } else {
+        for (int frame = 0; frame < frame_count; frame += 1)
+            out[frame * out_stride] = 0.0f;
+    }
+}
+
+// mono to stereo
+template <int IN_STRIDE, int OUT_STRIDE>
+static void duplicate_to_two(const float *in, int in_stride, float *out0, float *out1, int out_stride,
+        float gain0, float gain1, int frame_count)
+{
+    if (IN_STRIDE)
+        in_stride = IN_STRIDE;
+    if (OUT_STRIDE)
+        out_stride = OUT_STRIDE;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        float sample = in[frame * in_stride];
+        out0[frame * out_stride] = sample * gain0;
+        out1[frame * out_stride] = sample * gain1;
+    }
+}
+
+// stereo to mono
+template <int IN_STRIDE, int OUT_STRIDE>
+static void average_two(const float *in0, const float *in1, int in_stride, float *out, int out_stride,
+        float gain, int frame_count)
+{
+    if (IN_STRIDE)
+        in_stride = IN_STRIDE;
+    if (OUT_STRIDE)
+        out_stride = OUT_STRIDE;
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out[frame * out_stride] = (in0[frame * in_stride] + in1[frame * in_stride]) * gain;
+}
+
+static bool is_interleaved(float *const *channels, int stride, int channel_count) {
+    if (stride != channel_count)
+        return false;
+    for (int ch = 1; ch < channel_count; ch += 1) {
+        if (channels[ch] != channels[0] + ch)
+            return false;
+    }
+    return true;
+}
+
+static void run_identity(const ChannelRemap *remap, float *const *in, int in_stride,
+        float *const *out, int out_stride, int frame_count)
+{
+    int channel_count = remap->out_channel_count;
+    if (is_interleaved(in, in_stride, channel_count) && is_interleaved(out, out_stride, channel_count)) {
+        memcpy(out[0], in[0], frame_count * channel_count * sizeof(float));
+        return;
+    }
+    for (int ch = 0; ch < channel_count; ch += 1)
+        scale_channel(in[ch], in_stride, out[ch], out_stride, 1.0f, frame_count);
+}
+
+static void run_duplicate(const ChannelRemap *remap, float *const *in, int in_stride,
+        float *const *out, int out_stride, int frame_count)
+{
+    if (remap->out_channel_count == 2) {
+        if (in_stride == 1 && out_stride == 2) {
+            duplicate_to_two<1, 2>(in[0], in_stride, out[0], out[1], out_stride,
+                    remap->gains[0], remap->gains[1], frame_count);
+        } else {
+            duplicate_to_two<0, 0>(in[0], in_stride, out[0], out[1], out_stride,
+                    remap->gains[0], remap->gains[1], frame_count);
+        }
+        return;
+    }
+    for (int out_ch = 0; out_ch < remap->out_channel_count; out_ch += 1)
+        scale_channel(in[0], in_stride, out[out_ch], out_stride, remap->gains[out_ch], frame_count);
+}
+
+static void run_average(const ChannelRemap *remap, float *const *in, int in_stride,
+        float *const *out, int out_stride, int frame_count)
+{
+    float gain = remap->gains[0];
+    if (remap->in_channel_count == 2) {
+        if (in_stride == 2 && out_stride == 1)
+            average_two<2, 1>(in[0], in[1], in_stride, out[0], out_stride, gain, frame_count);
+        else
+            average_two<0, 0>(in[0], in[1], in_stride, out[0], out_stride, gain, frame_count);
+        return;
+    }
+    scale_channel(in[0], in_stride, out[0], out_stride, gain, frame_count);
+    for (int in_ch = 1; in_ch < remap->in_channel_count; in_ch += 1)
+        add_channel(in[in_ch], in_stride, out[0], out_stride, gain, frame_count);
+}
+
+static void run_sparse(const ChannelRemap *remap, float *const *in, int in_stride,
+        float *const *out, int out_stride, int frame_count)
+{
+    for (int out_ch = 0; out_ch < remap->out_channel_count; out_ch += 1) {
+        int source = remap->sources[out_ch];
+        if (source < 0)
+            zero_channel(out[out_ch], out_stride, frame_count);
+        else
+            scale_channel(in[source], in_stride, out[out_ch], out_stride, remap->gains[out_ch], frame_count);
+    }
+}
+
+static void run_matrix(const ChannelRemap *remap, float *const *in, int in_stride,
+        float *const *out, int out_stride, int frame_count)
+{
+    float in_block[GENESIS_MAX_CHANNELS][MATRIX_BLOCK_FRAMES];
+    float out_block[MATRIX_BLOCK_FRAMES];
+    const float *in_rows[GENESIS_MAX_CHANNELS];
+    for (int start = 0; start < frame_count; start += MATRIX_BLOCK_FRAMES) {
+        int block_frame_count = min(MATRIX_BLOCK_FRAMES, frame_count - start);
+        for (int in_ch = 0; in_ch < remap->in_channel_count; in_ch += 1) {
+            const float *in_ptr = in[in_ch] + start * in_stride;
+            if (in_stride == 1) {
+                in_rows[in_ch] = in_ptr;
+            } else {
+                scale_channel(in_ptr, in_stride, in_block[in_ch], 1, 1.0f, block_frame_count);
+                in_rows[in_ch] = in_block[in_ch];
+            }
+        }
+        for (int out_ch = 0; out_ch < remap->out_channel_count; out_ch += 1) {
+            float *out_ptr = out[out_ch] + start * out_stride;
+            float *row = (out_stride == 1) ? out_ptr : out_block;
+            memset(row, 0, block_frame_count * sizeof(float));
+            for (int in_ch = 0; in_ch < remap->in_channel_count; in_ch += 1) {
+                float gain = remap->matrix[out_ch][in_ch];
+                if (gain != 0.0f)
+                    mix_add_scaled(row, in_rows[in_ch], gain, block_frame_count);
+            }
+            if (out_stride != 1)
+                scale_channel(row, 1, out_ptr, out_stride, 1.0f, block_frame_count);
+        }
+    }
+}
+
+void channel_remap_run(const ChannelRemap *remap, float *const *in, int in_stride,
+        float *const *out, int out_stride, int frame_count)
+{
+    switch (remap->kind) {
+        case ChannelRemapKindIdentity:
+            run_identity(remap, in, in_stride, out, out_stride, frame_count);
+            return;
+        case ChannelRemapKindDuplicate:
+            run_duplicate(remap, in, in_stride, out, out_stride, frame_count);
+            return;
+        case ChannelRemapKindAverage:
+            run_average(remap, in, in_stride, out, out_stride, frame_count);
+            return;
+        case ChannelRemapKindSparse:
+            run_sparse(remap, in, in_stride, out, out_stride, frame_count);
+            return;
+        case ChannelRemapKindMatrix:
+            run_matrix(remap, in, in_stride, out, out_stride, frame_count);
+            return;
+    }
+    panic("invalid channel remap kind");
+}
@@ -0,0 +1,42 @@
+#ifndef CHANNEL_REMAP_HPP
+#define CHANNEL_REMAP_HPP
+
+#include "genesis.h"
+
+// What a channel matrix turns out to do, worked out ahead of time so that
+// each block takes the cheapest loop that gives the same result.
+enum ChannelRemapKind {
+    // each out channel is the in channel of the same index
+    ChannelRemapKindIdentity,
+    // one in channel, copied with a gain to every out channel
+    ChannelRemapKindDuplicate,
+    // one out channel, the sum of every in channel with the same gain
+    ChannelRemapKindAverage,
+    // each out channel is silent or one in channel with a gain
+    ChannelRemapKindSparse,
+    ChannelRemapKindMatrix,
+};
+
+struct ChannelRemap {
+    enum ChannelRemapKind kind;
+    int in_channel_count;
+    int out_channel_count;
+    // for each out channel, its in channel or -1, and the gain; duplicate,
+    // average and sparse only
+    int sources[GENESIS_MAX_CHANNELS];
+    float gains[GENESIS_MAX_CHANNELS];
+    // [out channel][in channel]
+    float matrix[GENESIS_MAX_CHANNELS][GENESIS_MAX_CHANNELS];
+};
+
+// matrix is indexed [out channel][in channel].
+void channel_remap_init(ChannelRemap *remap, const float matrix[][GENESIS_CHANNEL_ID_COUNT],
+        int in_channel_count, int out_channel_count);
+
+// in and out hold a pointer to the first sample of each channel, and the
+// strides are the distance between two samples of a channel, so planar and
+// interleaved buffers both work.
+void channel_remap_run(const ChannelRemap *remap, float *const *in, int in_stride,
+        float *const *out, int out_stride, int frame_count);
+
+#endif
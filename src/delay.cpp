@@ -9,6 +9,10 @@ struct DelayContext {
     int frame_offset;
     float delay_length_notes; // in whole notes
     int delay_length_frames;
+    int frame_rate;
+    long frame_pos;
+    // the tempo region that delay_length_frames was worked out in
+    struct GenesisTempoSegment tempo_segment;
 };
 
 static void delay_destroy(struct GenesisNode *node) {
@@ -26,14 +30,30 @@ static int delay_create(struct GenesisNode *node) {
         delay_destroy(node);
         return GenesisErrorNoMem;
     }
+    genesis_node_set_userdata_size(node, sizeof(DelayContext));
     delay_context->delay_length_notes = 1.0f;
+    // the dry signal goes straight through, so the node has no latency; the
+    // echoes are the effect, not a delay to compensate for
     return 0;
 }
 
+// Looks up the tempo at the node's position and sets the delay length from it.
+static void update_delay_length(struct GenesisNode *node) {
+    struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
+    struct GenesisTempoSegment *tempo_segment = &delay_context->tempo_segment;
+    genesis_pipeline_get_tempo_segment(genesis_node_pipeline(node), delay_context->frame_pos,
+            delay_context->frame_rate, tempo_segment);
+
+    double delay_ticks = delay_context->delay_length_notes * GENESIS_TICKS_PER_WHOLE_NOTE;
+    long delay_length_frames = delay_ticks * (delay_context->frame_rate * 60L) /
+        tempo_segment->ticks_per_minute;
+    delay_context->delay_length_frames = clamp(1L, delay_length_frames, (long)MAX_DELAY_FRAMES);
+    delay_context->frame_offset %= delay_context->delay_length_frames;
+}
+
 static int delay_port_connect(struct GenesisPort *audio_in_port, struct GenesisPort *other_port) {
     struct GenesisNode *node = audio_in_port->node;
     struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
-    struct GenesisPipeline *pipeline = node->descriptor->pipeline;
 
     delay_context->channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
     int new_capacity = delay_context->channel_count * MAX_DELAY_FRAMES;
@@ -47,8 +67,8 @@ static int delay_port_connect(struct GenesisPort *audio_in_port, struct GenesisP
         delay_context->delayed_frames_capacity = new_capacity;
     }
 
-    delay_context->delay_length_frames = genesis_whole_notes_to_frames(
-            pipeline, delay_context->delay_length_notes, genesis_audio_port_sample_rate(audio_in_port));
+    delay_context->frame_rate = genesis_audio_port_sample_rate(audio_in_port);
+    update_delay_length(node);
 
     return 0;
 }
@@ -57,38 +77,62 @@ static void delay_seek(struct GenesisNode *node) {
     struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
     delay_context->frame_offset = 0;
     memset(delay_context->delayed_frames, 0, delay_context->delayed_frames_capacity);
+    if (delay_context->frame_rate > 0) {
+        delay_context->frame_pos = genesis_whole_notes_to_sample_pos(genesis_node_pipeline(node),
+                node->timestamp, delay_context->frame_rate);
+        update_delay_length(node);
+    }
 }
 
 static void delay_run(struct GenesisNode *node) {
     struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
     struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
     struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    struct GenesisPort *feedback_port = genesis_node_port(node, 2);
 
     int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
     int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
     int frame_count = min(input_frame_count, output_frame_count);
 
+    // the tempo, and with it the delay length, can only change at a block
+    // that crosses into another tempo region
+    if (delay_context->frame_pos >= delay_context->tempo_segment.end_sample_pos ||
+        delay_context->frame_pos < delay_context->tempo_segment.start_sample_pos)
+    {
+        update_delay_length(node);
+    }
+
+    int segment_count;
+    const struct GenesisParamSegment *segments =
+        genesis_param_in_port_segments(feedback_port, frame_count, &segment_count);
+
     float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
     float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
-    for (int frame = 0; frame < frame_count; frame += 1) {
-        for (int channel = 0; channel < delay_context->channel_count; channel += 1) {
-            int sample_index = frame * delay_context->channel_count + channel;
-            float in_sample = in_buf[sample_index];
-            int delay_sample_index = delay_context->frame_offset * delay_context->channel_count + channel;
-            out_buf[sample_index] = in_sample + 0.50f * delay_context->delayed_frames[delay_sample_index];
-
-            delay_context->delayed_frames[delay_sample_index] =
-                delay_context->delayed_frames[delay_sample_index] * 0.50f + in_sample;
+    int frame = 0;
+    for (int segment_i = 0; segment_i < segment_count; segment_i += 1) {
+        const struct GenesisParamSegment *segment = &segments[segment_i];
+        for (int i = 0; i < segment->frame_count; i += 1, frame += 1) {
+            float feedback = segment->start_value + segment->step * i;
+            for (int channel = 0; channel < delay_context->channel_count; channel += 1) {
+                int sample_index = frame * delay_context->channel_count + channel;
+                float in_sample = in_buf[sample_index];
+                int delay_sample_index = delay_context->frame_offset * delay_context->channel_count + channel;
+                out_buf[sample_index] = in_sample + feedback * delay_context->delayed_frames[delay_sample_index];
+
+                delay_context->delayed_frames[delay_sample_index] =
+                    delay_context->delayed_frames[delay_sample_index] * feedback + in_sample;
+            }
+            delay_context->frame_offset = (delay_context->frame_offset + 1) % delay_context->delay_length_frames;
         }
-        delay_context->frame_offset = (delay_context->frame_offset + 1) % delay_context->delay_length_frames;
     }
 
+    delay_context->frame_pos += frame_count;
     genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
     genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
 }
 
 int create_delay_descriptor(GenesisPipeline *pipeline) {
-    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2, "delay", "Simple delay filter.");
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 3, "delay", "Simple delay filter.");
     if (!node_descr) {
         genesis_node_descriptor_destroy(node_descr);
         return GenesisErrorNoMem;
@@ -103,12 +147,16 @@ int create_delay_descriptor(GenesisPipeline *pipeline) {
             node_descr, 0, GenesisPortTypeAudioIn, "audio_in");
     struct GenesisPortDescriptor *audio_out_port = genesis_node_descriptor_create_port(
             node_descr, 1, GenesisPortTypeAudioOut, "audio_out");
+    struct GenesisPortDescriptor *feedback_port = genesis_node_descriptor_create_port(
+            node_descr, 2, GenesisPortTypeParamIn, "feedback");
 
-    if (!audio_in_port || !audio_out_port) {
+    if (!audio_in_port || !audio_out_port || !feedback_port) {
         genesis_node_descriptor_destroy(node_descr);
         return GenesisErrorNoMem;
     }
 
+    genesis_param_port_descriptor_set_range(feedback_port, 0.50f, 0.0f, 0.95f);
+
     int target_sample_rate = genesis_pipeline_get_sample_rate(pipeline);
 
     genesis_port_descriptor_set_connect_callback(audio_in_port, delay_port_connect);
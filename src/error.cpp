@@ -34,6 +34,8 @@ const char *genesis_strerror(int error) {
         case GenesisErrorIncompatibleDevice: return "incompatible device";
         case GenesisErrorDeviceNotFound: return "device not found";
         case GenesisErrorDecodingString: return "decoding string";
+        case GenesisErrorIncompatiblePortFormats: return "incompatible port formats";
+        case GenesisErrorQueueFull: return "queue full";
     }
     panic("invalid error enum value");
 }
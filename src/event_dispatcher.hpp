@@ -26,6 +26,7 @@ enum Event {
     EventDeviceDesignationChange,
     EventProjectSampleRateChanged,
     EventProjectChannelLayoutChanged,
+    EventProjectTempoChanged,
     EventSelectedIndexChanged,
     EventActivate,
     EventSettingsDefaultRenderFormatChanged,
@@ -34,6 +35,7 @@ enum Event {
     EventRenderJobsUpdated,
     EventAudioGraphPlayHeadChanged,
     EventAudioGraphPlayingChanged,
+    EventProjectAudioAssetVariantsChanged,
 };
 
 struct EventHandler {
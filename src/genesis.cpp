@@ -4,14 +4,24 @@
 #include "synth.hpp"
 #include "delay.hpp"
 #include "resample.hpp"
+#include "mix_kernels.hpp"
 #include "config.h"
+#include "warning.hpp"
+
+#include <limits.h>
 
 static const int BYTES_PER_SAMPLE = 4; // assuming float samples
 static const int EVENTS_PER_SECOND_CAPACITY = 16000;
-
-// When you finally get around to genericizing this code, take a peek at
-// project_whole_notes_to_frames and project_frames_to_whole_notes
-static const double whole_notes_per_second = 140.0 / 60.0;
+static const int PARAM_CHANGE_QUEUE_CAPACITY = 256;
+// queues have room for this many nodes more than the pipeline had when it
+// was started, for nodes added by live edits
+static const int EDIT_NODE_HEADROOM = 64;
+// weight of each new reading in the rolling DSP load average
+static const double DSP_LOAD_SMOOTHING = 0.05;
+// how much of each worker's stack is locked when the pipeline locks memory
+static const size_t WORKER_STACK_LOCK_SIZE = 256 * 1024;
+// ring buffers at least this big ask for transparent huge pages
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
 
 static int (*plugin_create_list[])(GenesisPipeline *pipeline) = {
     create_synth_descriptor,
@@ -30,6 +40,26 @@ struct PlaybackNodeContext {
     atomic_long offset;
     atomic_bool reset_offset_flag;
     atomic_int achieved_silence_path;
+    // when the previous callback that measured DSP load ran, or 0
+    uint64_t last_callback_ns;
+};
+
+struct VirtualDeviceDescriptorContext {
+    GenesisVirtualClock clock;
+    int period_frame_count;
+};
+
+struct VirtualDeviceNodeContext {
+    // first, so that the genesis_node_playback_* functions work on virtual
+    // devices too
+    PlaybackNodeContext playback;
+    OsThread *thread;
+    atomic_bool quit;
+    // bumped whenever the clock thread might have something new to look at
+    atomic_int wake_seq;
+    atomic_bool clock_waiting;
+    atomic_long period_count;
+    atomic_long missed_count;
 };
 
 struct RecordingNodeContext {
@@ -388,7 +418,7 @@ static void on_devices_change(SoundIo *soundio) {
 
 double genesis_frames_to_whole_notes(GenesisPipeline *pipeline, int frames, int frame_rate) {
     double seconds = frames / (double)frame_rate;
-    return whole_notes_per_second * seconds;
+    return tempo_map_seconds_to_whole_notes(&pipeline->tempo_map, seconds);
 }
 
 int genesis_whole_notes_to_frames(GenesisPipeline *pipeline, double whole_notes, int frame_rate) {
@@ -396,7 +426,56 @@ int genesis_whole_notes_to_frames(GenesisPipeline *pipeline, double whole_notes,
 }
 
 double genesis_whole_notes_to_seconds(GenesisPipeline *pipeline, double whole_notes, int frame_rate) {
-    return whole_notes / whole_notes_per_second;
+    return tempo_map_whole_notes_to_seconds(&pipeline->tempo_map, whole_notes);
+}
+
+long genesis_whole_notes_to_ticks(double whole_notes) {
+    return lround(whole_notes * GENESIS_TICKS_PER_WHOLE_NOTE);
+}
+
+double genesis_ticks_to_whole_notes(long ticks) {
+    return ticks / (double)GENESIS_TICKS_PER_WHOLE_NOTE;
+}
+
+long genesis_ticks_to_sample_pos(GenesisPipeline *pipeline, long ticks, int frame_rate) {
+    return tempo_map_ticks_to_sample_pos(&pipeline->tempo_map, ticks, frame_rate);
+}
+
+long genesis_sample_pos_to_ticks(GenesisPipeline *pipeline, long sample_pos, int frame_rate) {
+    return tempo_map_sample_pos_to_ticks(&pipeline->tempo_map, sample_pos, frame_rate);
+}
+
+long genesis_whole_notes_to_sample_pos(GenesisPipeline *pipeline, double whole_notes, int frame_rate) {
+    return genesis_ticks_to_sample_pos(pipeline, genesis_whole_notes_to_ticks(whole_notes), frame_rate);
+}
+
+int genesis_pipeline_set_tempo_map(struct GenesisPipeline *pipeline,
+        const struct GenesisTempoChange *changes, int change_count)
+{
+    if (change_count < 0)
+        return GenesisErrorInvalidParam;
+    if (pipeline->running.load() && !pipeline->edit_pending.load())
+        return GenesisErrorInvalidState;
+    return tempo_map_init(&pipeline->tempo_map, changes, change_count);
+}
+
+void genesis_pipeline_get_tempo_segment(struct GenesisPipeline *pipeline,
+        long sample_pos, int frame_rate, struct GenesisTempoSegment *out_segment)
+{
+    tempo_map_get_segment(&pipeline->tempo_map, sample_pos, frame_rate, out_segment);
+}
+
+long genesis_tempo_segment_ticks_to_sample_pos(const struct GenesisTempoSegment *segment, long ticks) {
+    return segment->start_sample_pos +
+        (ticks - segment->start_tick) * (segment->frame_rate * 60L) / segment->ticks_per_minute;
+}
+
+// the last tick that genesis_tempo_segment_ticks_to_sample_pos places at or
+// before sample_pos
+long genesis_tempo_segment_sample_pos_to_ticks(const struct GenesisTempoSegment *segment, long sample_pos) {
+    long frame_count = sample_pos - segment->start_sample_pos;
+    return segment->start_tick +
+        ((frame_count + 1) * segment->ticks_per_minute - 1) / (segment->frame_rate * 60L);
 }
 
 static void on_backend_disconnect(struct SoundIo *soundio, int err) {
@@ -407,6 +486,211 @@ static void on_backend_disconnect(struct SoundIo *soundio, int err) {
         context->sound_backend_disconnect_callback(context->sound_backend_disconnect_userdata);
 }
 
+static void destroy_execution_plan(GenesisExecutionPlan *plan) {
+    destroy(plan, 1);
+}
+
+// Walks upstream from every sink and orders the nodes found by level.
+// Returns GenesisErrorInvalidState if the connections form a loop.
+static int compile_execution_plan(GenesisPipeline *pipeline, GenesisExecutionPlan **out_plan) {
+    *out_plan = nullptr;
+    GenesisExecutionPlan *plan = create_zero<GenesisExecutionPlan>();
+    if (!plan)
+        return GenesisErrorNoMem;
+
+    int err;
+    List<GenesisNode *> found;
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1)
+        pipeline->nodes.at(node_index)->plan_index = -1;
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type != GenesisPortTypeAudioIn || !port->input_from)
+                continue;
+            GenesisAudioPortDescriptor *audio_port_descr = (GenesisAudioPortDescriptor *)port->descriptor;
+            if (!audio_port_descr->is_sink)
+                continue;
+            if ((err = plan->sink_ports.append((GenesisAudioPort *)port))) {
+                destroy_execution_plan(plan);
+                return err;
+            }
+            if (node->plan_index < 0) {
+                node->plan_index = found.length();
+                if ((err = found.append(node))) {
+                    destroy_execution_plan(plan);
+                    return err;
+                }
+            }
+        }
+    }
+
+    // breadth first search upstream, counting each distinct upstream node
+    // once no matter how many ports it is connected with.
+    List<GenesisNode *> edge_sources;
+    List<GenesisNode *> edge_targets;
+    for (int found_index = 0; found_index < found.length(); found_index += 1) {
+        GenesisNode *node = found.at(found_index);
+        node->dependency_count = 0;
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *from_port = node->ports[port_i]->input_from;
+            if (!from_port)
+                continue;
+            GenesisNode *from_node = from_port->node;
+            bool duplicate = false;
+            for (int other_port_i = 0; other_port_i < port_i; other_port_i += 1) {
+                GenesisPort *other_from_port = node->ports[other_port_i]->input_from;
+                if (other_from_port && other_from_port->node == from_node) {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (duplicate)
+                continue;
+            if (from_node->plan_index < 0) {
+                from_node->plan_index = found.length();
+                if ((err = found.append(from_node))) {
+                    destroy_execution_plan(plan);
+                    return err;
+                }
+            }
+            node->dependency_count += 1;
+            if ((err = edge_sources.append(from_node)) || (err = edge_targets.append(node))) {
+                destroy_execution_plan(plan);
+                return err;
+            }
+        }
+    }
+
+    if ((err = plan->successor_starts.resize(found.length() + 1)) ||
+        (err = plan->successors.resize(edge_targets.length())))
+    {
+        destroy_execution_plan(plan);
+        return err;
+    }
+    for (int i = 0; i < plan->successor_starts.length(); i += 1)
+        plan->successor_starts.at(i) = 0;
+    for (int edge_i = 0; edge_i < edge_sources.length(); edge_i += 1)
+        plan->successor_starts.at(edge_sources.at(edge_i)->plan_index + 1) += 1;
+    for (int i = 1; i < plan->successor_starts.length(); i += 1)
+        plan->successor_starts.at(i) += plan->successor_starts.at(i - 1);
+    List<int> successor_cursors;
+    if ((err = successor_cursors.resize(found.length()))) {
+        destroy_execution_plan(plan);
+        return err;
+    }
+    for (int i = 0; i < found.length(); i += 1)
+        successor_cursors.at(i) = plan->successor_starts.at(i);
+    for (int edge_i = 0; edge_i < edge_sources.length(); edge_i += 1) {
+        int *cursor = &successor_cursors.at(edge_sources.at(edge_i)->plan_index);
+        plan->successors.at(*cursor) = edge_targets.at(edge_i);
+        *cursor += 1;
+    }
+
+    // Kahn's algorithm, one level at a time
+    for (int found_index = 0; found_index < found.length(); found_index += 1) {
+        GenesisNode *node = found.at(found_index);
+        node->dependencies_left.store(node->dependency_count);
+        if (node->dependency_count == 0 && (err = plan->nodes.append(node))) {
+            destroy_execution_plan(plan);
+            return err;
+        }
+    }
+    int level_start = 0;
+    while (level_start < plan->nodes.length()) {
+        int level_end = plan->nodes.length();
+        if ((err = plan->level_starts.append(level_start))) {
+            destroy_execution_plan(plan);
+            return err;
+        }
+        for (int i = level_start; i < level_end; i += 1) {
+            GenesisNode *node = plan->nodes.at(i);
+            int successor_end = plan->successor_starts.at(node->plan_index + 1);
+            for (int j = plan->successor_starts.at(node->plan_index); j < successor_end; j += 1) {
+                GenesisNode *successor = plan->successors.at(j);
+                if (successor->dependencies_left.fetch_sub(1) == 1 &&
+                    (err = plan->nodes.append(successor)))
+                {
+                    destroy_execution_plan(plan);
+                    return err;
+                }
+            }
+        }
+        level_start = level_end;
+    }
+    if ((err = plan->level_starts.append(plan->nodes.length()))) {
+        destroy_execution_plan(plan);
+        return err;
+    }
+
+    // nodes in a loop never run out of dependencies
+    if (plan->nodes.length() != found.length()) {
+        destroy_execution_plan(plan);
+        return GenesisErrorInvalidState;
+    }
+
+    for (int i = 0; i < plan->nodes.length(); i += 1) {
+        GenesisNode *node = plan->nodes.at(i);
+        node->dependencies_left.store(node->dependency_count);
+    }
+
+    *out_plan = plan;
+    return 0;
+}
+
+static void destroy_workers(GenesisPipelineWorker *workers, int worker_count) {
+    if (!workers)
+        return;
+    for (int i = 0; i < worker_count; i += 1) {
+        GenesisPipelineWorker *worker = &workers[i];
+        assert(!worker->thread);
+        destroy(worker->steal_order, 0);
+    }
+    destroy(workers, worker_count);
+}
+
+static int create_workers(GenesisPipeline *pipeline, int requested_worker_count) {
+    int worker_count = requested_worker_count;
+    if (worker_count <= 0) {
+        // subtract one to make room for GUI thread, OS, and other miscellaneous
+        // interruptions.
+        worker_count = max(1, os_concurrency() - 1);
+    }
+
+    GenesisPipelineWorker *workers = allocate_class<GenesisPipelineWorker>(worker_count);
+    for (int i = 0; i < worker_count; i += 1) {
+        GenesisPipelineWorker *worker = &workers[i];
+        worker->pipeline = pipeline;
+        worker->index = i;
+        worker->thread = nullptr;
+        worker->steal_order = nullptr;
+        worker->policy_ready.store(false);
+    }
+    for (int i = 0; i < worker_count && worker_count > 1; i += 1) {
+        GenesisPipelineWorker *worker = &workers[i];
+        worker->steal_order = allocate_zero<int>(worker_count - 1);
+        if (!worker->steal_order) {
+            destroy_workers(workers, worker_count);
+            return GenesisErrorNoMem;
+        }
+        // i+1, i-1, i+2, i-2, ... wrapping around the ends
+        int steal_index = 0;
+        for (int distance = 1; steal_index < worker_count - 1; distance += 1) {
+            int after = (i + distance) % worker_count;
+            worker->steal_order[steal_index++] = after;
+            int before = euclidean_mod(i - distance, worker_count);
+            if (steal_index < worker_count - 1 && before != after)
+                worker->steal_order[steal_index++] = before;
+        }
+    }
+
+    destroy_workers(pipeline->workers, pipeline->worker_count);
+    pipeline->workers = workers;
+    pipeline->worker_count = worker_count;
+    pipeline->requested_worker_count = requested_worker_count;
+    return 0;
+}
+
 void genesis_pipeline_destroy(struct GenesisPipeline *pipeline) {
     if (!pipeline)
         return;
@@ -430,8 +714,8 @@ void genesis_pipeline_destroy(struct GenesisPipeline *pipeline) {
         int last_index = pipeline->node_descriptors.length() - 1;
         genesis_node_descriptor_destroy(pipeline->node_descriptors.at(last_index));
     }
-    destroy(pipeline->thread_pool, pipeline->thread_pool_size);
-
+    destroy_workers(pipeline->workers, pipeline->worker_count);
+    destroy_execution_plan(pipeline->plan);
 
     destroy(pipeline, 1);
 }
@@ -456,13 +740,16 @@ int genesis_pipeline_create(struct GenesisContext *context,
     pipeline->stream_fail_flag.test_and_set();
     pipeline->threads_paused.store(0);
 
-    int concurrency = os_concurrency();
-    // subtract one to make room for GUI thread, OS, and other miscellaneous
-    // interruptions.
-    pipeline->thread_pool_size = max(1, concurrency - 1);
-    pipeline->thread_pool_size = 1; // TODO remove this debug
-    pipeline->thread_pool = allocate_zero<OsThread *>(pipeline->thread_pool_size);
-    if (!pipeline->thread_pool) {
+    pipeline->wake_seq.store(0);
+    pipeline->sleeping_worker_count.store(0);
+    pipeline->thread_policy.scheduler = GenesisThreadSchedulerFifo;
+
+    if (tempo_map_init(&pipeline->tempo_map, nullptr, 0)) {
+        genesis_pipeline_destroy(pipeline);
+        return GenesisErrorNoMem;
+    }
+
+    if (create_workers(pipeline, 0)) {
         genesis_pipeline_destroy(pipeline);
         return GenesisErrorNoMem;
     }
@@ -487,10 +774,18 @@ int genesis_pipeline_create(struct GenesisContext *context,
     return 0;
 }
 
+static int init_once(void) {
+    int err;
+    if ((err = audio_file_init()))
+        return err;
+    mix_kernels_init();
+    return 0;
+}
+
 int genesis_context_create(struct GenesisContext **out_context) {
     *out_context = nullptr;
 
-    os_init(audio_file_init);
+    os_init(init_once);
 
     GenesisContext *context = create_zero<GenesisContext>();
     if (!context) {
@@ -650,6 +945,23 @@ const char *genesis_node_descriptor_description(const struct GenesisNodeDescript
     return node_descriptor->description;
 }
 
+double genesis_node_descriptor_latency(const struct GenesisNodeDescriptor *node_descriptor) {
+    return node_descriptor->latency;
+}
+
+double genesis_node_descriptor_ops_per_sample(const struct GenesisNodeDescriptor *node_descriptor) {
+    return node_descriptor->ops_per_sample;
+}
+
+void genesis_node_descriptor_set_cost(struct GenesisNodeDescriptor *node_descriptor,
+        double latency, double ops_per_sample)
+{
+    node_descriptor->latency = latency;
+    node_descriptor->ops_per_sample = ops_per_sample;
+}
+
+static void destroy_port(struct GenesisPort *port);
+
 static GenesisPort *create_port_from_descriptor(GenesisPortDescriptor *port_descriptor) {
     GenesisPort *port = nullptr;
     switch (port_descriptor->port_type) {
@@ -673,7 +985,30 @@ static GenesisPort *create_port_from_descriptor(GenesisPortDescriptor *port_desc
                 port = (GenesisPort*)events_port;
                 break;
             }
-
+        case GenesisPortTypeParamIn:
+            {
+                GenesisParamPortDescriptor *param_descr = (GenesisParamPortDescriptor *)port_descriptor;
+                GenesisParamPort *param_port = create_zero<GenesisParamPort>();
+                if (!param_port)
+                    return nullptr;
+                param_port->port.descriptor = port_descriptor;
+                param_port->value = param_descr->default_value;
+                if ((param_port->change_queue_err = ring_buffer_init(&param_port->change_queue,
+                                PARAM_CHANGE_QUEUE_CAPACITY * sizeof(GenesisParamChange))))
+                {
+                    destroy_port((GenesisPort *)param_port);
+                    return nullptr;
+                }
+                int max_change_count = param_port->change_queue.capacity / sizeof(GenesisParamChange);
+                param_port->segment_capacity = max_change_count * 2 + 2;
+                param_port->segments = allocate_zero<GenesisParamSegment>(param_port->segment_capacity);
+                if (!param_port->segments) {
+                    destroy_port((GenesisPort *)param_port);
+                    return nullptr;
+                }
+                port = (GenesisPort*)param_port;
+                break;
+            }
     }
     port->descriptor = port_descriptor;
     return port;
@@ -686,7 +1021,10 @@ struct GenesisNode *genesis_node_descriptor_create_node(struct GenesisNodeDescri
         return nullptr;
     }
     node->set_index = -1;
+    node->plan_index = -1;
     node->descriptor = node_descriptor;
+    node->id = node_descriptor->pipeline->next_node_id;
+    node_descriptor->pipeline->next_node_id += 1;
     node->port_count = node_descriptor->port_descriptors.length();
     node->ports = allocate_zero<GenesisPort*>(node->port_count);
     if (!node->ports) {
@@ -720,9 +1058,16 @@ struct GenesisNode *genesis_node_descriptor_create_node(struct GenesisNodeDescri
     return node;
 }
 
+static void deinit_extra_channel_buffers(GenesisAudioPort *audio_port) {
+    for (int i = 0; i < audio_port->extra_channel_buffer_count; i += 1)
+        os_deinit_mirrored_memory(&audio_port->extra_channel_buffers[i]);
+    audio_port->extra_channel_buffer_count = 0;
+}
+
 static void destroy_audio_port(GenesisAudioPort *audio_port) {
     if (!audio_port->sample_buffer_err)
         ring_buffer_deinit(&audio_port->sample_buffer);
+    deinit_extra_channel_buffers(audio_port);
     destroy(audio_port, 1);
 }
 
@@ -732,6 +1077,13 @@ static void destroy_events_port(GenesisEventsPort *events_port) {
     destroy(events_port, 1);
 }
 
+static void destroy_param_port(GenesisParamPort *param_port) {
+    if (!param_port->change_queue_err)
+        ring_buffer_deinit(&param_port->change_queue);
+    destroy(param_port->segments, param_port->segment_capacity);
+    destroy(param_port, 1);
+}
+
 static void destroy_port(struct GenesisPort *port) {
     if (!port)
         return;
@@ -744,6 +1096,9 @@ static void destroy_port(struct GenesisPort *port) {
         case GenesisPortTypeEventsOut:
             destroy_events_port((GenesisEventsPort *)port);
             return;
+        case GenesisPortTypeParamIn:
+            destroy_param_port((GenesisParamPort *)port);
+            return;
     }
     panic("invalid port type");
 }
@@ -753,6 +1108,13 @@ void genesis_node_disconnect_all_ports(struct GenesisNode *node) {
     for (int i = 0; i < node->port_count; i += 1) {
         GenesisPort *port = node->ports[i];
         if (port) {
+            if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
+                GenesisAudioPort *audio_out_port = (GenesisAudioPort *)port;
+                while (audio_out_port->reader_count > 0) {
+                    GenesisAudioPort *reader = audio_out_port->readers[audio_out_port->reader_count - 1];
+                    genesis_disconnect_ports(port, &reader->port);
+                }
+            }
             if (port->output_to)
                 genesis_disconnect_ports(port, port->output_to);
             if (port->input_from)
@@ -761,6 +1123,20 @@ void genesis_node_disconnect_all_ports(struct GenesisNode *node) {
     }
 }
 
+static void unlock_node_memory(GenesisNode *node) {
+    if (node->userdata_locked) {
+        os_unlock_memory(node->userdata, node->userdata_size);
+        node->userdata_locked = false;
+    }
+    for (int i = 0; i < node->memory_range_count; i += 1) {
+        GenesisMemoryRange *range = &node->memory_ranges[i];
+        if (range->locked) {
+            os_unlock_memory(range->address, range->size);
+            range->locked = false;
+        }
+    }
+}
+
 void genesis_node_destroy(struct GenesisNode *node) {
     if (!node)
         return;
@@ -772,6 +1148,8 @@ void genesis_node_destroy(struct GenesisNode *node) {
         genesis_node_disconnect_all_ports(node);
     }
 
+    unlock_node_memory(node);
+
     // call destructor on node
     if (node->constructed && node->descriptor->destroy)
         node->descriptor->destroy(node);
@@ -841,73 +1219,384 @@ int genesis_audio_file_codec_sample_rate_index(
     return codec->sample_rate_list.at(index);
 }
 
-static void get_audio_port_status(GenesisAudioPort *audio_out_port, bool *empty, bool *full) {
+static int round_down_to_quantum(GenesisPipeline *pipeline, int frame_count) {
+    return pipeline->quantum ? (frame_count & ~(pipeline->quantum - 1)) : frame_count;
+}
+
+static int round_up_to_quantum(GenesisPipeline *pipeline, int frame_count) {
+    return pipeline->quantum ? round_down_to_quantum(pipeline, frame_count + pipeline->quantum - 1) : frame_count;
+}
+
+static int audio_port_bytes_per_frame(GenesisAudioPort *audio_port) {
+    if (audio_port->format == GenesisAudioPortFormatPlanar)
+        return BYTES_PER_SAMPLE;
+    return BYTES_PER_SAMPLE * audio_port->channel_layout.channel_count;
+}
+
+// offset is a read or write offset of audio_port->sample_buffer
+static float *audio_port_channel_ptr(GenesisAudioPort *audio_port, long offset, int channel_index) {
+    RingBuffer *sample_buffer = &audio_port->sample_buffer;
+    long buffer_index = offset % sample_buffer->capacity;
+    if (audio_port->format == GenesisAudioPortFormatInterleaved)
+        return ((float *)(sample_buffer->mem.address + buffer_index)) + channel_index;
+    if (channel_index == 0)
+        return (float *)(sample_buffer->mem.address + buffer_index);
+    return (float *)(audio_port->extra_channel_buffers[channel_index - 1].address + buffer_index);
+}
+
+// device callbacks read and write whatever the hardware asks for, regardless
+// of the quantum.
+static int audio_in_port_fill_count_raw(GenesisPort *port) {
+    struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
+    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
+    long fill_count = audio_out_port->sample_buffer.write_offset.load() - audio_in_port->read_offset.load();
+    assert(fill_count >= 0);
+    return fill_count / audio_out_port->bytes_per_frame;
+}
+
+static thread_local GenesisPipelineWorker *current_worker = nullptr;
+static thread_local GenesisNode *rt_current_node = nullptr;
+
+static bool on_pipeline_worker(GenesisPipeline *pipeline) {
+    GenesisPipelineWorker *worker = current_worker;
+    return worker && worker->pipeline == pipeline;
+}
+
+static void leave_device_section(GenesisPipeline *pipeline, int epoch) {
+    atomic_int *section_count = &pipeline->device_section_counts[epoch & 1];
+    if (section_count->fetch_sub(1) == 1 && pipeline->device_grace_waiting.load())
+        os_futex_wake(reinterpret_cast<int*>(section_count), 1);
+}
+
+// Returns the epoch to pass to leave_device_section.
+static int enter_device_section(GenesisPipeline *pipeline) {
+    for (;;) {
+        int epoch = pipeline->device_epoch.load();
+        pipeline->device_section_counts[epoch & 1] += 1;
+        // counted against the epoch that a grace period is waiting for, so
+        // that the wait does not miss it
+        if (pipeline->device_epoch.load() == epoch)
+            return epoch;
+        leave_device_section(pipeline, epoch);
+    }
+}
+
+// Waits for the device sections that may not have seen what the caller
+// stored before. Sections that enter meanwhile count against the new epoch,
+// so they cannot hold the wait up.
+static void wait_for_device_grace(GenesisPipeline *pipeline) {
+    int epoch = pipeline->device_epoch.fetch_add(1);
+    atomic_int *section_count = &pipeline->device_section_counts[epoch & 1];
+    pipeline->device_grace_waiting.store(true);
+    for (;;) {
+        int count = section_count->load();
+        if (count == 0)
+            break;
+        os_futex_wait(reinterpret_cast<int*>(section_count), count);
+    }
+    pipeline->device_grace_waiting.store(false);
+}
+
+static long slowest_reader_offset(GenesisAudioPort *audio_out_port) {
+    long slowest_offset = LONG_MAX;
+    for (int i = 0; i < audio_out_port->reader_count; i += 1) {
+        GenesisAudioPort *reader = audio_out_port->readers[i];
+        if (reader->active.load(std::memory_order_relaxed))
+            slowest_offset = min(slowest_offset, reader->read_offset.load());
+    }
+    return slowest_offset;
+}
+
+// Moves the read offset of the out port's buffer up to its slowest reader,
+// which frees what every reader is done with. Readers that are not in the
+// plan do not run, so they must not hold the others back.
+static void advance_slowest_reader(GenesisPipeline *pipeline, GenesisAudioPort *audio_out_port) {
+    long slowest_offset;
+    if (on_pipeline_worker(pipeline)) {
+        // no edit changes the readers while a cycle runs
+        slowest_offset = slowest_reader_offset(audio_out_port);
+    } else {
+        // a device callback. during an edit the readers may be changing, so
+        // leave the buffer as it is; the next advance catches up.
+        int epoch = enter_device_section(pipeline);
+        slowest_offset = pipeline->edit_pending.load() ? LONG_MAX : slowest_reader_offset(audio_out_port);
+        leave_device_section(pipeline, epoch);
+    }
+    if (slowest_offset == LONG_MAX)
+        return;
+    // readers on other threads may be doing the same; only ever move forward
+    atomic_long *read_offset = &audio_out_port->sample_buffer.read_offset;
+    long old_offset = read_offset->load();
+    while (old_offset < slowest_offset &&
+            !read_offset->compare_exchange_weak(old_offset, slowest_offset))
+    {
+    }
+}
+
+static int audio_out_port_free_count_raw(GenesisPort *port) {
+    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
     int fill_count = ring_buffer_fill_count(&audio_out_port->sample_buffer);
-    *empty = (fill_count == 0);
-    *full = (fill_count == audio_out_port->sample_buffer_size);
+    int bytes_free_count = audio_out_port->sample_buffer_size - fill_count;
+    int result = bytes_free_count / audio_out_port->bytes_per_frame;
+    assert(result >= 0);
+    return result;
 }
 
-static void get_events_port_status(GenesisEventsPort *events_out_port, bool *empty, bool *full) {
-    *full = (events_out_port->time_requested.load() == 0.0);
-    *empty = (*full) ? false : (events_out_port->time_available.load() == 0.0);
+GenesisNode *genesis_rt_current_node(void) {
+    return rt_current_node;
 }
 
-static void get_port_status(GenesisPort *port, bool *empty, bool *full) {
-    switch (port->descriptor->port_type) {
-        case GenesisPortTypeAudioOut:
-            get_audio_port_status((GenesisAudioPort *)port, empty, full);
+// Device callbacks have the same realtime constraints as run callbacks, so
+// they count as running their node too.
+static void set_rt_current_node(GenesisNode *node) {
+    if (GENESIS_DEBUG_MODE)
+        rt_current_node = node;
+}
+
+static void queue_node(GenesisPipeline *pipeline, GenesisNode *node) {
+    GenesisPipelineWorker *worker = current_worker;
+    if (worker && worker->pipeline == pipeline) {
+        // nodes made ready by a worker are probably touching the same buffers
+        // it just touched, so keep them on this worker unless someone steals.
+        worker->deque.push(node);
+    } else {
+        pipeline->inject_queue.enqueue(node);
+    }
+    pipeline->wake_seq += 1;
+    if (pipeline->sleeping_worker_count.load() > 0)
+        os_futex_wake(reinterpret_cast<int*>(&pipeline->wake_seq), 1);
+}
+
+static bool sinks_satisfied(GenesisExecutionPlan *plan) {
+    for (int i = 0; i < plan->sink_ports.length(); i += 1) {
+        GenesisAudioPort *audio_in_port = plan->sink_ports.at(i);
+        GenesisAudioPort *audio_out_port = (GenesisAudioPort *)audio_in_port->port.input_from;
+        if (ring_buffer_fill_count(&audio_out_port->sample_buffer) < audio_out_port->sample_buffer_size)
+            return false;
+    }
+    return true;
+}
+
+static void dispatch_node(GenesisPipeline *pipeline, GenesisNode *node);
+
+static void begin_cycle(GenesisPipeline *pipeline) {
+    GenesisExecutionPlan *plan = pipeline->plan;
+    pipeline->cycle_start_ns.store(os_get_time_ns(), std::memory_order_relaxed);
+    pipeline->cycle_requested.store(false);
+    pipeline->cycle_progress.store(false);
+    pipeline->cycle_nodes_left.store(plan->nodes.length());
+    int first_level_end = plan->level_starts.at(1);
+    for (int i = 0; i < first_level_end; i += 1)
+        dispatch_node(pipeline, plan->nodes.at(i));
+}
+
+static bool offline_render_done(GenesisPipeline *pipeline) {
+    GenesisAudioPort *audio_in_port = pipeline->offline_sink_port;
+    return audio_in_port->read_offset.load() >= pipeline->offline_end_offset;
+}
+
+// gives up the right to run cycles, and hands it to an edit if one is waiting
+static void release_cycle(GenesisPipeline *pipeline) {
+    pipeline->cycle_running.store(false);
+    if (pipeline->edit_pending.load()) {
+        pipeline->cycle_release_seq += 1;
+        os_futex_wake(reinterpret_cast<int*>(&pipeline->cycle_release_seq), 1);
+    }
+}
+
+static void end_cycle(GenesisPipeline *pipeline) {
+    pipeline->busy_ns += os_get_time_ns() - pipeline->cycle_start_ns.load(std::memory_order_relaxed);
+    for (;;) {
+        if (!pipeline->running.load()) {
+            pipeline->cycle_running.store(false);
             return;
-        case GenesisPortTypeEventsOut:
-            get_events_port_status((GenesisEventsPort *)port, empty, full);
+        }
+        if (pipeline->edit_pending.load()) {
+            // the commit requests a cycle with the new plan
+            release_cycle(pipeline);
+            return;
+        }
+        bool offline_done = pipeline->offline_sink_port && offline_render_done(pipeline);
+        if (!offline_done && (pipeline->cycle_requested.load() ||
+            (pipeline->cycle_progress.load() && !sinks_satisfied(pipeline->plan))))
+        {
+            begin_cycle(pipeline);
+            return;
+        }
+        release_cycle(pipeline);
+        if (pipeline->offline_sink_port) {
+            // nothing outside the pipeline requests cycles during an offline
+            // render, so the graph is either done or stuck.
+            pipeline->offline_idle.store(1);
+            os_futex_wake(reinterpret_cast<int*>(&pipeline->offline_idle), 1);
+            return;
+        }
+        // a request that came in after we looked saw that a cycle was
+        // running and left it to us. pick it up unless someone else did.
+        if (!pipeline->cycle_requested.load() || pipeline->cycle_running.exchange(true))
             return;
-        case GenesisPortTypeAudioIn:
-        case GenesisPortTypeEventsIn:
-            panic("expected out port");
     }
-    panic("invalid port type");
 }
 
-static void queue_node_if_ready(GenesisPipeline *pipeline, GenesisNode *node, bool recursive) {
-    if (node->being_processed) {
-        // this node is already being processed; no point in queueing it again
-        return;
+static void finish_node(GenesisPipeline *pipeline, GenesisNode *node) {
+    GenesisExecutionPlan *plan = pipeline->plan;
+    int successor_end = plan->successor_starts.at(node->plan_index + 1);
+    for (int i = plan->successor_starts.at(node->plan_index); i < successor_end; i += 1) {
+        GenesisNode *successor = plan->successors.at(i);
+        if (successor->dependencies_left.fetch_sub(1) == 1)
+            dispatch_node(pipeline, successor);
     }
-    if (!node->descriptor->run) {
-        // this node has no run function; no point in queuing it
+    if (pipeline->cycle_nodes_left.fetch_sub(1) == 1)
+        end_cycle(pipeline);
+}
+
+static void dispatch_node(GenesisPipeline *pipeline, GenesisNode *node) {
+    // every dependency has finished, so nothing else touches this counter
+    // until the next cycle.
+    node->dependencies_left.store(node->dependency_count);
+    if (node->descriptor->run)
+        queue_node(pipeline, node);
+    else
+        finish_node(pipeline, node);
+}
+
+static void request_cycle(GenesisPipeline *pipeline) {
+    pipeline->cycle_requested.store(true);
+    if (!pipeline->running.load() || pipeline->edit_pending.load())
+        return;
+    if (pipeline->cycle_running.exchange(true))
+        return;
+    // only look at the plan once we hold cycle_running; an edit can replace
+    // it at any other time.
+    if (pipeline->plan->nodes.length() == 0) {
+        release_cycle(pipeline);
         return;
     }
-    // make sure all the children of this node are ready
-    bool waiting_for_any_children = false;
-    bool any_output_has_room = false;
-    bool has_any_output = false;
-    for (int parent_port_i = 0; parent_port_i < node->port_count; parent_port_i += 1) {
-        GenesisPort *port = node->ports[parent_port_i];
-
-        if (port->output_to) {
-            has_any_output = true;
-            bool empty, full;
-            get_port_status(port, &empty, &full);
-            if (!full)
-                any_output_has_room = true;
-        } else {
-            GenesisPort *child_port = port->input_from;
-            if (child_port && child_port != port) {
-                bool empty, full;
-                get_port_status(child_port, &empty, &full);
-                waiting_for_any_children = waiting_for_any_children || empty;
-                if (!full) {
-                    GenesisNode *child_node = child_port->node;
-                    if (recursive)
-                        queue_node_if_ready(pipeline, child_node, true);
-                }
+    begin_cycle(pipeline);
+}
+
+// Called by port accessors that moved data. Inside a cycle this only notes
+// that the graph is not idle yet. Device callbacks and other threads outside
+// the pipeline start a cycle instead.
+static void port_advanced(GenesisPipeline *pipeline) {
+    if (on_pipeline_worker(pipeline)) {
+        if (!pipeline->cycle_progress.load(std::memory_order_relaxed))
+            pipeline->cycle_progress.store(true, std::memory_order_relaxed);
+    } else {
+        request_cycle(pipeline);
+    }
+}
+
+// Called from the playback device callback. Returns the fraction of the time
+// since the previous callback that the graph spent running cycles.
+static double update_dsp_load(GenesisPipeline *pipeline, PlaybackNodeContext *playback_node_context) {
+    uint64_t now = os_get_time_ns();
+    long busy_ns = pipeline->busy_ns.exchange(0);
+    uint64_t last_callback_ns = playback_node_context->last_callback_ns;
+    playback_node_context->last_callback_ns = now;
+    if (last_callback_ns == 0 || now <= last_callback_ns)
+        return 0.0;
+
+    double load = busy_ns / (double)(now - last_callback_ns);
+    double average = pipeline->dsp_load_average.load();
+    pipeline->dsp_load_average.store(average + (load - average) * DSP_LOAD_SMOOTHING);
+    if (load > pipeline->dsp_load_peak.load())
+        pipeline->dsp_load_peak.store(load);
+    return load;
+}
+
+static void store_underrun_record(GenesisUnderrunSlot *slot, const GenesisUnderrun *record) {
+    long words[UNDERRUN_RECORD_WORD_COUNT] = {0};
+    memcpy(words, record, sizeof(GenesisUnderrun));
+    for (int i = 0; i < UNDERRUN_RECORD_WORD_COUNT; i += 1)
+        slot->record_words[i].store(words[i], std::memory_order_relaxed);
+}
+
+static void load_underrun_record(GenesisUnderrunSlot *slot, GenesisUnderrun *out_record) {
+    long words[UNDERRUN_RECORD_WORD_COUNT];
+    for (int i = 0; i < UNDERRUN_RECORD_WORD_COUNT; i += 1)
+        words[i] = slot->record_words[i].load(std::memory_order_relaxed);
+    memcpy(out_record, words, sizeof(GenesisUnderrun));
+}
+
+// Called from device callbacks. If two threads report an underrun at the
+// same time, only one of them records it.
+static void record_underrun(GenesisPipeline *pipeline, double dsp_load) {
+    if (pipeline->underrun_write_flag.test_and_set())
+        return;
+    // during an edit the plan may point at nodes that no longer exist
+    int epoch = enter_device_section(pipeline);
+    bool plan_valid = !pipeline->edit_pending.load();
+
+    long index = pipeline->underrun_count.load(std::memory_order_relaxed);
+    GenesisUnderrunSlot *slot = &pipeline->underrun_slots[index % GENESIS_UNDERRUN_HISTORY_COUNT];
+    slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    GenesisUnderrun underrun;
+    GenesisUnderrun *record = &underrun;
+    record->time_ns = os_get_time_ns();
+    record->dsp_load = dsp_load;
+    record->port_count = 0;
+    record->slowest_node_id = -1;
+    record->slowest_node_ns = 0;
+    bool stats_enabled = pipeline->stats_enabled.load(std::memory_order_relaxed);
+    GenesisExecutionPlan *plan = pipeline->plan;
+    int plan_node_count = plan_valid ? plan->nodes.length() : 0;
+    for (int i = 0; i < plan_node_count; i += 1) {
+        GenesisNode *node = plan->nodes.at(i);
+        if (stats_enabled) {
+            long ns = node->last_run_ns.load(std::memory_order_relaxed);
+            if (ns > record->slowest_node_ns) {
+                record->slowest_node_id = node->id;
+                record->slowest_node_ns = ns;
             }
         }
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type != GenesisPortTypeAudioIn || !port->input_from)
+                continue;
+            if (record->port_count >= GENESIS_UNDERRUN_MAX_PORTS)
+                continue;
+            GenesisUnderrunPortFill *port_fill = &record->ports[record->port_count];
+            record->port_count += 1;
+            port_fill->node_id = node->id;
+            port_fill->port_index = port_i;
+            port_fill->fill_count = audio_in_port_fill_count_raw(port);
+            port_fill->capacity = genesis_audio_in_port_capacity(port);
+        }
     }
-    if (!waiting_for_any_children && (!has_any_output || any_output_has_room)) {
-        // we know that we want it enqueued. now make sure it only happens once.
-        if (!node->being_processed.exchange(true))
-            pipeline->task_queue.enqueue(node);
-    }
+    leave_device_section(pipeline, epoch);
+
+    slot->index.store(index, std::memory_order_relaxed);
+    store_underrun_record(slot, record);
+    slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    pipeline->underrun_count.store(index + 1, std::memory_order_release);
+    pipeline->underrun_write_flag.clear();
+}
+
+void genesis_node_set_latency(struct GenesisNode *node, int frame_count) {
+    assert(frame_count >= 0);
+    node->latency_frame_count = frame_count;
+}
+
+void genesis_node_set_userdata_size(struct GenesisNode *node, int size) {
+    assert(size >= 0);
+    node->userdata_size = size;
+}
+
+void genesis_node_add_memory_range(struct GenesisNode *node, void *address, int size) {
+    assert(size >= 0);
+    assert(node->memory_range_count < GENESIS_MAX_NODE_MEMORY_RANGES);
+    GenesisMemoryRange *range = &node->memory_ranges[node->memory_range_count];
+    range->address = address;
+    range->size = size;
+    range->locked = false;
+    node->memory_range_count += 1;
+}
+
+double genesis_node_path_latency(struct GenesisNode *node) {
+    return node->path_latency;
 }
 
 double genesis_node_playback_latency(struct GenesisNode *node) {
@@ -1005,17 +1694,24 @@ static void playback_node_callback(SoundIoOutStream *outstream,
         if (playback_node_context->achieved_silence_path.exchange(1) == 0) {
             os_futex_wake(reinterpret_cast<int*>(&playback_node_context->achieved_silence_path), 1);
         }
+        playback_node_context->last_callback_ns = 0;
         playback_node_fill_silence(outstream, frame_count_min);
         return;
     }
 
+    double dsp_load = update_dsp_load(pipeline, playback_node_context);
+
     GenesisPort *audio_in_port = genesis_node_port(node, 0);
-    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int input_frame_count = audio_in_port_fill_count_raw(audio_in_port);
 
-    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
     const struct SoundIoChannelLayout *layout = &outstream->layout;
+    int in_stride = genesis_audio_port_channel_stride(audio_in_port);
+    float *in_bufs[GENESIS_MAX_CHANNELS];
+    for (int channel = 0; channel < layout->channel_count; channel += 1)
+        in_bufs[channel] = genesis_audio_in_port_channel_read_ptr(audio_in_port, channel);
 
     if (frame_count_max > input_frame_count) {
+        record_underrun(pipeline, dsp_load);
         playback_node_fill_silence(outstream, frame_count_min);
         soundio_outstream_pause(playback_node_context->outstream, 1);
         playback_node_error_callback(outstream, SoundIoErrorUnderflow);
@@ -1035,9 +1731,9 @@ static void playback_node_callback(SoundIoOutStream *outstream,
 
         for (int frame = 0; frame < frame_count; frame += 1) {
             for (int channel = 0; channel < layout->channel_count; channel += 1) {
-                playback_node_context->write_sample(areas[channel].ptr, *in_buf);
+                playback_node_context->write_sample(areas[channel].ptr, *in_bufs[channel]);
                 areas[channel].ptr += areas[channel].step;
-                in_buf += 1;
+                in_bufs[channel] += in_stride;
             }
         }
 
@@ -1066,6 +1762,10 @@ static void playback_node_callback(SoundIoOutStream *outstream,
 }
 
 static void playback_node_underrun_callback(SoundIoOutStream *outstream) {
+    GenesisNode *node = (GenesisNode *)outstream->userdata;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    if (pipeline->running.load())
+        record_underrun(pipeline, pipeline->dsp_load_average.load());
     playback_node_error_callback(outstream, SoundIoErrorUnderflow);
 }
 
@@ -1161,6 +1861,7 @@ static int playback_node_create(struct GenesisNode *node) {
         return GenesisErrorNoMem;
     }
     node->userdata = playback_node_context;
+    genesis_node_set_userdata_size(node, sizeof(PlaybackNodeContext));
     playback_node_context->offset.store(0);
     playback_node_context->reset_offset_flag.store(false);
 
@@ -1199,8 +1900,11 @@ static void recording_node_callback(SoundIoInStream *instream, int frame_count_m
     assert(pipeline->running);
 
     GenesisPort *audio_out_port = genesis_node_port(node, 0);
-    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
-    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    int output_frame_count = audio_out_port_free_count_raw(audio_out_port);
+    int out_stride = genesis_audio_port_channel_stride(audio_out_port);
+    float *out_bufs[GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < instream->layout.channel_count; ch += 1)
+        out_bufs[ch] = genesis_audio_out_port_channel_write_ptr(audio_out_port, ch);
 
     int write_frames = min(output_frame_count, frame_count_max);
     int read_frames = clamp(frame_count_min, output_frame_count, frame_count_max);
@@ -1227,9 +1931,9 @@ static void recording_node_callback(SoundIoInStream *instream, int frame_count_m
         } else {
             for (int frame = 0; frame < write_frame_count; frame += 1) {
                 for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-                    recording_node_context->read_sample(areas[ch].ptr, out_buf);
+                    recording_node_context->read_sample(areas[ch].ptr, out_bufs[ch]);
                     areas[ch].ptr += areas[ch].step;
-                    out_buf += 1;
+                    out_bufs[ch] += out_stride;
                 }
             }
         }
@@ -1290,6 +1994,7 @@ static int recording_node_create(struct GenesisNode *node) {
         return GenesisErrorNoMem;
     }
     node->userdata = recording_node_context;
+    genesis_node_set_userdata_size(node, sizeof(RecordingNodeContext));
 
     SoundIoDevice *device = (SoundIoDevice*)node->descriptor->userdata;
 
@@ -1419,34 +2124,256 @@ int genesis_audio_device_create_node_descriptor(struct GenesisPipeline *pipeline
     }
     genesis_audio_port_descriptor_set_channel_layout(audio_port, &layout, true, -1);
 
+    // the device callbacks copy sample by sample either way
+    genesis_audio_port_descriptor_set_format(audio_port, GenesisAudioPortFormatInterleaved, false, -1);
+
     genesis_audio_port_descriptor_set_is_sink(audio_port, true);
 
     *out = node_descr;
     return 0;
 }
 
-static void midi_node_on_event(struct GenesisMidiDevice *device, const struct GenesisMidiEvent *event) {
-    GenesisNode *node = (GenesisNode *)device->userdata;
-    GenesisPort *events_out_port = genesis_node_port(node, 0);
+static void virtual_device_wake_clock(VirtualDeviceNodeContext *context) {
+    context->wake_seq += 1;
+    if (context->clock_waiting.load())
+        os_futex_wake(reinterpret_cast<int*>(&context->wake_seq), 1);
+}
+
+static void virtual_device_wait(VirtualDeviceNodeContext *context, int wake_seq) {
+    context->clock_waiting.store(true);
+    os_futex_wait(reinterpret_cast<int*>(&context->wake_seq), wake_seq);
+    context->clock_waiting.store(false);
+}
+
+// Stands in for the device callback thread of a playback node.
+static void virtual_device_clock_run(void *arg) {
+    GenesisNode *node = (GenesisNode *)arg;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    VirtualDeviceDescriptorContext *descr_context = (VirtualDeviceDescriptorContext *)node->descriptor->userdata;
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    PlaybackNodeContext *playback_node_context = &context->playback;
+    GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int period_frame_count = descr_context->period_frame_count;
+    uint64_t period_ns = (uint64_t)period_frame_count * 1000000000 /
+        genesis_audio_port_sample_rate(audio_in_port);
+    uint64_t next_tick_ns = 0;
+
+    while (!context->quit.load()) {
+        int wake_seq = context->wake_seq.load();
+        if (!pipeline->running.load() || playback_node_context->ongoing_recovery.load()) {
+            if (playback_node_context->achieved_silence_path.exchange(1) == 0) {
+                os_futex_wake(reinterpret_cast<int*>(&playback_node_context->achieved_silence_path), 1);
+            }
+            playback_node_context->last_callback_ns = 0;
+            next_tick_ns = 0;
+            if (!pipeline->running.load() || playback_node_context->ongoing_recovery.load())
+                virtual_device_wait(context, wake_seq);
+            continue;
+        }
+
+        if (descr_context->clock == GenesisVirtualClockWallTime) {
+            uint64_t now = os_get_time_ns();
+            next_tick_ns = (next_tick_ns == 0) ? now : (next_tick_ns + period_ns);
+            os_sleep_until_ns(next_tick_ns);
+            if (context->quit.load() || !pipeline->running.load())
+                continue;
+        }
+
+        if (audio_in_port_fill_count_raw(audio_in_port) < period_frame_count) {
+            if (descr_context->clock == GenesisVirtualClockFreeRunning) {
+                // the run callback wakes us once the graph has produced more
+                virtual_device_wait(context, wake_seq);
+                continue;
+            }
+            double dsp_load = update_dsp_load(pipeline, playback_node_context);
+            record_underrun(pipeline, dsp_load);
+            context->missed_count += 1;
+            playback_node_context->ongoing_recovery.store(true);
+            pipeline->stream_fail_flag.clear();
+            emit_event_ready(pipeline->context);
+            continue;
+        }
+
+        set_rt_current_node(node);
+        update_dsp_load(pipeline, playback_node_context);
+        if (playback_node_context->reset_offset_flag.exchange(false)) {
+            playback_node_context->offset.store(period_frame_count);
+        } else {
+            playback_node_context->offset += period_frame_count;
+        }
+        context->period_count += 1;
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, period_frame_count);
+        set_rt_current_node(nullptr);
+    }
+}
+
+static void virtual_device_node_deactivate(struct GenesisNode *node) {
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    context->quit.store(true);
+    virtual_device_wake_clock(context);
+    os_thread_destroy(context->thread);
+    context->thread = nullptr;
+}
+
+static int virtual_device_node_activate(struct GenesisNode *node) {
+    VirtualDeviceDescriptorContext *descr_context = (VirtualDeviceDescriptorContext *)node->descriptor->userdata;
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    GenesisPort *audio_in_port = genesis_node_port(node, 0);
+
+    context->playback.ongoing_recovery.store(true);
+    context->playback.latency.store(descr_context->period_frame_count /
+            (double)genesis_audio_port_sample_rate(audio_in_port));
+    context->quit.store(false);
+
+    assert(!context->thread);
+    int err;
+    if ((err = os_thread_create(virtual_device_clock_run, node, true, &context->thread)))
+        return err;
+    return 0;
+}
+
+static void virtual_device_node_pause(struct GenesisNode *node) {
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    virtual_device_wake_clock(context);
+    playback_node_pause(node);
+}
+
+static void virtual_device_node_run(struct GenesisNode *node) {
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    PlaybackNodeContext *playback_node_context = &context->playback;
+
+    if (playback_node_context->ongoing_recovery.load()) {
+        struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+        int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+        int input_capacity = genesis_audio_in_port_capacity(audio_in_port);
+
+        if (input_frame_count == input_capacity) {
+            playback_node_context->reset_offset_flag.store(true);
+            playback_node_context->offset.store(0);
+            playback_node_context->achieved_silence_path.store(0);
+            playback_node_context->ongoing_recovery.store(false);
+        }
+    }
+    virtual_device_wake_clock(context);
+}
+
+static void virtual_device_node_destroy(struct GenesisNode *node) {
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    if (context) {
+        virtual_device_node_deactivate(node);
+        destroy(context, 1);
+    }
+}
+
+static int virtual_device_node_create(struct GenesisNode *node) {
+    VirtualDeviceNodeContext *context = create_zero<VirtualDeviceNodeContext>();
+    if (!context)
+        return GenesisErrorNoMem;
+    node->userdata = context;
+    genesis_node_set_userdata_size(node, sizeof(VirtualDeviceNodeContext));
+    context->playback.offset.store(0);
+    context->playback.reset_offset_flag.store(false);
+    context->period_count.store(0);
+    context->missed_count.store(0);
+    return 0;
+}
+
+static void virtual_device_node_seek(struct GenesisNode *node) {
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    context->playback.ongoing_recovery.store(true);
+}
+
+static void destroy_virtual_device_node_descriptor(struct GenesisNodeDescriptor *node_descriptor) {
+    VirtualDeviceDescriptorContext *descr_context = (VirtualDeviceDescriptorContext *)node_descriptor->userdata;
+    destroy(descr_context, 1);
+}
+
+int genesis_virtual_device_create_node_descriptor(struct GenesisPipeline *pipeline,
+        enum GenesisVirtualClock clock, int sample_rate, const struct SoundIoChannelLayout *channel_layout,
+        int period_frame_count, struct GenesisNodeDescriptor **out)
+{
+    *out = nullptr;
+
+    if (sample_rate <= 0 || period_frame_count <= 0 ||
+        channel_layout->channel_count <= 0 || channel_layout->channel_count > GENESIS_MAX_CHANNELS)
+    {
+        return GenesisErrorInvalidParam;
+    }
+
+    const char *description = (clock == GenesisVirtualClockWallTime) ?
+        "Virtual Device: Wall Time" : "Virtual Device: Free Running";
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 1,
+            "virtual-device", description);
+    if (!node_descr)
+        return GenesisErrorNoMem;
+
+    VirtualDeviceDescriptorContext *descr_context = create_zero<VirtualDeviceDescriptorContext>();
+    if (!descr_context) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+    descr_context->clock = clock;
+    descr_context->period_frame_count = period_frame_count;
+    node_descr->userdata = descr_context;
+    node_descr->destroy_descriptor = destroy_virtual_device_node_descriptor;
+    // the ring buffer has to hold at least one period
+    node_descr->min_software_latency = period_frame_count / (double)sample_rate;
+
+    struct GenesisPortDescriptor *audio_port = genesis_node_descriptor_create_port(
+            node_descr, 0, GenesisPortTypeAudioIn, "audio_in");
+    if (!audio_port) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    node_descr->activate = virtual_device_node_activate;
+    node_descr->deactivate = virtual_device_node_deactivate;
+    node_descr->pause = virtual_device_node_pause;
+    node_descr->run = virtual_device_node_run;
+    node_descr->create = virtual_device_node_create;
+    node_descr->destroy = virtual_device_node_destroy;
+    node_descr->seek = virtual_device_node_seek;
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_port, sample_rate, true, -1);
+    genesis_audio_port_descriptor_set_channel_layout(audio_port, channel_layout, true, -1);
+    genesis_audio_port_descriptor_set_is_sink(audio_port, true);
+
+    *out = node_descr;
+    return 0;
+}
+
+long genesis_node_virtual_device_period_count(struct GenesisNode *node) {
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    return context->period_count.load();
+}
+
+long genesis_node_virtual_device_missed_count(struct GenesisNode *node) {
+    VirtualDeviceNodeContext *context = (VirtualDeviceNodeContext *)node->userdata;
+    return context->missed_count.load();
+}
+
+static void midi_node_on_event(struct GenesisMidiDevice *device, const struct GenesisMidiEvent *event) {
+    GenesisNode *node = (GenesisNode *)device->userdata;
+    GenesisPort *events_out_port = genesis_node_port(node, 0);
 
     int event_count;
-    double time_requested;
-    genesis_events_out_port_free_count(events_out_port, &event_count, &time_requested);
+    long ticks_requested;
+    genesis_events_out_port_free_count(events_out_port, &event_count, &ticks_requested);
 
     assert(event_count >= 1); // TODO handle this error condition
 
     GenesisMidiEvent *out_ptr = genesis_events_out_port_write_ptr(events_out_port);
     memcpy(out_ptr, event, sizeof(GenesisMidiEvent));
 
-    genesis_events_out_port_advance_write_ptr(events_out_port, 1, time_requested);
+    genesis_events_out_port_advance_write_ptr(events_out_port, 1, ticks_requested);
 }
 
 static void midi_node_run(struct GenesisNode *node) {
     GenesisPort *events_out_port = genesis_node_port(node, 0);
     int event_count;
-    double time_requested;
-    genesis_events_out_port_free_count(events_out_port, &event_count, &time_requested);
-    genesis_events_out_port_advance_write_ptr(events_out_port, 0, time_requested);
+    long ticks_requested;
+    genesis_events_out_port_free_count(events_out_port, &event_count, &ticks_requested);
+    genesis_events_out_port_advance_write_ptr(events_out_port, 0, ticks_requested);
 }
 
 static int midi_node_create(struct GenesisNode *node) {
@@ -1536,6 +2463,10 @@ static void destroy_events_port_descriptor(GenesisEventsPortDescriptor *events_p
     destroy(events_port_descr, 1);
 }
 
+static void destroy_param_port_descriptor(GenesisParamPortDescriptor *param_port_descr) {
+    destroy(param_port_descr, 1);
+}
+
 void genesis_port_descriptor_destroy(struct GenesisPortDescriptor *port_descriptor) {
     free(port_descriptor->name);
     switch (port_descriptor->port_type) {
@@ -1547,6 +2478,9 @@ void genesis_port_descriptor_destroy(struct GenesisPortDescriptor *port_descript
     case GenesisPortTypeEventsOut:
         destroy_events_port_descriptor((GenesisEventsPortDescriptor *)port_descriptor);
         break;
+    case GenesisPortTypeParamIn:
+        destroy_param_port_descriptor((GenesisParamPortDescriptor *)port_descriptor);
+        break;
     }
 }
 
@@ -1602,27 +2536,42 @@ static void resolve_sample_rate(GenesisAudioPort *audio_port) {
     }
 }
 
+static void resolve_format(GenesisAudioPort *audio_port) {
+    GenesisAudioPortDescriptor *port_descr = (GenesisAudioPortDescriptor *)audio_port->port.descriptor;
+    if (port_descr->format_fixed) {
+        if (port_descr->same_format_index >= 0) {
+            GenesisAudioPort *other_port = (GenesisAudioPort *)
+                audio_port->port.node->ports[port_descr->same_format_index];
+            audio_port->format = other_port->format;
+        } else {
+            audio_port->format = port_descr->format;
+        }
+    }
+}
+
 static int connect_audio_ports(GenesisAudioPort *source, GenesisAudioPort *dest) {
     GenesisAudioPortDescriptor *source_audio_descr = (GenesisAudioPortDescriptor *) source->port.descriptor;
     GenesisAudioPortDescriptor *dest_audio_descr = (GenesisAudioPortDescriptor *) dest->port.descriptor;
     GenesisPipeline *pipeline = source->port.node->descriptor->pipeline;
 
+    if (source->reader_count >= GENESIS_MAX_PORT_READERS)
+        return GenesisErrorQueueFull;
+    // the readers the source already has depend on what it settled on
+    bool source_settled = source->reader_count > 0;
+
     resolve_channel_layout(source);
     resolve_channel_layout(dest);
-    if (source_audio_descr->channel_layout_fixed &&
-        dest_audio_descr->channel_layout_fixed)
-    {
+    bool source_layout_fixed = source_audio_descr->channel_layout_fixed || source_settled;
+    if (source_layout_fixed && dest_audio_descr->channel_layout_fixed) {
         // both fixed. they better match up
         if (!soundio_channel_layout_equal(&source->channel_layout, &dest->channel_layout)) {
             return GenesisErrorIncompatibleChannelLayouts;
         }
-    } else if (!source_audio_descr->channel_layout_fixed &&
-               !dest_audio_descr->channel_layout_fixed)
-    {
+    } else if (!source_layout_fixed && !dest_audio_descr->channel_layout_fixed) {
         // anything goes. default to mono
         source->channel_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
         dest->channel_layout = source->channel_layout;
-    } else if (source_audio_descr->channel_layout_fixed) {
+    } else if (source_layout_fixed) {
         // source is fixed, use that one
         dest->channel_layout = source->channel_layout;
     } else {
@@ -1632,17 +2581,16 @@ static int connect_audio_ports(GenesisAudioPort *source, GenesisAudioPort *dest)
 
     resolve_sample_rate(source);
     resolve_sample_rate(dest);
-    if (source_audio_descr->sample_rate_fixed && dest_audio_descr->sample_rate_fixed) {
+    bool source_rate_fixed = source_audio_descr->sample_rate_fixed || source_settled;
+    if (source_rate_fixed && dest_audio_descr->sample_rate_fixed) {
         // both fixed. they better match up
         if (source->sample_rate != dest->sample_rate)
             return GenesisErrorIncompatibleSampleRates;
-    } else if (!source_audio_descr->sample_rate_fixed &&
-               !dest_audio_descr->sample_rate_fixed)
-    {
+    } else if (!source_rate_fixed && !dest_audio_descr->sample_rate_fixed) {
         // anything goes. default to 48,000 Hz
         source->sample_rate = pipeline->target_sample_rate;
         dest->sample_rate = source->sample_rate;
-    } else if (source_audio_descr->sample_rate_fixed) {
+    } else if (source_rate_fixed) {
         // source is fixed, use that one
         dest->sample_rate = source->sample_rate;
     } else {
@@ -1650,6 +2598,25 @@ static int connect_audio_ports(GenesisAudioPort *source, GenesisAudioPort *dest)
         source->sample_rate = dest->sample_rate;
     }
 
+    resolve_format(source);
+    resolve_format(dest);
+    bool source_format_fixed = source_audio_descr->format_fixed || source_settled;
+    if (source_format_fixed && dest_audio_descr->format_fixed) {
+        // both fixed. they better match up
+        if (source->format != dest->format)
+            return GenesisErrorIncompatiblePortFormats;
+    } else if (!source_format_fixed && !dest_audio_descr->format_fixed) {
+        // anything goes. default to interleaved
+        source->format = GenesisAudioPortFormatInterleaved;
+        dest->format = source->format;
+    } else if (source_format_fixed) {
+        // source is fixed, use that one
+        dest->format = source->format;
+    } else {
+        // dest is fixed, use that one
+        source->format = dest->format;
+    }
+
     return 0;
 }
 
@@ -1657,9 +2624,44 @@ static int connect_events_ports(GenesisEventsPort *source, GenesisEventsPort *de
     return 0;
 }
 
-void genesis_disconnect_ports(struct GenesisPort *source, struct GenesisPort *dest) {
-    source->output_to = nullptr;
+// A new reader starts where the slowest one is. Preparing the pipeline
+// moves it to where its latency compensation says it should be.
+static void add_port_reader(GenesisAudioPort *source, GenesisAudioPort *dest) {
+    assert(source->reader_count < GENESIS_MAX_PORT_READERS);
+    dest->read_offset.store(source->sample_buffer.read_offset.load());
+    source->readers[source->reader_count] = dest;
+    source->reader_count += 1;
+}
+
+static void remove_port_reader(GenesisAudioPort *source, GenesisAudioPort *dest) {
+    for (int i = 0; i < source->reader_count; i += 1) {
+        if (source->readers[i] != dest)
+            continue;
+        for (int j = i + 1; j < source->reader_count; j += 1)
+            source->readers[j - 1] = source->readers[j];
+        source->reader_count -= 1;
+        return;
+    }
+}
+
+static void link_ports(GenesisPort *source, GenesisPort *dest) {
+    if (source->descriptor->port_type == GenesisPortTypeAudioOut)
+        add_port_reader((GenesisAudioPort *)source, (GenesisAudioPort *)dest);
+    else
+        source->output_to = dest;
+    dest->input_from = source;
+}
+
+static void unlink_ports(GenesisPort *source, GenesisPort *dest) {
+    if (source->descriptor->port_type == GenesisPortTypeAudioOut)
+        remove_port_reader((GenesisAudioPort *)source, (GenesisAudioPort *)dest);
+    else
+        source->output_to = nullptr;
     dest->input_from = nullptr;
+}
+
+void genesis_disconnect_ports(struct GenesisPort *source, struct GenesisPort *dest) {
+    unlink_ports(source, dest);
     if (source->descriptor->disconnect)
         source->descriptor->disconnect(source, dest);
     if (dest->descriptor->disconnect)
@@ -1667,6 +2669,9 @@ void genesis_disconnect_ports(struct GenesisPort *source, struct GenesisPort *de
 }
 
 int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest) {
+    if (dest->input_from)
+        genesis_disconnect_ports(dest->input_from, dest);
+
     int err = GenesisErrorInvalidPortType;
     switch (source->descriptor->port_type) {
         case GenesisPortTypeAudioOut:
@@ -1683,19 +2688,18 @@ int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest)
             break;
         case GenesisPortTypeAudioIn:
         case GenesisPortTypeEventsIn:
+        case GenesisPortTypeParamIn:
             return GenesisErrorInvalidPortDirection;
     }
     if (err)
         return err;
 
-    source->output_to = dest;
-    dest->input_from = source;
+    link_ports(source, dest);
 
     if (source->descriptor->connect) {
         err = source->descriptor->connect(source, dest);
         if (err) {
-            source->output_to = nullptr;
-            dest->input_from = nullptr;
+            unlink_ports(source, dest);
             return err;
         }
     }
@@ -1704,8 +2708,7 @@ int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest)
         if (err) {
             if (source->descriptor->disconnect)
                 source->descriptor->disconnect(source, dest);
-            source->output_to = nullptr;
-            dest->input_from = nullptr;
+            unlink_ports(source, dest);
             return err;
         }
     }
@@ -1781,12 +2784,31 @@ struct GenesisPortDescriptor *genesis_node_descriptor_create_port(
     switch (port_type) {
         case GenesisPortTypeAudioIn:
         case GenesisPortTypeAudioOut:
-            port_descr = (GenesisPortDescriptor*)create_zero<GenesisAudioPortDescriptor>();
-            break;
+            {
+                GenesisAudioPortDescriptor *audio_port_descr = create_zero<GenesisAudioPortDescriptor>();
+                if (audio_port_descr) {
+                    audio_port_descr->format_fixed = true;
+                    audio_port_descr->same_format_index = -1;
+                    audio_port_descr->format = GenesisAudioPortFormatInterleaved;
+                }
+                port_descr = (GenesisPortDescriptor*)audio_port_descr;
+                break;
+            }
         case GenesisPortTypeEventsIn:
         case GenesisPortTypeEventsOut:
             port_descr = (GenesisPortDescriptor*)create_zero<GenesisEventsPortDescriptor>();
             break;
+        case GenesisPortTypeParamIn:
+            {
+                GenesisParamPortDescriptor *param_port_descr = create_zero<GenesisParamPortDescriptor>();
+                if (param_port_descr) {
+                    param_port_descr->default_value = 0.0f;
+                    param_port_descr->min_value = 0.0f;
+                    param_port_descr->max_value = 1.0f;
+                }
+                port_descr = (GenesisPortDescriptor*)param_port_descr;
+                break;
+            }
     }
     if (!port_descr)
         return nullptr;
@@ -1805,9 +2827,20 @@ struct GenesisPortDescriptor *genesis_node_descriptor_create_port(
 }
 
 void genesis_debug_print_pipeline(GenesisPipeline *pipeline) {
+    double dsp_load_average, dsp_load_peak;
+    genesis_pipeline_get_dsp_load(pipeline, &dsp_load_average, &dsp_load_peak);
+    fprintf(stderr, "dsp load: %.1f%%  peak: %.1f%%  underruns: %ld\n", dsp_load_average * 100.0,
+            dsp_load_peak * 100.0, pipeline->underrun_count.load());
     for (int i = 0; i < pipeline->nodes.length(); i += 1) {
         GenesisNode *node = pipeline->nodes.at(i);
         fprintf(stderr, "node: %s\n", node->descriptor->name);
+        if (pipeline->stats_enabled.load()) {
+            GenesisNodeStats stats;
+            genesis_node_get_stats(node, &stats);
+            long average_ns = stats.call_count ? (stats.total_ns / stats.call_count) : 0;
+            fprintf(stderr, "  calls: %ld  frames: %ld  ns min/avg/max: %ld/%ld/%ld\n",
+                    stats.call_count, stats.frame_count, stats.min_ns, average_ns, stats.max_ns);
+        }
         for (int i = 0; i < node->port_count; i += 1) {
             GenesisPort *port = node->ports[i];
             const char *in_port_name = "-";
@@ -1818,9 +2851,14 @@ void genesis_debug_print_pipeline(GenesisPipeline *pipeline) {
                 in_port_name = port->input_from->descriptor->name;
                 in_node_name = port->input_from->node->descriptor->name;
             }
-            if (port->output_to) {
-                out_port_name = port->output_to->descriptor->name;
-                out_node_name = port->output_to->node->descriptor->name;
+            GenesisPort *output_to = port->output_to;
+            if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
+                GenesisAudioPort *audio_port = (GenesisAudioPort *)port;
+                output_to = (audio_port->reader_count > 0) ? &audio_port->readers[0]->port : nullptr;
+            }
+            if (output_to) {
+                out_port_name = output_to->descriptor->name;
+                out_node_name = output_to->node->descriptor->name;
             }
             fprintf(stderr, "  port: %s  in: %s.%s  out: %s.%s", port->descriptor->name,
                     in_node_name, in_port_name, out_node_name, out_port_name);
@@ -1856,13 +2894,17 @@ static void genesis_debug_print_channel_layout(const struct SoundIoChannelLayout
 static void debug_print_audio_port_config(GenesisAudioPort *port) {
     resolve_channel_layout(port);
     resolve_sample_rate(port);
+    resolve_format(port);
 
     GenesisAudioPortDescriptor *audio_descr = (GenesisAudioPortDescriptor *)port->port.descriptor;
     const char *chan_layout_fixed = audio_descr->channel_layout_fixed ? "(fixed)" : "(any)";
     const char *sample_rate_fixed = audio_descr->sample_rate_fixed ? "(fixed)" : "(any)";
+    const char *format_fixed = audio_descr->format_fixed ? "(fixed)" : "(any)";
+    const char *format_name = (port->format == GenesisAudioPortFormatPlanar) ? "planar" : "interleaved";
 
     fprintf(stderr, "audio port: %s\n", port->port.descriptor->name);
     fprintf(stderr, "sample rate: %s %d\n", sample_rate_fixed, port->sample_rate);
+    fprintf(stderr, "format: %s %s\n", format_fixed, format_name);
     fprintf(stderr, "channel_layout: %s ", chan_layout_fixed);
     fprintf(stderr, "is_sink: %d ", audio_descr->is_sink);
     genesis_debug_print_channel_layout(&port->channel_layout);
@@ -1872,6 +2914,13 @@ static void debug_print_events_port_config(GenesisEventsPort *port) {
     fprintf(stderr, "events port: %s\n", port->port.descriptor->name);
 }
 
+static void debug_print_param_port_config(GenesisParamPort *port) {
+    GenesisParamPortDescriptor *param_descr = (GenesisParamPortDescriptor *)port->port.descriptor;
+    fprintf(stderr, "param port: %s\n", port->port.descriptor->name);
+    fprintf(stderr, "range: %f - %f default: %f\n", param_descr->min_value,
+            param_descr->max_value, param_descr->default_value);
+}
+
 void genesis_debug_print_port_config(struct GenesisPort *port) {
     switch (port->descriptor->port_type) {
         case GenesisPortTypeAudioIn:
@@ -1882,21 +2931,149 @@ void genesis_debug_print_port_config(struct GenesisPort *port) {
         case GenesisPortTypeEventsOut:
             debug_print_events_port_config((GenesisEventsPort *)port);
             return;
+        case GenesisPortTypeParamIn:
+            debug_print_param_port_config((GenesisParamPort *)port);
+            return;
     }
     panic("invalid port type");
 }
 
+static GenesisNode *worker_find_node(GenesisPipelineWorker *worker) {
+    GenesisPipeline *pipeline = worker->pipeline;
+    GenesisNode *node = worker->deque.pop();
+    if (node)
+        return node;
+    pipeline->inject_queue.try_dequeue(&node);
+    if (node)
+        return node;
+    for (int i = 0; i < pipeline->worker_count - 1; i += 1) {
+        GenesisPipelineWorker *victim = &pipeline->workers[worker->steal_order[i]];
+        if ((node = victim->deque.steal()))
+            return node;
+    }
+    return nullptr;
+}
+
+// how far along the stream that best shows how much work the node did is:
+// its first audio output, or for sinks its first audio input.
+static long node_frame_position(GenesisNode *node) {
+    GenesisAudioPort *audio_in_port = nullptr;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
+            GenesisAudioPort *audio_out_port = (GenesisAudioPort *)port;
+            return audio_out_port->sample_buffer.write_offset.load() / audio_out_port->bytes_per_frame;
+        } else if (port->descriptor->port_type == GenesisPortTypeAudioIn && port->input_from &&
+                !audio_in_port)
+        {
+            audio_in_port = (GenesisAudioPort *)port;
+        }
+    }
+    if (audio_in_port) {
+        GenesisAudioPort *audio_source_port = (GenesisAudioPort *)audio_in_port->port.input_from;
+        return audio_in_port->read_offset.load() / audio_source_port->bytes_per_frame;
+    }
+    return 0;
+}
+
+static int stats_bucket(long ns) {
+    int bucket = 0;
+    while (ns > 1 && bucket < GENESIS_NODE_STATS_BUCKET_COUNT - 1) {
+        ns >>= 1;
+        bucket += 1;
+    }
+    return bucket;
+}
+
+static void record_node_stats(GenesisPipeline *pipeline, GenesisNode *node, long ns, long frame_count) {
+    GenesisNodeStatsCounters *stats = &node->stats;
+    int epoch = pipeline->stats_epoch.load(std::memory_order_relaxed);
+    if (stats->epoch.load(std::memory_order_relaxed) != epoch) {
+        stats->call_count.store(0, std::memory_order_relaxed);
+        stats->frame_count.store(0, std::memory_order_relaxed);
+        stats->total_ns.store(0, std::memory_order_relaxed);
+        stats->min_ns.store(0, std::memory_order_relaxed);
+        stats->max_ns.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < GENESIS_NODE_STATS_BUCKET_COUNT; i += 1)
+            stats->run_ns_histogram[i].store(0, std::memory_order_relaxed);
+        stats->epoch.store(epoch, std::memory_order_release);
+    }
+
+    // there is only one writer, so no need for read-modify-write operations
+    long call_count = stats->call_count.load(std::memory_order_relaxed);
+    if (call_count == 0 || ns < stats->min_ns.load(std::memory_order_relaxed))
+        stats->min_ns.store(ns, std::memory_order_relaxed);
+    if (ns > stats->max_ns.load(std::memory_order_relaxed))
+        stats->max_ns.store(ns, std::memory_order_relaxed);
+    stats->total_ns.store(stats->total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    stats->frame_count.store(stats->frame_count.load(std::memory_order_relaxed) + frame_count,
+            std::memory_order_relaxed);
+    atomic_long *bucket = &stats->run_ns_histogram[stats_bucket(ns)];
+    bucket->store(bucket->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    stats->call_count.store(call_count + 1, std::memory_order_relaxed);
+}
+
+static void call_run_callback(GenesisNode *node) {
+    if (GENESIS_DEBUG_MODE)
+        rt_current_node = node;
+    node->descriptor->run(node);
+    if (GENESIS_DEBUG_MODE)
+        rt_current_node = nullptr;
+}
+
+static void run_node(GenesisPipeline *pipeline, GenesisNode *node) {
+    if (!pipeline->stats_enabled.load(std::memory_order_relaxed)) {
+        call_run_callback(node);
+        return;
+    }
+    long start_frame = node_frame_position(node);
+    uint64_t start_ns = os_get_time_ns();
+    call_run_callback(node);
+    long ns = os_get_time_ns() - start_ns;
+    node->last_run_ns.store(ns, std::memory_order_relaxed);
+    record_node_stats(pipeline, node, ns, node_frame_position(node) - start_frame);
+}
+
+static void worker_run_node(GenesisPipeline *pipeline, GenesisNode *node) {
+    run_node(pipeline, node);
+    finish_node(pipeline, node);
+}
+
+static void apply_thread_policy(GenesisPipelineWorker *worker) {
+    const GenesisThreadPolicy *policy = &worker->pipeline->thread_policy;
+    int cpu = (policy->cpu_count > 0) ? policy->cpus[worker->index % policy->cpu_count] : -1;
+    int err = os_set_thread_policy(policy, cpu);
+
+    GenesisThreadPolicy *obtained = &worker->obtained_policy;
+    os_get_thread_policy(obtained);
+    // if the scheduler is right, it was the pinning that got refused
+    if (obtained->scheduler != policy->scheduler)
+        emit_warning(WarningHighPriorityThread);
+    else if (err)
+        emit_warning(WarningThreadAffinity);
+    worker->policy_ready.store(true);
+}
+
 static void pipeline_thread_run(void *userdata) {
-    GenesisPipeline *pipeline = reinterpret_cast<GenesisPipeline*>(userdata);
+    GenesisPipelineWorker *worker = reinterpret_cast<GenesisPipelineWorker*>(userdata);
+    GenesisPipeline *pipeline = worker->pipeline;
+    current_worker = worker;
+    apply_thread_policy(worker);
+    char *locked_stack = nullptr;
+    size_t locked_stack_size = 0;
+    if (pipeline->lock_memory) {
+        if (os_lock_stack(WORKER_STACK_LOCK_SIZE, &locked_stack, &locked_stack_size)) {
+            emit_warning(WarningLockMemory);
+            locked_stack = nullptr;
+        }
+    }
     for (;;) {
-        GenesisNode *node = pipeline->task_queue.dequeue();
         if (!pipeline->running) {
-            // Note: node is not valid inside this block.
             if (pipeline->paused.load() != 1)
                 break;
 
             int old_threads_paused = pipeline->threads_paused.fetch_add(1);
-            if (old_threads_paused + 1 == pipeline->thread_pool_size) {
+            if (old_threads_paused + 1 == pipeline->worker_count) {
                 os_futex_wake(reinterpret_cast<int*>(&pipeline->threads_paused), 1);
             }
             while (pipeline->paused.load() == 1) {
@@ -1906,10 +3083,44 @@ static void pipeline_thread_run(void *userdata) {
             continue;
         }
 
-        const GenesisNodeDescriptor *node_descriptor = node->descriptor;
-        node_descriptor->run(node);
-        node->being_processed.store(false);
+        GenesisNode *node = worker_find_node(worker);
+        if (node) {
+            worker_run_node(pipeline, node);
+            continue;
+        }
+
+        // Nothing to do. Announce that we are about to sleep before looking
+        // one more time, so that a node queued in the meantime either shows
+        // up in the second look or changes wake_seq and wakes us.
+        pipeline->sleeping_worker_count += 1;
+        int wake_seq = pipeline->wake_seq.load();
+        if (pipeline->running && !(node = worker_find_node(worker)))
+            os_futex_wait(reinterpret_cast<int*>(&pipeline->wake_seq), wake_seq);
+        pipeline->sleeping_worker_count -= 1;
+
+        if (node)
+            worker_run_node(pipeline, node);
+    }
+    if (locked_stack)
+        os_unlock_memory(locked_stack, locked_stack_size);
+    current_worker = nullptr;
+}
+
+// Each worker applies the thread policy to itself once it is running.
+static int start_workers(GenesisPipeline *pipeline) {
+    int err;
+    for (int i = 0; i < pipeline->worker_count; i += 1) {
+        GenesisPipelineWorker *worker = &pipeline->workers[i];
+        worker->policy_ready.store(false);
+        if ((err = os_thread_create(pipeline_thread_run, worker, false, &worker->thread)))
+            return err;
     }
+    return 0;
+}
+
+static void wake_all_workers(GenesisPipeline *pipeline) {
+    pipeline->wake_seq += 1;
+    os_futex_wake(reinterpret_cast<int*>(&pipeline->wake_seq), pipeline->worker_count);
 }
 
 int genesis_pipeline_start(struct GenesisPipeline *pipeline, double time) {
@@ -1933,25 +3144,22 @@ int genesis_pipeline_start(struct GenesisPipeline *pipeline, double time) {
         }
     }
 
-    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
-        if ((err = os_thread_create(pipeline_thread_run, pipeline, true, &pipeline->thread_pool[i]))) {
-            genesis_pipeline_stop(pipeline);
-            return err;
-        }
+    if ((err = start_workers(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
     }
 
-
     return 0;
 }
 
 void genesis_pipeline_pause(struct GenesisPipeline *pipeline) {
     pipeline->paused.store(1);
     pipeline->running.store(false);
-    pipeline->task_queue.wakeup_all();
+    wake_all_workers(pipeline);
 
     for (;;) {
         int threads_paused = pipeline->threads_paused.load();
-        if (threads_paused == pipeline->thread_pool_size)
+        if (threads_paused == pipeline->worker_count || !pipeline->workers[0].thread)
             break;
         os_futex_wait(reinterpret_cast<int*>(&pipeline->threads_paused), threads_paused);
     }
@@ -1964,43 +3172,29 @@ void genesis_pipeline_pause(struct GenesisPipeline *pipeline) {
 }
 
 void genesis_pipeline_seek(struct GenesisPipeline *pipeline, double time) {
-    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
-        GenesisNode *node = pipeline->nodes.at(node_index);
-        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
-            GenesisPort *port = node->ports[port_i];
-            if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
-                GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
-                if (!audio_port->sample_buffer_err)
-                    ring_buffer_clear(&audio_port->sample_buffer);
-            } else if (port->descriptor->port_type == GenesisPortTypeEventsOut) {
-                GenesisEventsPort *events_port = reinterpret_cast<GenesisEventsPort*>(port);
-                if (!events_port->event_buffer_err)
-                    ring_buffer_clear(&events_port->event_buffer);
-                events_port->time_available.store(0.0);
-                events_port->time_requested.store(0.0);
-            }
-        }
-        node->timestamp = time;
-        if (node->descriptor->seek)
-            node->descriptor->seek(node);
-    }
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1)
+        genesis_node_seek(pipeline->nodes.at(node_index), time);
 }
 
-void genesis_pipeline_stop(struct GenesisPipeline *pipeline) {
+static void stop_workers(GenesisPipeline *pipeline) {
     pipeline->running.store(false);
     pipeline->paused.store(0);
-    pipeline->task_queue.wakeup_all();
+    wake_all_workers(pipeline);
 
     int threads_paused = pipeline->threads_paused.load();
     if (threads_paused > 0) {
         os_futex_wake(reinterpret_cast<int*>(&pipeline->paused), threads_paused);
     }
 
-    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
-        OsThread *thread = pipeline->thread_pool[i];
-        os_thread_destroy(thread);
-        pipeline->thread_pool[i] = nullptr;
+    for (int i = 0; i < pipeline->worker_count; i += 1) {
+        GenesisPipelineWorker *worker = &pipeline->workers[i];
+        os_thread_destroy(worker->thread);
+        worker->thread = nullptr;
     }
+}
+
+void genesis_pipeline_stop(struct GenesisPipeline *pipeline) {
+    stop_workers(pipeline);
     for (int i = 0; i < pipeline->nodes.length(); i += 1) {
         GenesisNode *node = pipeline->nodes.at(i);
         assert(node->descriptor->pipeline);
@@ -2009,46 +3203,186 @@ void genesis_pipeline_stop(struct GenesisPipeline *pipeline) {
     }
 }
 
-int genesis_pipeline_resume(struct GenesisPipeline *pipeline) {
-    int err = pipeline->task_queue.resize(pipeline->nodes.length() + pipeline->thread_pool_size);
-    if (err) {
-        genesis_pipeline_stop(pipeline);
-        return err;
+static double desired_buffer_duration(GenesisPipeline *pipeline) {
+    // the 0.75 is because the outstream software_latency is pipeline->latency * 0.25
+    double buffer_duration = pipeline->latency * 0.75;
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        buffer_duration = max(node->descriptor->min_software_latency, buffer_duration);
     }
+    return buffer_duration;
+}
 
-    // the 0.75 is because the outstream software_latency is pipeline->latency * 0.25
-    double desired_buffer_duration = pipeline->latency * 0.75;
+static double node_latency_seconds(GenesisNode *node) {
+    if (node->latency_frame_count == 0)
+        return 0.0;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
+            GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
+            return node->latency_frame_count / (double)audio_port->sample_rate;
+        }
+    }
+    return 0.0;
+}
+
+// Works out how much each connection must be delayed so that all the inputs
+// of a node have been through the same amount of latency, that of the
+// slowest one.
+static void compensate_latency(GenesisPipeline *pipeline) {
     for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
         GenesisNode *node = pipeline->nodes.at(node_index);
-        desired_buffer_duration = max(node->descriptor->min_software_latency, desired_buffer_duration);
+        node->path_latency = 0.0;
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type == GenesisPortTypeAudioOut ||
+                port->descriptor->port_type == GenesisPortTypeAudioIn)
+            {
+                reinterpret_cast<GenesisAudioPort*>(port)->compensation_frame_count = 0;
+            }
+        }
+    }
+
+    // sources come first in the plan, so every node's inputs are done
+    // before the node itself
+    GenesisExecutionPlan *plan = pipeline->plan;
+    for (int plan_i = 0; plan_i < plan->nodes.length(); plan_i += 1) {
+        GenesisNode *node = plan->nodes.at(plan_i);
+        double input_latency = 0.0;
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type == GenesisPortTypeAudioIn && port->input_from)
+                input_latency = max(input_latency, port->input_from->node->path_latency);
+        }
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type != GenesisPortTypeAudioIn || !port->input_from)
+                continue;
+            GenesisAudioPort *audio_in_port = reinterpret_cast<GenesisAudioPort*>(port);
+            GenesisAudioPort *source_port = reinterpret_cast<GenesisAudioPort*>(port->input_from);
+            double lag = input_latency - source_port->port.node->path_latency;
+            audio_in_port->compensation_frame_count = lround(lag * source_port->sample_rate);
+            // the silence written to the buffer is a whole number of quanta,
+            // so that writes stay aligned; each reader skips what it does
+            // not need, and so is still lined up to the sample
+            source_port->compensation_frame_count = max(source_port->compensation_frame_count,
+                    round_up_to_quantum(pipeline, audio_in_port->compensation_frame_count));
+        }
+        node->path_latency = input_latency + node_latency_seconds(node);
     }
-    pipeline->actual_latency = desired_buffer_duration / 0.75;
+}
+
+// Writes frame_count frames of silence to an empty port buffer, and
+// remembers that it did. frame_count is a multiple of the quantum. Then puts each reader at the start of the buffer,
+// past the silence that its own connection does not need.
+static void prefill_compensation(GenesisAudioPort *audio_port, int frame_count) {
+    audio_port->buffer_compensation_frame_count = frame_count;
+    long read_offset = audio_port->sample_buffer.read_offset.load();
+    if (frame_count > 0) {
+        long write_offset = audio_port->sample_buffer.write_offset.load();
+        int buffer_count = (audio_port->format == GenesisAudioPortFormatPlanar) ?
+            audio_port->channel_layout.channel_count : 1;
+        for (int ch = 0; ch < buffer_count; ch += 1) {
+            memset(audio_port_channel_ptr(audio_port, write_offset, ch), 0,
+                    frame_count * audio_port->bytes_per_frame);
+        }
+        ring_buffer_advance_write_ptr(&audio_port->sample_buffer, frame_count * audio_port->bytes_per_frame);
+    }
+    for (int i = 0; i < audio_port->reader_count; i += 1) {
+        GenesisAudioPort *reader = audio_port->readers[i];
+        int skip_frame_count = clamp(0, frame_count - reader->compensation_frame_count, frame_count);
+        reader->buffer_compensation_frame_count = frame_count - skip_frame_count;
+        reader->read_offset.store(read_offset + skip_frame_count * audio_port->bytes_per_frame);
+    }
+}
+
+static bool readers_compensation_changed(GenesisAudioPort *audio_port) {
+    for (int i = 0; i < audio_port->reader_count; i += 1) {
+        GenesisAudioPort *reader = audio_port->readers[i];
+        if (reader->compensation_frame_count != reader->buffer_compensation_frame_count)
+            return true;
+    }
+    return false;
+}
+
+// Readers that were out of the plan fell behind while the others went on.
+// They pick up from where the buffer is now.
+static void catch_up_port_readers(GenesisAudioPort *audio_port) {
+    long read_offset = audio_port->sample_buffer.read_offset.load();
+    for (int i = 0; i < audio_port->reader_count; i += 1) {
+        GenesisAudioPort *reader = audio_port->readers[i];
+        if (reader->read_offset.load() < read_offset)
+            reader->read_offset.store(read_offset);
+    }
+}
 
+// Nodes with an activate callback, such as devices, have callbacks of their
+// own that touch their ports' buffers outside of cycles.
+static bool buffer_used_outside_cycles(GenesisAudioPort *audio_out_port) {
+    if (audio_out_port->port.node->descriptor->activate)
+        return true;
+    for (int i = 0; i < audio_out_port->reader_count; i += 1) {
+        if (audio_out_port->readers[i]->port.node->descriptor->activate)
+            return true;
+    }
+    return false;
+}
+
+// Allocates the ring buffers of ports that do not have one yet, or whose
+// size changed. Ports that already have the right buffer keep its contents.
+// A live edit must not replace a buffer that a device callback may be
+// reading right now, so that is an error.
+static int prepare_port_buffers(GenesisPipeline *pipeline, bool live_edit) {
+    double desired_buffer_duration = pipeline->buffer_duration;
+    int err;
+    compensate_latency(pipeline);
     for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
         GenesisNode *node = pipeline->nodes.at(node_index);
-        node->being_processed = false;
         for (int port_i = 0; port_i < node->port_count; port_i += 1) {
             GenesisPort *port = node->ports[port_i];
             if (port->descriptor->port_type == GenesisPortTypeAudioIn) {
                 GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
-                audio_port->bytes_per_frame = BYTES_PER_SAMPLE * audio_port->channel_layout.channel_count;
+                audio_port->bytes_per_frame = audio_port_bytes_per_frame(audio_port);
             } else if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
                 GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
                 int sample_buffer_frame_count = ceil(desired_buffer_duration * audio_port->sample_rate);
-                audio_port->bytes_per_frame = BYTES_PER_SAMPLE * audio_port->channel_layout.channel_count;
+                sample_buffer_frame_count = round_up_to_quantum(pipeline,
+                        sample_buffer_frame_count + audio_port->compensation_frame_count);
+                audio_port->bytes_per_frame = audio_port_bytes_per_frame(audio_port);
                 int new_sample_buffer_size = sample_buffer_frame_count * audio_port->bytes_per_frame;
-                bool different = new_sample_buffer_size != audio_port->sample_buffer_size;
+                int extra_channel_buffer_count = (audio_port->format == GenesisAudioPortFormatPlanar) ?
+                    (audio_port->channel_layout.channel_count - 1) : 0;
+                bool different = new_sample_buffer_size != audio_port->sample_buffer_size ||
+                    extra_channel_buffer_count != audio_port->extra_channel_buffer_count ||
+                    audio_port->compensation_frame_count != audio_port->buffer_compensation_frame_count ||
+                    readers_compensation_changed(audio_port);
                 audio_port->sample_buffer_size = new_sample_buffer_size;
 
                 if (audio_port->sample_buffer_err || different) {
+                    if (live_edit && !audio_port->sample_buffer_err &&
+                        buffer_used_outside_cycles(audio_port))
+                    {
+                        return GenesisErrorInvalidState;
+                    }
                     if (!audio_port->sample_buffer_err)
                         ring_buffer_deinit(&audio_port->sample_buffer);
+                    deinit_extra_channel_buffers(audio_port);
                     if ((audio_port->sample_buffer_err =
                             ring_buffer_init(&audio_port->sample_buffer, audio_port->sample_buffer_size)))
                     {
-                        genesis_pipeline_stop(pipeline);
                         return audio_port->sample_buffer_err;
                     }
+                    for (int i = 0; i < extra_channel_buffer_count; i += 1) {
+                        if ((err = os_init_mirrored_memory(&audio_port->extra_channel_buffers[i],
+                                        audio_port->sample_buffer.capacity)))
+                        {
+                            return err;
+                        }
+                        audio_port->extra_channel_buffer_count += 1;
+                    }
+                    prefill_compensation(audio_port, audio_port->compensation_frame_count);
+                } else {
+                    catch_up_port_readers(audio_port);
                 }
             } else if (port->descriptor->port_type == GenesisPortTypeEventsOut) {
                 GenesisEventsPort *events_port = reinterpret_cast<GenesisEventsPort*>(port);
@@ -2061,7 +3395,6 @@ int genesis_pipeline_resume(struct GenesisPipeline *pipeline) {
                     if ((events_port->event_buffer_err = ring_buffer_init(&events_port->event_buffer,
                                     min_event_buffer_size)))
                     {
-                        genesis_pipeline_stop(pipeline);
                         return events_port->event_buffer_err;
                     }
                 }
@@ -2069,33 +3402,326 @@ int genesis_pipeline_resume(struct GenesisPipeline *pipeline) {
         }
     }
 
-    pipeline->running.store(true);
-    pipeline->paused.store(0);
+    return 0;
+}
 
-    int threads_paused = pipeline->threads_paused.load();
-    if (threads_paused > 0) {
-        os_futex_wake(reinterpret_cast<int*>(&pipeline->paused), threads_paused);
+static bool lock_mirrored_memory(GenesisPipeline *pipeline, OsMirroredMemory *mem) {
+    bool huge_pages = pipeline->lock_huge_pages && mem->capacity >= HUGE_PAGE_SIZE;
+    return !os_lock_mirrored_memory(mem, huge_pages);
+}
+
+// Locks whatever is not locked yet: buffers allocated since the last time
+// and the memory of new nodes.
+static void lock_pipeline_memory(GenesisPipeline *pipeline) {
+    if (!pipeline->lock_memory)
+        return;
+    bool ok = true;
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        if (!node->memory_locked) {
+            node->memory_locked = true;
+            if (node->userdata && node->userdata_size > 0) {
+                node->userdata_locked = !os_lock_memory(node->userdata, node->userdata_size, false);
+                ok = node->userdata_locked && ok;
+            }
+            for (int i = 0; i < node->memory_range_count; i += 1) {
+                GenesisMemoryRange *range = &node->memory_ranges[i];
+                if (range->size > 0) {
+                    range->locked = !os_lock_memory(range->address, range->size, false);
+                    ok = range->locked && ok;
+                }
+            }
+        }
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            switch (port->descriptor->port_type) {
+                case GenesisPortTypeAudioOut:
+                    {
+                        GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
+                        if (audio_port->sample_buffer_err)
+                            break;
+                        ok = lock_mirrored_memory(pipeline, &audio_port->sample_buffer.mem) && ok;
+                        for (int i = 0; i < audio_port->extra_channel_buffer_count; i += 1)
+                            ok = lock_mirrored_memory(pipeline, &audio_port->extra_channel_buffers[i]) && ok;
+                        break;
+                    }
+                case GenesisPortTypeEventsOut:
+                    {
+                        GenesisEventsPort *events_port = reinterpret_cast<GenesisEventsPort*>(port);
+                        if (!events_port->event_buffer_err)
+                            ok = lock_mirrored_memory(pipeline, &events_port->event_buffer.mem) && ok;
+                        break;
+                    }
+                case GenesisPortTypeParamIn:
+                    {
+                        GenesisParamPort *param_port = reinterpret_cast<GenesisParamPort*>(port);
+                        ok = lock_mirrored_memory(pipeline, &param_port->change_queue.mem) && ok;
+                        break;
+                    }
+                case GenesisPortTypeAudioIn:
+                case GenesisPortTypeEventsIn:
+                    // these read from the buffer of the port they are connected to
+                    break;
+            }
+        }
     }
+    if (!ok)
+        emit_warning(WarningLockMemory);
+}
 
-    // Iterate over the ports which are sinks and ask for frames.
+// Only called while no cycle runs and device callbacks keep off the
+// readers, so that advance_slowest_reader sees the membership of one plan.
+static void activate_plan_readers(GenesisPipeline *pipeline) {
     for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
         GenesisNode *node = pipeline->nodes.at(node_index);
+        bool in_plan = node->plan_index >= 0;
         for (int port_i = 0; port_i < node->port_count; port_i += 1) {
             GenesisPort *port = node->ports[port_i];
-            if (port->descriptor->port_type == GenesisPortTypeAudioIn) {
-                GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
-                GenesisAudioPortDescriptor *audio_port_descr =
-                    (GenesisAudioPortDescriptor *)port->descriptor;
-                if (audio_port_descr->is_sink) {
-                    genesis_audio_in_port_advance_read_ptr(&audio_port->port, 0);
-                }
+            if (port->descriptor->port_type == GenesisPortTypeAudioIn)
+                reinterpret_cast<GenesisAudioPort*>(port)->active.store(in_plan, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Compiles the execution plan and sizes the queues and buffers for it.
+static int prepare_pipeline(GenesisPipeline *pipeline) {
+    GenesisExecutionPlan *plan;
+    int err;
+    if ((err = compile_execution_plan(pipeline, &plan)))
+        return err;
+    destroy_execution_plan(pipeline->plan);
+    pipeline->plan = plan;
+    activate_plan_readers(pipeline);
+    pipeline->cycle_running.store(false);
+    pipeline->cycle_requested.store(false);
+    pipeline->edit_pending.store(false);
+    pipeline->busy_ns.store(0);
+
+    // Each node is queued at most once per cycle, so no queue ever needs
+    // to hold more than all of them. Leave room for nodes added by edits.
+    pipeline->node_capacity = pipeline->nodes.length() + EDIT_NODE_HEADROOM;
+    if ((err = pipeline->inject_queue.resize(pipeline->node_capacity + pipeline->worker_count)))
+        return err;
+    for (int i = 0; i < pipeline->worker_count; i += 1) {
+        GenesisPipelineWorker *worker = &pipeline->workers[i];
+        if ((err = worker->deque.resize(pipeline->node_capacity)))
+            return err;
+    }
+
+    pipeline->buffer_duration = desired_buffer_duration(pipeline);
+    pipeline->actual_latency = pipeline->buffer_duration / 0.75;
+
+    if ((err = prepare_port_buffers(pipeline, false)))
+        return err;
+    lock_pipeline_memory(pipeline);
+    return 0;
+}
+
+// The caller changes connections and destroys nodes in place, and nodes
+// read their ports' connections while they run, so no cycle may run until
+// the commit. Device callbacks go on meanwhile, which is why they keep off
+// the plan and port readers once they see edit_pending, and why the edit
+// never replaces a buffer they read.
+void genesis_pipeline_begin_edit(struct GenesisPipeline *pipeline) {
+    assert(!pipeline->edit_pending.load());
+    pipeline->edit_pending.store(true);
+    if (!pipeline->running.load())
+        return;
+
+    // wait for the cycle in progress to end and keep any more from starting
+    for (;;) {
+        int release_seq = pipeline->cycle_release_seq.load();
+        if (!pipeline->cycle_running.exchange(true))
+            break;
+        os_futex_wait(reinterpret_cast<int*>(&pipeline->cycle_release_seq), release_seq);
+    }
+    wait_for_device_grace(pipeline);
+}
+
+// Swaps in a plan for the edited graph. Returns an error if the edit needs
+// bigger queues or buffers than the running pipeline has.
+static int commit_running_edit(GenesisPipeline *pipeline) {
+    if (pipeline->nodes.length() > pipeline->node_capacity)
+        return GenesisErrorInvalidState;
+    if (desired_buffer_duration(pipeline) > pipeline->buffer_duration)
+        return GenesisErrorInvalidState;
+
+    GenesisExecutionPlan *plan;
+    int err;
+    if ((err = compile_execution_plan(pipeline, &plan)))
+        return err;
+    destroy_execution_plan(pipeline->plan);
+    pipeline->plan = plan;
+    activate_plan_readers(pipeline);
+
+    if ((err = prepare_port_buffers(pipeline, true)))
+        return err;
+    lock_pipeline_memory(pipeline);
+    return 0;
+}
+
+int genesis_pipeline_commit_edit(struct GenesisPipeline *pipeline) {
+    assert(pipeline->edit_pending.load());
+    if (!pipeline->running.load()) {
+        pipeline->edit_pending.store(false);
+        return 0;
+    }
+
+    int err;
+    if ((err = commit_running_edit(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        pipeline->edit_pending.store(false);
+        return err;
+    }
+
+    pipeline->edit_pending.store(false);
+    pipeline->cycle_running.store(false);
+    // new nodes have empty buffers to fill
+    request_cycle(pipeline);
+    return 0;
+}
+
+// Changes still queued were scheduled against the old position. Jump
+// straight to where they lead and restart the frame count.
+static void seek_param_port(GenesisParamPort *param_port) {
+    if (param_port->ramp_frames_left > 0) {
+        param_port->value = param_port->ramp_target;
+        param_port->ramp_frames_left = 0;
+    }
+    RingBuffer *change_queue = &param_port->change_queue;
+    int change_count = ring_buffer_fill_count(change_queue) / sizeof(GenesisParamChange);
+    for (int i = 0; i < change_count; i += 1) {
+        GenesisParamChange *change = (GenesisParamChange *)ring_buffer_read_ptr(change_queue);
+        param_port->value = change->value;
+        ring_buffer_advance_read_ptr(change_queue, sizeof(GenesisParamChange));
+    }
+    param_port->frame_index.store(0);
+}
+
+void genesis_node_seek(struct GenesisNode *node, double time) {
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
+            GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
+            if (!audio_port->sample_buffer_err) {
+                ring_buffer_clear(&audio_port->sample_buffer);
+                prefill_compensation(audio_port, audio_port->buffer_compensation_frame_count);
             }
+        } else if (port->descriptor->port_type == GenesisPortTypeEventsOut) {
+            GenesisEventsPort *events_port = reinterpret_cast<GenesisEventsPort*>(port);
+            if (!events_port->event_buffer_err)
+                ring_buffer_clear(&events_port->event_buffer);
+            events_port->ticks_available.store(0);
+            events_port->ticks_requested.store(0);
+        } else if (port->descriptor->port_type == GenesisPortTypeParamIn) {
+            seek_param_port(reinterpret_cast<GenesisParamPort*>(port));
         }
     }
+    node->timestamp = time;
+    if (node->descriptor->seek)
+        node->descriptor->seek(node);
+}
+
+int genesis_pipeline_resume(struct GenesisPipeline *pipeline) {
+    int err;
+    if ((err = prepare_pipeline(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    pipeline->running.store(true);
+    pipeline->paused.store(0);
+
+    int threads_paused = pipeline->threads_paused.load();
+    if (threads_paused > 0) {
+        os_futex_wake(reinterpret_cast<int*>(&pipeline->paused), threads_paused);
+    }
+
+    // fill up the sinks
+    request_cycle(pipeline);
 
     return 0;
 }
 
+static int render_offline_on_this_thread(GenesisPipeline *pipeline) {
+    GenesisExecutionPlan *plan = pipeline->plan;
+    // port accessors note progress instead of requesting cycles
+    current_worker = &pipeline->workers[0];
+    int err = 0;
+    while (!offline_render_done(pipeline)) {
+        pipeline->cycle_progress.store(false);
+        for (int i = 0; i < plan->nodes.length(); i += 1) {
+            GenesisNode *node = plan->nodes.at(i);
+            if (node->descriptor->run)
+                run_node(pipeline, node);
+        }
+        if (!pipeline->cycle_progress.load()) {
+            err = GenesisErrorInvalidState;
+            break;
+        }
+    }
+    current_worker = nullptr;
+    return err;
+}
+
+static int render_offline_on_workers(GenesisPipeline *pipeline) {
+    pipeline->offline_idle.store(0);
+    pipeline->running.store(true);
+    pipeline->paused.store(0);
+
+    int err;
+    if ((err = start_workers(pipeline))) {
+        stop_workers(pipeline);
+        return err;
+    }
+
+    request_cycle(pipeline);
+    while (pipeline->offline_idle.load() == 0)
+        os_futex_wait(reinterpret_cast<int*>(&pipeline->offline_idle), 0);
+
+    stop_workers(pipeline);
+    return offline_render_done(pipeline) ? 0 : GenesisErrorInvalidState;
+}
+
+int genesis_pipeline_render_offline(struct GenesisPipeline *pipeline,
+        struct GenesisNode *sink_node, long frame_count)
+{
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
+    if (frame_count < 0)
+        return GenesisErrorInvalidParam;
+
+    GenesisAudioPort *sink_port = nullptr;
+    for (int port_i = 0; port_i < sink_node->port_count; port_i += 1) {
+        GenesisPort *port = sink_node->ports[port_i];
+        if (port->descriptor->port_type == GenesisPortTypeAudioIn && port->input_from &&
+            ((GenesisAudioPortDescriptor *)port->descriptor)->is_sink)
+        {
+            sink_port = (GenesisAudioPort *)port;
+            break;
+        }
+    }
+    if (!sink_port)
+        return GenesisErrorInvalidParam;
+
+    int err;
+    if ((err = prepare_pipeline(pipeline)))
+        return err;
+
+    GenesisAudioPort *audio_out_port = (GenesisAudioPort *)sink_port->port.input_from;
+    pipeline->offline_sink_port = sink_port;
+    pipeline->offline_end_offset = sink_port->read_offset.load() +
+        frame_count * audio_out_port->bytes_per_frame;
+
+    if (pipeline->worker_count == 1)
+        err = render_offline_on_this_thread(pipeline);
+    else
+        err = render_offline_on_workers(pipeline);
+
+    pipeline->offline_sink_port = nullptr;
+    return err;
+}
+
 bool genesis_pipeline_is_running(struct GenesisPipeline *pipeline) {
     assert(pipeline);
     return pipeline->running;
@@ -2117,6 +3743,80 @@ double genesis_pipeline_get_latency(struct GenesisPipeline *pipeline) {
     return pipeline->latency;
 }
 
+int genesis_pipeline_set_thread_count(struct GenesisPipeline *pipeline, int thread_count) {
+    if (thread_count < 0)
+        return GenesisErrorInvalidParam;
+    if (pipeline->running || pipeline->workers[0].thread)
+        return GenesisErrorInvalidState;
+
+    return create_workers(pipeline, thread_count);
+}
+
+int genesis_pipeline_get_thread_count(struct GenesisPipeline *pipeline) {
+    return pipeline->worker_count;
+}
+
+int genesis_pipeline_set_thread_policy(struct GenesisPipeline *pipeline,
+        const struct GenesisThreadPolicy *policy)
+{
+    if (policy->priority < 0 || policy->cpu_count < 0 || policy->cpu_count > GENESIS_MAX_THREAD_CPUS)
+        return GenesisErrorInvalidParam;
+    if (policy->scheduler == GenesisThreadSchedulerDeadline &&
+        (policy->deadline_runtime_ns <= 0 || policy->deadline_period_ns < policy->deadline_runtime_ns))
+    {
+        return GenesisErrorInvalidParam;
+    }
+    for (int i = 0; i < policy->cpu_count; i += 1) {
+        if (policy->cpus[i] < 0)
+            return GenesisErrorInvalidParam;
+    }
+    if (pipeline->running || pipeline->workers[0].thread)
+        return GenesisErrorInvalidState;
+
+    pipeline->thread_policy = *policy;
+    return 0;
+}
+
+int genesis_pipeline_get_worker_thread_policy(struct GenesisPipeline *pipeline,
+        int worker_index, struct GenesisThreadPolicy *out_policy)
+{
+    if (worker_index < 0 || worker_index >= pipeline->worker_count)
+        return GenesisErrorInvalidParam;
+    GenesisPipelineWorker *worker = &pipeline->workers[worker_index];
+    if (!worker->policy_ready.load())
+        return GenesisErrorInvalidState;
+
+    *out_policy = worker->obtained_policy;
+    return 0;
+}
+
+int genesis_pipeline_set_quantum(struct GenesisPipeline *pipeline, int frame_count) {
+    if (frame_count < 0 || (frame_count & (frame_count - 1)) != 0)
+        return GenesisErrorInvalidParam;
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
+
+    pipeline->quantum = frame_count;
+    return 0;
+}
+
+int genesis_pipeline_get_quantum(struct GenesisPipeline *pipeline) {
+    return pipeline->quantum;
+}
+
+int genesis_pipeline_set_lock_memory(struct GenesisPipeline *pipeline, bool enabled, bool huge_pages) {
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
+
+    pipeline->lock_memory = enabled;
+    pipeline->lock_huge_pages = huge_pages;
+    return 0;
+}
+
+long genesis_context_locked_memory_size(struct GenesisContext *context) {
+    return os_locked_memory_size();
+}
+
 int genesis_pipeline_set_sample_rate(struct GenesisPipeline *pipeline, int sample_rate) {
     if (sample_rate <= 0)
         return GenesisErrorInvalidParam;
@@ -2145,6 +3845,77 @@ struct GenesisNodeDescriptor *genesis_node_descriptor(struct GenesisNode *node)
     return node->descriptor;
 }
 
+int genesis_node_id(struct GenesisNode *node) {
+    return node->id;
+}
+
+struct GenesisNode *genesis_pipeline_find_node(struct GenesisPipeline *pipeline, int node_id) {
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNode *node = pipeline->nodes.at(i);
+        if (node->id == node_id)
+            return node;
+    }
+    return nullptr;
+}
+
+void genesis_pipeline_set_stats_enabled(struct GenesisPipeline *pipeline, bool enabled) {
+    pipeline->stats_enabled.store(enabled);
+}
+
+void genesis_node_get_stats(struct GenesisNode *node, struct GenesisNodeStats *out_stats) {
+    GenesisNodeStatsCounters *stats = &node->stats;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    if (stats->epoch.load(std::memory_order_acquire) != pipeline->stats_epoch.load()) {
+        memset(out_stats, 0, sizeof(GenesisNodeStats));
+        return;
+    }
+    out_stats->call_count = stats->call_count.load(std::memory_order_relaxed);
+    out_stats->frame_count = stats->frame_count.load(std::memory_order_relaxed);
+    out_stats->total_ns = stats->total_ns.load(std::memory_order_relaxed);
+    out_stats->min_ns = stats->min_ns.load(std::memory_order_relaxed);
+    out_stats->max_ns = stats->max_ns.load(std::memory_order_relaxed);
+    for (int i = 0; i < GENESIS_NODE_STATS_BUCKET_COUNT; i += 1)
+        out_stats->run_ns_histogram[i] = stats->run_ns_histogram[i].load(std::memory_order_relaxed);
+}
+
+void genesis_pipeline_reset_stats(struct GenesisPipeline *pipeline) {
+    pipeline->stats_epoch += 1;
+}
+
+void genesis_pipeline_get_dsp_load(struct GenesisPipeline *pipeline, double *average, double *peak) {
+    *average = pipeline->dsp_load_average.load();
+    *peak = pipeline->dsp_load_peak.load();
+}
+
+void genesis_pipeline_reset_dsp_load(struct GenesisPipeline *pipeline) {
+    pipeline->dsp_load_peak.store(0.0);
+}
+
+int genesis_pipeline_get_underruns(struct GenesisPipeline *pipeline,
+        struct GenesisUnderrun *out_underruns, int max_count)
+{
+    long count = pipeline->underrun_count.load(std::memory_order_acquire);
+    int copied_count = 0;
+    for (long index = count - 1; index >= 0 && copied_count < max_count; index -= 1) {
+        if (count - index > GENESIS_UNDERRUN_HISTORY_COUNT)
+            break;
+        GenesisUnderrunSlot *slot = &pipeline->underrun_slots[index % GENESIS_UNDERRUN_HISTORY_COUNT];
+        int seq;
+        long slot_index;
+        do {
+            seq = slot->seq.load(std::memory_order_acquire);
+            load_underrun_record(slot, &out_underruns[copied_count]);
+            slot_index = slot->index.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != slot->seq.load(std::memory_order_relaxed));
+        // the writer lapped us and this slot now holds a newer underrun
+        if (slot_index != index)
+            break;
+        copied_count += 1;
+    }
+    return copied_count;
+}
+
 float genesis_midi_note_to_pitch(int note) {
     return midi_note_to_pitch[note];
 }
@@ -2156,15 +3927,15 @@ int genesis_audio_in_port_capacity(struct GenesisPort *port) {
 }
 
 int genesis_audio_in_port_fill_count(GenesisPort *port) {
-    struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
-    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
-    return ring_buffer_fill_count(&audio_out_port->sample_buffer) / audio_out_port->bytes_per_frame;
+    return round_down_to_quantum(port->node->descriptor->pipeline, audio_in_port_fill_count_raw(port));
 }
 
 float *genesis_audio_in_port_read_ptr(GenesisPort *port) {
     struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
-    return (float*)ring_buffer_read_ptr(&audio_out_port->sample_buffer);
+    assert(audio_out_port->format == GenesisAudioPortFormatInterleaved);
+    RingBuffer *sample_buffer = &audio_out_port->sample_buffer;
+    return (float*)(sample_buffer->mem.address + audio_in_port->read_offset.load() % sample_buffer->capacity);
 }
 
 void genesis_audio_in_port_advance_read_ptr(GenesisPort *port, int frame_count) {
@@ -2173,22 +3944,20 @@ void genesis_audio_in_port_advance_read_ptr(GenesisPort *port, int frame_count)
     int byte_count = frame_count * audio_out_port->bytes_per_frame;
     assert(byte_count >= 0);
     assert(byte_count <= audio_out_port->sample_buffer_size);
-    ring_buffer_advance_read_ptr(&audio_out_port->sample_buffer, byte_count);
-    struct GenesisNode *child_node = audio_out_port->port.node;
-    queue_node_if_ready(child_node->descriptor->pipeline, child_node, true);
+    audio_in_port->read_offset += byte_count;
+    GenesisPipeline *pipeline = port->node->descriptor->pipeline;
+    advance_slowest_reader(pipeline, audio_out_port);
+    if (frame_count > 0)
+        port_advanced(pipeline);
 }
 
 int genesis_audio_out_port_free_count(GenesisPort *port) {
-    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
-    int fill_count = ring_buffer_fill_count(&audio_out_port->sample_buffer);
-    int bytes_free_count = audio_out_port->sample_buffer_size - fill_count;
-    int result = bytes_free_count / audio_out_port->bytes_per_frame;
-    assert(result >= 0);
-    return result;
+    return round_down_to_quantum(port->node->descriptor->pipeline, audio_out_port_free_count_raw(port));
 }
 
 float *genesis_audio_out_port_write_ptr(GenesisPort *port) {
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
+    assert(audio_out_port->format == GenesisAudioPortFormatInterleaved);
     return (float*)ring_buffer_write_ptr(&audio_out_port->sample_buffer);
 }
 
@@ -2198,10 +3967,34 @@ void genesis_audio_out_port_advance_write_ptr(GenesisPort *port, int frame_count
     assert(byte_count >= 0);
     assert(byte_count <= (audio_out_port->sample_buffer_size - ring_buffer_fill_count(&audio_out_port->sample_buffer)));
     ring_buffer_advance_write_ptr(&audio_out_port->sample_buffer, byte_count);
-    GenesisAudioPort *audio_in_port = (GenesisAudioPort *)audio_out_port->port.output_to;
-    GenesisNode *other_node = audio_in_port->port.node;
-    GenesisPipeline *pipeline = port->node->descriptor->pipeline;
-    queue_node_if_ready(pipeline, other_node, false);
+    if (frame_count > 0)
+        port_advanced(port->node->descriptor->pipeline);
+}
+
+float *genesis_audio_in_port_channel_read_ptr(struct GenesisPort *port, int channel_index) {
+    struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
+    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
+    assert(channel_index >= 0 && channel_index < audio_out_port->channel_layout.channel_count);
+    return audio_port_channel_ptr(audio_out_port, audio_in_port->read_offset.load(), channel_index);
+}
+
+float *genesis_audio_out_port_channel_write_ptr(struct GenesisPort *port, int channel_index) {
+    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
+    assert(channel_index >= 0 && channel_index < audio_out_port->channel_layout.channel_count);
+    return audio_port_channel_ptr(audio_out_port, audio_out_port->sample_buffer.write_offset.load(),
+            channel_index);
+}
+
+int genesis_audio_port_channel_stride(struct GenesisPort *port) {
+    struct GenesisAudioPort *audio_port = (struct GenesisAudioPort *)port;
+    if (audio_port->format == GenesisAudioPortFormatPlanar)
+        return 1;
+    return audio_port->channel_layout.channel_count;
+}
+
+enum GenesisAudioPortFormat genesis_audio_port_format(struct GenesisPort *port) {
+    struct GenesisAudioPort *audio_port = (struct GenesisAudioPort *)port;
+    return audio_port->format;
 }
 
 int genesis_audio_port_bytes_per_frame(struct GenesisPort *port) {
@@ -2220,25 +4013,26 @@ const SoundIoChannelLayout *genesis_audio_port_channel_layout(struct GenesisPort
 }
 
 void genesis_events_in_port_fill_count(struct GenesisPort *port,
-        double time_requested, int *event_count, double *time_available)
+        long ticks_requested, int *event_count, long *ticks_available)
 {
     struct GenesisEventsPort *events_in_port = (struct GenesisEventsPort *) port;
     struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) events_in_port->port.input_from;
     assert(events_out_port); // assume it is connected
     *event_count = ring_buffer_fill_count(&events_out_port->event_buffer) / sizeof(GenesisMidiEvent);
-    *time_available = events_out_port->time_available.load();
-    events_out_port->time_requested.add(time_requested);
+    *ticks_available = events_out_port->ticks_available.load();
+    events_out_port->ticks_requested += ticks_requested;
+    if (ticks_requested > 0)
+        port_advanced(port->node->descriptor->pipeline);
 }
 
-void genesis_events_in_port_advance_read_ptr(struct GenesisPort *port, int event_count, double buf_size) {
+void genesis_events_in_port_advance_read_ptr(struct GenesisPort *port, int event_count, long tick_count) {
     struct GenesisEventsPort *events_in_port = (struct GenesisEventsPort *) port;
     struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) events_in_port->port.input_from;
     assert(events_out_port); // assume it is connected
     ring_buffer_advance_read_ptr(&events_out_port->event_buffer, event_count * sizeof(GenesisMidiEvent));
-    events_out_port->time_available.add(-buf_size);
-
-    struct GenesisNode *child_node = events_out_port->port.node;
-    queue_node_if_ready(child_node->descriptor->pipeline, child_node, true);
+    events_out_port->ticks_available -= tick_count;
+    if (event_count > 0 || tick_count > 0)
+        port_advanced(port->node->descriptor->pipeline);
 }
 
 GenesisMidiEvent *genesis_events_in_port_read_ptr(GenesisPort *port) {
@@ -2249,28 +4043,24 @@ GenesisMidiEvent *genesis_events_in_port_read_ptr(GenesisPort *port) {
 }
 
 void genesis_events_out_port_free_count(struct GenesisPort *port,
-        int *event_count, double *time_requested)
+        int *event_count, long *ticks_requested)
 {
     struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) port;
     int bytes_free_count = events_out_port->event_buffer.capacity -
         ring_buffer_fill_count(&events_out_port->event_buffer);
     *event_count = bytes_free_count / sizeof(GenesisMidiEvent);
-    *time_requested = events_out_port->time_requested.load();
+    *ticks_requested = events_out_port->ticks_requested.load();
 }
 
 void genesis_events_out_port_advance_write_ptr(struct GenesisPort *port, int event_count,
-        double buf_size)
+        long tick_count)
 {
     struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) port;
     ring_buffer_advance_write_ptr(&events_out_port->event_buffer, event_count * sizeof(GenesisMidiEvent));
-    events_out_port->time_requested.add(-buf_size);
-    events_out_port->time_available.add(buf_size);
-
-    GenesisEventsPort *events_in_port = (GenesisEventsPort *)events_out_port->port.output_to;
-    assert(events_in_port);
-    GenesisNode *other_node = events_in_port->port.node;
-    GenesisPipeline *pipeline = port->node->descriptor->pipeline;
-    queue_node_if_ready(pipeline, other_node, false);
+    events_out_port->ticks_requested -= tick_count;
+    events_out_port->ticks_available += tick_count;
+    if (event_count > 0 || tick_count > 0)
+        port_advanced(port->node->descriptor->pipeline);
 }
 
 struct GenesisMidiEvent *genesis_events_out_port_write_ptr(struct GenesisPort *port) {
@@ -2278,6 +4068,92 @@ struct GenesisMidiEvent *genesis_events_out_port_write_ptr(struct GenesisPort *p
     return (GenesisMidiEvent*)ring_buffer_write_ptr(&events_out_port->event_buffer);
 }
 
+long genesis_param_port_frame_index(struct GenesisPort *port) {
+    struct GenesisParamPort *param_port = (struct GenesisParamPort *) port;
+    return param_port->frame_index.load();
+}
+
+int genesis_param_port_schedule(struct GenesisPort *port, long frame, float value, int ramp_frame_count) {
+    struct GenesisParamPort *param_port = (struct GenesisParamPort *) port;
+    GenesisParamPortDescriptor *param_descr = (GenesisParamPortDescriptor *)port->descriptor;
+    if (ring_buffer_free_count(&param_port->change_queue) < (int)sizeof(GenesisParamChange))
+        return GenesisErrorQueueFull;
+    GenesisParamChange *change = (GenesisParamChange *)ring_buffer_write_ptr(&param_port->change_queue);
+    change->frame = frame;
+    change->value = clamp(param_descr->min_value, value, param_descr->max_value);
+    change->ramp_frame_count = ramp_frame_count;
+    ring_buffer_advance_write_ptr(&param_port->change_queue, sizeof(GenesisParamChange));
+    return 0;
+}
+
+static void apply_param_change(GenesisParamPort *param_port, const GenesisParamChange *change) {
+    if (change->ramp_frame_count <= 0) {
+        param_port->value = change->value;
+        param_port->ramp_frames_left = 0;
+    } else {
+        param_port->ramp_target = change->value;
+        param_port->ramp_step = (change->value - param_port->value) / change->ramp_frame_count;
+        param_port->ramp_frames_left = change->ramp_frame_count;
+    }
+}
+
+// Appends the segments for the next frame_count frames of the current ramp,
+// or of the current value if there is no ramp.
+static void append_param_segments(GenesisParamPort *param_port, int frame_count, int *segment_count) {
+    if (frame_count <= 0)
+        return;
+    if (param_port->ramp_frames_left > 0) {
+        int ramp_frame_count = min(frame_count, param_port->ramp_frames_left);
+        GenesisParamSegment *segment = &param_port->segments[*segment_count];
+        *segment_count += 1;
+        segment->frame_count = ramp_frame_count;
+        segment->start_value = param_port->value;
+        segment->step = param_port->ramp_step;
+        param_port->ramp_frames_left -= ramp_frame_count;
+        if (param_port->ramp_frames_left == 0)
+            param_port->value = param_port->ramp_target;
+        else
+            param_port->value += param_port->ramp_step * ramp_frame_count;
+        frame_count -= ramp_frame_count;
+        if (frame_count == 0)
+            return;
+    }
+    GenesisParamSegment *segment = &param_port->segments[*segment_count];
+    *segment_count += 1;
+    segment->frame_count = frame_count;
+    segment->start_value = param_port->value;
+    segment->step = 0.0f;
+}
+
+const struct GenesisParamSegment *genesis_param_in_port_segments(struct GenesisPort *port,
+        int frame_count, int *segment_count)
+{
+    struct GenesisParamPort *param_port = (struct GenesisParamPort *) port;
+    RingBuffer *change_queue = &param_port->change_queue;
+    long frame_index = param_port->frame_index.load(std::memory_order_relaxed);
+    long end_frame_index = frame_index + frame_count;
+
+    // only look at changes that were there when we started, so that the
+    // segments are bounded by the queue size
+    int change_count = ring_buffer_fill_count(change_queue) / sizeof(GenesisParamChange);
+    *segment_count = 0;
+    for (; change_count > 0; change_count -= 1) {
+        GenesisParamChange *change = (GenesisParamChange *)ring_buffer_read_ptr(change_queue);
+        if (change->frame >= end_frame_index)
+            break;
+        long change_frame_index = max(change->frame, frame_index);
+        append_param_segments(param_port, change_frame_index - frame_index, segment_count);
+        frame_index = change_frame_index;
+        apply_param_change(param_port, change);
+        ring_buffer_advance_read_ptr(change_queue, sizeof(GenesisParamChange));
+    }
+    append_param_segments(param_port, end_frame_index - frame_index, segment_count);
+    assert(*segment_count <= param_port->segment_capacity);
+
+    param_port->frame_index.store(end_frame_index, std::memory_order_relaxed);
+    return param_port->segments;
+}
+
 void genesis_node_descriptor_set_run_callback(struct GenesisNodeDescriptor *node_descriptor,
         void (*run)(struct GenesisNode *node))
 {
@@ -2354,6 +4230,46 @@ int genesis_audio_port_descriptor_set_sample_rate(
     return 0;
 }
 
+int genesis_audio_port_descriptor_set_format(
+        struct GenesisPortDescriptor *port_descr,
+        enum GenesisAudioPortFormat format, bool fixed, int other_port_index)
+{
+    assert(port_descr);
+
+    if (port_descr->port_type != GenesisPortTypeAudioIn &&
+        port_descr->port_type != GenesisPortTypeAudioOut)
+    {
+        return GenesisErrorInvalidPortType;
+    }
+
+    GenesisAudioPortDescriptor *audio_port_descr = (GenesisAudioPortDescriptor *)port_descr;
+
+    audio_port_descr->format = format;
+    audio_port_descr->format_fixed = fixed;
+    audio_port_descr->same_format_index = other_port_index;
+
+    return 0;
+}
+
+int genesis_param_port_descriptor_set_range(struct GenesisPortDescriptor *port_descr,
+        float default_value, float min_value, float max_value)
+{
+    assert(port_descr);
+
+    if (port_descr->port_type != GenesisPortTypeParamIn)
+        return GenesisErrorInvalidPortType;
+    if (min_value > max_value || default_value < min_value || default_value > max_value)
+        return GenesisErrorInvalidParam;
+
+    GenesisParamPortDescriptor *param_port_descr = (GenesisParamPortDescriptor *)port_descr;
+
+    param_port_descr->default_value = default_value;
+    param_port_descr->min_value = min_value;
+    param_port_descr->max_value = max_value;
+
+    return 0;
+}
+
 void genesis_audio_port_descriptor_set_is_sink(
         struct GenesisPortDescriptor *port_descr, bool is_sink)
 {
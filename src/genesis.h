@@ -24,6 +24,15 @@
 
 #define GENESIS_NOTES_COUNT 128
 #define GENESIS_MAX_CHANNELS SOUNDIO_MAX_CHANNELS
+/// How many audio in ports one audio out port can feed.
+#define GENESIS_MAX_PORT_READERS 16
+/// How many times a node can call ::genesis_node_add_memory_range.
+#define GENESIS_MAX_NODE_MEMORY_RANGES 8
+/// Whole notes divide into this many ticks. Event times and durations are
+/// counted in ticks, so that they add up exactly over long sessions.
+#define GENESIS_TICKS_PER_WHOLE_NOTE 3840
+/// The tempo of a timeline without tempo changes, in whole notes per minute.
+#define GENESIS_DEFAULT_BPM 140.0
 
 /// How many SoundIoChannelId values there are.
 #define GENESIS_CHANNEL_ID_COUNT 70
@@ -60,6 +69,8 @@ enum GenesisError {
     GenesisErrorIncompatibleDevice,
     GenesisErrorDeviceNotFound,
     GenesisErrorDecodingString,
+    GenesisErrorIncompatiblePortFormats,
+    GenesisErrorQueueFull,
 };
 
 enum GenesisPortType {
@@ -67,11 +78,46 @@ enum GenesisPortType {
     GenesisPortTypeAudioOut,
     GenesisPortTypeEventsIn,
     GenesisPortTypeEventsOut,
+    // a parameter of the node, driven from outside the graph rather than
+    // connected to another port
+    GenesisPortTypeParamIn,
+};
+
+// How the samples of an audio port are laid out in memory.
+enum GenesisAudioPortFormat {
+    // one buffer, channels alternate within each frame
+    GenesisAudioPortFormatInterleaved,
+    // one contiguous buffer per channel
+    GenesisAudioPortFormatPlanar,
 };
 
 struct GenesisContext;
 struct GenesisPipeline;
 
+// A stretch of consecutive frames over which a parameter follows a straight
+// line: frame i of the segment has the value start_value + i * step.
+struct GenesisParamSegment {
+    int frame_count;
+    float start_value;
+    float step; // 0 when the value is constant
+};
+
+struct GenesisTempoChange {
+    double pos; // in whole notes
+    double bpm; // whole notes per minute from pos on
+};
+
+// One region of constant tempo, placed at frame_rate. Nodes keep the
+// segment their position is in and only look up another one once their
+// position leaves it.
+struct GenesisTempoSegment {
+    long start_sample_pos;
+    long end_sample_pos; // LONG_MAX for the last region
+    long start_tick;
+    long ticks_per_minute;
+    int frame_rate;
+};
+
 struct GenesisExportFormat {
     struct GenesisAudioFileCodec *codec;
     enum SoundIoFormat sample_format;
@@ -93,6 +139,83 @@ struct GenesisSoundBackend {
     int connect_err;
 };
 
+#define GENESIS_NODE_STATS_BUCKET_COUNT 32
+
+struct GenesisNodeStats {
+    long call_count;
+    // frames written to the node's first audio out port, or for nodes
+    // without one, frames read from its first audio in port
+    long frame_count;
+    long total_ns;
+    long min_ns;
+    long max_ns;
+    // run_ns_histogram[i] counts runs that took at least 2^i and less than
+    // 2^(i+1) nanoseconds. the last bucket also counts anything longer.
+    long run_ns_histogram[GENESIS_NODE_STATS_BUCKET_COUNT];
+};
+
+#define GENESIS_UNDERRUN_MAX_PORTS 16
+#define GENESIS_UNDERRUN_HISTORY_COUNT 16
+
+struct GenesisUnderrunPortFill {
+    // the node, see ::genesis_node_id, and index of an audio in port
+    int node_id;
+    int port_index;
+    int fill_count; // frames
+    int capacity; // frames
+};
+
+// Nodes are given by id rather than by pointer, since a record can outlive
+// the nodes it mentions.
+struct GenesisUnderrun {
+    long time_ns; // same clock as the node stats
+    // load measured at the device callback that ran out of frames
+    double dsp_load;
+    // fill levels of audio in ports in execution order, at most
+    // GENESIS_UNDERRUN_MAX_PORTS of them
+    int port_count;
+    struct GenesisUnderrunPortFill ports[GENESIS_UNDERRUN_MAX_PORTS];
+    // the id of the node whose last run took the longest. Only known while
+    // ::genesis_pipeline_set_stats_enabled is on; otherwise -1 and
+    // slowest_node_ns is 0.
+    int slowest_node_id;
+    long slowest_node_ns;
+};
+
+enum GenesisThreadScheduler {
+    // the normal time sharing scheduler
+    GenesisThreadSchedulerOther,
+    // realtime, runs until it blocks or a higher priority thread wakes
+    GenesisThreadSchedulerFifo,
+    // realtime, like Fifo but takes turns with threads of equal priority
+    GenesisThreadSchedulerRoundRobin,
+    // Linux SCHED_DEADLINE: guaranteed deadline_runtime_ns of CPU time in
+    // every deadline_period_ns. The kernel does not allow it on threads
+    // pinned to a subset of the cores, so cpus is ignored.
+    GenesisThreadSchedulerDeadline,
+};
+
+#define GENESIS_MAX_THREAD_CPUS 64
+
+struct GenesisThreadPolicy {
+    enum GenesisThreadScheduler scheduler;
+    // for Fifo and RoundRobin, 1 is the lowest. 0 means the highest the
+    // system allows.
+    int priority;
+    long deadline_runtime_ns;
+    long deadline_period_ns;
+    // worker i runs only on core cpus[i % cpu_count]. 0 means any core.
+    int cpu_count;
+    int cpus[GENESIS_MAX_THREAD_CPUS];
+};
+
+enum GenesisVirtualClock {
+    // takes each period as soon as the graph has produced it
+    GenesisVirtualClockFreeRunning,
+    // takes one period per period of wall time, like a sound card
+    GenesisVirtualClockWallTime,
+};
+
 struct GenesisMidiDevice;
 
 struct GenesisPortDescriptor;
@@ -111,6 +234,12 @@ GENESIS_EXPORT const char *genesis_version_string(void);
 GENESIS_EXPORT int genesis_context_create(struct GenesisContext **context);
 GENESIS_EXPORT void genesis_context_destroy(struct GenesisContext *context);
 
+// Bytes of memory the process has locked for pipelines that lock memory,
+// for sizing RLIMIT_MEMLOCK. A page counts once however many locked ranges
+// share it.
+// Lock-free; can be called from any thread.
+GENESIS_EXPORT long genesis_context_locked_memory_size(struct GenesisContext *context);
+
 GENESIS_EXPORT const char *genesis_strerror(int error);
 
 // when you call genesis_flush_events, device information becomes invalid
@@ -218,11 +347,47 @@ GENESIS_EXPORT double genesis_frames_to_whole_notes(struct GenesisPipeline *pipe
 GENESIS_EXPORT int genesis_whole_notes_to_frames(struct GenesisPipeline *pipeline, double whole_notes, int frame_rate);
 GENESIS_EXPORT double genesis_whole_notes_to_seconds(struct GenesisPipeline *pipeline, double whole_notes, int frame_rate);
 
+// Sample positions count frames at frame_rate from the start of the
+// timeline, in 64 bits. Converting ticks to sample positions is exact
+// integer arithmetic, rounding down, so that nodes can work out where
+// things happen once and then only compare integers.
+GENESIS_EXPORT long genesis_whole_notes_to_ticks(double whole_notes);
+GENESIS_EXPORT double genesis_ticks_to_whole_notes(long ticks);
+GENESIS_EXPORT long genesis_ticks_to_sample_pos(struct GenesisPipeline *pipeline, long ticks, int frame_rate);
+// the tick that sample_pos falls in
+GENESIS_EXPORT long genesis_sample_pos_to_ticks(struct GenesisPipeline *pipeline, long sample_pos, int frame_rate);
+GENESIS_EXPORT long genesis_whole_notes_to_sample_pos(struct GenesisPipeline *pipeline,
+        double whole_notes, int frame_rate);
+
+/// Replaces the tempo map that every conversion above goes through. changes
+/// must be sorted by pos. The first tempo also applies before its pos, and
+/// with no changes the tempo is GENESIS_DEFAULT_BPM. Can only be called when
+/// the pipeline is stopped or in an edit; positions that nodes worked out
+/// with the old tempo map are not updated.
+GENESIS_EXPORT int genesis_pipeline_set_tempo_map(struct GenesisPipeline *pipeline,
+        const struct GenesisTempoChange *changes, int change_count);
+/// Looks up the tempo region that sample_pos falls in. Takes a binary search
+/// over the tempo map, so nodes should call it only when the position they
+/// are at leaves the segment they have.
+GENESIS_EXPORT void genesis_pipeline_get_tempo_segment(struct GenesisPipeline *pipeline,
+        long sample_pos, int frame_rate, struct GenesisTempoSegment *out_segment);
+/// ticks must be within the segment.
+GENESIS_EXPORT long genesis_tempo_segment_ticks_to_sample_pos(
+        const struct GenesisTempoSegment *segment, long ticks);
+/// sample_pos must be within the segment.
+GENESIS_EXPORT long genesis_tempo_segment_sample_pos_to_ticks(
+        const struct GenesisTempoSegment *segment, long sample_pos);
+
 
 GENESIS_EXPORT struct GenesisNodeDescriptor *genesis_node_descriptor_find(
         struct GenesisPipeline *pipeline, const char *name);
 GENESIS_EXPORT const char *genesis_node_descriptor_name(const struct GenesisNodeDescriptor *node_descriptor);
 GENESIS_EXPORT const char *genesis_node_descriptor_description(const struct GenesisNodeDescriptor *node_descriptor);
+// Rough figures for choosing between descriptors that do the same job: how
+// much latency their nodes add, in seconds, and how many multiply-adds they
+// spend per output sample. Both are 0 if the descriptor does not say.
+GENESIS_EXPORT double genesis_node_descriptor_latency(const struct GenesisNodeDescriptor *node_descriptor);
+GENESIS_EXPORT double genesis_node_descriptor_ops_per_sample(const struct GenesisNodeDescriptor *node_descriptor);
 
 GENESIS_EXPORT int genesis_audio_device_create_node_descriptor(
         struct GenesisPipeline *pipeline,
@@ -232,6 +397,22 @@ GENESIS_EXPORT int genesis_midi_device_create_node_descriptor(
         struct GenesisPipeline *pipeline,
         struct GenesisMidiDevice *midi_device,
         struct GenesisNodeDescriptor **out_node_descriptor);
+// A playback node that needs no sound hardware. A thread of its own takes
+// `period_frame_count` frames from the input at every tick of a simulated
+// clock. With GenesisVirtualClockWallTime, a tick that finds less than a
+// period buffered is a missed deadline: it is recorded as an underrun and
+// the node recovers the same way a playback device does.
+// ::genesis_node_playback_latency and ::genesis_node_playback_offset work on
+// these nodes too.
+GENESIS_EXPORT int genesis_virtual_device_create_node_descriptor(
+        struct GenesisPipeline *pipeline, enum GenesisVirtualClock clock,
+        int sample_rate, const struct SoundIoChannelLayout *channel_layout,
+        int period_frame_count, struct GenesisNodeDescriptor **out_node_descriptor);
+// `virtual_node` must be a node created with
+// ::genesis_virtual_device_create_node_descriptor. Counts since the node was
+// created. Lock-free; can be called from any thread.
+GENESIS_EXPORT long genesis_node_virtual_device_period_count(struct GenesisNode *virtual_node);
+GENESIS_EXPORT long genesis_node_virtual_device_missed_count(struct GenesisNode *virtual_node);
 
 // name and description are copied internally
 GENESIS_EXPORT struct GenesisNodeDescriptor *genesis_create_node_descriptor(
@@ -251,6 +432,8 @@ GENESIS_EXPORT void genesis_node_descriptor_set_create_callback(struct GenesisNo
 GENESIS_EXPORT void genesis_node_descriptor_set_destroy_callback(struct GenesisNodeDescriptor *node_descriptor,
         void (*destroy)(struct GenesisNode *node));
 GENESIS_EXPORT void *genesis_node_descriptor_userdata(const struct GenesisNodeDescriptor *node_descriptor);
+GENESIS_EXPORT void genesis_node_descriptor_set_cost(struct GenesisNodeDescriptor *node_descriptor,
+        double latency, double ops_per_sample);
 
 GENESIS_EXPORT void genesis_node_descriptor_set_activate_callback(
         struct GenesisNodeDescriptor *descr, int (*activate)(struct GenesisNode *node));
@@ -265,9 +448,20 @@ GENESIS_EXPORT void genesis_node_destroy(struct GenesisNode *node);
 
 GENESIS_EXPORT struct GenesisPort *genesis_node_port(struct GenesisNode *node, int port_index);
 GENESIS_EXPORT struct GenesisNodeDescriptor *genesis_node_descriptor(struct GenesisNode *node);
+// Unique among the nodes of a pipeline, and never reused for another node.
+GENESIS_EXPORT int genesis_node_id(struct GenesisNode *node);
+// Returns NULL if the node has been destroyed.
+GENESIS_EXPORT struct GenesisNode *genesis_pipeline_find_node(struct GenesisPipeline *pipeline, int node_id);
 GENESIS_EXPORT struct GenesisPipeline *genesis_node_pipeline(struct GenesisNode *node);
 GENESIS_EXPORT void genesis_node_disconnect_all_ports(struct GenesisNode *node);
 
+// An audio out port can feed up to GENESIS_MAX_PORT_READERS audio in ports.
+// They all read the same samples, each at its own pace, and the source can
+// only write as far ahead as the slowest of them allows. Once a source has a
+// reader its channel layout, sample rate and format are settled, so further
+// readers must accept them. Returns GenesisErrorQueueFull if the source has
+// no room for another reader. Events out ports feed one port only. If dest
+// is already connected, it is disconnected first.
 GENESIS_EXPORT int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest);
 GENESIS_EXPORT void genesis_disconnect_ports(struct GenesisPort *source, struct GenesisPort *dest);
 // shortcut for connecting audio nodes. calls genesis_connect_ports internally
@@ -277,8 +471,53 @@ GENESIS_EXPORT int genesis_connect_audio_nodes(struct GenesisNode *source, struc
 /// Returns the latency in seconds.
 GENESIS_EXPORT double genesis_node_playback_latency(struct GenesisNode *playback_node);
 GENESIS_EXPORT long genesis_node_playback_offset(struct GenesisNode *playback_node);
+
+// Declares how many frames later than its input the node's audio output is,
+// for example because of lookahead. Call it from the create or connect
+// callback. When the pipeline starts, connections that run in parallel with
+// a node that has latency are delayed by the same amount, so that they
+// arrive at the node they meet at lined up to the sample.
+GENESIS_EXPORT void genesis_node_set_latency(struct GenesisNode *node, int frame_count);
+// Total processing latency from the sources of the graph to the output of
+// the node, in seconds, as of the last time the pipeline started.
+GENESIS_EXPORT double genesis_node_path_latency(struct GenesisNode *node);
+
+// Tells the pipeline how many bytes node->userdata points to, so that it can
+// lock them into memory along with the port buffers. Call it from the create
+// callback.
+GENESIS_EXPORT void genesis_node_set_userdata_size(struct GenesisNode *node, int size);
+// Tells the pipeline about other memory that the run callback uses, such as
+// arrays that userdata points to, so that it is locked along with userdata.
+// The memory must stay put until the node is destroyed. Call it from the
+// create callback.
+GENESIS_EXPORT void genesis_node_add_memory_range(struct GenesisNode *node, void *address, int size);
+
 GENESIS_EXPORT void genesis_node_playback_reset_offset(struct GenesisNode *playback_node);
 
+// Collecting run time statistics costs two clock reads per node run, so it
+// is off by default.
+GENESIS_EXPORT void genesis_pipeline_set_stats_enabled(struct GenesisPipeline *pipeline, bool enabled);
+// Lock-free; can be called from any thread while the pipeline is running.
+// Each counter is up to date, but they may not all be from the same run.
+GENESIS_EXPORT void genesis_node_get_stats(struct GenesisNode *node, struct GenesisNodeStats *out_stats);
+// Zeroes the stats of every node. Lock-free; each node clears its own
+// counters the next time it runs.
+GENESIS_EXPORT void genesis_pipeline_reset_stats(struct GenesisPipeline *pipeline);
+
+// DSP load is the fraction of the playback device period that the graph
+// spent running cycles. Measured at each playback callback; 0 when there is no
+// playback node. `average` is smoothed over roughly the last 20 callbacks
+// and `peak` is the highest single reading since the last reset.
+// Lock-free; can be called from any thread.
+GENESIS_EXPORT void genesis_pipeline_get_dsp_load(struct GenesisPipeline *pipeline,
+        double *average, double *peak);
+GENESIS_EXPORT void genesis_pipeline_reset_dsp_load(struct GenesisPipeline *pipeline);
+// Copies up to `max_count` of the most recent underruns, newest first, and
+// returns how many were copied. Only the last GENESIS_UNDERRUN_HISTORY_COUNT
+// are kept. Lock-free; can be called from any thread.
+GENESIS_EXPORT int genesis_pipeline_get_underruns(struct GenesisPipeline *pipeline,
+        struct GenesisUnderrun *out_underruns, int max_count);
+
 
 
 GENESIS_EXPORT struct GenesisNode *genesis_port_node(struct GenesisPort *port);
@@ -310,6 +549,23 @@ GENESIS_EXPORT int genesis_audio_port_descriptor_set_sample_rate(
         struct GenesisPortDescriptor *audio_port_descr,
         int sample_rate, bool fixed, int other_port_index);
 
+// Audio ports are fixed to GenesisAudioPortFormatInterleaved by default. Set
+// fixed to false if the node can handle either format, in which case the
+// port uses whatever the other end of the connection is fixed to, or
+// interleaved if neither end is fixed.
+// if fixed is true then other_port_index is the index
+// of the other port that it is the same as, or -1 if it is fixed
+// to the value of format
+GENESIS_EXPORT int genesis_audio_port_descriptor_set_format(
+        struct GenesisPortDescriptor *audio_port_descr,
+        enum GenesisAudioPortFormat format, bool fixed, int other_port_index);
+
+// New nodes start with the parameter at default_value. Scheduled values are
+// clamped to the range.
+GENESIS_EXPORT int genesis_param_port_descriptor_set_range(
+        struct GenesisPortDescriptor *param_port_descr,
+        float default_value, float min_value, float max_value);
+
 
 /// Set this to true if we should kick off the audio graph by running
 /// nodes attached to this port.
@@ -328,6 +584,25 @@ GENESIS_EXPORT void genesis_pipeline_pause(struct GenesisPipeline *pipeline);
 GENESIS_EXPORT int genesis_pipeline_resume(struct GenesisPipeline *pipeline);
 /// Must be called only when pipeline is paused or stopped.
 GENESIS_EXPORT void genesis_pipeline_seek(struct GenesisPipeline *pipeline, double time);
+/// Seeks a single node. Must be called only when the pipeline is paused,
+/// stopped, or in an edit.
+GENESIS_EXPORT void genesis_node_seek(struct GenesisNode *node, double time);
+
+/// Changes the graph of a running pipeline without stopping it. Once begin
+/// returns, no node runs until the edit is committed. Until then nodes can be
+/// created, destroyed, connected, disconnected and seeked, while devices keep
+/// playing the audio that is already buffered. Commit allocates buffers for
+/// new ports, publishes the new execution plan and resumes running nodes.
+/// Nodes stop for the whole edit, so keep it short: the devices underrun if
+/// it takes longer than the buffered audio lasts.
+/// Connections to device nodes must not change during an edit.
+/// If the pipeline is not running, the edit takes effect when it is started.
+GENESIS_EXPORT void genesis_pipeline_begin_edit(struct GenesisPipeline *pipeline);
+/// Returns GenesisErrorInvalidState if the edit needs a restart, because it
+/// raises the latency, adds too many nodes, or changes the latency
+/// compensation of a buffer that a device reads. On error the pipeline is
+/// stopped; call ::genesis_pipeline_start to run the edited graph.
+GENESIS_EXPORT int genesis_pipeline_commit_edit(struct GenesisPipeline *pipeline);
 
 GENESIS_EXPORT bool genesis_pipeline_is_running(struct GenesisPipeline *pipeline);
 
@@ -337,6 +612,62 @@ GENESIS_EXPORT bool genesis_pipeline_is_running(struct GenesisPipeline *pipeline
 GENESIS_EXPORT int genesis_pipeline_set_latency(struct GenesisPipeline *pipeline, double latency);
 GENESIS_EXPORT double genesis_pipeline_get_latency(struct GenesisPipeline *pipeline);
 
+// number of worker threads that run nodes. 0 means one per core, minus one
+// to leave room for the GUI thread. The default is 0.
+// can only set this when the pipeline is stopped.
+GENESIS_EXPORT int genesis_pipeline_set_thread_count(struct GenesisPipeline *pipeline,
+        int thread_count);
+// returns the actual number of worker threads
+GENESIS_EXPORT int genesis_pipeline_get_thread_count(struct GenesisPipeline *pipeline);
+
+// How worker threads are scheduled and which cores they run on. The default
+// is Fifo at the highest priority on any core. Where the system refuses
+// part of the policy, for example realtime scheduling without the
+// permission for it, workers fall back to the closest thing they can get
+// and a warning is printed.
+// can only set this when the pipeline is stopped.
+GENESIS_EXPORT int genesis_pipeline_set_thread_policy(struct GenesisPipeline *pipeline,
+        const struct GenesisThreadPolicy *policy);
+// The policy worker `worker_index` actually got, as of the last time the
+// pipeline started. cpus lists the cores it may run on, or is empty if it
+// may run on all of them. Returns GenesisErrorInvalidState if the worker
+// has not run yet.
+GENESIS_EXPORT int genesis_pipeline_get_worker_thread_policy(struct GenesisPipeline *pipeline,
+        int worker_index, struct GenesisThreadPolicy *out_policy);
+
+// when non-zero, ::genesis_audio_out_port_free_count and
+// ::genesis_audio_in_port_fill_count return multiples of this many frames,
+// and ring buffers hold a whole number of them. Nodes can then do their work
+// in fixed size blocks. Must be a power of 2. The default is 0, which means
+// nodes process whatever is available.
+// can only set this when the pipeline is stopped.
+GENESIS_EXPORT int genesis_pipeline_set_quantum(struct GenesisPipeline *pipeline, int frame_count);
+GENESIS_EXPORT int genesis_pipeline_get_quantum(struct GenesisPipeline *pipeline);
+
+// When enabled, starting or resuming the pipeline locks the ring buffers of
+// every port, the stacks of the worker threads and the userdata and memory
+// ranges of every node into physical memory and faults them in, so that the
+// first cycles do not take page faults. Each is unlocked again when it is
+// freed. With `huge_pages`, ring buffers of 2 MiB or more ask for
+// transparent huge pages. If the system refuses to lock, for example
+// because of RLIMIT_MEMLOCK, the memory is still faulted in and a warning is
+// printed. Off by default.
+// can only set this when the pipeline is stopped.
+GENESIS_EXPORT int genesis_pipeline_set_lock_memory(struct GenesisPipeline *pipeline,
+        bool enabled, bool huge_pages);
+
+// Runs the pipeline without any devices, as fast as possible, until
+// `sink_node` has consumed at least `frame_count` frames. Returns when done.
+// With one worker thread the nodes run on the calling thread; otherwise they
+// run on the worker threads. Buffer sizes come from the latency, so a large
+// latency means large blocks. The pipeline must be stopped, and is stopped
+// again when this returns. Call ::genesis_pipeline_seek first to choose where
+// to start.
+// Returns GenesisErrorInvalidState if the graph stops making progress before
+// the sink consumed `frame_count` frames.
+GENESIS_EXPORT int genesis_pipeline_render_offline(struct GenesisPipeline *pipeline,
+        struct GenesisNode *sink_node, long frame_count);
+
 // can only set this when the pipeline is stopped.
 // also if you change this, you must destroy and re-create all nodes and node
 // descriptors
@@ -363,28 +694,58 @@ GENESIS_EXPORT int genesis_audio_out_port_free_count(struct GenesisPort *port);
 GENESIS_EXPORT float *genesis_audio_out_port_write_ptr(struct GenesisPort *port);
 GENESIS_EXPORT void genesis_audio_out_port_advance_write_ptr(struct GenesisPort *port, int frame_count);
 
+// The interleaved read and write pointers above are only valid for
+// interleaved ports. These work for either format: consecutive samples of a
+// channel are genesis_audio_port_channel_stride samples apart.
+GENESIS_EXPORT float *genesis_audio_in_port_channel_read_ptr(struct GenesisPort *port, int channel_index);
+GENESIS_EXPORT float *genesis_audio_out_port_channel_write_ptr(struct GenesisPort *port, int channel_index);
+// 1 for planar ports, the channel count for interleaved ports
+GENESIS_EXPORT int genesis_audio_port_channel_stride(struct GenesisPort *port);
+GENESIS_EXPORT enum GenesisAudioPortFormat genesis_audio_port_format(struct GenesisPort *port);
+
+// bytes that one frame takes up in the buffer returned by the read or write
+// pointer accessors. For planar ports that is the size of one sample.
 GENESIS_EXPORT int genesis_audio_port_bytes_per_frame(struct GenesisPort *port);
 GENESIS_EXPORT int genesis_audio_port_sample_rate(struct GenesisPort *port);
 GENESIS_EXPORT const struct SoundIoChannelLayout *genesis_audio_port_channel_layout(struct GenesisPort *port);
 
-// time_requested is how much time in whole notes you want to be available.
+// ticks_requested is how much time in ticks you want to be available.
 // event_count is the number of events available to read.
-// time_available is how much time in whole notes is accounted for in the buffer.
+// ticks_available is how much time in ticks is accounted for in the buffer.
 GENESIS_EXPORT void genesis_events_in_port_fill_count(struct GenesisPort *port,
-        double time_requested, int *event_count, double *time_available);
-// event_count is how many events you consumed. buf_size is the amount of whole notes you consumed.
-GENESIS_EXPORT void genesis_events_in_port_advance_read_ptr(struct GenesisPort *port, int event_count, double buf_size);
+        long ticks_requested, int *event_count, long *ticks_available);
+// event_count is how many events you consumed. tick_count is the amount of ticks you consumed.
+GENESIS_EXPORT void genesis_events_in_port_advance_read_ptr(struct GenesisPort *port, int event_count, long tick_count);
 GENESIS_EXPORT struct GenesisMidiEvent *genesis_events_in_port_read_ptr(struct GenesisPort *port);
 
 // event_count is the number of events that can be written.
-// time_requested is how much time in whole notes you should account for if you can.
+// ticks_requested is how much time in ticks you should account for if you can.
 GENESIS_EXPORT void genesis_events_out_port_free_count(struct GenesisPort *port,
-        int *event_count, double *time_requested);
-// event_count is how many events you wrote to the buffer. buf_size is the amount of whole notes
+        int *event_count, long *ticks_requested);
+// event_count is how many events you wrote to the buffer. tick_count is the amount of ticks
 // you accounted for.
-GENESIS_EXPORT void genesis_events_out_port_advance_write_ptr(struct GenesisPort *port, int event_count, double buf_size);
+GENESIS_EXPORT void genesis_events_out_port_advance_write_ptr(struct GenesisPort *port, int event_count, long tick_count);
 GENESIS_EXPORT struct GenesisMidiEvent *genesis_events_out_port_write_ptr(struct GenesisPort *port);
 
+// Parameter frames count the frames the node has run since it was last
+// seeked. Lock-free; can be called from any thread.
+GENESIS_EXPORT long genesis_param_port_frame_index(struct GenesisPort *port);
+// Schedules the parameter to start moving towards value at the given frame,
+// reaching it ramp_frame_count frames later. A frame that has already passed
+// takes effect at the start of the next run. Changes must be scheduled in
+// frame order from one thread at a time; it does not have to be the thread
+// that built the graph. Returns GenesisErrorQueueFull if the node has not
+// yet consumed enough of the earlier changes.
+GENESIS_EXPORT int genesis_param_port_schedule(struct GenesisPort *port,
+        long frame, float value, int ramp_frame_count);
+// Call from the run callback with the number of frames the node is about to
+// process. Returns the segments covering those frames, in order, and
+// advances the parameter's frame index past them. When nothing is
+// scheduled this is a single constant segment. The segments are valid until
+// the next call.
+GENESIS_EXPORT const struct GenesisParamSegment *genesis_param_in_port_segments(
+        struct GenesisPort *port, int frame_count, int *segment_count);
+
 
 ////////////// Formats and Codecs
 
@@ -6,11 +6,15 @@
 #include "midi_hardware.hpp"
 #include "os.hpp"
 #include "thread_safe_queue.hpp"
+#include "work_stealing_deque.hpp"
 #include "ring_buffer.hpp"
+#include "tempo_map.hpp"
 #include "atomic_double.hpp"
 #include "atomics.hpp"
 
 struct GenesisPipeline;
+struct GenesisNode;
+struct GenesisAudioPort;
 
 struct GenesisContext {
     GenesisSoundBackend *sound_backend_list;
@@ -35,12 +39,114 @@ struct GenesisContext {
     List<GenesisPipeline*> pipelines;
 };
 
+struct GenesisPipelineWorker {
+    GenesisPipeline *pipeline;
+    int index;
+    OsThread *thread;
+    // nodes that this worker made ready. The worker pops from the bottom;
+    // idle workers steal from the top.
+    WorkStealingDeque<GenesisNode *> deque;
+    // the other workers, nearest index first. Neighbouring workers are most
+    // likely to share a cache, so they are asked for work before distant ones.
+    int *steal_order;
+    // what the thread got of pipeline->thread_policy; written by the worker
+    // before it sets policy_ready
+    GenesisThreadPolicy obtained_policy;
+    atomic_bool policy_ready;
+};
+
+// Compiled at resume from the nodes that can reach a sink. Every node in a
+// level only reads from nodes in earlier levels. A cycle runs each node once:
+// the first level is queued right away and every other node is queued by
+// the last of its dependencies to finish.
+struct GenesisExecutionPlan {
+    // topological order, grouped by level
+    List<GenesisNode *> nodes;
+    // index into nodes where each level starts, plus nodes.length() at the end
+    List<int> level_starts;
+    // successors of node are successors[successor_starts[node->plan_index]]
+    // up to successors[successor_starts[node->plan_index + 1]]
+    List<int> successor_starts;
+    List<GenesisNode *> successors;
+    // a cycle that made progress is followed by another one until all of
+    // these are full
+    List<GenesisAudioPort *> sink_ports;
+};
+
+static const int UNDERRUN_RECORD_WORD_COUNT = (sizeof(GenesisUnderrun) + sizeof(long) - 1) / sizeof(long);
+
+// seqlock: the writer makes seq odd, fills in the record, then makes it even
+// again. readers retry if seq was odd or changed while they copied. The
+// record is copied in and out a word at a time with relaxed atomics, so a
+// reader racing the writer gets a torn copy that it throws away rather than
+// a data race.
+struct GenesisUnderrunSlot {
+    atomic_int seq;
+    // which underrun this is; see GenesisPipeline::underrun_count
+    atomic_long index;
+    atomic_long record_words[UNDERRUN_RECORD_WORD_COUNT];
+};
+
 struct GenesisPipeline {
     GenesisContext *context;
 
-    OsThread **thread_pool;
-    int thread_pool_size;
+    GenesisPipelineWorker *workers;
+    int worker_count;
+    // 0 means one worker per core, minus one
+    int requested_worker_count;
     atomic_int threads_paused;
+    // bumped every time a node is queued; idle workers futex wait on it.
+    atomic_int wake_seq;
+    atomic_int sleeping_worker_count;
+
+    GenesisExecutionPlan *plan;
+    // set from the moment a cycle is started until its last node finishes
+    atomic_bool cycle_running;
+    // a device consumed or produced frames; another cycle is needed
+    atomic_bool cycle_requested;
+    // some node moved data during the current cycle
+    atomic_bool cycle_progress;
+    atomic_int cycle_nodes_left;
+    // set from genesis_pipeline_begin_edit until the edit is committed. no
+    // cycle starts while it is set, and the edit takes cycle_running for
+    // itself as soon as the current cycle ends.
+    atomic_bool edit_pending;
+    // bumped when cycle_running is released while an edit waits for it
+    atomic_int cycle_release_seq;
+    // Device callbacks read the plan and port readers outside of a cycle,
+    // each inside a section counted in device_section_counts[epoch & 1].
+    // Sections leave those alone once they see edit_pending. An edit bumps
+    // device_epoch and waits for the count of the old epoch to drain before
+    // it lets nodes be destroyed.
+    atomic_int device_epoch;
+    atomic_int device_section_counts[2];
+    atomic_bool device_grace_waiting;
+    // queues are sized for this many nodes so that edits can add nodes
+    // without resizing them while workers are running
+    int node_capacity;
+    // how many seconds of audio each ring buffer holds
+    double buffer_duration;
+
+    // set during genesis_pipeline_render_offline. cycles stop once the
+    // sink port's read offset reaches offline_end_offset.
+    GenesisAudioPort *offline_sink_port;
+    long offline_end_offset;
+    atomic_int offline_idle;
+
+    atomic_bool stats_enabled;
+    atomic_int stats_epoch;
+
+    // when the running cycle started, and time spent in cycles since the
+    // last playback callback took it
+    atomic_long cycle_start_ns;
+    atomic_long busy_ns;
+    AtomicDouble dsp_load_average;
+    AtomicDouble dsp_load_peak;
+    // total number of underruns recorded; the record for underrun i is in
+    // underrun_slots[i % GENESIS_UNDERRUN_HISTORY_COUNT]
+    atomic_long underrun_count;
+    atomic_flag underrun_write_flag;
+    GenesisUnderrunSlot underrun_slots[GENESIS_UNDERRUN_HISTORY_COUNT];
 
     void (*underrun_callback)(void *userdata);
     void *underrun_callback_userdata;
@@ -48,11 +154,20 @@ struct GenesisPipeline {
 
     List<GenesisNodeDescriptor*> node_descriptors;
     List<GenesisNode*> nodes;
+    int next_node_id;
     atomic_bool running;
     atomic_int paused;
-    ThreadSafeQueue<GenesisNode *> task_queue;
+    // nodes queued from threads that are not workers, such as device callbacks
+    // starting a cycle
+    ThreadSafeQueue<GenesisNode *> inject_queue;
     double latency;
     double actual_latency;
+    // 0 or a power of 2 number of frames
+    int quantum;
+    GenesisThreadPolicy thread_policy;
+    // lock port buffers, worker stacks and node userdata into memory at resume
+    bool lock_memory;
+    bool lock_huge_pages;
 
     // The sample rate that we use if a range of sample rates are available. For example
     // if a device supports 44100 - 96000, and target_sample_rate is 48000, then 48000
@@ -60,6 +175,9 @@ struct GenesisPipeline {
     int target_sample_rate;
 
     SoundIoChannelLayout channel_layout;
+
+    // only changes while no node runs, so nodes read it without locking
+    TempoMap tempo_map;
 };
 
 struct GenesisPortDescriptor {
@@ -74,6 +192,13 @@ struct GenesisEventsPortDescriptor {
     struct GenesisPortDescriptor port_descriptor;
 };
 
+struct GenesisParamPortDescriptor {
+    struct GenesisPortDescriptor port_descriptor;
+    float default_value;
+    float min_value;
+    float max_value;
+};
+
 struct GenesisAudioPortDescriptor {
     struct GenesisPortDescriptor port_descriptor;
 
@@ -91,6 +216,13 @@ struct GenesisAudioPortDescriptor {
     int same_sample_rate_index;
     int sample_rate;
 
+    bool format_fixed;
+    // if format_fixed is true then this is the index
+    // of the other port that it is the same as, or -1 if it is fixed
+    // to the value of format
+    int same_format_index;
+    enum GenesisAudioPortFormat format;
+
     // Set this to true if we should kick off the audio graph by running
     // nodes attached to this port.
     bool is_sink;
@@ -110,6 +242,9 @@ struct GenesisNodeDescriptor {
     void (*pause)(struct GenesisNode *node);
     int set_index;
     double min_software_latency;
+    // see genesis_node_descriptor_set_cost
+    double latency;
+    double ops_per_sample;
 
     void *userdata;
     void (*destroy_descriptor)(struct GenesisNodeDescriptor *);
@@ -119,6 +254,8 @@ struct GenesisPort {
     struct GenesisPortDescriptor *descriptor;
     struct GenesisNode *node;
     struct GenesisPort *input_from;
+    // events out ports only; audio out ports keep their readers in
+    // GenesisAudioPort::readers
     struct GenesisPort *output_to;
 };
 
@@ -126,29 +263,123 @@ struct GenesisAudioPort {
     struct GenesisPort port;
     struct SoundIoChannelLayout channel_layout;
     int sample_rate;
+    enum GenesisAudioPortFormat format;
+    // for planar ports this holds channel 0, and its offsets are the read
+    // and write offsets of every channel.
     RingBuffer sample_buffer;
     int sample_buffer_err;
     int sample_buffer_size; // in bytes
+    // size of a frame in sample_buffer; one sample for planar ports
     int bytes_per_frame;
+    // channels 1 and up of a planar port, each with the same capacity as
+    // sample_buffer
+    OsMirroredMemory extra_channel_buffers[GENESIS_MAX_CHANNELS - 1];
+    int extra_channel_buffer_count;
+    // latency compensation. on an in port, how much its connection must be
+    // delayed; on an out port, the most that any of its readers must be. the
+    // out port's buffer starts out with this many frames of silence, and
+    // each reader skips the part of it that it does not need.
+    int compensation_frame_count;
+    // what the buffer was last filled with; differs from the above until
+    // the buffer is prepared again
+    int buffer_compensation_frame_count;
+    // for out ports, the in ports reading sample_buffer. its read offset is
+    // that of the slowest active reader.
+    struct GenesisAudioPort *readers[GENESIS_MAX_PORT_READERS];
+    int reader_count;
+    // for in ports, how far this reader is through the source's sample_buffer
+    atomic_long read_offset;
+    // for in ports, whether the node is in the published plan. only changes
+    // while no cycle runs and device callbacks keep off the readers.
+    atomic_bool active;
 };
 
 struct GenesisEventsPort {
     struct GenesisPort port;
     RingBuffer event_buffer;
     int event_buffer_err;
-    AtomicDouble time_available; // in whole notes
-    AtomicDouble time_requested; // in whole notes
+    atomic_long ticks_available;
+    atomic_long ticks_requested;
+};
+
+struct GenesisParamChange {
+    long frame;
+    float value;
+    int ramp_frame_count;
+};
+
+struct GenesisParamPort {
+    struct GenesisPort port;
+    // GenesisParamChange items; the scheduling thread writes and the thread
+    // running the node reads
+    RingBuffer change_queue;
+    int change_queue_err;
+    atomic_long frame_index;
+
+    // only used by the thread running the node
+    float value;
+    float ramp_target;
+    float ramp_step;
+    int ramp_frames_left;
+    // enough for two segments per queued change plus the last one
+    GenesisParamSegment *segments;
+    int segment_capacity;
+};
+
+// written only by the thread running the node, so that readers never need
+// a lock. after a reset, epoch lags pipeline->stats_epoch until the node next
+// runs and zeroes its counters.
+struct GenesisNodeStatsCounters {
+    atomic_int epoch;
+    atomic_long call_count;
+    atomic_long frame_count;
+    atomic_long total_ns;
+    atomic_long min_ns;
+    atomic_long max_ns;
+    atomic_long run_ns_histogram[GENESIS_NODE_STATS_BUCKET_COUNT];
+};
+
+struct GenesisMemoryRange {
+    void *address;
+    int size;
+    bool locked;
 };
 
 struct GenesisNode {
     struct GenesisNodeDescriptor *descriptor;
+    int id;
     int port_count;
     struct GenesisPort **ports;
     int set_index; // index into context->nodes
-    atomic_bool being_processed;
+    int plan_index; // index into plan->successor_starts, or -1
+    // number of distinct nodes in the plan that this node reads from
+    int dependency_count;
+    // counts down to 0 during a cycle, at which point the node is queued
+    atomic_int dependencies_left;
+    GenesisNodeStatsCounters stats;
+    // duration of the most recent run, if stats are enabled
+    atomic_long last_run_ns;
     double timestamp; // in whole notes
+    // processing delay the node adds, in frames of its audio output
+    int latency_frame_count;
+    // latency from the sources of the graph to the output of this node, in
+    // seconds, including compensation. computed when the pipeline starts.
+    double path_latency;
     void *userdata;
+    int userdata_size;
+    GenesisMemoryRange memory_ranges[GENESIS_MAX_NODE_MEMORY_RANGES];
+    int memory_range_count;
+    // set once the pipeline has tried to lock the memory of the node.
+    // whatever did lock is unlocked when the node is destroyed.
+    bool memory_locked;
+    bool userdata_locked;
     bool constructed;
 };
 
+// The node whose run callback the calling thread is inside, or NULL. The
+// period of a virtual device counts as a run of its node. Only kept track
+// of in debug builds, so that test/rt_watchdog.cpp can catch run callbacks
+// that allocate, lock or block.
+GenesisNode *genesis_rt_current_node(void);
+
 #endif
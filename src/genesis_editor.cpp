@@ -92,6 +92,7 @@ static void on_flush_events(Event, void *userdata) {
         editor_window->fps_widget->set_text(fps_text);
     }
 
+    project_flush_events(genesis_editor->project);
     audio_graph_flush_events(genesis_editor->audio_graph);
 
     for (int i = 0; i < genesis_editor->gui->render_jobs.length(); i += 1) {
@@ -100,6 +101,11 @@ static void on_flush_events(Event, void *userdata) {
     }
 }
 
+static const char *underrun_node_name(GenesisEditor *genesis_editor, int node_id) {
+    GenesisNode *node = genesis_pipeline_find_node(genesis_editor->audio_graph->pipeline, node_id);
+    return node ? genesis_node_descriptor_name(genesis_node_descriptor(node)) : "(destroyed)";
+}
+
 static void on_buffer_underrun(Event, void *userdata) {
     GenesisEditor *genesis_editor = (GenesisEditor *)userdata;
 
@@ -108,6 +114,23 @@ static void on_buffer_underrun(Event, void *userdata) {
     double new_latency = latency + 0.005;
     fprintf(stderr, "recovering from stream error. latency %f -> %f\n", latency, new_latency);
 
+    GenesisUnderrun underrun;
+    if (audio_graph_get_underruns(genesis_editor->audio_graph, &underrun, 1)) {
+        fprintf(stderr, "  dsp load %.1f%%", underrun.dsp_load * 100.0);
+        if (underrun.slowest_node_id >= 0) {
+            fprintf(stderr, ", slowest node %s took %ldns",
+                    underrun_node_name(genesis_editor, underrun.slowest_node_id),
+                    underrun.slowest_node_ns);
+        }
+        fprintf(stderr, "\n");
+        for (int i = 0; i < underrun.port_count; i += 1) {
+            GenesisUnderrunPortFill *port_fill = &underrun.ports[i];
+            fprintf(stderr, "  %s port %d: %d/%d frames\n",
+                    underrun_node_name(genesis_editor, port_fill->node_id),
+                    port_fill->port_index, port_fill->fill_count, port_fill->capacity);
+        }
+    }
+
     audio_graph_recover_stream(genesis_editor->audio_graph, new_latency);
 }
 
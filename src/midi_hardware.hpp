@@ -33,7 +33,7 @@ struct MidiEventSegmentData {
 
 struct GenesisMidiEvent {
     int event_type;
-    double start; // in whole notes
+    long start; // in ticks
     union {
         MidiEventNoteData note_data;
         MidiEventPitchData pitch_data;
@@ -0,0 +1,348 @@
+#include "mix_kernels.hpp"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+#include <immintrin.h>
+#define MIX_KERNELS_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIX_KERNELS_NEON
+#endif
+
+// The vector versions return how many samples or frames they did, always a
+// whole number of vectors.
+
+#if defined(MIX_KERNELS_X86)
+
+__attribute__((target("avx2")))
+static int add_scaled_avx2(float *out, const float *in, float gain, int sample_count) {
+    __m256 gain_vec = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= sample_count; i += 8) {
+        __m256 product = _mm256_mul_ps(_mm256_loadu_ps(in + i), gain_vec);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), product));
+    }
+    return i;
+}
+
+static int add_scaled_sse(float *out, const float *in, float gain, int sample_count) {
+    __m128 gain_vec = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 4 <= sample_count; i += 4) {
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(in + i), gain_vec);
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), product));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int add_multiplied_avx2(float *out, const float *in, const float *gains, int sample_count) {
+    int i = 0;
+    for (; i + 8 <= sample_count; i += 8) {
+        __m256 product = _mm256_mul_ps(_mm256_loadu_ps(in + i), _mm256_loadu_ps(gains + i));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), product));
+    }
+    return i;
+}
+
+static int add_multiplied_sse(float *out, const float *in, const float *gains, int sample_count) {
+    int i = 0;
+    for (; i + 4 <= sample_count; i += 4) {
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(gains + i));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), product));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int add_stereo_scaled_avx2(float *out, const float *left, const float *right,
+        float left_gain, float right_gain, int frame_count)
+{
+    __m256 left_gain_vec = _mm256_set1_ps(left_gain);
+    __m256 right_gain_vec = _mm256_set1_ps(right_gain);
+    int frame = 0;
+    for (; frame + 8 <= frame_count; frame += 8) {
+        __m256 l = _mm256_mul_ps(_mm256_loadu_ps(left + frame), left_gain_vec);
+        __m256 r = _mm256_mul_ps(_mm256_loadu_ps(right + frame), right_gain_vec);
+        // unpack works within each 128 bit lane, so put the lanes back in order
+        __m256 lo = _mm256_unpacklo_ps(l, r);
+        __m256 hi = _mm256_unpackhi_ps(l, r);
+        __m256 first = _mm256_permute2f128_ps(lo, hi, 0x20);
+        __m256 second = _mm256_permute2f128_ps(lo, hi, 0x31);
+        float *out_ptr = out + frame * 2;
+        _mm256_storeu_ps(out_ptr, _mm256_add_ps(_mm256_loadu_ps(out_ptr), first));
+        _mm256_storeu_ps(out_ptr + 8, _mm256_add_ps(_mm256_loadu_ps(out_ptr + 8), second));
+    }
+    return frame;
+}
+
+static int add_stereo_scaled_sse(float *out, const float *left, const float *right,
+        float left_gain, float right_gain, int frame_count)
+{
+    __m128 left_gain_vec = _mm_set1_ps(left_gain);
+    __m128 right_gain_vec = _mm_set1_ps(right_gain);
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        __m128 l = _mm_mul_ps(_mm_loadu_ps(left + frame), left_gain_vec);
+        __m128 r = _mm_mul_ps(_mm_loadu_ps(right + frame), right_gain_vec);
+        float *out_ptr = out + frame * 2;
+        _mm_storeu_ps(out_ptr, _mm_add_ps(_mm_loadu_ps(out_ptr), _mm_unpacklo_ps(l, r)));
+        _mm_storeu_ps(out_ptr + 4, _mm_add_ps(_mm_loadu_ps(out_ptr + 4), _mm_unpackhi_ps(l, r)));
+    }
+    return frame;
+}
+
+__attribute__((target("avx2")))
+static int add_stereo_multiplied_avx2(float *out, const float *left, const float *right,
+        const float *sample_gains, int frame_count)
+{
+    int frame = 0;
+    for (; frame + 8 <= frame_count; frame += 8) {
+        __m256 l = _mm256_loadu_ps(left + frame);
+        __m256 r = _mm256_loadu_ps(right + frame);
+        __m256 lo = _mm256_unpacklo_ps(l, r);
+        __m256 hi = _mm256_unpackhi_ps(l, r);
+        __m256 first = _mm256_permute2f128_ps(lo, hi, 0x20);
+        __m256 second = _mm256_permute2f128_ps(lo, hi, 0x31);
+        float *out_ptr = out + frame * 2;
+        const float *gains_ptr = sample_gains + frame * 2;
+        first = _mm256_mul_ps(first, _mm256_loadu_ps(gains_ptr));
+        second = _mm256_mul_ps(second, _mm256_loadu_ps(gains_ptr + 8));
+        _mm256_storeu_ps(out_ptr, _mm256_add_ps(_mm256_loadu_ps(out_ptr), first));
+        _mm256_storeu_ps(out_ptr + 8, _mm256_add_ps(_mm256_loadu_ps(out_ptr + 8), second));
+    }
+    return frame;
+}
+
+static int add_stereo_multiplied_sse(float *out, const float *left, const float *right,
+        const float *sample_gains, int frame_count)
+{
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        __m128 l = _mm_loadu_ps(left + frame);
+        __m128 r = _mm_loadu_ps(right + frame);
+        float *out_ptr = out + frame * 2;
+        const float *gains_ptr = sample_gains + frame * 2;
+        __m128 first = _mm_mul_ps(_mm_unpacklo_ps(l, r), _mm_loadu_ps(gains_ptr));
+        __m128 second = _mm_mul_ps(_mm_unpackhi_ps(l, r), _mm_loadu_ps(gains_ptr + 4));
+        _mm_storeu_ps(out_ptr, _mm_add_ps(_mm_loadu_ps(out_ptr), first));
+        _mm_storeu_ps(out_ptr + 4, _mm_add_ps(_mm_loadu_ps(out_ptr + 4), second));
+    }
+    return frame;
+}
+
+__attribute__((target("avx2")))
+static int dot_product_avx2(const float *a, const float *b, int count, float *out_sum) {
+    // two sums, so that each add does not wait on the one before
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    *out_sum = _mm_cvtss_f32(half);
+    return i;
+}
+
+static int dot_product_sse(const float *a, const float *b, int count, float *out_sum) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    *out_sum = _mm_cvtss_f32(sum);
+    return i;
+}
+
+typedef int (*AddScaledKernel)(float *out, const float *in, float gain, int sample_count);
+typedef int (*AddMultipliedKernel)(float *out, const float *in, const float *gains, int sample_count);
+typedef int (*AddStereoScaledKernel)(float *out, const float *left, const float *right,
+        float left_gain, float right_gain, int frame_count);
+typedef int (*AddStereoMultipliedKernel)(float *out, const float *left, const float *right,
+        const float *sample_gains, int frame_count);
+typedef int (*DotProductKernel)(const float *a, const float *b, int count, float *out_sum);
+
+// Every CPU this is built for has SSE, so these work before mix_kernels_init
+// has looked for AVX2.
+static AddScaledKernel add_scaled_vec = add_scaled_sse;
+static AddMultipliedKernel add_multiplied_vec = add_multiplied_sse;
+static AddStereoScaledKernel add_stereo_scaled_vec = add_stereo_scaled_sse;
+static AddStereoMultipliedKernel add_stereo_multiplied_vec = add_stereo_multiplied_sse;
+static DotProductKernel dot_product_vec = dot_product_sse;
+
+#elif defined(MIX_KERNELS_NEON)
+
+static int add_scaled_neon(float *out, const float *in, float gain, int sample_count) {
+    float32x4_t gain_vec = vdupq_n_f32(gain);
+    int i = 0;
+    for (; i + 4 <= sample_count; i += 4) {
+        float32x4_t product = vmulq_f32(vld1q_f32(in + i), gain_vec);
+        vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), product));
+    }
+    return i;
+}
+
+static int add_multiplied_neon(float *out, const float *in, const float *gains, int sample_count) {
+    int i = 0;
+    for (; i + 4 <= sample_count; i += 4) {
+        float32x4_t product = vmulq_f32(vld1q_f32(in + i), vld1q_f32(gains + i));
+        vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), product));
+    }
+    return i;
+}
+
+static int add_stereo_scaled_neon(float *out, const float *left, const float *right,
+        float left_gain, float right_gain, int frame_count)
+{
+    float32x4_t left_gain_vec = vdupq_n_f32(left_gain);
+    float32x4_t right_gain_vec = vdupq_n_f32(right_gain);
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        float *out_ptr = out + frame * 2;
+        // loads and stores 4 frames split into channels
+        float32x4x2_t out_frames = vld2q_f32(out_ptr);
+        out_frames.val[0] = vaddq_f32(out_frames.val[0], vmulq_f32(vld1q_f32(left + frame), left_gain_vec));
+        out_frames.val[1] = vaddq_f32(out_frames.val[1], vmulq_f32(vld1q_f32(right + frame), right_gain_vec));
+        vst2q_f32(out_ptr, out_frames);
+    }
+    return frame;
+}
+
+static int add_stereo_multiplied_neon(float *out, const float *left, const float *right,
+        const float *sample_gains, int frame_count)
+{
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        float *out_ptr = out + frame * 2;
+        float32x4x2_t out_frames = vld2q_f32(out_ptr);
+        float32x4x2_t gain_frames = vld2q_f32(sample_gains + frame * 2);
+        out_frames.val[0] = vaddq_f32(out_frames.val[0], vmulq_f32(vld1q_f32(left + frame), gain_frames.val[0]));
+        out_frames.val[1] = vaddq_f32(out_frames.val[1], vmulq_f32(vld1q_f32(right + frame), gain_frames.val[1]));
+        vst2q_f32(out_ptr, out_frames);
+    }
+    return frame;
+}
+
+static int dot_product_neon(const float *a, const float *b, int count, float *out_sum) {
+    float32x4_t sum0 = vdupq_n_f32(0.0f);
+    float32x4_t sum1 = vdupq_n_f32(0.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t sum = vaddq_f32(sum0, sum1);
+    float32x2_t half = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+    *out_sum = vget_lane_f32(vpadd_f32(half, half), 0);
+    return i;
+}
+
+#endif
+
+void mix_kernels_init(void) {
+#if defined(MIX_KERNELS_X86)
+    if (__builtin_cpu_supports("avx2")) {
+        add_scaled_vec = add_scaled_avx2;
+        add_multiplied_vec = add_multiplied_avx2;
+        add_stereo_scaled_vec = add_stereo_scaled_avx2;
+        add_stereo_multiplied_vec = add_stereo_multiplied_avx2;
+        dot_product_vec = dot_product_avx2;
+    }
+#endif
+}
+
+void mix_add_scaled(float *out, const float *in, float gain, int sample_count) {
+    int i = 0;
+#if defined(MIX_KERNELS_X86)
+    i = add_scaled_vec(out, in, gain, sample_count);
+#elif defined(MIX_KERNELS_NEON)
+    i = add_scaled_neon(out, in, gain, sample_count);
+#endif
+    for (; i < sample_count; i += 1)
+        out[i] += in[i] * gain;
+}
+
+void mix_add_multiplied(float *out, const float *in, const float *gains, int sample_count) {
+    int i = 0;
+#if defined(MIX_KERNELS_X86)
+    i = add_multiplied_vec(out, in, gains, sample_count);
+#elif defined(MIX_KERNELS_NEON)
+    i = add_multiplied_neon(out, in, gains, sample_count);
+#endif
+    for (; i < sample_count; i += 1)
+        out[i] += in[i] * gains[i];
+}
+
+void mix_add_planar_scaled(float *out, float **in_channels, const float *channel_gains,
+        int channel_count, int frame_count)
+{
+    int start_frame = 0;
+    if (channel_count == 2) {
+#if defined(MIX_KERNELS_X86)
+        start_frame = add_stereo_scaled_vec(out, in_channels[0], in_channels[1],
+                channel_gains[0], channel_gains[1], frame_count);
+#elif defined(MIX_KERNELS_NEON)
+        start_frame = add_stereo_scaled_neon(out, in_channels[0], in_channels[1],
+                channel_gains[0], channel_gains[1], frame_count);
+#endif
+    }
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        const float *in_ptr = in_channels[ch];
+        float gain = channel_gains[ch];
+        float *out_sample = out + start_frame * channel_count + ch;
+        for (int frame = start_frame; frame < frame_count; frame += 1) {
+            *out_sample += in_ptr[frame] * gain;
+            out_sample += channel_count;
+        }
+    }
+}
+
+void mix_add_planar_multiplied(float *out, float **in_channels, const float *sample_gains,
+        int channel_count, int frame_count)
+{
+    // one channel is laid out the same planar or interleaved
+    if (channel_count == 1) {
+        mix_add_multiplied(out, in_channels[0], sample_gains, frame_count);
+        return;
+    }
+
+    int start_frame = 0;
+    if (channel_count == 2) {
+#if defined(MIX_KERNELS_X86)
+        start_frame = add_stereo_multiplied_vec(out, in_channels[0], in_channels[1],
+                sample_gains, frame_count);
+#elif defined(MIX_KERNELS_NEON)
+        start_frame = add_stereo_multiplied_neon(out, in_channels[0], in_channels[1],
+                sample_gains, frame_count);
+#endif
+    }
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        const float *in_ptr = in_channels[ch];
+        for (int frame = start_frame; frame < frame_count; frame += 1) {
+            int sample_index = frame * channel_count + ch;
+            out[sample_index] += in_ptr[frame] * sample_gains[sample_index];
+        }
+    }
+}
+
+float mix_dot_product(const float *a, const float *b, int count) {
+    float sum = 0.0f;
+    int i = 0;
+#if defined(MIX_KERNELS_X86)
+    i = dot_product_vec(a, b, count, &sum);
+#elif defined(MIX_KERNELS_NEON)
+    i = dot_product_neon(a, b, count, &sum);
+#endif
+    for (; i < count; i += 1)
+        sum += a[i] * b[i];
+    return sum;
+}
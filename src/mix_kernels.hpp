@@ -0,0 +1,31 @@
+#ifndef GENESIS_MIX_KERNELS_HPP
+#define GENESIS_MIX_KERNELS_HPP
+
+// Accumulate loops for mixing and filtering. Each one has AVX2, SSE and NEON
+// versions, picked for the CPU it runs on, and a scalar loop that does
+// whatever the vector loops leave over and everything on other CPUs.
+
+// Picks the versions for the CPU. The kernels work before this is called,
+// just not with the widest vectors. Called once from
+// genesis_context_create.
+void mix_kernels_init(void);
+
+// out[i] += in[i] * gain
+void mix_add_scaled(float *out, const float *in, float gain, int sample_count);
+
+// out[i] += in[i] * gains[i]
+void mix_add_multiplied(float *out, const float *in, const float *gains, int sample_count);
+
+// Adds a planar input into an interleaved output, with a gain per channel.
+void mix_add_planar_scaled(float *out, float **in_channels, const float *channel_gains,
+        int channel_count, int frame_count);
+
+// Adds a planar input into an interleaved output. sample_gains is
+// interleaved like the output.
+void mix_add_planar_multiplied(float *out, float **in_channels, const float *sample_gains,
+        int channel_count, int frame_count);
+
+// Returns the sum of a[i] * b[i].
+float mix_dot_product(const float *a, const float *b, int count);
+
+#endif
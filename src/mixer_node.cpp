@@ -1,19 +1,55 @@
 #include "mixer_node.hpp"
+#include "mix_kernels.hpp"
+
+// Inputs are mixed this many frames at a time, so that the output block
+// stays in cache while every input is added into it.
+static const int MIX_BLOCK_FRAMES = 256;
 
 struct DescriptorContext {
     int input_port_count;
 };
 
+// Where a node is in the segments of one of its param ports during a run.
+struct ParamCursor {
+    const struct GenesisParamSegment *segments;
+    int segment_index;
+    int frame_index; // within the segment
+};
+
 struct MixerContext {
     int input_port_count;
+    // one per interleaved input
     float **read_ptrs;
+    int *interleaved_inputs;
+    // GENESIS_MAX_CHANNELS per planar input
+    float **channel_read_ptrs;
+    int *planar_inputs;
+    // one per input
+    ParamCursor *gain_cursors;
+    ParamCursor *pan_cursors;
+
+    // scratch for one input over one block
+    float frame_gains[MIX_BLOCK_FRAMES];
+    float frame_pans[MIX_BLOCK_FRAMES];
+    float sample_gains[MIX_BLOCK_FRAMES * GENESIS_MAX_CHANNELS];
 };
 
 static void mixer_destroy(struct GenesisNode *node) {
     struct MixerContext *mixer_context = (struct MixerContext *)node->userdata;
     if (mixer_context) {
+        int input_port_count = mixer_context->input_port_count;
         if (mixer_context->read_ptrs)
-            destroy(mixer_context->read_ptrs, mixer_context->input_port_count);
+            destroy(mixer_context->read_ptrs, input_port_count);
+        if (mixer_context->interleaved_inputs)
+            destroy(mixer_context->interleaved_inputs, input_port_count);
+        if (mixer_context->channel_read_ptrs)
+            destroy(mixer_context->channel_read_ptrs, input_port_count * GENESIS_MAX_CHANNELS);
+        if (mixer_context->planar_inputs)
+            destroy(mixer_context->planar_inputs, input_port_count);
+        if (mixer_context->gain_cursors)
+            destroy(mixer_context->gain_cursors, input_port_count);
+        if (mixer_context->pan_cursors)
+            destroy(mixer_context->pan_cursors, input_port_count);
         destroy(mixer_context, 1);
     }
 }
@@ -35,60 +71,261 @@ static int mixer_create(struct GenesisNode *node) {
         mixer_destroy(node);
         return GenesisErrorNoMem;
     }
-    mixer_context->input_port_count = descr_context->input_port_count;
-    mixer_context->read_ptrs = allocate_zero<float *>(mixer_context->input_port_count);
-    if (!mixer_context->read_ptrs) {
+    genesis_node_set_userdata_size(node, sizeof(MixerContext));
+    int input_port_count = descr_context->input_port_count;
+    mixer_context->input_port_count = input_port_count;
+    mixer_context->read_ptrs = allocate_zero<float *>(input_port_count);
+    mixer_context->interleaved_inputs = allocate_zero<int>(input_port_count);
+    mixer_context->channel_read_ptrs = allocate_zero<float *>(input_port_count * GENESIS_MAX_CHANNELS);
+    mixer_context->planar_inputs = allocate_zero<int>(input_port_count);
+    mixer_context->gain_cursors = allocate_zero<ParamCursor>(input_port_count);
+    mixer_context->pan_cursors = allocate_zero<ParamCursor>(input_port_count);
+    if (!mixer_context->read_ptrs || !mixer_context->interleaved_inputs ||
+        !mixer_context->channel_read_ptrs || !mixer_context->planar_inputs ||
+        !mixer_context->gain_cursors || !mixer_context->pan_cursors)
+    {
         mixer_destroy(node);
         return GenesisErrorNoMem;
     }
+    genesis_node_add_memory_range(node, mixer_context->read_ptrs, input_port_count * sizeof(float *));
+    genesis_node_add_memory_range(node, mixer_context->interleaved_inputs, input_port_count * sizeof(int));
+    genesis_node_add_memory_range(node, mixer_context->channel_read_ptrs,
+            input_port_count * GENESIS_MAX_CHANNELS * sizeof(float *));
+    genesis_node_add_memory_range(node, mixer_context->planar_inputs, input_port_count * sizeof(int));
+    genesis_node_add_memory_range(node, mixer_context->gain_cursors, input_port_count * sizeof(ParamCursor));
+    genesis_node_add_memory_range(node, mixer_context->pan_cursors, input_port_count * sizeof(ParamCursor));
 
     return 0;
 }
 
+static void start_param_cursor(ParamCursor *cursor, struct GenesisPort *param_port, int frame_count) {
+    int segment_count;
+    cursor->segments = genesis_param_in_port_segments(param_port, frame_count, &segment_count);
+    cursor->segment_index = 0;
+    cursor->frame_index = 0;
+}
+
+// Moves the cursor over the next frame_count frames. Returns true with the
+// value if the parameter holds still over them, and otherwise fills values
+// with one value per frame.
+static bool read_param(ParamCursor *cursor, int frame_count, float *value, float *values) {
+    const GenesisParamSegment *segment = &cursor->segments[cursor->segment_index];
+    if (segment->step == 0.0f && segment->frame_count - cursor->frame_index >= frame_count) {
+        *value = segment->start_value;
+        cursor->frame_index += frame_count;
+        if (cursor->frame_index == segment->frame_count) {
+            cursor->segment_index += 1;
+            cursor->frame_index = 0;
+        }
+        return true;
+    }
+
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        segment = &cursor->segments[cursor->segment_index];
+        values[frame] = segment->start_value + segment->step * cursor->frame_index;
+        cursor->frame_index += 1;
+        if (cursor->frame_index == segment->frame_count) {
+            cursor->segment_index += 1;
+            cursor->frame_index = 0;
+        }
+    }
+    return false;
+}
+
+// -1 for channels on the left, 1 for channels on the right, 0 for the rest
+static int channel_side(enum SoundIoChannelId channel_id) {
+    switch (channel_id) {
+        case SoundIoChannelIdFrontLeft:
+        case SoundIoChannelIdBackLeft:
+        case SoundIoChannelIdFrontLeftCenter:
+        case SoundIoChannelIdSideLeft:
+        case SoundIoChannelIdTopFrontLeft:
+        case SoundIoChannelIdTopBackLeft:
+            return -1;
+        case SoundIoChannelIdFrontRight:
+        case SoundIoChannelIdBackRight:
+        case SoundIoChannelIdFrontRightCenter:
+        case SoundIoChannelIdSideRight:
+        case SoundIoChannelIdTopFrontRight:
+        case SoundIoChannelIdTopBackRight:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Balance pan: centered leaves every channel alone, and panning one way
+// turns the channels on the other side down.
+static float pan_gain(int side, float pan) {
+    if (side < 0)
+        return min(1.0f, 1.0f - pan);
+    else if (side > 0)
+        return min(1.0f, 1.0f + pan);
+    else
+        return 1.0f;
+}
+
+// Works out the gain of each channel of one input for the next frame_count
+// frames. Returns true with channel_gains set if they hold still, and
+// otherwise fills sample_gains, interleaved like the output.
+static bool read_input_gains(MixerContext *mixer_context, int input_index, const int *sides,
+        int channel_count, int frame_count, float *channel_gains)
+{
+    float gain;
+    float pan;
+    bool gain_constant = read_param(&mixer_context->gain_cursors[input_index], frame_count,
+            &gain, mixer_context->frame_gains);
+    bool pan_constant = read_param(&mixer_context->pan_cursors[input_index], frame_count,
+            &pan, mixer_context->frame_pans);
+
+    if (gain_constant && pan_constant) {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            channel_gains[ch] = gain * pan_gain(sides[ch], pan);
+        return true;
+    }
+
+    float *sample_gains = mixer_context->sample_gains;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        float frame_gain = gain_constant ? gain : mixer_context->frame_gains[frame];
+        float frame_pan = pan_constant ? pan : mixer_context->frame_pans[frame];
+        for (int ch = 0; ch < channel_count; ch += 1)
+            sample_gains[frame * channel_count + ch] = frame_gain * pan_gain(sides[ch], frame_pan);
+    }
+    return false;
+}
+
+static void mix_interleaved_input(MixerContext *mixer_context, float *out_ptr, const float *in_ptr,
+        const float *channel_gains, bool gains_constant, int channel_count, int frame_count)
+{
+    int sample_count = frame_count * channel_count;
+    if (!gains_constant) {
+        mix_add_multiplied(out_ptr, in_ptr, mixer_context->sample_gains, sample_count);
+        return;
+    }
+
+    bool same_gain = true;
+    for (int ch = 1; ch < channel_count; ch += 1)
+        same_gain = same_gain && (channel_gains[ch] == channel_gains[0]);
+    if (same_gain) {
+        // a muted input costs nothing
+        if (channel_gains[0] != 0.0f)
+            mix_add_scaled(out_ptr, in_ptr, channel_gains[0], sample_count);
+        return;
+    }
+
+    float *sample_gains = mixer_context->sample_gains;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            sample_gains[frame * channel_count + ch] = channel_gains[ch];
+    }
+    mix_add_multiplied(out_ptr, in_ptr, sample_gains, sample_count);
+}
+
 static void mixer_run(struct GenesisNode *node) {
     struct MixerContext *mixer_context = (struct MixerContext *)node->userdata;
     struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int input_port_count = mixer_context->input_port_count;
 
     int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
     const struct SoundIoChannelLayout * out_channel_layout = genesis_audio_port_channel_layout(audio_out_port);
     int channel_count = out_channel_layout->channel_count;
 
+    int sides[GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1)
+        sides[ch] = channel_side(out_channel_layout->channels[ch]);
+
     int min_frame_count = output_frame_count;
-    for (int i = 0; i < mixer_context->input_port_count; i += 1) {
+    int interleaved_count = 0;
+    int planar_count = 0;
+    for (int i = 0; i < input_port_count; i += 1) {
         GenesisPort *audio_in_port = genesis_node_port(node, i + 1);
-        mixer_context->read_ptrs[i] = genesis_audio_in_port_read_ptr(audio_in_port);
+        if (genesis_audio_port_format(audio_in_port) == GenesisAudioPortFormatPlanar) {
+            float **channel_ptrs = &mixer_context->channel_read_ptrs[planar_count * GENESIS_MAX_CHANNELS];
+            for (int ch = 0; ch < channel_count; ch += 1)
+                channel_ptrs[ch] = genesis_audio_in_port_channel_read_ptr(audio_in_port, ch);
+            mixer_context->planar_inputs[planar_count] = i;
+            planar_count += 1;
+        } else {
+            mixer_context->read_ptrs[interleaved_count] = genesis_audio_in_port_read_ptr(audio_in_port);
+            mixer_context->interleaved_inputs[interleaved_count] = i;
+            interleaved_count += 1;
+        }
         int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
         min_frame_count = min(min_frame_count, input_frame_count);
     }
 
+    for (int i = 0; i < input_port_count; i += 1) {
+        start_param_cursor(&mixer_context->gain_cursors[i],
+                genesis_node_port(node, 1 + input_port_count + i), min_frame_count);
+        start_param_cursor(&mixer_context->pan_cursors[i],
+                genesis_node_port(node, 1 + input_port_count * 2 + i), min_frame_count);
+    }
+
+    // Mix one block at a time and one input at a time, so that every pass
+    // is a straight run over contiguous samples while the output block is
+    // still in cache.
+    int quantum = genesis_pipeline_get_quantum(genesis_node_pipeline(node));
+    int max_block_frame_count = quantum ? min(quantum, MIX_BLOCK_FRAMES) : MIX_BLOCK_FRAMES;
+    float channel_gains[GENESIS_MAX_CHANNELS];
     float *out_ptr = genesis_audio_out_port_write_ptr(audio_out_port);
-    for (int frame = 0; frame < min_frame_count; frame += 1) {
-        float total[GENESIS_MAX_CHANNELS] = {0.0f};
-        for (int port_i = 0; port_i < mixer_context->input_port_count; port_i += 1) {
-            for (int ch = 0; ch < channel_count; ch += 1) {
-                total[ch] += mixer_context->read_ptrs[port_i][0];
-                mixer_context->read_ptrs[port_i] += 1;
-            }
-        }
+    for (int frame = 0; frame < min_frame_count; frame += max_block_frame_count) {
+        int block_frame_count = min(max_block_frame_count, min_frame_count - frame);
+        int block_sample_count = block_frame_count * channel_count;
+        memset(out_ptr, 0, block_sample_count * sizeof(float));
 
-        for (int ch = 0; ch < channel_count; ch += 1) {
-            out_ptr[0] = total[ch];
-            out_ptr += 1;
+        for (int port_i = 0; port_i < interleaved_count; port_i += 1) {
+            int input_index = mixer_context->interleaved_inputs[port_i];
+            bool gains_constant = read_input_gains(mixer_context, input_index, sides,
+                    channel_count, block_frame_count, channel_gains);
+            mix_interleaved_input(mixer_context, out_ptr, mixer_context->read_ptrs[port_i],
+                    channel_gains, gains_constant, channel_count, block_frame_count);
+            mixer_context->read_ptrs[port_i] += block_sample_count;
+        }
+        for (int port_i = 0; port_i < planar_count; port_i += 1) {
+            int input_index = mixer_context->planar_inputs[port_i];
+            float **channel_ptrs = &mixer_context->channel_read_ptrs[port_i * GENESIS_MAX_CHANNELS];
+            bool gains_constant = read_input_gains(mixer_context, input_index, sides,
+                    channel_count, block_frame_count, channel_gains);
+            if (gains_constant) {
+                mix_add_planar_scaled(out_ptr, channel_ptrs, channel_gains,
+                        channel_count, block_frame_count);
+            } else {
+                mix_add_planar_multiplied(out_ptr, channel_ptrs, mixer_context->sample_gains,
+                        channel_count, block_frame_count);
+            }
+            for (int ch = 0; ch < channel_count; ch += 1)
+                channel_ptrs[ch] += block_frame_count;
         }
+        out_ptr += block_sample_count;
     }
 
     genesis_audio_out_port_advance_write_ptr(audio_out_port, min_frame_count);
-    for (int i = 0; i < mixer_context->input_port_count; i += 1) {
+    for (int i = 0; i < input_port_count; i += 1) {
         GenesisPort *audio_in_port = genesis_node_port(node, i + 1);
         genesis_audio_in_port_advance_read_ptr(audio_in_port, min_frame_count);
     }
 }
 
+static int mixer_input_count(struct GenesisNode *mixer_node) {
+    const GenesisNodeDescriptor *node_descr = genesis_node_descriptor(mixer_node);
+    DescriptorContext *descr_context = (DescriptorContext *)genesis_node_descriptor_userdata(node_descr);
+    return descr_context->input_port_count;
+}
+
+struct GenesisPort *mixer_gain_port(struct GenesisNode *mixer_node, int input_index) {
+    return genesis_node_port(mixer_node, 1 + mixer_input_count(mixer_node) + input_index);
+}
+
+struct GenesisPort *mixer_pan_port(struct GenesisNode *mixer_node, int input_index) {
+    return genesis_node_port(mixer_node, 1 + mixer_input_count(mixer_node) * 2 + input_index);
+}
+
 int create_mixer_descriptor(GenesisPipeline *pipeline, int input_port_count, GenesisNodeDescriptor **out) {
     *out = nullptr;
 
+    // audio out, then the audio in, gain and pan ports of each input
     GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(
-            pipeline, input_port_count + 1, "mixer", "Audio mixer.");
+            pipeline, input_port_count * 3 + 1, "mixer", "Audio mixer.");
     if (!node_descr) {
         genesis_node_descriptor_destroy(node_descr);
         return GenesisErrorNoMem;
@@ -136,6 +373,21 @@ int create_mixer_descriptor(GenesisPipeline *pipeline, int input_port_count, Gen
                 true, 0);
 
         genesis_audio_port_descriptor_set_sample_rate(audio_in_port, target_sample_rate, true, 0);
+        genesis_audio_port_descriptor_set_format(audio_in_port, GenesisAudioPortFormatInterleaved,
+                false, -1);
+
+        sprintf(name, "gain_%d", i);
+        struct GenesisPortDescriptor *gain_port = genesis_node_descriptor_create_port(
+            node_descr, 1 + input_port_count + i, GenesisPortTypeParamIn, name);
+        sprintf(name, "pan_%d", i);
+        struct GenesisPortDescriptor *pan_port = genesis_node_descriptor_create_port(
+            node_descr, 1 + input_port_count * 2 + i, GenesisPortTypeParamIn, name);
+        if (!gain_port || !pan_port) {
+            genesis_node_descriptor_destroy(node_descr);
+            return GenesisErrorNoMem;
+        }
+        genesis_param_port_descriptor_set_range(gain_port, 1.0f, 0.0f, MIXER_MAX_GAIN);
+        genesis_param_port_descriptor_set_range(pan_port, 0.0f, -1.0f, 1.0f);
     }
 
     *out = node_descr;
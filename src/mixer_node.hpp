@@ -3,8 +3,17 @@
 
 #include "genesis.hpp"
 
+// about +12 dB
+static const float MIXER_MAX_GAIN = 4.0f;
+
+// Port 0 is the audio out and ports 1 through input_port_count the audio ins.
+// Each input also has a gain param port, 1.0 by default, and a pan param
+// port from -1.0 (left) to 1.0 (right), 0.0 by default.
 int create_mixer_descriptor(GenesisPipeline *pipeline, int input_port_count,
         GenesisNodeDescriptor **out);
 
+struct GenesisPort *mixer_gain_port(struct GenesisNode *mixer_node, int input_index);
+struct GenesisPort *mixer_pan_port(struct GenesisNode *mixer_node, int input_index);
+
 #endif
 
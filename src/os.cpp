@@ -3,6 +3,8 @@
 #include "random.hpp"
 #include "error.h"
 #include "warning.hpp"
+#include "atomics.hpp"
+#include "hash_map.hpp"
 
 #include <linux/futex.h>
 #include <sys/syscall.h>
@@ -52,11 +54,14 @@
 #include <windows.h>
 #include <mmsystem.h>
 #include <objbase.h>
+#include <malloc.h>
 
 #else
 
 #include <pthread.h>
 #include <unistd.h>
+#include <alloca.h>
+#include <sched.h>
 #include <sys/mman.h>
 #ifndef MAP_ANONYMOUS
 #define MAP_ANONYMOUS MAP_ANON
@@ -136,6 +141,20 @@ static clock_serv_t cclock;
 #endif
 
 static int page_size;
+// bytes of physical memory locked through this file and not yet unlocked
+static atomic_long locked_memory_size;
+
+static uint32_t hash_page(const uintptr_t &page) {
+    return (uint32_t)(page >> 12) * 2654435761u;
+}
+
+// How many ranges locked with os_lock_memory include each page, by page
+// address. mlock does not nest, so a page that two ranges share, such as
+// one holding two small heap allocations, stays locked until both are
+// unlocked, and counts once in locked_memory_size.
+typedef HashMap<uintptr_t, int, hash_page> LockedPageMap;
+static LockedPageMap *locked_pages;
+static struct OsMutex *locked_pages_mutex;
 static RandomState random_state;
 static const mode_t default_dir_mode = 0777;
 
@@ -567,6 +586,47 @@ double os_get_time(void) {
 #endif
 }
 
+uint64_t os_get_time_ns(void) {
+#if defined(GENESIS_OS_WINDOWS)
+    unsigned __int64 time;
+    QueryPerformanceCounter((LARGE_INTEGER*) &time);
+    return (uint64_t)(time * win32_time_resolution * 1000000000.0);
+#elif defined(__MACH__)
+    mach_timespec_t mts;
+
+    kern_return_t err = clock_get_time(cclock, &mts);
+    assert(!err);
+
+    return ((uint64_t)mts.tv_sec) * 1000000000 + (uint64_t)mts.tv_nsec;
+#else
+    struct timespec tms;
+    clock_gettime(CLOCK_MONOTONIC, &tms);
+    return ((uint64_t)tms.tv_sec) * 1000000000 + (uint64_t)tms.tv_nsec;
+#endif
+}
+
+void os_sleep_until_ns(uint64_t time_ns) {
+#if defined(GENESIS_OS_WINDOWS) || defined(__MACH__)
+    uint64_t now = os_get_time_ns();
+    if (time_ns <= now)
+        return;
+    uint64_t duration_ns = time_ns - now;
+#if defined(GENESIS_OS_WINDOWS)
+    Sleep((DWORD)(duration_ns / 1000000));
+#else
+    struct timespec tms;
+    tms.tv_sec = duration_ns / 1000000000;
+    tms.tv_nsec = duration_ns % 1000000000;
+    nanosleep(&tms, nullptr);
+#endif
+#else
+    struct timespec tms;
+    tms.tv_sec = time_ns / 1000000000;
+    tms.tv_nsec = time_ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tms, nullptr) == EINTR) {}
+#endif
+}
+
 #if defined(GENESIS_OS_WINDOWS)
 static DWORD WINAPI run_win32_thread(LPVOID userdata) {
     struct OsThread *thread = (struct OsThread *)userdata;
@@ -685,6 +745,136 @@ void os_thread_destroy(struct OsThread *thread) {
     free(thread);
 }
 
+#if defined(__linux__)
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+// the argument of the sched_setattr and sched_getattr system calls, which
+// glibc did not wrap until recently
+struct LinuxSchedAttr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+#endif
+
+int os_set_thread_policy(const struct GenesisThreadPolicy *policy, int cpu) {
+    bool refused = false;
+    GenesisThreadScheduler scheduler = policy->scheduler;
+    int priority = policy->priority;
+    if (scheduler == GenesisThreadSchedulerDeadline) {
+#if defined(__linux__) && defined(SYS_sched_setattr)
+        LinuxSchedAttr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.sched_policy = SCHED_DEADLINE;
+        attr.sched_runtime = policy->deadline_runtime_ns;
+        attr.sched_deadline = policy->deadline_period_ns;
+        attr.sched_period = policy->deadline_period_ns;
+        if (syscall(SYS_sched_setattr, 0, &attr, 0) == 0)
+            return 0;
+#endif
+        refused = true;
+        scheduler = GenesisThreadSchedulerFifo;
+        priority = 0;
+    }
+
+#if defined(GENESIS_OS_WINDOWS)
+    if (cpu >= 0) {
+        if (cpu >= (int)(sizeof(DWORD_PTR) * 8) ||
+            !SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1) << cpu))
+        {
+            refused = true;
+        }
+    }
+    // Windows has one realtime priority to offer
+    if (scheduler != GenesisThreadSchedulerOther) {
+        if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+            refused = true;
+    }
+#else
+    if (cpu >= 0) {
+#if defined(__linux__)
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        if (cpu >= CPU_SETSIZE) {
+            refused = true;
+        } else {
+            CPU_SET(cpu, &cpu_set);
+            if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set))
+                refused = true;
+        }
+#else
+        // only affinity hints elsewhere
+        refused = true;
+#endif
+    }
+    if (scheduler != GenesisThreadSchedulerOther) {
+        int sched_policy = (scheduler == GenesisThreadSchedulerFifo) ? SCHED_FIFO : SCHED_RR;
+        int min_priority = sched_get_priority_min(sched_policy);
+        int max_priority = sched_get_priority_max(sched_policy);
+        struct sched_param param;
+        param.sched_priority = (priority == 0) ? max_priority :
+            clamp(min_priority, priority, max_priority);
+        if (min_priority == -1 || max_priority == -1 ||
+            pthread_setschedparam(pthread_self(), sched_policy, &param))
+        {
+            refused = true;
+        }
+    }
+#endif
+
+    return refused ? GenesisErrorPermissionDenied : 0;
+}
+
+void os_get_thread_policy(struct GenesisThreadPolicy *out_policy) {
+    memset(out_policy, 0, sizeof(GenesisThreadPolicy));
+#if defined(GENESIS_OS_WINDOWS)
+    if (GetThreadPriority(GetCurrentThread()) == THREAD_PRIORITY_TIME_CRITICAL)
+        out_policy->scheduler = GenesisThreadSchedulerFifo;
+#else
+    int sched_policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &sched_policy, &param))
+        return;
+    if (sched_policy == SCHED_FIFO) {
+        out_policy->scheduler = GenesisThreadSchedulerFifo;
+        out_policy->priority = param.sched_priority;
+    } else if (sched_policy == SCHED_RR) {
+        out_policy->scheduler = GenesisThreadSchedulerRoundRobin;
+        out_policy->priority = param.sched_priority;
+    }
+#if defined(__linux__)
+#if defined(SYS_sched_getattr)
+    if (sched_policy == SCHED_DEADLINE) {
+        LinuxSchedAttr attr;
+        if (syscall(SYS_sched_getattr, 0, &attr, sizeof(attr), 0) == 0) {
+            out_policy->scheduler = GenesisThreadSchedulerDeadline;
+            out_policy->deadline_runtime_ns = attr.sched_runtime;
+            out_policy->deadline_period_ns = attr.sched_period;
+        }
+    }
+#endif
+    cpu_set_t cpu_set;
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set))
+        return;
+    if (CPU_COUNT(&cpu_set) >= sysconf(_SC_NPROCESSORS_ONLN))
+        return;
+    for (int cpu = 0; cpu < CPU_SETSIZE && out_policy->cpu_count < GENESIS_MAX_THREAD_CPUS; cpu += 1) {
+        if (CPU_ISSET(cpu, &cpu_set)) {
+            out_policy->cpus[out_policy->cpu_count] = cpu;
+            out_policy->cpu_count += 1;
+        }
+    }
+#endif
+#endif
+}
+
 struct OsMutex *os_mutex_create(void) {
     struct OsMutex *mutex = allocate_zero<OsMutex>(1);
     if (!mutex) {
@@ -1001,6 +1191,11 @@ static int internal_init(int (*init_once)(void)) {
 #endif
 #endif
 
+    locked_pages = create_zero<LockedPageMap>();
+    locked_pages_mutex = os_mutex_create();
+    if (!locked_pages || !locked_pages_mutex)
+        return GenesisErrorNoMem;
+
     if (init_once && (err = init_once())) {
         return err;
     }
@@ -1157,6 +1352,7 @@ int os_init_mirrored_memory(struct OsMirroredMemory *mem, size_t requested_capac
 #endif
 
     mem->capacity = actual_capacity;
+    mem->locked = false;
     return 0;
 }
 
@@ -1174,9 +1370,151 @@ void os_deinit_mirrored_memory(struct OsMirroredMemory *mem) {
 #else
     int err = munmap(mem->address, 2 * mem->capacity);
     assert(!err);
+#endif
+    // unmapping unlocked it
+    if (mem->locked) {
+        locked_memory_size -= mem->capacity;
+        mem->locked = false;
+    }
+}
+
+static size_t lock_page_size(void) {
+#if defined(GENESIS_OS_WINDOWS)
+    // page_size is the allocation granularity, which is coarser
+    return win32_system_info.dwPageSize;
+#else
+    return page_size;
+#endif
+}
+
+// widens address to address + size to whole pages
+static void page_range(void *address, size_t size, char **out_start, size_t *out_size) {
+    size_t lock_page = lock_page_size();
+    uintptr_t start = (uintptr_t)address & ~(uintptr_t)(lock_page - 1);
+    uintptr_t end = ((uintptr_t)address + size + lock_page - 1) & ~(uintptr_t)(lock_page - 1);
+    *out_start = (char *)start;
+    *out_size = end - start;
+}
+
+// start and size are whole pages. If the lock fails the pages are faulted
+// in by reading them instead.
+static int lock_pages(char *start, size_t size, bool huge_pages) {
+#if defined(GENESIS_OS_WINDOWS)
+    bool locked = VirtualLock(start, size);
+#else
+#if defined(MADV_HUGEPAGE)
+    if (huge_pages)
+        madvise(start, size, MADV_HUGEPAGE);
+#endif
+    bool locked = (mlock(start, size) == 0);
+#endif
+    if (!locked) {
+        size_t lock_page = lock_page_size();
+        for (size_t offset = 0; offset < size; offset += lock_page)
+            (void)*(volatile char *)(start + offset);
+        return GenesisErrorSystemResources;
+    }
+    return 0;
+}
+
+static void unlock_pages(char *start, size_t size) {
+    if (size == 0)
+        return;
+#if defined(GENESIS_OS_WINDOWS)
+    VirtualUnlock(start, size);
+#else
+    munlock(start, size);
 #endif
 }
 
+int os_lock_memory(void *address, size_t size, bool huge_pages) {
+    char *start;
+    size_t range_size;
+    page_range(address, size, &start, &range_size);
+
+    OsMutexLocker locker(locked_pages_mutex);
+    int err;
+    if ((err = lock_pages(start, range_size, huge_pages)))
+        return err;
+
+    size_t lock_page = lock_page_size();
+    for (size_t offset = 0; offset < range_size; offset += lock_page) {
+        uintptr_t page = (uintptr_t)(start + offset);
+        LockedPageMap::Entry *entry = locked_pages->maybe_get(page);
+        if (entry) {
+            entry->value += 1;
+        } else {
+            locked_pages->put(page, 1);
+            locked_memory_size += lock_page;
+        }
+    }
+    return 0;
+}
+
+void os_unlock_memory(void *address, size_t size) {
+    char *start;
+    size_t range_size;
+    page_range(address, size, &start, &range_size);
+
+    OsMutexLocker locker(locked_pages_mutex);
+    // unlocks runs of pages that no other range still needs
+    size_t lock_page = lock_page_size();
+    char *run_start = start;
+    size_t run_size = 0;
+    for (size_t offset = 0; offset < range_size; offset += lock_page) {
+        uintptr_t page = (uintptr_t)(start + offset);
+        LockedPageMap::Entry *entry = locked_pages->maybe_get(page);
+        if (entry && entry->value > 1) {
+            entry->value -= 1;
+        } else if (entry) {
+            locked_pages->remove(page);
+            locked_memory_size -= lock_page;
+            if (run_size == 0)
+                run_start = start + offset;
+            run_size += lock_page;
+            continue;
+        }
+        unlock_pages(run_start, run_size);
+        run_size = 0;
+    }
+    unlock_pages(run_start, run_size);
+}
+
+// The pages of a mirror are its own, so they are not counted per page like
+// os_lock_memory. Both halves map the same memory, so it counts once.
+int os_lock_mirrored_memory(struct OsMirroredMemory *mem, bool huge_pages) {
+    if (mem->locked)
+        return 0;
+    int err;
+    if ((err = lock_pages(mem->address, mem->capacity, huge_pages)))
+        return err;
+    if ((err = lock_pages(mem->address + mem->capacity, mem->capacity, huge_pages))) {
+        unlock_pages(mem->address, mem->capacity);
+        return err;
+    }
+    locked_memory_size += mem->capacity;
+    mem->locked = true;
+    return 0;
+}
+
+int os_lock_stack(size_t size, char **out_address, size_t *out_size) {
+#if defined(GENESIS_OS_WINDOWS)
+    char *stack = (char *)_alloca(size);
+#else
+    char *stack = (char *)alloca(size);
+#endif
+    // write rather than read, so that every page gets its own frame
+    size_t lock_page = lock_page_size();
+    for (size_t offset = 0; offset < size; offset += lock_page)
+        *(volatile char *)(stack + offset) = 0;
+    page_range(stack, size, out_address, out_size);
+    return os_lock_memory(*out_address, *out_size, false);
+}
+
+long os_locked_memory_size(void) {
+    return locked_memory_size.load();
+}
+
 int os_concurrency(void) {
     long cpu_core_count = sysconf(_SC_NPROCESSORS_ONLN);
     if (cpu_core_count <= 0)
@@ -1216,6 +1554,13 @@ int os_futex_wait(int *address, int val) {
     return futex(address, FUTEX_WAIT, val, nullptr, nullptr, 0) ? errno : 0;
 }
 
+int os_futex_wait_timeout(int *address, int val, uint64_t timeout_ns) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ns / 1000000000;
+    timeout.tv_nsec = timeout_ns % 1000000000;
+    return futex(address, FUTEX_WAIT, val, &timeout, nullptr, 0) ? errno : 0;
+}
+
 int os_futex_wake(int *address, int count) {
     return futex(address, FUTEX_WAKE, count, nullptr, nullptr, 0) ? errno : 0;
 }
@@ -32,6 +32,10 @@ uint64_t os_random_uint64(void); // 64 bits of entropy
 double os_random_double(void); // 32 bits of entropy in range [0.0, 1.0)
 void os_open_in_browser(const String &url);
 double os_get_time(void);
+// monotonic, in nanoseconds. for measuring short durations.
+uint64_t os_get_time_ns(void);
+// blocks until os_get_time_ns() reaches time_ns
+void os_sleep_until_ns(uint64_t time_ns);
 String os_get_user_name(void);
 
 int os_delete(const char *path);
@@ -74,6 +78,15 @@ int os_thread_create(
 
 void os_thread_destroy(struct OsThread *thread);
 
+// Applies policy to the calling thread and pins it to core `cpu`, unless cpu
+// is -1. Where the system refuses, it falls back: Deadline to Fifo at the
+// highest priority, Fifo and RoundRobin to Other, and pinning to any core.
+// Returns GenesisErrorPermissionDenied if it had to fall back. policy->cpus
+// is not used.
+int os_set_thread_policy(const struct GenesisThreadPolicy *policy, int cpu);
+// What the calling thread has. cpus is empty if it may run on any core.
+void os_get_thread_policy(struct GenesisThreadPolicy *out_policy);
+
 
 struct OsMutex;
 struct OsMutex *os_mutex_create(void);
@@ -104,6 +117,7 @@ struct OsMirroredMemory {
     size_t capacity;
     char *address;
     void *priv;
+    bool locked;
 };
 
 // returned capacity might be increased from capacity to be a multiple of the
@@ -111,6 +125,25 @@ struct OsMirroredMemory {
 int os_init_mirrored_memory(struct OsMirroredMemory *mem, size_t capacity);
 void os_deinit_mirrored_memory(struct OsMirroredMemory *mem);
 
+// Locks the pages spanning address to address + size into physical memory,
+// faulting them in. huge_pages asks for transparent huge pages first, where
+// the system has them. If the lock fails, for example because of
+// RLIMIT_MEMLOCK, the pages are still faulted in by reading them, and
+// GenesisErrorSystemResources is returned. Ranges may share pages; a page
+// stays locked until every range that locked it has been unlocked.
+int os_lock_memory(void *address, size_t size, bool huge_pages);
+// Only for ranges that os_lock_memory succeeded on.
+void os_unlock_memory(void *address, size_t size);
+// Both halves of the mirror. Unlocked again by os_deinit_mirrored_memory.
+int os_lock_mirrored_memory(struct OsMirroredMemory *mem, bool huge_pages);
+// Faults in and locks the top `size` bytes of the calling thread's stack,
+// below the caller's frame. Unlock the range it returns before the thread
+// exits, since thread stacks can be cached and reused.
+int os_lock_stack(size_t size, char **out_address, size_t *out_size);
+// Bytes of memory the process currently has locked through the functions
+// above. Pages shared by ranges, and the two halves of a mirror, count once.
+long os_locked_memory_size(void);
+
 int os_concurrency(void);
 
 struct OsMutexLocker {
@@ -131,6 +164,8 @@ int os_get_current_year(void);
 void os_spawn_process(const char *exe, const List<ByteBuffer> &args, bool detached);
 
 int os_futex_wait(int *address, int val);
+// Returns ETIMEDOUT if not woken within timeout_ns.
+int os_futex_wait_timeout(int *address, int val, uint64_t timeout_ns);
 int os_futex_wake(int *address, int count);
 
 #endif
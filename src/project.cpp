@@ -1,5 +1,7 @@
 #include "project.hpp"
 #include "audio_graph.hpp"
+#include "asset_variant_cache.hpp"
+#include "warning.hpp"
 
 #include <limits.h>
 
@@ -25,6 +27,7 @@ enum PropKey {
     PropKeyTagAlbumArtist,
     PropKeyTagAlbum,
     PropKeyTagYear,
+    PropKeyTempoChange,
 };
 
 static const int PROP_KEY_SIZE = 4;
@@ -63,6 +66,10 @@ enum SerializableFieldKey {
     SerializableFieldKeyNewSampleRate,
     SerializableFieldKeyOldChannelLayout,
     SerializableFieldKeyNewChannelLayout,
+    SerializableFieldKeyBpm,
+    SerializableFieldKeyTempoChangeId,
+    SerializableFieldKeyOldVolume,
+    SerializableFieldKeyNewVolume,
 };
 
 // modifying this structure affects project file backward compatibility
@@ -297,6 +304,34 @@ static const SerializableField<AudioClipSegment> *get_serializable_fields(AudioC
     return fields;
 }
 
+static const SerializableField<TempoChange> *get_serializable_fields(TempoChange *) {
+    static const SerializableField<TempoChange> fields[] = {
+        {
+            SerializableFieldKeyPos,
+            SerializableFieldTypeDouble,
+            [](TempoChange *tempo_change) -> void * {
+                return &tempo_change->pos;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyBpm,
+            SerializableFieldTypeDouble,
+            [](TempoChange *tempo_change) -> void * {
+                return &tempo_change->bpm;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyInvalid,
+            SerializableFieldTypeInvalid,
+            nullptr,
+            nullptr,
+        },
+    };
+    return fields;
+}
+
 static const SerializableField<Effect> *get_serializable_fields(Effect *) {
     static const SerializableField<Effect> fields[] = {
         {
@@ -657,6 +692,80 @@ static const SerializableField<ChangeChannelLayoutCommand> *get_serializable_fie
     return fields;
 }
 
+static const SerializableField<AddTempoChangeCommand> *get_serializable_fields(AddTempoChangeCommand *) {
+    static const SerializableField<AddTempoChangeCommand> fields[] = {
+        {
+            SerializableFieldKeyTempoChangeId,
+            SerializableFieldTypeUInt256,
+            [](AddTempoChangeCommand *cmd) -> void * {
+                return &cmd->tempo_change_id;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyPos,
+            SerializableFieldTypeDouble,
+            [](AddTempoChangeCommand *cmd) -> void * {
+                return &cmd->pos;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyBpm,
+            SerializableFieldTypeDouble,
+            [](AddTempoChangeCommand *cmd) -> void * {
+                return &cmd->bpm;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyInvalid,
+            SerializableFieldTypeInvalid,
+            nullptr,
+            nullptr,
+        },
+    };
+    return fields;
+}
+
+static const SerializableField<ChangeMixerLineVolumeCommand> *get_serializable_fields(
+        ChangeMixerLineVolumeCommand *)
+{
+    static const SerializableField<ChangeMixerLineVolumeCommand> fields[] = {
+        {
+            SerializableFieldKeyMixerLineId,
+            SerializableFieldTypeUInt256,
+            [](ChangeMixerLineVolumeCommand *cmd) -> void * {
+                return &cmd->mixer_line_id;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyOldVolume,
+            SerializableFieldTypeFloat,
+            [](ChangeMixerLineVolumeCommand *cmd) -> void * {
+                return &cmd->old_volume;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyNewVolume,
+            SerializableFieldTypeFloat,
+            [](ChangeMixerLineVolumeCommand *cmd) -> void * {
+                return &cmd->new_volume;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyInvalid,
+            SerializableFieldTypeInvalid,
+            nullptr,
+            nullptr,
+        },
+    };
+    return fields;
+}
+
 static const SerializableField<UndoCommand> *get_serializable_fields(UndoCommand *) {
     static const SerializableField<UndoCommand> fields[] = {
         {
@@ -1132,6 +1241,11 @@ static int deserialize_from_enum(void *ptr, SerializableFieldType type, const By
                     return deserialize_object(reinterpret_cast<ChangeSampleRateCommand*>(cmd), buffer, offset);
                 case CommandTypeChangeChannelLayout:
                     return deserialize_object(reinterpret_cast<ChangeChannelLayoutCommand*>(cmd), buffer, offset);
+                case CommandTypeAddTempoChange:
+                    return deserialize_object(reinterpret_cast<AddTempoChangeCommand*>(cmd), buffer, offset);
+                case CommandTypeChangeMixerLineVolume:
+                    return deserialize_object(reinterpret_cast<ChangeMixerLineVolumeCommand*>(cmd),
+                            buffer, offset);
             }
             panic("unreachable");
         }
@@ -1242,6 +1356,15 @@ static int compare_audio_clip_segments(AudioClipSegment *a, AudioClipSegment *b)
         return uint256::compare(a->id, b->id);
 }
 
+static int compare_tempo_changes(TempoChange *a, TempoChange *b) {
+    if (a->pos < b->pos)
+        return -1;
+    else if (a->pos > b->pos)
+        return 1;
+    else
+        return uint256::compare(a->id, b->id);
+}
+
 static int compare_effects(Effect *a, Effect *b) {
     int sort_key_cmp = SortKey::compare(a->sort_key, b->sort_key);
     return (sort_key_cmp == 0) ? uint256::compare(a->id, b->id) : sort_key_cmp;
@@ -1307,6 +1430,19 @@ static void project_sort_audio_clip_segments(Project *project) {
     }
 }
 
+static void project_sort_tempo_changes(Project *project) {
+    project_sort_item<TempoChange *, compare_tempo_changes>(project->tempo_change_list, project->tempo_changes);
+
+    List<GenesisTempoChange> *changes = &project->tempo_map_changes;
+    ok_or_panic(changes->resize(project->tempo_change_list.length()));
+    for (int i = 0; i < changes->length(); i += 1) {
+        TempoChange *tempo_change = project->tempo_change_list.at(i);
+        changes->at(i).pos = tempo_change->pos;
+        changes->at(i).bpm = tempo_change->bpm;
+    }
+    ok_or_panic(tempo_map_init(&project->tempo_map, changes->raw(), changes->length()));
+}
+
 static void project_sort_effects(Project *project) {
     for (int i = 0; i < project->mixer_line_list.length(); i += 1) {
         MixerLine *mixer_line = project->mixer_line_list.at(i);
@@ -1340,6 +1476,7 @@ static void project_compute_indexes(Project *project) {
     if (project->audio_asset_list_dirty) project_sort_audio_assets(project);
     if (project->audio_clip_list_dirty) project_sort_audio_clips(project);
     if (project->mixer_line_list_dirty) project_sort_mixer_lines(project);
+    if (project->tempo_changes_dirty) project_sort_tempo_changes(project);
     // depends on tracks being sorted
     if (project->audio_clip_segments_dirty) project_sort_audio_clip_segments(project);
     // depends on mixer lines being sorted
@@ -1377,6 +1514,10 @@ static void project_compute_indexes(Project *project) {
         project->effects_dirty = false;
         trigger_event(project, EventProjectEffectsChanged);
     }
+    if (project->tempo_changes_dirty) {
+        project->tempo_changes_dirty = false;
+        trigger_event(project, EventProjectTempoChanged);
+    }
 }
 
 int project_get_next_revision(Project *project) {
@@ -1713,6 +1854,12 @@ static int deserialize_command(Project *project, const ByteBuffer &key, const By
         case CommandTypeChangeChannelLayout:
             command = create_zero<ChangeChannelLayoutCommand>();
             break;
+        case CommandTypeAddTempoChange:
+            command = create_zero<AddTempoChangeCommand>();
+            break;
+        case CommandTypeChangeMixerLineVolume:
+            command = create_zero<ChangeMixerLineVolumeCommand>();
+            break;
         case CommandTypeUndo:
             command = create_zero<UndoCommand>();
             break;
@@ -1770,6 +1917,34 @@ static int deserialize_undo_stack_item(Project *project, const ByteBuffer &key,
     return 0;
 }
 
+static int deserialize_tempo_change(Project *project, const ByteBuffer &key, const ByteBuffer &value) {
+    TempoChange *tempo_change = create_zero<TempoChange>();
+    if (!tempo_change)
+        return GenesisErrorNoMem;
+
+    int err;
+    if ((err = object_key_to_id(key, &tempo_change->id))) {
+        destroy(tempo_change, 1);
+        return err;
+    }
+
+    int offset = 0;
+    if ((err = deserialize_object(tempo_change, value, &offset))) {
+        destroy(tempo_change, 1);
+        return err;
+    }
+
+    if (!(tempo_change->bpm > 0.0) || tempo_change->pos < 0.0) {
+        destroy(tempo_change, 1);
+        return GenesisErrorInvalidFormat;
+    }
+
+    project->tempo_changes.put(tempo_change->id, tempo_change);
+    project->tempo_changes_dirty = true;
+
+    return 0;
+}
+
 static int read_scalar_byte_buffer(Project *project, PropKey prop_key, ByteBuffer &buffer) {
     buffer.resize(4);
     write_uint32be(buffer.raw(), prop_key);
@@ -1994,6 +2169,14 @@ int project_open(GenesisContext *genesis_context, const char *path, User *user,
         return err;
     }
 
+    // read tempo changes. projects from before the tempo map have none, and
+    // the tempo map still needs building for them.
+    if ((err = iterate_prefix(project, PropKeyTempoChange, deserialize_tempo_change))) {
+        project_close(project);
+        return err;
+    }
+    project->tempo_changes_dirty = true;
+
     // read command history (depends on users)
     err = iterate_prefix(project, PropKeyCommand, deserialize_command);
     if (err) {
@@ -2113,6 +2296,16 @@ int project_create(GenesisContext *genesis_context, const char *path, const uint
     ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyChannelLayout),
                 omf_buf_channel_layout(&project->channel_layout)));
 
+    // Add default tempo
+    TempoChange *tempo_change = ok_mem(create_zero<TempoChange>());
+    tempo_change->id = uint256::random();
+    tempo_change->pos = 0.0;
+    tempo_change->bpm = GENESIS_DEFAULT_BPM;
+    project->tempo_changes.put(tempo_change->id, tempo_change);
+    project->tempo_changes_dirty = true;
+    ok_or_panic(ordered_map_file_batch_put(batch, create_id_key(PropKeyTempoChange, tempo_change->id),
+                omf_buf_obj(tempo_change)));
+
     // Add default project tags
     project->tag_title = "";
     ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyTagTitle),
@@ -2146,6 +2339,11 @@ void project_close(Project *project) {
     if (!project)
         return;
 
+    asset_variant_cache_destroy(project->asset_variant_cache);
+    for (int i = 0; i < project->retired_variant_audio_files.length(); i += 1)
+        genesis_audio_file_destroy(project->retired_variant_audio_files.at(i));
+    for (int i = 0; i < project->audio_asset_list.length(); i += 1)
+        genesis_audio_file_destroy(project->audio_asset_list.at(i)->variant_audio_file);
     ordered_map_file_close(project->omf);
     for (int i = 0; i < project->command_list.length(); i += 1) {
         Command *cmd = project->command_list.at(i);
@@ -2168,6 +2366,10 @@ void project_close(Project *project) {
         }
         destroy(mixer_line, 1);
     }
+    for (int i = 0; i < project->tempo_change_list.length(); i += 1) {
+        TempoChange *tempo_change = project->tempo_change_list.at(i);
+        destroy(tempo_change, 1);
+    }
     destroy(project, 1);
 }
 
@@ -2247,16 +2449,113 @@ void project_delete_track(Project *project, Track *track) {
     project_perform_command(delete_track);
 }
 
+static void get_audio_asset_full_path(Project *project, AudioAsset *audio_asset, ByteBuffer &out_path) {
+    ByteBuffer project_dir = os_path_dirname(project->path);
+    os_path_join(out_path, project_dir, audio_asset->path);
+}
+
 int project_ensure_audio_asset_loaded(Project *project, AudioAsset *audio_asset) {
     if (audio_asset->audio_file)
         return 0;
 
-    ByteBuffer project_dir = os_path_dirname(project->path);
     ByteBuffer full_path;
-    os_path_join(full_path, project_dir, audio_asset->path);
+    get_audio_asset_full_path(project, audio_asset, full_path);
     return genesis_audio_file_load(project->genesis_context, full_path.raw(), &audio_asset->audio_file);
 }
 
+static int request_audio_asset_variant(Project *project, AudioAsset *audio_asset) {
+    int err;
+    if (!project->asset_variant_cache) {
+        ByteBuffer cache_dir;
+        os_path_join(cache_dir, os_path_dirname(project->path), "cache");
+        if ((err = asset_variant_cache_create(project->genesis_context, cache_dir,
+                        &project->asset_variant_cache)))
+        {
+            return err;
+        }
+    }
+
+    ByteBuffer full_path;
+    get_audio_asset_full_path(project, audio_asset, full_path);
+    return asset_variant_cache_request(project->asset_variant_cache, audio_asset->sha256sum,
+            full_path, project->sample_rate);
+}
+
+GenesisAudioFile *project_audio_asset_playback_file(Project *project, AudioAsset *audio_asset) {
+    assert(audio_asset->audio_file);
+    if (genesis_audio_file_sample_rate(audio_asset->audio_file) == project->sample_rate)
+        return audio_asset->audio_file;
+
+    GenesisAudioFile *variant = audio_asset->variant_audio_file;
+    if (variant && genesis_audio_file_sample_rate(variant) == project->sample_rate)
+        return variant;
+
+    if (audio_asset->variant_request_sample_rate != project->sample_rate) {
+        audio_asset->variant_request_sample_rate = project->sample_rate;
+        if (request_audio_asset_variant(project, audio_asset))
+            emit_warning(WarningAssetVariant);
+    }
+    return audio_asset->audio_file;
+}
+
+static void destroy_retired_variants(Project *project) {
+    if (project->asset_variant_hold_count > 0)
+        return;
+    for (int i = 0; i < project->retired_variant_audio_files.length(); i += 1)
+        genesis_audio_file_destroy(project->retired_variant_audio_files.at(i));
+    project->retired_variant_audio_files.clear();
+}
+
+void project_hold_asset_variants(Project *project) {
+    project->asset_variant_hold_count += 1;
+}
+
+void project_release_asset_variants(Project *project) {
+    assert(project->asset_variant_hold_count > 0);
+    project->asset_variant_hold_count -= 1;
+    destroy_retired_variants(project);
+}
+
+bool project_asset_variant_is_retired(Project *project, GenesisAudioFile *audio_file) {
+    for (int i = 0; i < project->retired_variant_audio_files.length(); i += 1) {
+        if (project->retired_variant_audio_files.at(i) == audio_file)
+            return true;
+    }
+    return false;
+}
+
+void project_flush_events(Project *project) {
+    if (!project->asset_variant_cache)
+        return;
+
+    bool changed = false;
+    AssetVariant *variant;
+    while ((variant = asset_variant_cache_take_done(project->asset_variant_cache))) {
+        auto entry = project->audio_assets_by_digest.maybe_get(variant->sha256sum);
+        if (!variant->audio_file) {
+            emit_warning(WarningAssetVariant);
+        } else if (entry && variant->sample_rate == project->sample_rate) {
+            AudioAsset *audio_asset = entry->value;
+            if (audio_asset->variant_audio_file) {
+                ok_or_panic(project->retired_variant_audio_files.append(
+                            audio_asset->variant_audio_file));
+            }
+            audio_asset->variant_audio_file = variant->audio_file;
+            changed = true;
+        } else {
+            genesis_audio_file_destroy(variant->audio_file);
+        }
+        asset_variant_destroy(variant);
+    }
+
+    if (!changed)
+        return;
+
+    // the playback graph lets go of replaced variants as it handles this
+    trigger_event(project, EventProjectAudioAssetVariantsChanged);
+    destroy_retired_variants(project);
+}
+
 int project_add_audio_asset(Project *project, const ByteBuffer &full_path, AudioAsset **out_audio_asset) {
     *out_audio_asset = nullptr;
 
@@ -2423,31 +2722,31 @@ void project_set_channel_layout(Project *project, const SoundIoChannelLayout *la
     project_perform_command(cmd);
 }
 
-// When you finally get around to genericizing this code, take a peek at
-// whole_notes_per_second at the top of genesis.cpp
-static const double whole_notes_per_second = 140.0 / 60.0;
-
-static double project_whole_notes_to_seconds(Project *project, double whole_notes) {
-    return whole_notes / whole_notes_per_second;
+void project_add_tempo_change(Project *project, double pos, double bpm) {
+    AddTempoChangeCommand *cmd = create<AddTempoChangeCommand>(project, pos, bpm);
+    project_perform_command(cmd);
 }
 
-static long project_whole_notes_to_frames(Project *project, double whole_notes) {
-    return project->sample_rate * project_whole_notes_to_seconds(project, whole_notes);
+void project_set_mixer_line_volume(Project *project, MixerLine *mixer_line, float volume) {
+    ChangeMixerLineVolumeCommand *cmd = create<ChangeMixerLineVolumeCommand>(project, mixer_line, volume);
+    project_perform_command(cmd);
 }
 
-static double project_frames_to_whole_notes(Project *project, long frames) {
-    double seconds = frames / (double)project->sample_rate;
-    return whole_notes_per_second * seconds;
+static long project_whole_notes_to_frames(Project *project, double whole_notes) {
+    return project->sample_rate * tempo_map_whole_notes_to_seconds(&project->tempo_map, whole_notes);
 }
 
 double project_get_duration_whole_notes(Project *project) {
     double last_pos = 0.0;
     for (int track_i = 0; track_i < project->track_list.length(); track_i += 1) {
         Track *track = project->track_list.at(track_i);
+        if (track->audio_clip_segments.length() == 0)
+            continue;
         AudioClipSegment *last_segment = track->audio_clip_segments.last();
         long duration_frames = last_segment->end - last_segment->start;
-        double duration_whole_notes = project_frames_to_whole_notes(project, duration_frames);
-        double end_pos = last_segment->pos + duration_whole_notes;
+        double start_seconds = tempo_map_whole_notes_to_seconds(&project->tempo_map, last_segment->pos);
+        double end_seconds = start_seconds + duration_frames / (double)project->sample_rate;
+        double end_pos = tempo_map_seconds_to_whole_notes(&project->tempo_map, end_seconds);
         last_pos = max(last_pos, end_pos);
     }
     return last_pos;
@@ -2681,6 +2980,79 @@ int ChangeChannelLayoutCommand::deserialize(const ByteBuffer &buffer, int *offse
     return deserialize_object(this, buffer, offset);
 }
 
+AddTempoChangeCommand::AddTempoChangeCommand(Project *project, double pos, double bpm) :
+    Command(project),
+    pos(pos),
+    bpm(bpm)
+{
+    tempo_change_id = uint256::random();
+}
+
+void AddTempoChangeCommand::undo(OrderedMapFileBatch *batch) {
+    TempoChange *tempo_change = project->tempo_changes.get(tempo_change_id);
+
+    project->tempo_changes.remove(tempo_change_id);
+    project->tempo_changes_dirty = true;
+
+    ordered_map_file_batch_del(batch, create_id_key(PropKeyTempoChange, tempo_change->id));
+
+    destroy(tempo_change, 1);
+}
+
+void AddTempoChangeCommand::redo(OrderedMapFileBatch *batch) {
+    TempoChange *tempo_change = ok_mem(create_zero<TempoChange>());
+    tempo_change->id = tempo_change_id;
+    tempo_change->pos = pos;
+    tempo_change->bpm = bpm;
+
+    project->tempo_changes.put(tempo_change->id, tempo_change);
+    project->tempo_changes_dirty = true;
+
+    ok_or_panic(ordered_map_file_batch_put(batch,
+                create_id_key(PropKeyTempoChange, tempo_change->id), omf_buf_obj(tempo_change)));
+}
+
+void AddTempoChangeCommand::serialize(ByteBuffer &buf) {
+    serialize_object(this, buf);
+}
+
+int AddTempoChangeCommand::deserialize(const ByteBuffer &buffer, int *offset) {
+    return deserialize_object(this, buffer, offset);
+}
+
+ChangeMixerLineVolumeCommand::ChangeMixerLineVolumeCommand(Project *project,
+        MixerLine *mixer_line, float volume) :
+    Command(project)
+{
+    this->mixer_line_id = mixer_line->id;
+    this->old_volume = mixer_line->volume;
+    this->new_volume = volume;
+}
+
+void ChangeMixerLineVolumeCommand::undo(OrderedMapFileBatch *batch) {
+    MixerLine *mixer_line = project->mixer_lines.get(mixer_line_id);
+    mixer_line->volume = old_volume;
+    project->mixer_line_list_dirty = true;
+    ok_or_panic(ordered_map_file_batch_put(batch, create_mixer_line_key(mixer_line->id),
+                omf_buf_obj(mixer_line)));
+}
+
+void ChangeMixerLineVolumeCommand::redo(OrderedMapFileBatch *batch) {
+    MixerLine *mixer_line = project->mixer_lines.get(mixer_line_id);
+    mixer_line->volume = new_volume;
+    project->mixer_line_list_dirty = true;
+    ok_or_panic(ordered_map_file_batch_put(batch, create_mixer_line_key(mixer_line->id),
+                omf_buf_obj(mixer_line)));
+}
+
+void ChangeMixerLineVolumeCommand::serialize(ByteBuffer &buf) {
+    serialize_object(this, buf);
+}
+
+int ChangeMixerLineVolumeCommand::deserialize(const ByteBuffer &buffer, int *offset) {
+    return deserialize_object(this, buffer, offset);
+}
+
 UndoCommand::UndoCommand(Project *project, Command *other_command) :
     Command(project),
     other_command(other_command)
@@ -8,10 +8,12 @@
 #include "ordered_map_file.hpp"
 #include "event_dispatcher.hpp"
 #include "device_id.hpp"
+#include "tempo_map.hpp"
 
 class Command;
 struct AudioClipSegment;
 struct Project;
+struct AssetVariantCache;
 
 struct AudioAsset {
     // canonical data
@@ -21,6 +23,12 @@ struct AudioAsset {
 
     // prepared view of data
     GenesisAudioFile *audio_file;
+    // audio_file at the project sample rate, once the asset variant cache
+    // has made it
+    GenesisAudioFile *variant_audio_file;
+    // the sample rate the last variant was asked for, so that it is asked
+    // for once
+    int variant_request_sample_rate;
 };
 
 struct AudioClip {
@@ -65,6 +73,13 @@ struct User {
     String name;
 };
 
+struct TempoChange {
+    // canonical data
+    uint256 id;
+    double pos; // in whole notes
+    double bpm; // whole notes per minute
+};
+
 struct Effect;
 
 struct MixerLine {
@@ -128,6 +143,7 @@ struct Project {
     IdMap<User *> users;
     IdMap<MixerLine *> mixer_lines;
     IdMap<Effect *> effects;
+    IdMap<TempoChange *> tempo_changes;
     SoundIoChannelLayout channel_layout;
     int sample_rate;
     String tag_title;
@@ -169,12 +185,24 @@ struct Project {
     List<MixerLine *> mixer_line_list;
     bool mixer_line_list_dirty;
 
+    List<TempoChange *> tempo_change_list;
+    // tempo_change_list as genesis_pipeline_set_tempo_map takes it
+    List<GenesisTempoChange> tempo_map_changes;
+    TempoMap tempo_map;
+    bool tempo_changes_dirty;
+
     ////////// transient state
     GenesisContext *genesis_context;
     User *active_user; // the user that is running this instance of genesis
     OrderedMapFile *omf;
     EventDispatcher events;
     ByteBuffer path; // path to the project file
+    // made on the first variant request
+    AssetVariantCache *asset_variant_cache;
+    // replaced variants, kept while a render that may still be reading them
+    // holds the asset variants
+    List<GenesisAudioFile *> retired_variant_audio_files;
+    int asset_variant_hold_count;
 };
 
 int project_get_next_revision(Project *project);
@@ -189,6 +217,8 @@ enum CommandType {
     CommandTypeAddAudioClipSegment,
     CommandTypeChangeSampleRate,
     CommandTypeChangeChannelLayout,
+    CommandTypeAddTempoChange,
+    CommandTypeChangeMixerLineVolume,
 };
 
 class Command {
@@ -371,6 +401,58 @@ public:
     SoundIoChannelLayout new_layout;
 };
 
+class AddTempoChangeCommand : public Command {
+public:
+    AddTempoChangeCommand(Project *project, double pos, double bpm);
+    AddTempoChangeCommand() {}
+    ~AddTempoChangeCommand() override {}
+
+    String description() const override {
+        ByteBuffer desc;
+        desc.format("Change Tempo to %g BPM", bpm);
+        return desc;
+    }
+    int allocated_size() const override {
+        return sizeof(AddTempoChangeCommand);
+    }
+
+    void undo(OrderedMapFileBatch *batch) override;
+    void redo(OrderedMapFileBatch *batch) override;
+    void serialize(ByteBuffer &buf) override;
+    int deserialize(const ByteBuffer &buf, int *offset) override;
+    CommandType command_type() const override { return CommandTypeAddTempoChange; }
+
+    uint256 tempo_change_id;
+    double pos;
+    double bpm;
+};
+
+class ChangeMixerLineVolumeCommand : public Command {
+public:
+    ChangeMixerLineVolumeCommand(Project *project, MixerLine *mixer_line, float volume);
+    ChangeMixerLineVolumeCommand() {}
+    ~ChangeMixerLineVolumeCommand() override {}
+
+    String description() const override {
+        ByteBuffer desc;
+        desc.format("Change Volume from %g to %g", old_volume, new_volume);
+        return desc;
+    }
+    int allocated_size() const override {
+        return sizeof(ChangeMixerLineVolumeCommand);
+    }
+
+    void undo(OrderedMapFileBatch *batch) override;
+    void redo(OrderedMapFileBatch *batch) override;
+    void serialize(ByteBuffer &buf) override;
+    int deserialize(const ByteBuffer &buf, int *offset) override;
+    CommandType command_type() const override { return CommandTypeChangeMixerLineVolume; }
+
+    uint256 mixer_line_id;
+    float old_volume;
+    float new_volume;
+};
+
 class UndoCommand : public Command {
 public:
     UndoCommand(Project *project, Command *other_command);
@@ -450,6 +532,17 @@ void project_add_audio_clip_segment(Project *project, AudioClip *audio_clip, Tra
         long start, long end, double pos);
 
 int project_ensure_audio_asset_loaded(Project *project, AudioAsset *audio_asset);
+// The audio to play for a loaded audio asset: its variant at the project
+// sample rate if that is done, otherwise the asset itself, and then the
+// variant is asked for.
+GenesisAudioFile *project_audio_asset_playback_file(Project *project, AudioAsset *audio_asset);
+// Takes in the asset variants that are done. Call from the main thread.
+void project_flush_events(Project *project);
+// A render reads the asset variants it started with to the end, so while it
+// holds them the variants that get replaced are not destroyed.
+void project_hold_asset_variants(Project *project);
+void project_release_asset_variants(Project *project);
+bool project_asset_variant_is_retired(Project *project, GenesisAudioFile *audio_file);
 long project_audio_clip_frame_count(Project *project, AudioClip *audio_clip);
 int project_audio_clip_sample_rate(Project *project, AudioClip *audio_clip);
 
@@ -457,6 +550,9 @@ void project_get_effect_string(Project *project, Effect *effect, String &result)
 
 void project_set_sample_rate(Project *project, int sample_rate);
 void project_set_channel_layout(Project *project, const SoundIoChannelLayout *layout);
+// the tempo from pos until the next tempo change
+void project_add_tempo_change(Project *project, double pos, double bpm);
+void project_set_mixer_line_volume(Project *project, MixerLine *mixer_line, float volume);
 
 double project_get_duration_whole_notes(Project *project);
 long project_get_duration_frames(Project *project);
@@ -39,7 +39,7 @@ void render_job_start(RenderJob *rj, const GenesisExportFormat *export_format,
 
     rj->audio_graph->events.attach_handler(EventAudioGraphPlayHeadChanged, on_render_job_updated, rj);
 
-    audio_graph_start_pipeline(rj->audio_graph);
+    audio_graph_start_render(rj->audio_graph);
 }
 
 void render_job_stop(RenderJob *rj) {
@@ -1,28 +1,80 @@
 #include "resample.hpp"
 #include "audio_file.hpp"
 #include "util.hpp"
+#include "mix_kernels.hpp"
+#include "channel_remap.hpp"
 
 static const double PI = 3.14159265358979323846;
-static const double transition_band_hz = 800.0;
+
+enum ResampleFilter {
+    ResampleFilterLinear,
+    ResampleFilterCubic,
+    ResampleFilterSinc,
+};
+
+// Each quality is a node descriptor of its own. They all run the same
+// polyphase filter; only the filter differs.
+struct ResampleQuality {
+    const char *name;
+    const char *description;
+    ResampleFilter filter;
+    // Sinc filters only. The transition band is transition_band_hz wide,
+    // or if that is 0, transition_band_ratio times the lower sample rate.
+    // Each side of the filter is 2 / transition band seconds long.
+    double transition_band_hz;
+    double transition_band_ratio;
+};
+
+static const ResampleQuality resample_qualities[] = {
+    {"resample_linear", "Resample audio with linear interpolation and remap channel layouts.",
+        ResampleFilterLinear, 0.0, 0.0},
+    {"resample_cubic", "Resample audio with cubic interpolation and remap channel layouts.",
+        ResampleFilterCubic, 0.0, 0.0},
+    {"resample_sinc", "Resample audio with a short sinc filter and remap channel layouts.",
+        ResampleFilterSinc, 0.0, 0.25},
+    {"resample", "Resample audio and remap channel layouts.",
+        ResampleFilterSinc, 800.0, 0.0},
+};
 
 static const double lfe_mix_level = 1.0;
 static const double surround_mix_level = 1.0;
 
+// Input frames are channel remapped this many at a time.
+static const int REMAP_BLOCK_FRAMES = 1024;
+
 struct ResampleContext {
+    const ResampleQuality *quality;
+
     bool in_connected;
     bool out_connected;
 
-    long over_offset;
-
     long upsample_factor;
     long downsample_factor;
 
-    float *impulse_response;
-    int impulse_response_size;
-
-    long oversampled_rate;
+    // The low-pass filter split into upsample_factor phases of taps_per_phase
+    // taps each, one per position of an output frame between two input
+    // frames. Each phase is stored back to front, so that it lines up with
+    // the input frames it multiplies in the order they come in.
+    float *phases;
+    int phase_count;
+    int taps_per_phase;
+
+    // Input frames after channel remapping, one row of remapped_stride
+    // floats per output channel. The first taps_per_phase - 1 frames are
+    // history from earlier runs, zeroes after a seek.
+    float *remapped;
+    int remapped_stride;
+    int remapped_channel_count;
+    int remapped_frame_count;
+
+    // Where the next output frame is, in oversampled frames from the first
+    // remapped frame, plus half the filter length; the last input frame it
+    // needs is filter_pos / upsample_factor.
+    long filter_pos;
+    long half_window_size;
 
     float channel_matrix[GENESIS_CHANNEL_ID_COUNT][GENESIS_CHANNEL_ID_COUNT];
+    ChannelRemap channel_remap;
 };
 
 static double sinc(double x) {
@@ -35,10 +87,33 @@ static double blackman_window(double n, double size) {
         0.08 * cos(4.0 * PI * n / (size - 1.0));
 }
 
+// distance is in input frames
+static double linear_kernel(double distance) {
+    distance = fabs(distance);
+    return (distance < 1.0) ? (1.0 - distance) : 0.0;
+}
+
+// Catmull-Rom spline
+static double cubic_kernel(double distance) {
+    distance = fabs(distance);
+    if (distance < 1.0)
+        return (1.5 * distance - 2.5) * distance * distance + 1.0;
+    else if (distance < 2.0)
+        return ((-0.5 * distance + 2.5) * distance - 4.0) * distance + 2.0;
+    else
+        return 0.0;
+}
+
+static double sinc_transition_band_hz(const ResampleQuality *quality, int min_sample_rate) {
+    return (quality->transition_band_hz > 0.0) ?
+        quality->transition_band_hz : quality->transition_band_ratio * min_sample_rate;
+}
+
 static void resample_destroy(struct GenesisNode *node) {
     struct ResampleContext *resample_context = (struct ResampleContext *)node->userdata;
     if (resample_context) {
-        destroy(resample_context->impulse_response, resample_context->impulse_response_size);
+        destroy(resample_context->phases, 0);
+        destroy(resample_context->remapped, 0);
         destroy(resample_context, 1);
     }
 }
@@ -50,25 +125,128 @@ static int resample_create(struct GenesisNode *node) {
         resample_destroy(node);
         return GenesisErrorNoMem;
     }
+    resample_context->quality = (const ResampleQuality *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    genesis_node_set_userdata_size(node, sizeof(ResampleContext));
+    // No latency to declare: the filter starts half a window ahead, see
+    // reset_filter, so each output frame is centered on its own time in
+    // the input. The filter waits for more input instead of delaying it.
     return 0;
 }
 
+static void reset_filter(ResampleContext *resample_context) {
+    if (!resample_context->phases)
+        return;
+    int history_frame_count = resample_context->taps_per_phase - 1;
+    for (int ch = 0; ch < resample_context->remapped_channel_count; ch += 1) {
+        float *channel = resample_context->remapped + ch * resample_context->remapped_stride;
+        memset(channel, 0, history_frame_count * sizeof(float));
+    }
+    resample_context->remapped_frame_count = history_frame_count;
+    resample_context->filter_pos = resample_context->half_window_size +
+        history_frame_count * resample_context->upsample_factor;
+}
+
 static void resample_seek(struct GenesisNode *node) {
     struct ResampleContext *resample_context = (struct ResampleContext *)node->userdata;
-    resample_context->over_offset = 0;
+    reset_filter(resample_context);
 }
 
-static float get_channel_value(float *samples, ResampleContext *resample_context,
-        const struct SoundIoChannelLayout *in_layout,
-        const struct SoundIoChannelLayout *out_layout,
-        int in_frame_index, int out_channel_index)
+// Remaps frame_count input frames starting at in_frame_index onto the end
+// of the remapped frames.
+static void remap_frames(ResampleContext *resample_context, float **in_bufs, int in_stride,
+        int in_channel_count, int in_frame_index, int frame_count)
 {
-    float sum = 0.0f;
-    for (int in_ch = 0; in_ch < in_layout->channel_count; in_ch += 1) {
-        float in_sample = samples[in_frame_index * in_layout->channel_count + in_ch];
-        sum += resample_context->channel_matrix[out_channel_index][in_ch] * in_sample;
+    float *in_ptrs[GENESIS_MAX_CHANNELS];
+    for (int in_ch = 0; in_ch < in_channel_count; in_ch += 1)
+        in_ptrs[in_ch] = in_bufs[in_ch] + in_frame_index * in_stride;
+    float *out_ptrs[GENESIS_MAX_CHANNELS];
+    for (int out_ch = 0; out_ch < resample_context->remapped_channel_count; out_ch += 1) {
+        out_ptrs[out_ch] = resample_context->remapped + out_ch * resample_context->remapped_stride +
+            resample_context->remapped_frame_count;
+    }
+    channel_remap_run(&resample_context->channel_remap, in_ptrs, in_stride, out_ptrs, 1, frame_count);
+    resample_context->remapped_frame_count += frame_count;
+}
+
+// Drops the remapped frames that no output frame still to come reads.
+static void drop_used_frames(ResampleContext *resample_context) {
+    long first_needed = resample_context->filter_pos / resample_context->upsample_factor -
+        (resample_context->taps_per_phase - 1);
+    int drop_count = min((long)resample_context->remapped_frame_count, first_needed);
+    if (drop_count <= 0)
+        return;
+    int keep_count = resample_context->remapped_frame_count - drop_count;
+    for (int ch = 0; ch < resample_context->remapped_channel_count; ch += 1) {
+        float *channel = resample_context->remapped + ch * resample_context->remapped_stride;
+        memmove(channel, channel + drop_count, keep_count * sizeof(float));
     }
-    return sum;
+    resample_context->remapped_frame_count = keep_count;
+    resample_context->filter_pos -= drop_count * resample_context->upsample_factor;
+}
+
+// Filters input_frame_count planar input frames into at most
+// output_frame_count interleaved output frames, taking only the input that
+// the output space needs. Returns how many of each it used.
+static void filter_frames(ResampleContext *resample_context, float **in_bufs, int in_stride,
+        int in_channel_count, int input_frame_count, float *out_buf, int output_frame_count,
+        int *out_in_frame_count, int *out_out_frame_count)
+{
+    // Output frame n sits at n * downsample_factor in the oversampled rate
+    // and input frame k at k * upsample_factor. Which phase of the filter an
+    // output frame takes depends only on where it falls between two input
+    // frames, and the phase's taps multiply consecutive input frames.
+    long upsample_factor = resample_context->upsample_factor;
+    long downsample_factor = resample_context->downsample_factor;
+    int taps_per_phase = resample_context->taps_per_phase;
+    int remapped_capacity = resample_context->remapped_stride;
+    int out_channel_count = resample_context->remapped_channel_count;
+    int in_frame_count = 0;
+    int out_frame_count = 0;
+    for (;;) {
+        // take only the input the free output space needs
+        int want_frame_count = 0;
+        int out_free_count = output_frame_count - out_frame_count;
+        if (out_free_count > 0) {
+            long last_pos = resample_context->filter_pos + (out_free_count - 1) * downsample_factor;
+            long needed = last_pos / upsample_factor + 1 - resample_context->remapped_frame_count;
+            want_frame_count = max(0L, needed);
+        }
+        int take_count = min(min(input_frame_count - in_frame_count, want_frame_count),
+                remapped_capacity - resample_context->remapped_frame_count);
+        if (take_count > 0) {
+            remap_frames(resample_context, in_bufs, in_stride, in_channel_count,
+                    in_frame_count, take_count);
+            in_frame_count += take_count;
+        }
+
+        int block_out_count = 0;
+        while (out_frame_count < output_frame_count) {
+            long last_in_frame = resample_context->filter_pos / upsample_factor;
+            if (last_in_frame >= resample_context->remapped_frame_count)
+                break;
+            int phase = resample_context->filter_pos % upsample_factor;
+            const float *taps = resample_context->phases + phase * taps_per_phase;
+            long first_in_frame = last_in_frame - (taps_per_phase - 1);
+            float *out_frame = out_buf + out_frame_count * out_channel_count;
+            for (int ch = 0; ch < out_channel_count; ch += 1) {
+                const float *in_ptr = resample_context->remapped +
+                    ch * resample_context->remapped_stride + first_in_frame;
+                out_frame[ch] = mix_dot_product(taps, in_ptr, taps_per_phase);
+            }
+            resample_context->filter_pos += downsample_factor;
+            out_frame_count += 1;
+            block_out_count += 1;
+        }
+
+        drop_used_frames(resample_context);
+
+        if (take_count == 0 && block_out_count == 0)
+            break;
+    }
+
+    *out_in_frame_count = in_frame_count;
+    *out_out_frame_count = out_frame_count;
 }
 
 static void resample_run(struct GenesisNode *node) {
@@ -84,86 +262,125 @@ static void resample_run(struct GenesisNode *node) {
 
     int out_channel_count = out_channel_layout->channel_count;
 
-    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    // the input may be planar or interleaved
+    int in_stride = genesis_audio_port_channel_stride(audio_in_port);
+    float *in_bufs[GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < in_channel_layout->channel_count; ch += 1)
+        in_bufs[ch] = genesis_audio_in_port_channel_read_ptr(audio_in_port, ch);
     float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
 
-    if (!resample_context->impulse_response) {
+    if (!resample_context->phases) {
         // no resampling; only channel remapping
         int frame_count = min(input_frame_count, output_frame_count);
-        for (int frame = 0; frame < frame_count; frame += 1) {
-            for (int ch = 0; ch < out_channel_count; ch += 1) {
-                out_buf[frame * out_channel_count + ch] = get_channel_value(in_buf,
-                        resample_context, in_channel_layout, out_channel_layout, frame, ch);
-            }
-        }
+        float *out_ptrs[GENESIS_MAX_CHANNELS];
+        for (int ch = 0; ch < out_channel_count; ch += 1)
+            out_ptrs[ch] = out_buf + ch;
+        channel_remap_run(&resample_context->channel_remap, in_bufs, in_stride,
+                out_ptrs, out_channel_count, frame_count);
         genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
         genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
         return;
     }
 
-    // pretend that we have upsampled the input to the oversample rate by adding zeroes
-    // now low-pass filter using our impulse response window
-
-    int window_size = resample_context->impulse_response_size;
-    int half_window_size = window_size / 2;
-
-    // compute available input start and end in oversample coordinates
-    long over_input_start = resample_context->over_offset;
-    long over_input_end = over_input_start + input_frame_count * resample_context->upsample_factor;
-
-    // compute available output start and end in oversample coordinates
-    long over_output_start = resample_context->over_offset;
-    long over_output_end = over_output_start + output_frame_count * resample_context->downsample_factor;
+    int in_frame_count;
+    int out_frame_count;
+    filter_frames(resample_context, in_bufs, in_stride, in_channel_layout->channel_count,
+            input_frame_count, out_buf, output_frame_count, &in_frame_count, &out_frame_count);
 
-    long over_actual_input_end = over_input_end - half_window_size;
-
-    if (over_actual_input_end <= over_output_start)
-        return;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, in_frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, out_frame_count);
+}
 
-    long over_actual_output_end = min(over_output_end, over_actual_input_end);
-    long over_out_count = over_actual_output_end - over_output_start;
-    assert(over_out_count > 0);
+// Sets up the filter from in_sample_rate to out_sample_rate for
+// channel_count channels after remapping. Equal rates need no filter.
+static int init_filter(ResampleContext *resample_context, int in_sample_rate, int out_sample_rate,
+        int channel_count)
+{
+    int gcd = greatest_common_denominator(in_sample_rate, out_sample_rate);
+    resample_context->upsample_factor = out_sample_rate / gcd;
+    resample_context->downsample_factor = in_sample_rate / gcd;
 
-    // actual output frame count in output sample rate coordinates
-    int out_frame_count = over_out_count / resample_context->downsample_factor;
-    assert(out_frame_count >= 0);
-    if (out_frame_count == 0)
-        return;
+    long oversampled_rate = in_sample_rate * resample_context->upsample_factor;
+
+    destroy(resample_context->phases, 0);
+    resample_context->phases = nullptr;
+    destroy(resample_context->remapped, 0);
+    resample_context->remapped = nullptr;
+
+    if (in_sample_rate != out_sample_rate) {
+        const ResampleQuality *quality = resample_context->quality;
+        int phase_count = resample_context->upsample_factor;
+        int min_sample_rate = min(in_sample_rate, out_sample_rate);
+
+        // in oversampled frames, and always odd so that the middle tap falls
+        // on an output frame
+        int window_size;
+        switch (quality->filter) {
+            case ResampleFilterLinear:
+                window_size = 2 * phase_count - 1;
+                break;
+            case ResampleFilterCubic:
+                window_size = 4 * phase_count - 1;
+                break;
+            case ResampleFilterSinc:
+            default:
+                {
+                    double transition_band = sinc_transition_band_hz(quality, min_sample_rate) /
+                        oversampled_rate;
+                    window_size = ceil(4.0 / transition_band);
+                    window_size += !(window_size % 2);
+                    break;
+                }
+        }
 
-    int in_frame_count = over_out_count / resample_context->upsample_factor;
+        int taps_per_phase = (window_size + phase_count - 1) / phase_count;
+        int remapped_stride = taps_per_phase - 1 + REMAP_BLOCK_FRAMES;
 
-    for (long frame = 0; frame < out_frame_count; frame += 1) {
-        long over_frame = resample_context->over_offset + (frame * resample_context->downsample_factor);
-        // calculate this oversampled frame
-        float total[GENESIS_MAX_CHANNELS] = {0.0f};
+        resample_context->phases = allocate_zero<float>(phase_count * taps_per_phase);
+        resample_context->remapped = allocate_zero<float>(channel_count * remapped_stride);
+        if (!resample_context->phases || !resample_context->remapped)
+            return GenesisErrorNoMem;
 
-        int impulse_start = resample_context->upsample_factor - (((over_frame - half_window_size) +
-                (resample_context->upsample_factor * half_window_size)) % resample_context->upsample_factor);
-        for (int impulse_i = impulse_start; impulse_i < window_size;
-                impulse_i += resample_context->upsample_factor)
-        {
-            long over_in_index = over_frame + (impulse_i - half_window_size);
-            int in_index = (over_in_index - resample_context->over_offset) / resample_context->upsample_factor;
-            if (in_index < 0)
-                continue;
-            for (int ch = 0; ch < out_channel_count; ch += 1) {
-                float over_value = get_channel_value(in_buf, resample_context,
-                        in_channel_layout, out_channel_layout, in_index, ch);
-                int impulse_response_index = window_size - impulse_i - 1;
-                total[ch] += resample_context->impulse_response[impulse_response_index] * over_value;
+        resample_context->phase_count = phase_count;
+        resample_context->taps_per_phase = taps_per_phase;
+        resample_context->remapped_stride = remapped_stride;
+        resample_context->remapped_channel_count = channel_count;
+        resample_context->half_window_size = window_size / 2;
+
+        // The interpolating filters weigh the input frames around an output
+        // frame by distance. The sinc filter samples the sinc function,
+        // multiplies by the blackman window, and scales so that each phase
+        // passes DC at unity gain when downsampling too. Taps past the end of
+        // the window stay zero.
+        double cutoff_freq_float = min_sample_rate / 2.0 / (double)oversampled_rate;
+        double gain = min_sample_rate / (double)in_sample_rate;
+        double center = (window_size - 1) / 2.0;
+        for (int phase = 0; phase < phase_count; phase += 1) {
+            float *taps = resample_context->phases + phase * taps_per_phase;
+            for (int tap = 0; tap < taps_per_phase; tap += 1) {
+                int i = phase + (taps_per_phase - 1 - tap) * phase_count;
+                if (i >= window_size)
+                    continue;
+                double distance = (i - center) / phase_count;
+                switch (quality->filter) {
+                    case ResampleFilterLinear:
+                        taps[tap] = linear_kernel(distance);
+                        break;
+                    case ResampleFilterCubic:
+                        taps[tap] = cubic_kernel(distance);
+                        break;
+                    case ResampleFilterSinc:
+                        taps[tap] = gain * sinc(2.0 * cutoff_freq_float * (i - center)) *
+                            blackman_window(i, window_size);
+                        break;
+                }
             }
         }
-        for (int ch = 0; ch < out_channel_count; ch += 1) {
-            int out_sample_index = frame * out_channel_count + ch;
-            out_buf[out_sample_index] = total[ch];
-        }
-    }
 
-    genesis_audio_in_port_advance_read_ptr(audio_in_port, in_frame_count);
-    genesis_audio_out_port_advance_write_ptr(audio_out_port, out_frame_count);
+        reset_filter(resample_context);
+    }
 
-    resample_context->over_offset = (resample_context->over_offset +
-            out_frame_count * resample_context->downsample_factor) % resample_context->oversampled_rate;
+    return 0;
 }
 
 static int port_connected(struct GenesisNode *node) {
@@ -177,40 +394,11 @@ static int port_connected(struct GenesisNode *node) {
     int in_sample_rate = genesis_audio_port_sample_rate(audio_in_port);
     int out_sample_rate = genesis_audio_port_sample_rate(audio_out_port);
 
-    int gcd = greatest_common_denominator(in_sample_rate, out_sample_rate);
-    resample_context->upsample_factor = out_sample_rate / gcd;
-    resample_context->downsample_factor = in_sample_rate / gcd;
-
-    resample_context->oversampled_rate = in_sample_rate * resample_context->upsample_factor;
-
-    if (in_sample_rate == out_sample_rate) {
-        destroy(resample_context->impulse_response, resample_context->impulse_response_size);
-        resample_context->impulse_response = nullptr;
-    } else {
-        double cutoff_freq_hz = min(in_sample_rate, out_sample_rate) / 2.0;
-        double cutoff_freq_float = cutoff_freq_hz / (double)resample_context->oversampled_rate;
-
-        double transition_band = transition_band_hz / resample_context->oversampled_rate;
-        int window_size = ceil(4.0 / transition_band);
-        window_size += !(window_size % 2);
-
-        float *new_impulse_response = reallocate_safe(resample_context->impulse_response,
-                resample_context->impulse_response_size, window_size);
-
-        if (!new_impulse_response)
-            return GenesisErrorNoMem;
-
-        resample_context->impulse_response = new_impulse_response;
-        resample_context->impulse_response_size = window_size;
-
-        // create impulse response by sampling the sinc function and then
-        // multiplying by the blackman window
-        for (int i = 0; i < window_size; i += 1) {
-            // sample the sinc function
-            double sinc_sample = sinc(2.0 * cutoff_freq_float * (i - (window_size - 1) / 2.0));
-            double sample = sinc_sample * blackman_window(i, window_size);
-            resample_context->impulse_response[i] = sample;
-        }
+    int err;
+    if ((err = init_filter(resample_context, in_sample_rate, out_sample_rate,
+                    genesis_audio_port_channel_layout(audio_out_port)->channel_count)))
+    {
+        return err;
     }
 
     // set up channel matrix
@@ -381,6 +569,9 @@ static int port_connected(struct GenesisNode *node) {
         }
     }
 
+    channel_remap_init(&resample_context->channel_remap, resample_context->channel_matrix,
+            in_channel_layout->channel_count, out_channel_layout->channel_count);
+
     return 0;
 }
 
@@ -410,15 +601,43 @@ static void out_disconnect(struct GenesisPort *port, struct GenesisPort *other_p
     resample_context->out_connected = false;
 }
 
-int create_resample_descriptor(GenesisPipeline *pipeline) {
+// How far ahead of its output a node reads, and how many multiply-adds it
+// spends per output sample, when upsampling from sample_rate.
+static void get_quality_cost(const ResampleQuality *quality, int sample_rate,
+        double *latency, double *ops_per_sample)
+{
+    switch (quality->filter) {
+        case ResampleFilterLinear:
+            *latency = 1.0 / sample_rate;
+            *ops_per_sample = 2.0;
+            return;
+        case ResampleFilterCubic:
+            *latency = 2.0 / sample_rate;
+            *ops_per_sample = 4.0;
+            return;
+        case ResampleFilterSinc:
+            {
+                double transition_band_hz = sinc_transition_band_hz(quality, sample_rate);
+                *latency = 2.0 / transition_band_hz;
+                *ops_per_sample = ceil(4.0 * sample_rate / transition_band_hz);
+                return;
+            }
+    }
+    panic("invalid resample filter");
+}
+
+static int create_resample_quality_descriptor(GenesisPipeline *pipeline,
+        const ResampleQuality *quality)
+{
     GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2,
-            "resample", "Resample audio and remap channel layouts.");
+            quality->name, quality->description);
 
     if (!node_descr) {
         genesis_node_descriptor_destroy(node_descr);
         return GenesisErrorNoMem;
     }
 
+    genesis_node_descriptor_set_userdata(node_descr, (void *)quality);
     genesis_node_descriptor_set_run_callback(node_descr, resample_run);
     genesis_node_descriptor_set_create_callback(node_descr, resample_create);
     genesis_node_descriptor_set_destroy_callback(node_descr, resample_destroy);
@@ -441,14 +660,148 @@ int create_resample_descriptor(GenesisPipeline *pipeline) {
 
     int default_sample_rate = genesis_pipeline_get_sample_rate(pipeline);
 
+    double latency;
+    double ops_per_sample;
+    get_quality_cost(quality, default_sample_rate, &latency, &ops_per_sample);
+    genesis_node_descriptor_set_cost(node_descr, latency, ops_per_sample);
+
     const struct SoundIoChannelLayout *mono_layout =
         soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
 
     genesis_audio_port_descriptor_set_channel_layout(audio_in_port, mono_layout, false, -1);
     genesis_audio_port_descriptor_set_sample_rate(audio_in_port, default_sample_rate, false, -1);
+    genesis_audio_port_descriptor_set_format(audio_in_port, GenesisAudioPortFormatInterleaved, false, -1);
 
     genesis_audio_port_descriptor_set_channel_layout(audio_out_port, mono_layout, false, -1);
     genesis_audio_port_descriptor_set_sample_rate(audio_out_port, default_sample_rate, false, -1);
 
     return 0;
 }
+
+int create_resample_descriptor(GenesisPipeline *pipeline) {
+    for (int i = 0; i < array_length(resample_qualities); i += 1) {
+        int err;
+        if ((err = create_resample_quality_descriptor(pipeline, &resample_qualities[i])))
+            return err;
+    }
+    return 0;
+}
+
+// Output frames are made this many at a time before they are split into
+// the channels of the output file.
+static const int OFFLINE_BLOCK_FRAMES = 4096;
+
+// Filters all of in_file into audio_file, whose channels are already
+// sized for it.
+static void filter_audio_file(ResampleContext *resample_context, GenesisAudioFile *in_file,
+        GenesisAudioFile *audio_file, float *zeroes, float *out_block)
+{
+    int channel_count = in_file->channel_layout.channel_count;
+    long in_frame_total = genesis_audio_file_frame_count(in_file);
+    long out_frame_total = genesis_audio_file_frame_count(audio_file);
+
+    // after the last input frame, zeroes let the filter run out
+    long in_frame_index = 0;
+    long out_frame_index = 0;
+    while (out_frame_index < out_frame_total) {
+        float *in_bufs[GENESIS_MAX_CHANNELS];
+        int input_frame_count;
+        if (in_frame_index < in_frame_total) {
+            input_frame_count = min(in_frame_total - in_frame_index, (long)REMAP_BLOCK_FRAMES);
+            for (int ch = 0; ch < channel_count; ch += 1)
+                in_bufs[ch] = in_file->channels.at(ch).samples.raw() + in_frame_index;
+        } else {
+            input_frame_count = REMAP_BLOCK_FRAMES;
+            for (int ch = 0; ch < channel_count; ch += 1)
+                in_bufs[ch] = zeroes;
+        }
+        int output_frame_count = min(out_frame_total - out_frame_index, (long)OFFLINE_BLOCK_FRAMES);
+
+        int in_frame_count;
+        int out_frame_count;
+        filter_frames(resample_context, in_bufs, 1, channel_count, input_frame_count,
+                out_block, output_frame_count, &in_frame_count, &out_frame_count);
+
+        if (in_frame_index < in_frame_total)
+            in_frame_index += in_frame_count;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            float *out_ptr = audio_file->channels.at(ch).samples.raw() + out_frame_index;
+            for (int frame = 0; frame < out_frame_count; frame += 1)
+                out_ptr[frame] = out_block[frame * channel_count + ch];
+        }
+        out_frame_index += out_frame_count;
+    }
+}
+
+static int init_offline_context(ResampleContext *resample_context, GenesisAudioFile *in_file,
+        int sample_rate)
+{
+    int channel_count = in_file->channel_layout.channel_count;
+
+    // the last quality is the best one
+    resample_context->quality = &resample_qualities[array_length(resample_qualities) - 1];
+
+    int err;
+    if ((err = init_filter(resample_context, in_file->sample_rate, sample_rate, channel_count)))
+        return err;
+
+    for (int ch = 0; ch < channel_count; ch += 1)
+        resample_context->channel_matrix[ch][ch] = 1.0f;
+    channel_remap_init(&resample_context->channel_remap, resample_context->channel_matrix,
+            channel_count, channel_count);
+    return 0;
+}
+
+int resample_audio_file(GenesisAudioFile *in_file, int sample_rate, GenesisAudioFile **out_file) {
+    *out_file = nullptr;
+
+    int channel_count = in_file->channel_layout.channel_count;
+    long in_frame_total = genesis_audio_file_frame_count(in_file);
+
+    GenesisAudioFile *audio_file = genesis_audio_file_create(in_file->genesis_context, sample_rate);
+    ResampleContext *resample_context = create_zero<ResampleContext>();
+    float *zeroes = allocate_zero<float>(REMAP_BLOCK_FRAMES);
+    float *out_block = allocate_zero<float>(OFFLINE_BLOCK_FRAMES * channel_count);
+
+    int err = (audio_file && resample_context && zeroes && out_block) ? 0 : GenesisErrorNoMem;
+    if (!err)
+        err = init_offline_context(resample_context, in_file, sample_rate);
+    if (!err)
+        err = genesis_audio_file_set_channel_layout(audio_file, &in_file->channel_layout);
+
+    // output frame n lines up with input frame n * in rate / out rate
+    long out_frame_total = 0;
+    if (!err) {
+        out_frame_total = (in_frame_total * resample_context->upsample_factor +
+                resample_context->downsample_factor - 1) / resample_context->downsample_factor;
+    }
+    for (int ch = 0; !err && ch < channel_count; ch += 1)
+        err = audio_file->channels.at(ch).samples.resize(out_frame_total);
+
+    if (!err) {
+        if (resample_context->phases) {
+            filter_audio_file(resample_context, in_file, audio_file, zeroes, out_block);
+        } else {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                memcpy(audio_file->channels.at(ch).samples.raw(),
+                        in_file->channels.at(ch).samples.raw(), in_frame_total * sizeof(float));
+            }
+        }
+    }
+
+    if (resample_context) {
+        destroy(resample_context->phases, 0);
+        destroy(resample_context->remapped, 0);
+        destroy(resample_context, 1);
+    }
+    destroy(zeroes, 0);
+    destroy(out_block, 0);
+
+    if (err) {
+        genesis_audio_file_destroy(audio_file);
+        return err;
+    }
+
+    *out_file = audio_file;
+    return 0;
+}
@@ -5,4 +5,8 @@
 
 int create_resample_descriptor(GenesisPipeline *pipeline);
 
+// Resamples all of in_file to sample_rate with the best quality filter,
+// keeping its channel layout. For audio resampled ahead of playback.
+int resample_audio_file(GenesisAudioFile *in_file, int sample_rate, GenesisAudioFile **out_file);
+
 #endif
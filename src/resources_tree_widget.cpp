@@ -881,6 +881,7 @@ void ResourcesTreeWidget::designate_clicked_device_as(DeviceId device_id) {
     sf_device_id->backend = selected_node->audio_device->soundio->current_backend;
     sf_device_id->device_id = selected_node->audio_device->id;
     sf_device_id->is_raw = selected_node->audio_device->is_raw;
+    sf_device_id->is_virtual = false;
 
     settings_file_commit(settings_file);
 
@@ -239,6 +239,11 @@ static int on_string(struct LaxJsonContext *json,
             }
         case SettingsFileStateDeviceDesignationIdBackend:
             {
+                if (ByteBuffer::compare(value, "virtual") == 0) {
+                    sf->current_sf_device_id->is_virtual = true;
+                    sf->state = SettingsFileStateDeviceDesignationIdProp;
+                    break;
+                }
                 sf->current_sf_device_id->backend = get_backend_from_str(value.raw());
                 if (sf->current_sf_device_id->backend == SoundIoBackendNone)
                     return parse_error(sf, "invalid backend name");
@@ -728,10 +733,12 @@ static void json_line_device_designations(FILE *f, int indent, const char *key,
         do_indent(f, indent);
         fprintf(f, "\"%s\": ", device_id_str((DeviceId)i));
 
-        if (sf_device_id->backend != SoundIoBackendNone) {
+        if (sf_device_id->backend != SoundIoBackendNone || sf_device_id->is_virtual) {
             json_line_indent(f, &indent, "{");
 
-            json_line_str(f, indent, "backend", soundio_backend_name(sf_device_id->backend));
+            const char *backend_name = sf_device_id->is_virtual ?
+                "virtual" : soundio_backend_name(sf_device_id->backend);
+            json_line_str(f, indent, "backend", backend_name);
             json_line_str(f, indent, "device", sf_device_id->device_id);
             json_line_bool(f, indent, "raw", sf_device_id->is_raw);
 
@@ -789,6 +796,7 @@ SettingsFile *settings_file_open(const ByteBuffer &path) {
     for (int i = 0; i < sf->device_designations.length(); i += 1) {
         SettingsFileDeviceId *sf_device_id = &sf->device_designations.at(i);
         sf_device_id->backend = SoundIoBackendNone;
+        sf_device_id->is_virtual = false;
     }
 
     FILE *f = fopen(path.raw(), "rb");
@@ -91,6 +91,9 @@ struct SettingsFileDeviceId {
     SoundIoBackend backend;
     ByteBuffer device_id;
     bool is_raw;
+    // backend "virtual": a virtual device with no sound hardware. device_id
+    // names its clock, "wall-time" or "free-running".
+    bool is_virtual;
 };
 
 struct SettingsFile {
@@ -0,0 +1,140 @@
+#include "tempo_map.hpp"
+
+#include <limits.h>
+#include <math.h>
+
+static long bpm_to_ticks_per_minute(double bpm) {
+    return max(1L, lround(bpm * GENESIS_TICKS_PER_WHOLE_NOTE));
+}
+
+int tempo_map_init(TempoMap *tempo_map, const GenesisTempoChange *changes, int change_count) {
+    for (int i = 0; i < change_count; i += 1) {
+        if (!(changes[i].bpm > 0.0) || changes[i].pos < 0.0)
+            return GenesisErrorInvalidParam;
+        if (i > 0 && changes[i].pos < changes[i - 1].pos)
+            return GenesisErrorInvalidParam;
+    }
+
+    int err;
+    if ((err = tempo_map->regions.ensure_capacity(max(1, change_count))))
+        return err;
+
+    tempo_map->regions.clear();
+    TempoRegion first_region;
+    first_region.start_tick = 0;
+    first_region.ticks_per_minute = bpm_to_ticks_per_minute(
+            (change_count > 0) ? changes[0].bpm : GENESIS_DEFAULT_BPM);
+    first_region.start_seconds = 0.0;
+    ok_or_panic(tempo_map->regions.append(first_region));
+
+    for (int i = 1; i < change_count; i += 1) {
+        TempoRegion *prev_region = &tempo_map->regions.last();
+        long start_tick = genesis_whole_notes_to_ticks(changes[i].pos);
+        long ticks_per_minute = bpm_to_ticks_per_minute(changes[i].bpm);
+        // of changes on the same tick, the last one wins
+        if (start_tick == prev_region->start_tick) {
+            prev_region->ticks_per_minute = ticks_per_minute;
+            continue;
+        }
+        TempoRegion region;
+        region.start_tick = start_tick;
+        region.ticks_per_minute = ticks_per_minute;
+        region.start_seconds = prev_region->start_seconds +
+            (start_tick - prev_region->start_tick) * 60.0 / prev_region->ticks_per_minute;
+        ok_or_panic(tempo_map->regions.append(region));
+    }
+
+    return 0;
+}
+
+// Rounds down, so that the last frames of a region never land past the
+// start of the next one.
+static long region_start_sample_pos(const TempoRegion *region, int frame_rate) {
+    return (long)floor(region->start_seconds * frame_rate);
+}
+
+static int find_region_at_tick(const TempoMap *tempo_map, double tick) {
+    int start = 0;
+    int end = tempo_map->regions.length();
+    while (end - start > 1) {
+        int mid = (start + end) / 2;
+        if (tempo_map->regions.at(mid).start_tick <= tick)
+            start = mid;
+        else
+            end = mid;
+    }
+    return start;
+}
+
+static int find_region_at_seconds(const TempoMap *tempo_map, double seconds) {
+    int start = 0;
+    int end = tempo_map->regions.length();
+    while (end - start > 1) {
+        int mid = (start + end) / 2;
+        if (tempo_map->regions.at(mid).start_seconds <= seconds)
+            start = mid;
+        else
+            end = mid;
+    }
+    return start;
+}
+
+static int find_region_at_sample_pos(const TempoMap *tempo_map, long sample_pos, int frame_rate) {
+    int start = 0;
+    int end = tempo_map->regions.length();
+    while (end - start > 1) {
+        int mid = (start + end) / 2;
+        if (region_start_sample_pos(&tempo_map->regions.at(mid), frame_rate) <= sample_pos)
+            start = mid;
+        else
+            end = mid;
+    }
+    return start;
+}
+
+static void get_region_segment(const TempoMap *tempo_map, int region_index, int frame_rate,
+        GenesisTempoSegment *out_segment)
+{
+    const TempoRegion *region = &tempo_map->regions.at(region_index);
+    out_segment->start_sample_pos = region_start_sample_pos(region, frame_rate);
+    if (region_index + 1 < tempo_map->regions.length()) {
+        out_segment->end_sample_pos = region_start_sample_pos(
+                &tempo_map->regions.at(region_index + 1), frame_rate);
+    } else {
+        out_segment->end_sample_pos = LONG_MAX;
+    }
+    out_segment->start_tick = region->start_tick;
+    out_segment->ticks_per_minute = region->ticks_per_minute;
+    out_segment->frame_rate = frame_rate;
+}
+
+double tempo_map_whole_notes_to_seconds(const TempoMap *tempo_map, double whole_notes) {
+    double tick = whole_notes * GENESIS_TICKS_PER_WHOLE_NOTE;
+    const TempoRegion *region = &tempo_map->regions.at(find_region_at_tick(tempo_map, tick));
+    return region->start_seconds + (tick - region->start_tick) * 60.0 / region->ticks_per_minute;
+}
+
+double tempo_map_seconds_to_whole_notes(const TempoMap *tempo_map, double seconds) {
+    const TempoRegion *region = &tempo_map->regions.at(find_region_at_seconds(tempo_map, seconds));
+    double tick = region->start_tick + (seconds - region->start_seconds) * region->ticks_per_minute / 60.0;
+    return tick / GENESIS_TICKS_PER_WHOLE_NOTE;
+}
+
+long tempo_map_ticks_to_sample_pos(const TempoMap *tempo_map, long ticks, int frame_rate) {
+    GenesisTempoSegment segment;
+    get_region_segment(tempo_map, find_region_at_tick(tempo_map, ticks), frame_rate, &segment);
+    return genesis_tempo_segment_ticks_to_sample_pos(&segment, ticks);
+}
+
+long tempo_map_sample_pos_to_ticks(const TempoMap *tempo_map, long sample_pos, int frame_rate) {
+    GenesisTempoSegment segment;
+    tempo_map_get_segment(tempo_map, sample_pos, frame_rate, &segment);
+    return genesis_tempo_segment_sample_pos_to_ticks(&segment, sample_pos);
+}
+
+void tempo_map_get_segment(const TempoMap *tempo_map, long sample_pos, int frame_rate,
+        GenesisTempoSegment *out_segment)
+{
+    int region_index = find_region_at_sample_pos(tempo_map, sample_pos, frame_rate);
+    get_region_segment(tempo_map, region_index, frame_rate, out_segment);
+}
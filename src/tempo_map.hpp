@@ -0,0 +1,33 @@
+#ifndef GENESIS_TEMPO_MAP_HPP
+#define GENESIS_TEMPO_MAP_HPP
+
+#include "genesis.h"
+#include "list.hpp"
+
+struct TempoRegion {
+    long start_tick;
+    long ticks_per_minute;
+    // time from the start of the timeline to start_tick
+    double start_seconds;
+};
+
+// Regions sorted by start_tick, the first one starting at tick 0. The time
+// each region starts at is worked out ahead, so that a conversion is a binary
+// search followed by arithmetic within one region.
+struct TempoMap {
+    List<TempoRegion> regions;
+};
+
+// changes must be sorted by pos. On error the tempo map is unchanged.
+int tempo_map_init(TempoMap *tempo_map, const GenesisTempoChange *changes, int change_count);
+
+double tempo_map_whole_notes_to_seconds(const TempoMap *tempo_map, double whole_notes);
+double tempo_map_seconds_to_whole_notes(const TempoMap *tempo_map, double seconds);
+
+long tempo_map_ticks_to_sample_pos(const TempoMap *tempo_map, long ticks, int frame_rate);
+long tempo_map_sample_pos_to_ticks(const TempoMap *tempo_map, long sample_pos, int frame_rate);
+
+void tempo_map_get_segment(const TempoMap *tempo_map, long sample_pos, int frame_rate,
+        GenesisTempoSegment *out_segment);
+
+#endif
@@ -298,9 +298,9 @@ void TrackEditorWidget::update_model() {
 
             int frame_rate = project_audio_clip_sample_rate(project, segment->audio_clip);
             int frame_count = project_audio_clip_frame_count(project, segment->audio_clip);
-            double whole_note_len = genesis_frames_to_whole_notes(
-                    audio_graph->pipeline, frame_count, frame_rate);
-            double whole_note_end = segment->pos + whole_note_len;
+            double start_seconds = tempo_map_whole_notes_to_seconds(&project->tempo_map, segment->pos);
+            double end_seconds = start_seconds + frame_count / (double)frame_rate;
+            double whole_note_end = tempo_map_seconds_to_whole_notes(&project->tempo_map, end_seconds);
 
             gui_audio_clip_segment->left = whole_note_to_pixel(segment->pos);
             gui_audio_clip_segment->right = whole_note_to_pixel(whole_note_end);
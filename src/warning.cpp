@@ -14,6 +14,21 @@ void emit_warning(Warning warning) {
             fprintf(stderr, "warning: unable to set high priority thread: Operation not permitted\n");
             fprintf(stderr, "See https://github.com/andrewrk/genesis/wiki/warning:-unable-to-set-high-priority-thread:-Operation-not-permitted\n");
             return;
+        case WarningLockMemory:
+            fprintf(stderr, "warning: unable to lock audio buffers into memory\n");
+            fprintf(stderr, "Raise RLIMIT_MEMLOCK (ulimit -l) to avoid page faults on the audio path.\n");
+            return;
+        case WarningThreadAffinity:
+            fprintf(stderr, "warning: unable to pin pipeline workers to the requested CPU cores\n");
+            return;
+        case WarningAssetVariant:
+            fprintf(stderr, "warning: unable to resample audio assets to the project sample rate ahead of time\n");
+            fprintf(stderr, "Those assets are resampled during playback instead, which costs more CPU time.\n");
+            return;
+        case WarningAssetVariantSave:
+            fprintf(stderr, "warning: unable to save resampled audio assets in the project cache directory\n");
+            fprintf(stderr, "They are resampled again each time the project is opened.\n");
+            return;
         case WarningCount:
             panic("invalid warning");
     }
@@ -3,6 +3,10 @@
 
 enum Warning {
     WarningHighPriorityThread,
+    WarningLockMemory,
+    WarningThreadAffinity,
+    WarningAssetVariant,
+    WarningAssetVariantSave,
 
     WarningCount,
 };
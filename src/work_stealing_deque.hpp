@@ -0,0 +1,128 @@
+#ifndef WORK_STEALING_DEQUE
+#define WORK_STEALING_DEQUE
+
+#include "error.h"
+#include "util.hpp"
+#include "atomics.hpp"
+
+#include <assert.h>
+
+// single owner, many thief, fixed size, lock-free double-ended queue.
+// (Chase-Lev). The owner thread pushes and pops at the bottom in LIFO order,
+// so that the work it most recently produced is run while it is still in
+// cache. Other threads steal from the top in FIFO order.
+// must call resize before you can start using it
+// size must be at least the maximum number of items that can be in the
+// queue at the same time. It is rounded up to a power of 2.
+template<typename T>
+class WorkStealingDeque {
+public:
+    WorkStealingDeque() {
+        _items = nullptr;
+        _mask = 0;
+        _allocated_size = 0;
+        _top.store(0);
+        _bottom.store(0);
+    }
+    ~WorkStealingDeque() {
+        destroy(_items, _allocated_size);
+    }
+
+    // this method not thread safe
+    int __attribute__((warn_unused_result)) resize(int size) {
+        if (size < 0)
+            return GenesisErrorInvalidParam;
+
+        int power_of_2_size = 1;
+        while (power_of_2_size < size)
+            power_of_2_size *= 2;
+
+        if (power_of_2_size > _allocated_size) {
+            std::atomic<T> *new_items = allocate_zero<std::atomic<T>>(power_of_2_size);
+            if (!new_items)
+                return GenesisErrorNoMem;
+
+            destroy(_items, _allocated_size);
+            _allocated_size = power_of_2_size;
+            _items = new_items;
+        }
+
+        _mask = power_of_2_size - 1;
+        _top.store(0);
+        _bottom.store(0);
+
+        return 0;
+    }
+
+    // put an item at the bottom of the queue. only the owner thread may call
+    // this. panics if you attempt to put an item into a full queue.
+    void push(T item) {
+        long bottom = _bottom.load(std::memory_order_relaxed);
+        long top = _top.load(std::memory_order_acquire);
+        if (bottom - top > _mask)
+            panic("work stealing deque overflow");
+        _items[bottom & _mask].store(item, std::memory_order_relaxed);
+        _bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // take the most recently pushed item from the bottom of the queue.
+    // returns NULL if the queue is empty. only the owner thread may call this.
+    T pop() {
+        long bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        _bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long top = _top.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            // empty
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T item = _items[bottom & _mask].load(std::memory_order_relaxed);
+        if (top == bottom) {
+            // last item; race against thieves for it
+            if (!_top.compare_exchange_strong(top, top + 1,
+                        std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // take the oldest item from the top of the queue. returns NULL if the
+    // queue is empty or if another thread won the race for the item.
+    // thread-safe.
+    T steal() {
+        long top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long bottom = _bottom.load(std::memory_order_acquire);
+
+        if (top >= bottom)
+            return nullptr;
+
+        T item = _items[top & _mask].load(std::memory_order_relaxed);
+        if (!_top.compare_exchange_strong(top, top + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return item;
+    }
+
+    // approximate when called from a thread other than the owner.
+    bool empty() const {
+        return _bottom.load() <= _top.load();
+    }
+
+private:
+    std::atomic<T> *_items;
+    long _mask;
+    int _allocated_size;
+    atomic_long _top;
+    atomic_long _bottom;
+};
+
+#endif
@@ -0,0 +1,441 @@
+#undef NDEBUG
+
+#include "genesis.hpp"
+#include "audio_graph.hpp"
+#include "mixer_node.hpp"
+#include "os.hpp"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Runs the built-in nodes and fails if any of their run callbacks allocates,
+// takes a lock or makes a blocking system call. The functions that can do
+// that are interposed below; they check genesis_rt_current_node, which the
+// library only keeps up to date in debug builds, and report the node and
+// the stack. The period of a virtual device counts as a run of its node, so
+// the device callback path is checked the same way. Also measures how many
+// page faults the graph takes per cycle once it is warmed up.
+
+// glibc's own entry points, so that the allocator can be interposed
+// without calling dlsym from inside malloc.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+// the build hides symbols by default, which would keep the shared libraries
+// calling the real functions
+#define INTERPOSE extern "C" __attribute__((visibility("default")))
+
+// Nodes that only ever run offline and are allowed to block.
+static const char *exempt_node_names[] = {
+    // writes the rendered file
+    "render",
+};
+
+static atomic_int violation_count;
+static thread_local bool reporting = false;
+
+static bool is_exempt(GenesisNode *node) {
+    const char *name = genesis_node_descriptor_name(genesis_node_descriptor(node));
+    for (int i = 0; i < array_length(exempt_node_names); i += 1) {
+        if (strcmp(name, exempt_node_names[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void check_realtime(const char *what) {
+    if (reporting)
+        return;
+    GenesisNode *node = genesis_rt_current_node();
+    if (!node || is_exempt(node))
+        return;
+
+    reporting = true;
+    violation_count += 1;
+    fprintf(stderr, "\nrealtime violation: %s in the run callback of node \"%s\"\n", what,
+            genesis_node_descriptor_name(genesis_node_descriptor(node)));
+    void *frames[64];
+    int frame_count = backtrace(frames, array_length(frames));
+    backtrace_symbols_fd(frames, frame_count, STDERR_FILENO);
+    reporting = false;
+}
+
+template<typename T>
+static T next_symbol(T *cache, const char *name) {
+    if (!*cache)
+        *cache = (T)dlsym(RTLD_NEXT, name);
+    return *cache;
+}
+
+INTERPOSE void *malloc(size_t size) {
+    check_realtime("malloc");
+    return __libc_malloc(size);
+}
+
+INTERPOSE void *calloc(size_t count, size_t size) {
+    check_realtime("calloc");
+    return __libc_calloc(count, size);
+}
+
+INTERPOSE void *realloc(void *ptr, size_t size) {
+    check_realtime("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+INTERPOSE void free(void *ptr) {
+    if (ptr)
+        check_realtime("free");
+    __libc_free(ptr);
+}
+
+INTERPOSE int posix_memalign(void **out_ptr, size_t alignment, size_t size) {
+    check_realtime("posix_memalign");
+    void *ptr = __libc_memalign(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+    *out_ptr = ptr;
+    return 0;
+}
+
+INTERPOSE void *aligned_alloc(size_t alignment, size_t size) {
+    check_realtime("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+INTERPOSE int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    static int (*real)(pthread_mutex_t *);
+    check_realtime("pthread_mutex_lock");
+    return next_symbol(&real, "pthread_mutex_lock")(mutex);
+}
+
+INTERPOSE int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    static int (*real)(pthread_cond_t *, pthread_mutex_t *);
+    check_realtime("pthread_cond_wait");
+    return next_symbol(&real, "pthread_cond_wait")(cond, mutex);
+}
+
+INTERPOSE int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+        const struct timespec *abstime)
+{
+    static int (*real)(pthread_cond_t *, pthread_mutex_t *, const struct timespec *);
+    check_realtime("pthread_cond_timedwait");
+    return next_symbol(&real, "pthread_cond_timedwait")(cond, mutex, abstime);
+}
+
+INTERPOSE int sem_wait(sem_t *sem) {
+    static int (*real)(sem_t *);
+    check_realtime("sem_wait");
+    return next_symbol(&real, "sem_wait")(sem);
+}
+
+INTERPOSE ssize_t read(int fd, void *buf, size_t count) {
+    static ssize_t (*real)(int, void *, size_t);
+    check_realtime("read");
+    return next_symbol(&real, "read")(fd, buf, count);
+}
+
+INTERPOSE ssize_t write(int fd, const void *buf, size_t count) {
+    static ssize_t (*real)(int, const void *, size_t);
+    check_realtime("write");
+    return next_symbol(&real, "write")(fd, buf, count);
+}
+
+INTERPOSE int nanosleep(const struct timespec *req, struct timespec *rem) {
+    static int (*real)(const struct timespec *, struct timespec *);
+    check_realtime("nanosleep");
+    return next_symbol(&real, "nanosleep")(req, rem);
+}
+
+INTERPOSE int usleep(useconds_t usec) {
+    static int (*real)(useconds_t);
+    check_realtime("usleep");
+    return next_symbol(&real, "usleep")(usec);
+}
+
+// waking other threads is fine; waiting is not
+INTERPOSE long syscall(long number, ...) {
+    static long (*real)(long, ...);
+    va_list ap;
+    va_start(ap, number);
+    long args[6];
+    for (int i = 0; i < 6; i += 1)
+        args[i] = va_arg(ap, long);
+    va_end(ap);
+    if (number == SYS_futex && (args[1] & FUTEX_CMD_MASK) == FUTEX_WAIT)
+        check_realtime("futex wait");
+    return next_symbol(&real, "syscall")(number, args[0], args[1], args[2], args[3], args[4], args[5]);
+}
+
+struct EventsSource {
+    bool note_on_written;
+};
+
+static int events_source_create(struct GenesisNode *node) {
+    node->userdata = create_zero<EventsSource>();
+    return node->userdata ? 0 : (int)GenesisErrorNoMem;
+}
+
+static void events_source_destroy(struct GenesisNode *node) {
+    destroy((EventsSource *)node->userdata, 1);
+}
+
+static void events_source_seek(struct GenesisNode *node) {
+    EventsSource *source = (EventsSource *)node->userdata;
+    source->note_on_written = false;
+}
+
+// one held note
+static void events_source_run(struct GenesisNode *node) {
+    EventsSource *source = (EventsSource *)node->userdata;
+    struct GenesisPort *events_out_port = genesis_node_port(node, 0);
+    int event_count;
+    long ticks_requested;
+    genesis_events_out_port_free_count(events_out_port, &event_count, &ticks_requested);
+    int write_count = 0;
+    if (!source->note_on_written && event_count >= 1) {
+        GenesisMidiEvent *event = genesis_events_out_port_write_ptr(events_out_port);
+        event->event_type = GenesisMidiEventTypeNoteOn;
+        event->start = 0;
+        event->data.note_data.note = 69;
+        event->data.note_data.velocity = 0.5f;
+        source->note_on_written = true;
+        write_count = 1;
+    }
+    genesis_events_out_port_advance_write_ptr(events_out_port, write_count, ticks_requested);
+}
+
+static void sink_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, genesis_audio_in_port_fill_count(audio_in_port));
+}
+
+static long page_fault_count(int who) {
+    struct rusage usage;
+    if (getrusage(who, &usage))
+        panic("getrusage failed");
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+static void check_faults_per_cycle(long fault_count, long cycle_count) {
+    double faults_per_cycle = fault_count / (double)max(1L, cycle_count);
+    fprintf(stderr, "%.3f page faults per cycle...", faults_per_cycle);
+    if (faults_per_cycle > 0.1) {
+        fprintf(stderr, "\npage faults in steady state\n");
+        violation_count += 1;
+    }
+}
+
+// events source -> synth -> delay -> resample (channel remapping only) ->
+// mixer -> out_node
+static void connect_synth_chain(GenesisPipeline *pipeline, GenesisNode *out_node) {
+    GenesisNodeDescriptor *source_descr = ok_mem(genesis_create_node_descriptor(pipeline, 1,
+                "events_source", "events_source"));
+    genesis_node_descriptor_set_create_callback(source_descr, events_source_create);
+    genesis_node_descriptor_set_destroy_callback(source_descr, events_source_destroy);
+    genesis_node_descriptor_set_seek_callback(source_descr, events_source_seek);
+    genesis_node_descriptor_set_run_callback(source_descr, events_source_run);
+    ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeEventsOut, "events_out"));
+
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 1, &mixer_descr));
+
+    GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    GenesisNode *synth_node = ok_mem(genesis_node_descriptor_create_node(
+                genesis_node_descriptor_find(pipeline, "synth")));
+    GenesisNode *delay_node = ok_mem(genesis_node_descriptor_create_node(
+                genesis_node_descriptor_find(pipeline, "delay")));
+    GenesisNode *resample_node = ok_mem(genesis_node_descriptor_create_node(
+                genesis_node_descriptor_find(pipeline, "resample")));
+    GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+
+    // mixer inputs take their channel layout from the mixer output
+    ok_or_panic(genesis_connect_audio_nodes(mixer_node, out_node));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(synth_node, 0)));
+    ok_or_panic(genesis_connect_audio_nodes(synth_node, delay_node));
+    ok_or_panic(genesis_connect_audio_nodes(delay_node, resample_node));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(resample_node, 1), genesis_node_port(mixer_node, 1)));
+}
+
+static void test_synth_chain(GenesisContext *context) {
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    // the calling thread runs every node, so its page faults are the graph's
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, 1));
+    genesis_pipeline_set_stats_enabled(pipeline, true);
+
+    GenesisNodeDescriptor *sink_descr = ok_mem(genesis_create_node_descriptor(pipeline, 1, "sink", "sink"));
+    genesis_node_descriptor_set_run_callback(sink_descr, sink_run);
+    GenesisPortDescriptor *sink_port_descr = ok_mem(genesis_node_descriptor_create_port(sink_descr, 0,
+                GenesisPortTypeAudioIn, "audio_in"));
+    genesis_audio_port_descriptor_set_channel_layout(sink_port_descr,
+            genesis_pipeline_get_channel_layout(pipeline), true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(sink_port_descr,
+            genesis_pipeline_get_sample_rate(pipeline), true, -1);
+    genesis_audio_port_descriptor_set_is_sink(sink_port_descr, true);
+
+    GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    connect_synth_chain(pipeline, sink_node);
+
+    // The first render touches everything for the first time and is not
+    // measured. After that, the difference between a short and a long
+    // render is what the graph costs per cycle, without what starting and
+    // stopping costs.
+    long frame_counts[] = {48000, 48000, 480000};
+    long fault_counts[3];
+    long cycle_counts[3];
+    for (int i = 0; i < 3; i += 1) {
+        genesis_pipeline_seek(pipeline, 0.0);
+        genesis_pipeline_reset_stats(pipeline);
+        long fault_count_before = page_fault_count(RUSAGE_THREAD);
+        ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, frame_counts[i]));
+        fault_counts[i] = page_fault_count(RUSAGE_THREAD) - fault_count_before;
+        GenesisNodeStats stats;
+        genesis_node_get_stats(sink_node, &stats);
+        cycle_counts[i] = stats.call_count;
+    }
+    check_faults_per_cycle(fault_counts[2] - fault_counts[1], cycle_counts[2] - cycle_counts[1]);
+
+    genesis_pipeline_destroy(pipeline);
+}
+
+// Waits for the virtual device to have taken period_count periods. Counts
+// as a violation if it takes more than timeout_ns.
+static bool wait_for_periods(GenesisNode *device_node, long period_count, uint64_t timeout_ns) {
+    uint64_t deadline = os_get_time_ns() + timeout_ns;
+    while (genesis_node_virtual_device_period_count(device_node) < period_count) {
+        if (os_get_time_ns() > deadline) {
+            fprintf(stderr, "\nvirtual device stalled at %ld periods\n",
+                    genesis_node_virtual_device_period_count(device_node));
+            violation_count += 1;
+            return false;
+        }
+        os_sleep_until_ns(os_get_time_ns() + 1000000);
+    }
+    return true;
+}
+
+// The same graph playing to a free running virtual device, whose clock
+// thread takes the place of the device callbacks. The workers run the
+// nodes, so page faults are counted for the whole process, which is only
+// sleeping otherwise.
+static void test_virtual_device_callbacks(GenesisContext *context) {
+    static const int PERIOD_FRAME_COUNT = 256;
+    static const long WARM_UP_PERIOD_COUNT = 200;
+    static const long MEASURED_PERIOD_COUNT = 2000;
+    static const uint64_t TIMEOUT_NS = 10000000000ULL;
+
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+
+    GenesisNodeDescriptor *device_descr;
+    ok_or_panic(genesis_virtual_device_create_node_descriptor(pipeline, GenesisVirtualClockFreeRunning,
+                genesis_pipeline_get_sample_rate(pipeline), genesis_pipeline_get_channel_layout(pipeline),
+                PERIOD_FRAME_COUNT, &device_descr));
+    GenesisNode *device_node = ok_mem(genesis_node_descriptor_create_node(device_descr));
+    connect_synth_chain(pipeline, device_node);
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    if (wait_for_periods(device_node, WARM_UP_PERIOD_COUNT, TIMEOUT_NS)) {
+        long period_count_before = genesis_node_virtual_device_period_count(device_node);
+        long fault_count_before = page_fault_count(RUSAGE_SELF);
+        if (wait_for_periods(device_node, period_count_before + MEASURED_PERIOD_COUNT, TIMEOUT_NS)) {
+            long fault_count = page_fault_count(RUSAGE_SELF) - fault_count_before;
+            long period_count = genesis_node_virtual_device_period_count(device_node) - period_count_before;
+            check_faults_per_cycle(fault_count, period_count);
+        }
+    }
+    genesis_pipeline_stop(pipeline);
+
+    genesis_pipeline_destroy(pipeline);
+}
+
+// audio clip and clip event nodes -> resample -> mixer, rendered with the
+// same graph that exports a project
+static void test_audio_clip_render(GenesisContext *context) {
+    static const char *tmp_proj_path = "/tmp/test_genesis_rt_watchdog.gdaw";
+    static const char *tmp_out_path = "/tmp/test_genesis_rt_watchdog.flac";
+    os_delete(tmp_proj_path);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+
+    ByteBuffer asset_path("../test/tiny-sine.ogg");
+    AudioAsset *audio_asset;
+    ok_or_panic(project_add_audio_asset(project, asset_path, &audio_asset));
+    project_add_audio_clip(project, audio_asset);
+    AudioClip *audio_clip = project->audio_clip_list.at(0);
+    long clip_frame_count = project_audio_clip_frame_count(project, audio_clip);
+    project_add_audio_clip_segment(project, audio_clip, project->track_list.at(0), 0, clip_frame_count, 0.0);
+
+    // make the clip go through the resampler
+    int clip_sample_rate = project_audio_clip_sample_rate(project, audio_clip);
+    int sample_rate = (clip_sample_rate == 48000) ? 44100 : 48000;
+    project_set_sample_rate(project, sample_rate);
+
+    GenesisExportFormat format;
+    format.bit_rate = 320 * 1000;
+    format.codec = genesis_guess_audio_file_codec(context, tmp_out_path, nullptr, nullptr);
+    assert(format.codec);
+    format.sample_format = genesis_audio_file_codec_sample_format_index(format.codec, 0);
+    format.sample_rate = sample_rate;
+
+    AudioGraph *audio_graph;
+    ok_or_panic(audio_graph_create_render(project, context, &format, ByteBuffer(tmp_out_path), &audio_graph));
+    audio_graph_start_render(audio_graph);
+    // wait for the render to finish
+    os_thread_destroy(audio_graph->render_thread);
+    audio_graph->render_thread = nullptr;
+    assert(audio_graph->render_frame_index.load() == audio_graph->render_frame_count);
+    audio_graph_destroy(audio_graph);
+
+    project_close(project);
+    user_destroy(user);
+    os_delete(tmp_proj_path);
+    os_delete(tmp_out_path);
+}
+
+struct Test {
+    const char *name;
+    void (*fn)(GenesisContext *context);
+};
+
+static struct Test tests[] = {
+    {"synth, delay, resample and mixer", test_synth_chain},
+    {"virtual device callbacks", test_virtual_device_callbacks},
+    {"audio clip render", test_audio_clip_render},
+    {NULL, NULL},
+};
+
+int main(int argc, char *argv[]) {
+    if (!GENESIS_DEBUG_MODE) {
+        fprintf(stderr, "skipped: run callbacks are only tracked in debug builds\n");
+        return 0;
+    }
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    for (struct Test *test = &tests[0]; test->name; test += 1) {
+        fprintf(stderr, "testing %s...", test->name);
+        int violation_count_before = violation_count.load();
+        test->fn(context);
+        fprintf(stderr, (violation_count.load() == violation_count_before) ? "OK\n" : "FAILED\n");
+    }
+
+    genesis_context_destroy(context);
+    return (violation_count.load() == 0) ? 0 : 1;
+}
@@ -7,6 +7,7 @@
 #include "ring_buffer_test.hpp"
 #include "error.h"
 #include "thread_safe_queue_test.hpp"
+#include "work_stealing_deque_test.hpp"
 #include "sort_key.hpp"
 #include "locked_queue.hpp"
 #include "crc32.hpp"
@@ -15,6 +16,10 @@
 #include "settings_file.hpp"
 #include "project.hpp"
 #include "genesis.h"
+#include "mixer_node.hpp"
+#include "mix_kernels.hpp"
+#include "channel_remap.hpp"
+#include "asset_variant_cache.hpp"
 #include "atomic_value.hpp"
 #include "atomic_double.hpp"
 
@@ -383,7 +388,61 @@ static void test_basic_project_editing(void) {
     project_redo(project);
     assert(project->track_list.length() == 2);
 
+    MixerLine *master_line = project->mixer_line_list.at(0);
+    assert(master_line->volume == 1.0f);
+    project_set_mixer_line_volume(project, master_line, 0.5f);
+    assert(master_line->volume == 0.5f);
+    project_undo(project);
+    assert(master_line->volume == 1.0f);
+    project_redo(project);
+    assert(master_line->volume == 0.5f);
+
+    // one second of audio one whole note in. Doubling the tempo half way
+    // there brings it forward by a quarter of a whole note.
+    ByteBuffer asset_src_path("../test/tiny-sine.ogg");
+    AudioAsset *audio_asset;
+    ok_or_panic(project_add_audio_asset(project, asset_src_path, &audio_asset));
+    ByteBuffer asset_path;
+    os_path_join(asset_path, os_path_dirname(project->path), audio_asset->path);
+    project_add_audio_clip(project, audio_asset);
+    project_add_audio_clip_segment(project, project->audio_clip_list.at(0), project->track_list.at(0),
+            0, project->sample_rate, 1.0);
+    double whole_note_seconds = 60.0 / GENESIS_DEFAULT_BPM;
+    long default_tempo_frames = project->sample_rate * (whole_note_seconds + 1.0);
+    long tempo_change_frames = project->sample_rate * (whole_note_seconds * 0.75 + 1.0);
+    assert(labs(project_get_duration_frames(project) - default_tempo_frames) <= 1);
+    assert(project->tempo_change_list.length() == 1);
+    project_add_tempo_change(project, 0.5, GENESIS_DEFAULT_BPM * 2.0);
+    assert(project->tempo_change_list.length() == 2);
+    assert(labs(project_get_duration_frames(project) - tempo_change_frames) <= 1);
+    project_undo(project);
+    assert(project->tempo_change_list.length() == 1);
+    assert(labs(project_get_duration_frames(project) - default_tempo_frames) <= 1);
+    project_redo(project);
+    assert(project->tempo_change_list.length() == 2);
+
     project_close(project);
+    project = nullptr;
+
+    err = project_open(context, tmp_proj_path, user, &project);
+    assert(err == 0);
+    assert(project->mixer_line_list.at(0)->volume == 0.5f);
+    assert(project->tempo_change_list.length() == 2);
+    assert(project->tempo_change_list.at(1)->pos == 0.5);
+    assert(project->tempo_change_list.at(1)->bpm == GENESIS_DEFAULT_BPM * 2.0);
+    assert(labs(project_get_duration_frames(project) - tempo_change_frames) <= 1);
+
+    // the pipeline takes the tempo map the project keeps for it
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_tempo_map(pipeline, project->tempo_map_changes.raw(),
+                project->tempo_map_changes.length()));
+    assert(fabs(genesis_whole_notes_to_seconds(pipeline, 1.0, project->sample_rate) -
+                whole_note_seconds * 0.75) < 0.0001);
+    genesis_pipeline_destroy(pipeline);
+
+    project_close(project);
+    os_delete(asset_path.raw());
 
     user_destroy(user);
     os_delete(tmp_proj_path);
@@ -425,6 +484,1204 @@ static void test_audio_file(void) {
     os_delete(tmp_file_path);
 }
 
+struct OfflineRenderTestSink {
+    long frame_count;
+    bool samples_correct;
+};
+
+static void offline_render_test_source_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int i = 0; i < frame_count * channel_count; i += 1)
+        out_buf[i] = 0.25f;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void offline_render_test_planar_source_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    assert(genesis_audio_port_channel_stride(audio_out_port) == 1);
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        float *out_buf = genesis_audio_out_port_channel_write_ptr(audio_out_port, ch);
+        for (int i = 0; i < frame_count; i += 1)
+            out_buf[i] = 0.25f;
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void offline_render_test_sink_run(struct GenesisNode *node) {
+    OfflineRenderTestSink *sink = (OfflineRenderTestSink *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    for (int i = 0; i < frame_count * channel_count; i += 1) {
+        if (in_buf[i] != 0.5f)
+            sink->samples_correct = false;
+    }
+    sink->frame_count += frame_count;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+static GenesisNodeDescriptor *create_offline_render_test_descriptor(GenesisPipeline *pipeline,
+        const char *name, GenesisPortType port_type, void (*run)(struct GenesisNode *), bool is_sink,
+        GenesisAudioPortFormat format)
+{
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 1, name, name);
+    assert(node_descr);
+    genesis_node_descriptor_set_run_callback(node_descr, run);
+    GenesisPortDescriptor *port_descr = genesis_node_descriptor_create_port(node_descr, 0, port_type,
+            (port_type == GenesisPortTypeAudioIn) ? "audio_in" : "audio_out");
+    assert(port_descr);
+    genesis_audio_port_descriptor_set_channel_layout(port_descr,
+            genesis_pipeline_get_channel_layout(pipeline), true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(port_descr,
+            genesis_pipeline_get_sample_rate(pipeline), true, -1);
+    ok_or_panic(genesis_audio_port_descriptor_set_format(port_descr, format, true, -1));
+    if (is_sink)
+        genesis_audio_port_descriptor_set_is_sink(port_descr, true);
+    return node_descr;
+}
+
+static void test_offline_render(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    // once on the calling thread, once on workers with fixed size blocks
+    for (int run_i = 0; run_i < 2; run_i += 1) {
+        GenesisPipeline *pipeline;
+        ok_or_panic(genesis_pipeline_create(context, &pipeline));
+        ok_or_panic(genesis_pipeline_set_thread_count(pipeline, (run_i == 0) ? 1 : 3));
+        ok_or_panic(genesis_pipeline_set_quantum(pipeline, (run_i == 0) ? 0 : 64));
+        assert(genesis_pipeline_set_quantum(pipeline, 100) == GenesisErrorInvalidParam);
+
+        OfflineRenderTestSink sink = {0, true};
+        GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+                "source", GenesisPortTypeAudioOut, offline_render_test_source_run, false,
+                GenesisAudioPortFormatInterleaved);
+        GenesisNodeDescriptor *planar_source_descr = create_offline_render_test_descriptor(pipeline,
+                "planar source", GenesisPortTypeAudioOut, offline_render_test_planar_source_run, false,
+                GenesisAudioPortFormatPlanar);
+        GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+                "sink", GenesisPortTypeAudioIn, offline_render_test_sink_run, true,
+                GenesisAudioPortFormatInterleaved);
+        genesis_node_descriptor_set_userdata(sink_descr, &sink);
+        GenesisNodeDescriptor *mixer_descr;
+        ok_or_panic(create_mixer_descriptor(pipeline, 2, &mixer_descr));
+
+        GenesisNode *sink_node = genesis_node_descriptor_create_node(sink_descr);
+        GenesisNode *mixer_node = genesis_node_descriptor_create_node(mixer_descr);
+        GenesisNode *source_node = genesis_node_descriptor_create_node(source_descr);
+        GenesisNode *planar_source_node = genesis_node_descriptor_create_node(planar_source_descr);
+        assert(sink_node && mixer_node && source_node && planar_source_node);
+
+        // the sink only takes interleaved audio; the mixer takes either
+        assert(genesis_connect_ports(genesis_node_port(planar_source_node, 0),
+                    genesis_node_port(sink_node, 0)) == GenesisErrorIncompatiblePortFormats);
+        ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+        ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0),
+                    genesis_node_port(mixer_node, 1)));
+        ok_or_panic(genesis_connect_ports(genesis_node_port(planar_source_node, 0),
+                    genesis_node_port(mixer_node, 2)));
+        assert(genesis_audio_port_format(genesis_node_port(mixer_node, 1)) == GenesisAudioPortFormatInterleaved);
+        assert(genesis_audio_port_format(genesis_node_port(mixer_node, 2)) == GenesisAudioPortFormatPlanar);
+
+        genesis_pipeline_set_stats_enabled(pipeline, true);
+        genesis_pipeline_seek(pipeline, 0.0);
+        ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 100000));
+        assert(sink.frame_count >= 100000);
+        assert(sink.samples_correct);
+        assert(!genesis_pipeline_is_running(pipeline));
+
+        genesis_pipeline_destroy(pipeline);
+    }
+
+    genesis_context_destroy(context);
+}
+
+// Each channel of each frame gets a value of its own, so that a sample read
+// from the wrong channel or the wrong frame shows up.
+struct PlanarTestCounter {
+    long frame_index;
+    bool samples_correct;
+};
+
+static float planar_test_sample(long frame_index, int channel_index) {
+    return channel_index * 1000.0f + (frame_index % 997);
+}
+
+static void planar_test_source_run(struct GenesisNode *node) {
+    PlanarTestCounter *counter = (PlanarTestCounter *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    assert(genesis_audio_port_channel_stride(audio_out_port) == 1);
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        float *out_buf = genesis_audio_out_port_channel_write_ptr(audio_out_port, ch);
+        for (int i = 0; i < frame_count; i += 1)
+            out_buf[i] = planar_test_sample(counter->frame_index + i, ch);
+    }
+    counter->frame_index += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// reads planar or interleaved input through the per-channel pointers
+static void planar_test_sink_run(struct GenesisNode *node) {
+    PlanarTestCounter *counter = (PlanarTestCounter *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    int stride = genesis_audio_port_channel_stride(audio_in_port);
+    bool planar = genesis_audio_port_format(audio_in_port) == GenesisAudioPortFormatPlanar;
+    if (stride != (planar ? 1 : channel_count))
+        counter->samples_correct = false;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        float *in_buf = genesis_audio_in_port_channel_read_ptr(audio_in_port, ch);
+        for (int i = 0; i < frame_count; i += 1) {
+            if (in_buf[i * stride] != planar_test_sample(counter->frame_index + i, ch))
+                counter->samples_correct = false;
+        }
+    }
+    counter->frame_index += frame_count;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+// A planar source read straight by a planar sink, and through the mixer by
+// an interleaved one. Renders wrap around the ring buffers many times.
+static void test_planar_ports(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    for (int run_i = 0; run_i < 2; run_i += 1) {
+        bool through_mixer = (run_i == 1);
+        GenesisPipeline *pipeline;
+        ok_or_panic(genesis_pipeline_create(context, &pipeline));
+        assert(genesis_pipeline_get_channel_layout(pipeline)->channel_count >= 2);
+
+        PlanarTestCounter source_counter = {0, true};
+        PlanarTestCounter sink_counter = {0, true};
+        GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+                "planar source", GenesisPortTypeAudioOut, planar_test_source_run, false,
+                GenesisAudioPortFormatPlanar);
+        genesis_node_descriptor_set_userdata(source_descr, &source_counter);
+        GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+                "sink", GenesisPortTypeAudioIn, planar_test_sink_run, true,
+                through_mixer ? GenesisAudioPortFormatInterleaved : GenesisAudioPortFormatPlanar);
+        genesis_node_descriptor_set_userdata(sink_descr, &sink_counter);
+        GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+        GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+
+        if (through_mixer) {
+            GenesisNodeDescriptor *mixer_descr;
+            ok_or_panic(create_mixer_descriptor(pipeline, 1, &mixer_descr));
+            GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+            ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+            ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0),
+                        genesis_node_port(mixer_node, 1)));
+            assert(genesis_audio_port_format(genesis_node_port(mixer_node, 1)) == GenesisAudioPortFormatPlanar);
+        } else {
+            ok_or_panic(genesis_connect_audio_nodes(source_node, sink_node));
+        }
+        assert(genesis_audio_port_format(genesis_node_port(sink_node, 0)) ==
+                (through_mixer ? GenesisAudioPortFormatInterleaved : GenesisAudioPortFormatPlanar));
+
+        genesis_pipeline_seek(pipeline, 0.0);
+        ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 100000));
+        assert(sink_counter.frame_index >= 100000);
+        assert(sink_counter.samples_correct);
+
+        genesis_pipeline_destroy(pipeline);
+    }
+
+    genesis_context_destroy(context);
+}
+
+static const long STATS_TEST_RUN_NS = 50000;
+
+// takes at least STATS_TEST_RUN_NS per run
+static void stats_test_slow_source_run(struct GenesisNode *node) {
+    uint64_t end_ns = os_get_time_ns() + STATS_TEST_RUN_NS;
+    offline_render_test_source_run(node);
+    while (os_get_time_ns() < end_ns) {}
+}
+
+static void test_node_stats(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, 1));
+
+    OfflineRenderTestSink sink = {0, true};
+    GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+            "slow source", GenesisPortTypeAudioOut, stats_test_slow_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, offline_render_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, &sink);
+    GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    // the mixer doubles the 0.25 of the source into what the sink expects
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 1, &mixer_descr));
+    GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+    ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(mixer_node, 1)));
+    ok_or_panic(genesis_param_port_schedule(mixer_gain_port(mixer_node, 0), 0, 2.0f, 0));
+
+    // off by default: nothing is counted
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 10000));
+    GenesisNodeStats stats;
+    genesis_node_get_stats(source_node, &stats);
+    assert(stats.call_count == 0);
+    assert(stats.total_ns == 0);
+
+    genesis_pipeline_set_stats_enabled(pipeline, true);
+    sink.frame_count = 0;
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 10000));
+    assert(sink.samples_correct);
+
+    // every run of the source took at least STATS_TEST_RUN_NS, so it lands
+    // in the bucket for that or above
+    genesis_node_get_stats(source_node, &stats);
+    assert(stats.call_count > 0);
+    assert(stats.min_ns >= STATS_TEST_RUN_NS);
+    assert(stats.min_ns <= stats.max_ns);
+    assert(stats.total_ns >= stats.call_count * STATS_TEST_RUN_NS);
+    assert(stats.total_ns <= stats.call_count * stats.max_ns);
+    // the source can get ahead of the sink by what the buffer holds
+    assert(stats.frame_count >= sink.frame_count);
+    int min_bucket = 0;
+    while ((2L << min_bucket) <= STATS_TEST_RUN_NS)
+        min_bucket += 1;
+    long histogram_total = 0;
+    for (int i = 0; i < GENESIS_NODE_STATS_BUCKET_COUNT; i += 1) {
+        if (i < min_bucket)
+            assert(stats.run_ns_histogram[i] == 0);
+        histogram_total += stats.run_ns_histogram[i];
+    }
+    assert(histogram_total == stats.call_count);
+
+    // a node without an audio out port counts what it read
+    GenesisNodeStats sink_stats;
+    genesis_node_get_stats(sink_node, &sink_stats);
+    assert(sink_stats.frame_count == sink.frame_count);
+
+    genesis_pipeline_reset_stats(pipeline);
+    genesis_node_get_stats(source_node, &stats);
+    assert(stats.call_count == 0);
+    assert(stats.frame_count == 0);
+    for (int i = 0; i < GENESIS_NODE_STATS_BUCKET_COUNT; i += 1)
+        assert(stats.run_ns_histogram[i] == 0);
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static void fan_out_test_idle_run(struct GenesisNode *node) {
+}
+
+static void fan_out_test_source_run(struct GenesisNode *node) {
+    PlanarTestCounter *counter = (PlanarTestCounter *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int i = 0; i < frame_count; i += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            out_buf[i * channel_count + ch] = planar_test_sample(counter->frame_index + i, ch);
+    }
+    counter->frame_index += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// Two readers of one source are added up by the mixer. The sum is only
+// right if both read the same frames.
+static void fan_out_test_sink_run(struct GenesisNode *node) {
+    PlanarTestCounter *counter = (PlanarTestCounter *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    for (int i = 0; i < frame_count; i += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            if (in_buf[i * channel_count + ch] != 2.0f * planar_test_sample(counter->frame_index + i, ch))
+                counter->samples_correct = false;
+        }
+    }
+    counter->frame_index += frame_count;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+static void test_port_fan_out(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, 2));
+    genesis_pipeline_set_stats_enabled(pipeline, true);
+
+    PlanarTestCounter source_counter = {0, true};
+    PlanarTestCounter sink_counter = {0, true};
+    GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+            "source", GenesisPortTypeAudioOut, fan_out_test_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(source_descr, &source_counter);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, fan_out_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, &sink_counter);
+    GenesisNodeDescriptor *idle_descr = create_offline_render_test_descriptor(pipeline,
+            "idle", GenesisPortTypeAudioIn, fan_out_test_idle_run, false,
+            GenesisAudioPortFormatInterleaved);
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 2, &mixer_descr));
+
+    GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+    GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    GenesisNode *idle_node = ok_mem(genesis_node_descriptor_create_node(idle_descr));
+    GenesisAudioPort *source_port = reinterpret_cast<GenesisAudioPort*>(genesis_node_port(source_node, 0));
+
+    // the idle reader leads to no sink, so it never runs and must not hold
+    // the source back
+    ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(mixer_node, 1)));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(mixer_node, 2)));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(idle_node, 0)));
+    assert(source_port->reader_count == 3);
+    // a reader takes the format the source already settled on
+    assert(genesis_audio_port_format(genesis_node_port(mixer_node, 2)) == GenesisAudioPortFormatInterleaved);
+
+    // many times the buffer size, so that the source only keeps going if
+    // the idle reader is left out
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 100000));
+    assert(sink_counter.frame_index >= 100000);
+    assert(sink_counter.samples_correct);
+    assert(source_counter.frame_index >= sink_counter.frame_index);
+    GenesisNodeStats stats;
+    genesis_node_get_stats(idle_node, &stats);
+    assert(stats.call_count == 0);
+    genesis_node_get_stats(source_node, &stats);
+    assert(stats.frame_count == source_counter.frame_index);
+
+    // destroying a reader leaves the others reading from the same place
+    genesis_node_destroy(idle_node);
+    assert(source_port->reader_count == 2);
+    source_counter.frame_index = 0;
+    sink_counter.frame_index = 0;
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 10000));
+    assert(sink_counter.frame_index >= 10000);
+    assert(sink_counter.samples_correct);
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static const uint64_t TEST_TIMEOUT_NS = 10000000000ULL;
+
+// Waits until *flag is non-zero. Fails the test after TEST_TIMEOUT_NS.
+static void wait_for_flag(atomic_int *flag, const char *what) {
+    uint64_t deadline = os_get_time_ns() + TEST_TIMEOUT_NS;
+    while (!flag->load()) {
+        uint64_t now = os_get_time_ns();
+        if (now >= deadline)
+            panic("timed out waiting for %s", what);
+        os_futex_wait_timeout(reinterpret_cast<int *>(flag), 0, deadline - now);
+    }
+}
+
+static void set_flag(atomic_int *flag) {
+    if (!flag->load()) {
+        flag->store(1);
+        os_futex_wake(reinterpret_cast<int *>(flag), 1);
+    }
+}
+
+struct LiveEditTestSink {
+    atomic_int saw_old_source;
+    atomic_int saw_new_source;
+    atomic_bool samples_correct;
+};
+
+static void live_edit_test_source_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int i = 0; i < frame_count * channel_count; i += 1)
+        out_buf[i] = 0.5f;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void live_edit_test_sink_run(struct GenesisNode *node) {
+    LiveEditTestSink *sink = (LiveEditTestSink *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    for (int i = 0; i < frame_count * channel_count; i += 1) {
+        if (in_buf[i] == 0.25f) {
+            // nothing from the old source after the new one
+            if (sink->saw_new_source.load())
+                sink->samples_correct.store(false);
+            set_flag(&sink->saw_old_source);
+        } else if (in_buf[i] == 0.5f) {
+            set_flag(&sink->saw_new_source);
+        } else {
+            sink->samples_correct.store(false);
+        }
+    }
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+static void test_live_edit(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, 2));
+
+    LiveEditTestSink sink;
+    sink.saw_old_source.store(0);
+    sink.saw_new_source.store(0);
+    sink.samples_correct.store(true);
+    GenesisNodeDescriptor *old_source_descr = create_offline_render_test_descriptor(pipeline,
+            "old source", GenesisPortTypeAudioOut, offline_render_test_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    GenesisNodeDescriptor *new_source_descr = create_offline_render_test_descriptor(pipeline,
+            "new source", GenesisPortTypeAudioOut, live_edit_test_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, live_edit_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, &sink);
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 1, &mixer_descr));
+
+    GenesisNode *sink_node = genesis_node_descriptor_create_node(sink_descr);
+    GenesisNode *mixer_node = genesis_node_descriptor_create_node(mixer_descr);
+    GenesisNode *old_source_node = genesis_node_descriptor_create_node(old_source_descr);
+    assert(sink_node && mixer_node && old_source_node);
+    ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(old_source_node, 0),
+                genesis_node_port(mixer_node, 1)));
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    // the edit has to land on a graph that is already playing
+    wait_for_flag(&sink.saw_old_source, "the old source");
+
+    // swap the source while the graph keeps running
+    genesis_pipeline_begin_edit(pipeline);
+    assert(genesis_pipeline_is_running(pipeline));
+    genesis_node_destroy(old_source_node);
+    GenesisNode *new_source_node = genesis_node_descriptor_create_node(new_source_descr);
+    assert(new_source_node);
+    ok_or_panic(genesis_connect_ports(genesis_node_port(new_source_node, 0),
+                genesis_node_port(mixer_node, 1)));
+    genesis_node_seek(new_source_node, 0.0);
+    ok_or_panic(genesis_pipeline_commit_edit(pipeline));
+    assert(genesis_pipeline_is_running(pipeline));
+
+    wait_for_flag(&sink.saw_new_source, "the new source");
+    genesis_pipeline_stop(pipeline);
+    assert(sink.samples_correct.load());
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static const int LATENCY_TEST_FRAMES = 100;
+
+struct LatencyTestSink {
+    long frame_count;
+    long impulse_frame;
+    float impulse_value;
+    int impulse_count;
+};
+
+struct LatencyTestSource {
+    bool impulse_written;
+};
+
+static int latency_test_source_create(struct GenesisNode *node) {
+    node->userdata = create_zero<LatencyTestSource>();
+    return node->userdata ? 0 : (int)GenesisErrorNoMem;
+}
+
+static void latency_test_source_destroy(struct GenesisNode *node) {
+    destroy((LatencyTestSource *)node->userdata, 1);
+}
+
+// a single 1.0 at the first frame, then silence
+static void latency_test_source_run(struct GenesisNode *node) {
+    LatencyTestSource *source = (LatencyTestSource *)node->userdata;
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int i = 0; i < frame_count * channel_count; i += 1)
+        out_buf[i] = 0.0f;
+    if (frame_count > 0 && !source->impulse_written) {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            out_buf[ch] = 1.0f;
+        source->impulse_written = true;
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+struct LatencyTestDelay {
+    int silence_left;
+};
+
+static int latency_test_delay_create(struct GenesisNode *node) {
+    LatencyTestDelay *delay = create_zero<LatencyTestDelay>();
+    if (!delay)
+        return GenesisErrorNoMem;
+    delay->silence_left = LATENCY_TEST_FRAMES;
+    node->userdata = delay;
+    genesis_node_set_latency(node, LATENCY_TEST_FRAMES);
+    return 0;
+}
+
+static void latency_test_delay_destroy(struct GenesisNode *node) {
+    destroy((LatencyTestDelay *)node->userdata, 1);
+}
+
+// outputs LATENCY_TEST_FRAMES of silence, then its input
+static void latency_test_delay_run(struct GenesisNode *node) {
+    LatencyTestDelay *delay = (LatencyTestDelay *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    int out_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    int silence_frame_count = min(out_frame_count, delay->silence_left);
+    for (int i = 0; i < silence_frame_count * channel_count; i += 1)
+        out_buf[i] = 0.0f;
+    delay->silence_left -= silence_frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, silence_frame_count);
+
+    int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port),
+            genesis_audio_out_port_free_count(audio_out_port));
+    memcpy(genesis_audio_out_port_write_ptr(audio_out_port), genesis_audio_in_port_read_ptr(audio_in_port),
+            frame_count * channel_count * sizeof(float));
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void latency_test_sink_run(struct GenesisNode *node) {
+    LatencyTestSink *sink = (LatencyTestSink *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        if (in_buf[frame * channel_count] != 0.0f) {
+            sink->impulse_frame = sink->frame_count + frame;
+            sink->impulse_value = in_buf[frame * channel_count];
+            sink->impulse_count += 1;
+        }
+    }
+    sink->frame_count += frame_count;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+// Two copies of an impulse reach a mixer, one of them through a node with
+// latency. The other one has to be delayed to match, to the sample even
+// when the latency is not a multiple of the quantum.
+static void run_latency_compensation_test(int quantum) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, 1));
+    ok_or_panic(genesis_pipeline_set_quantum(pipeline, quantum));
+
+    LatencyTestSink sink = {0, -1, 0.0f, 0};
+    GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+            "impulse", GenesisPortTypeAudioOut, latency_test_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_create_callback(source_descr, latency_test_source_create);
+    genesis_node_descriptor_set_destroy_callback(source_descr, latency_test_source_destroy);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, latency_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, &sink);
+
+    GenesisNodeDescriptor *delay_descr = genesis_create_node_descriptor(pipeline, 2, "lookahead", "lookahead");
+    assert(delay_descr);
+    genesis_node_descriptor_set_run_callback(delay_descr, latency_test_delay_run);
+    genesis_node_descriptor_set_create_callback(delay_descr, latency_test_delay_create);
+    genesis_node_descriptor_set_destroy_callback(delay_descr, latency_test_delay_destroy);
+    for (int i = 0; i < 2; i += 1) {
+        GenesisPortDescriptor *port_descr = genesis_node_descriptor_create_port(delay_descr, i,
+                (i == 0) ? GenesisPortTypeAudioIn : GenesisPortTypeAudioOut, (i == 0) ? "audio_in" : "audio_out");
+        assert(port_descr);
+        genesis_audio_port_descriptor_set_channel_layout(port_descr,
+                genesis_pipeline_get_channel_layout(pipeline), true, -1);
+        genesis_audio_port_descriptor_set_sample_rate(port_descr,
+                genesis_pipeline_get_sample_rate(pipeline), true, -1);
+    }
+
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 2, &mixer_descr));
+
+    GenesisNode *sink_node = genesis_node_descriptor_create_node(sink_descr);
+    GenesisNode *mixer_node = genesis_node_descriptor_create_node(mixer_descr);
+    GenesisNode *direct_node = genesis_node_descriptor_create_node(source_descr);
+    GenesisNode *delayed_node = genesis_node_descriptor_create_node(source_descr);
+    GenesisNode *delay_node = genesis_node_descriptor_create_node(delay_descr);
+    assert(sink_node && mixer_node && direct_node && delayed_node && delay_node);
+
+    ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(direct_node, 0), genesis_node_port(mixer_node, 1)));
+    ok_or_panic(genesis_connect_audio_nodes(delayed_node, delay_node));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(delay_node, 1), genesis_node_port(mixer_node, 2)));
+
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 10000));
+    assert(sink.impulse_count == 1);
+    assert(sink.impulse_frame == LATENCY_TEST_FRAMES);
+    assert(sink.impulse_value == 2.0f);
+    double expected_latency = LATENCY_TEST_FRAMES / (double)genesis_pipeline_get_sample_rate(pipeline);
+    assert(fabs(genesis_node_path_latency(sink_node) - expected_latency) < 0.000001);
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static void test_latency_compensation(void) {
+    run_latency_compensation_test(0);
+    run_latency_compensation_test(64);
+}
+
+static void test_param_port(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 1, "param", "param");
+    assert(node_descr);
+    GenesisPortDescriptor *port_descr = genesis_node_descriptor_create_port(node_descr, 0,
+            GenesisPortTypeParamIn, "gain");
+    assert(port_descr);
+    assert(genesis_param_port_descriptor_set_range(port_descr, 2.0f, 0.0f, 1.0f) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_param_port_descriptor_set_range(port_descr, 0.5f, 0.0f, 1.0f));
+    GenesisNode *node = genesis_node_descriptor_create_node(node_descr);
+    assert(node);
+    GenesisPort *port = genesis_node_port(node, 0);
+
+    // nothing scheduled: one constant segment at the default
+    int segment_count;
+    const GenesisParamSegment *segments = genesis_param_in_port_segments(port, 16, &segment_count);
+    assert(segment_count == 1);
+    assert(segments[0].frame_count == 16 && segments[0].start_value == 0.5f && segments[0].step == 0.0f);
+    assert(genesis_param_port_frame_index(port) == 16);
+
+    // a jump at frame 26, then a ramp down to 0 over 10 frames from frame 36
+    ok_or_panic(genesis_param_port_schedule(port, 26, 2.0f, 0));
+    ok_or_panic(genesis_param_port_schedule(port, 36, 0.0f, 10));
+    segments = genesis_param_in_port_segments(port, 64, &segment_count);
+    assert(segment_count == 4);
+    assert(segments[0].frame_count == 10 && segments[0].start_value == 0.5f);
+    assert(segments[1].frame_count == 10 && segments[1].start_value == 1.0f && segments[1].step == 0.0f);
+    assert(segments[2].frame_count == 10 && segments[2].start_value == 1.0f);
+    assert(fabsf(segments[2].step + 0.1f) < 0.0001f);
+    assert(segments[3].frame_count == 34 && segments[3].start_value == 0.0f && segments[3].step == 0.0f);
+
+    // a ramp that spans two blocks, scheduled for a frame that already passed
+    ok_or_panic(genesis_param_port_schedule(port, 0, 1.0f, 8));
+    segments = genesis_param_in_port_segments(port, 4, &segment_count);
+    assert(segment_count == 1 && segments[0].frame_count == 4 && segments[0].step == 0.125f);
+    segments = genesis_param_in_port_segments(port, 8, &segment_count);
+    assert(segment_count == 2);
+    assert(segments[0].frame_count == 4 && segments[0].start_value == 0.5f);
+    assert(segments[1].frame_count == 4 && segments[1].start_value == 1.0f);
+
+    // the consumer has to keep up
+    int err = 0;
+    for (int i = 0; i < 100000 && !err; i += 1)
+        err = genesis_param_port_schedule(port, 100 + i, 0.25f, 0);
+    assert(err == GenesisErrorQueueFull);
+
+    // seeking applies whatever was still queued
+    genesis_node_seek(node, 0.0);
+    assert(genesis_param_port_frame_index(port) == 0);
+    segments = genesis_param_in_port_segments(port, 4, &segment_count);
+    assert(segment_count == 1 && segments[0].start_value == 0.25f);
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+struct MixerGainTestSink {
+    long frame_count;
+    bool samples_correct;
+};
+
+static void mixer_gain_test_sink_run(struct GenesisNode *node) {
+    MixerGainTestSink *sink = (MixerGainTestSink *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    assert(genesis_audio_port_channel_layout(audio_in_port)->channel_count == 2);
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        if (in_buf[frame * 2] != 1.5f || in_buf[frame * 2 + 1] != 0.5f)
+            sink->samples_correct = false;
+    }
+    sink->frame_count += frame_count;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+static void test_mixer_gain_pan(void) {
+    // the vector loops and the scalar tail agree with plain arithmetic
+    float in[37];
+    float gains[37];
+    float out[37];
+    for (int i = 0; i < 37; i += 1) {
+        in[i] = i * 0.25f;
+        gains[i] = (i % 4) * 0.5f;
+        out[i] = 1.0f;
+    }
+    mix_add_scaled(out, in, 2.0f, 37);
+    mix_add_multiplied(out, in, gains, 37);
+    for (int i = 0; i < 37; i += 1)
+        assert(out[i] == 1.0f + in[i] * 2.0f + in[i] * gains[i]);
+
+    float left[19];
+    float right[19];
+    float stereo_out[38];
+    for (int i = 0; i < 19; i += 1) {
+        left[i] = i * 0.5f;
+        right[i] = -i * 0.25f;
+    }
+    float *channels[2] = {left, right};
+    float channel_gains[2] = {2.0f, 0.5f};
+    memset(stereo_out, 0, sizeof(stereo_out));
+    mix_add_planar_scaled(stereo_out, channels, channel_gains, 2, 19);
+    for (int i = 0; i < 19; i += 1) {
+        assert(stereo_out[i * 2] == left[i] * 2.0f);
+        assert(stereo_out[i * 2 + 1] == right[i] * 0.5f);
+    }
+
+    float sample_gains[38];
+    for (int i = 0; i < 38; i += 1)
+        sample_gains[i] = (i % 5) * 0.25f;
+    mix_add_planar_multiplied(stereo_out, channels, sample_gains, 2, 19);
+    for (int i = 0; i < 19; i += 1) {
+        assert(stereo_out[i * 2] == left[i] * 2.0f + left[i] * sample_gains[i * 2]);
+        assert(stereo_out[i * 2 + 1] == right[i] * 0.5f + right[i] * sample_gains[i * 2 + 1]);
+    }
+    float mono_out[19];
+    memset(mono_out, 0, sizeof(mono_out));
+    mix_add_planar_multiplied(mono_out, channels, sample_gains, 1, 19);
+    for (int i = 0; i < 19; i += 1)
+        assert(mono_out[i] == left[i] * sample_gains[i]);
+
+    // an interleaved input at double gain in the middle and a planar one at
+    // four times gain panned hard left
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+
+    MixerGainTestSink sink = {0, true};
+    GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+            "source", GenesisPortTypeAudioOut, offline_render_test_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    GenesisNodeDescriptor *planar_source_descr = create_offline_render_test_descriptor(pipeline,
+            "planar source", GenesisPortTypeAudioOut, offline_render_test_planar_source_run, false,
+            GenesisAudioPortFormatPlanar);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, mixer_gain_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, &sink);
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 2, &mixer_descr));
+
+    GenesisNode *sink_node = genesis_node_descriptor_create_node(sink_descr);
+    GenesisNode *mixer_node = genesis_node_descriptor_create_node(mixer_descr);
+    GenesisNode *source_node = genesis_node_descriptor_create_node(source_descr);
+    GenesisNode *planar_source_node = genesis_node_descriptor_create_node(planar_source_descr);
+    assert(sink_node && mixer_node && source_node && planar_source_node);
+
+    ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0),
+                genesis_node_port(mixer_node, 1)));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(planar_source_node, 0),
+                genesis_node_port(mixer_node, 2)));
+
+    ok_or_panic(genesis_param_port_schedule(mixer_gain_port(mixer_node, 0), 0, 2.0f, 0));
+    ok_or_panic(genesis_param_port_schedule(mixer_gain_port(mixer_node, 1), 0, 4.0f, 0));
+    ok_or_panic(genesis_param_port_schedule(mixer_pan_port(mixer_node, 1), 0, -1.0f, 0));
+
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 10000));
+    assert(sink.frame_count >= 10000);
+    assert(sink.samples_correct);
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static const int MIXER_RAMP_TEST_FRAMES = 4000;
+
+struct MixerRampTestSink {
+    long frame_count;
+    // the first output channel, one sample per frame
+    float samples[MIXER_RAMP_TEST_FRAMES];
+};
+
+static void mixer_ramp_test_sink_run(struct GenesisNode *node) {
+    MixerRampTestSink *sink = (MixerRampTestSink *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        long frame_index = sink->frame_count + frame;
+        if (frame_index < MIXER_RAMP_TEST_FRAMES)
+            sink->samples[frame_index] = in_buf[frame * channel_count];
+    }
+    sink->frame_count += frame_count;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+static void test_mixer_gain_ramp(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+
+    MixerRampTestSink *sink = ok_mem(create_zero<MixerRampTestSink>());
+    GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+            "source", GenesisPortTypeAudioOut, offline_render_test_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, mixer_ramp_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, sink);
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 1, &mixer_descr));
+
+    GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+    GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, mixer_node));
+
+    // seeking applies whatever is queued, so schedule after it. The gain
+    // ramps from 1 to 3 over frames 1000 to 2000, then jumps to a value
+    // above the range, which is clamped to MIXER_MAX_GAIN.
+    genesis_pipeline_seek(pipeline, 0.0);
+    GenesisPort *gain_port = mixer_gain_port(mixer_node, 0);
+    ok_or_panic(genesis_param_port_schedule(gain_port, 1000, 3.0f, 1000));
+    ok_or_panic(genesis_param_port_schedule(gain_port, 3000, 100.0f, 0));
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, MIXER_RAMP_TEST_FRAMES));
+    assert(sink->frame_count >= MIXER_RAMP_TEST_FRAMES);
+
+    for (int i = 0; i <= 1000; i += 1)
+        assert(sink->samples[i] == 0.25f);
+    for (int i = 1001; i <= 2000; i += 1)
+        assert(sink->samples[i] > sink->samples[i - 1]);
+    assert(fabsf(sink->samples[1500] - 0.5f) < 0.001f);
+    for (int i = 2000; i < 3000; i += 1)
+        assert(fabsf(sink->samples[i] - 0.75f) < 0.0001f);
+    for (int i = 3000; i < MIXER_RAMP_TEST_FRAMES; i += 1)
+        assert(sink->samples[i] == 0.25f * MIXER_MAX_GAIN);
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+    destroy(sink, 1);
+}
+
+static const int RESAMPLE_TEST_IN_RATE = 48000;
+static const double RESAMPLE_TEST_HZ = 1000.0;
+
+struct ResampleTestCounter {
+    long frame_count;
+    double max_error;
+};
+
+static void resample_test_source_run(struct GenesisNode *node) {
+    ResampleTestCounter *source = (ResampleTestCounter *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        double t = (source->frame_count + frame) / (double)RESAMPLE_TEST_IN_RATE;
+        for (int ch = 0; ch < channel_count; ch += 1)
+            out_buf[frame * channel_count + ch] = 0.5 * sin(2.0 * M_PI * RESAMPLE_TEST_HZ * t);
+    }
+    source->frame_count += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void resample_test_sink_run(struct GenesisNode *node) {
+    ResampleTestCounter *sink = (ResampleTestCounter *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    int sample_rate = genesis_audio_port_sample_rate(audio_in_port);
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        long frame_index = sink->frame_count + frame;
+        // the filter starts out from silence
+        if (frame_index < 1000)
+            continue;
+        double expected = 0.5 * sin(2.0 * M_PI * RESAMPLE_TEST_HZ * frame_index / sample_rate);
+        for (int ch = 0; ch < channel_count; ch += 1)
+            sink->max_error = max(sink->max_error, fabs(in_buf[frame * channel_count + ch] - expected));
+    }
+    sink->frame_count += frame_count;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+struct ResampleTestQuality {
+    const char *name;
+    double max_error;
+};
+
+// from cheapest to best
+static const ResampleTestQuality resample_test_qualities[] = {
+    {"resample_linear", 0.002},
+    {"resample_cubic", 0.0001},
+    {"resample_sinc", 0.0001},
+    {"resample", 0.000001},
+};
+
+static void test_resample(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    assert(genesis_pipeline_get_sample_rate(pipeline) != RESAMPLE_TEST_IN_RATE);
+
+    ResampleTestCounter source = {0, 0.0};
+    ResampleTestCounter sink = {0, 0.0};
+    GenesisNodeDescriptor *source_descr = genesis_create_node_descriptor(pipeline, 1, "sine", "sine");
+    assert(source_descr);
+    genesis_node_descriptor_set_run_callback(source_descr, resample_test_source_run);
+    genesis_node_descriptor_set_userdata(source_descr, &source);
+    GenesisPortDescriptor *port_descr = genesis_node_descriptor_create_port(source_descr, 0,
+            GenesisPortTypeAudioOut, "audio_out");
+    assert(port_descr);
+    genesis_audio_port_descriptor_set_channel_layout(port_descr,
+            genesis_pipeline_get_channel_layout(pipeline), true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(port_descr, RESAMPLE_TEST_IN_RATE, true, -1);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, resample_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, &sink);
+
+    GenesisNode *source_node = genesis_node_descriptor_create_node(source_descr);
+    GenesisNode *sink_node = genesis_node_descriptor_create_node(sink_descr);
+    assert(source_node && sink_node);
+
+    GenesisNodeDescriptor *prev_descr = nullptr;
+    for (int i = 0; i < array_length(resample_test_qualities); i += 1) {
+        const ResampleTestQuality *quality = &resample_test_qualities[i];
+        GenesisNodeDescriptor *resample_descr = genesis_node_descriptor_find(pipeline, quality->name);
+        assert(resample_descr);
+        // better quality costs more
+        assert(genesis_node_descriptor_latency(resample_descr) > 0.0);
+        if (prev_descr) {
+            assert(genesis_node_descriptor_latency(resample_descr) >
+                    genesis_node_descriptor_latency(prev_descr));
+            assert(genesis_node_descriptor_ops_per_sample(resample_descr) >
+                    genesis_node_descriptor_ops_per_sample(prev_descr));
+        }
+        prev_descr = resample_descr;
+
+        GenesisNode *resample_node = genesis_node_descriptor_create_node(resample_descr);
+        assert(resample_node);
+        ok_or_panic(genesis_connect_audio_nodes(source_node, resample_node));
+        ok_or_panic(genesis_connect_audio_nodes(resample_node, sink_node));
+
+        source.frame_count = 0;
+        sink.frame_count = 0;
+        sink.max_error = 0.0;
+        genesis_pipeline_seek(pipeline, 0.0);
+        ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 20000));
+        assert(sink.frame_count >= 20000);
+        assert(sink.max_error < quality->max_error);
+
+        genesis_node_destroy(resample_node);
+    }
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static AssetVariant *wait_for_asset_variant(AssetVariantCache *cache) {
+    uint64_t deadline = os_get_time_ns() + 10000000000ULL;
+    AssetVariant *variant;
+    while (!(variant = asset_variant_cache_take_done(cache))) {
+        if (os_get_time_ns() > deadline)
+            panic("timed out waiting for asset variant");
+        os_sleep_until_ns(os_get_time_ns() + 1000000);
+    }
+    return variant;
+}
+
+static void test_asset_variant_cache(void) {
+    static const char *asset_path = "../test/tiny-sine.ogg";
+    ByteBuffer sha256sum("test_asset_variant_cache");
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisAudioFile *asset_file;
+    ok_or_panic(genesis_audio_file_load(context, asset_path, &asset_file));
+    int asset_sample_rate = genesis_audio_file_sample_rate(asset_file);
+    int sample_rate = (asset_sample_rate == 48000) ? 44100 : 48000;
+    long frame_count = (genesis_audio_file_frame_count(asset_file) * sample_rate +
+            asset_sample_rate - 1) / asset_sample_rate;
+    genesis_audio_file_destroy(asset_file);
+
+    ByteBuffer variant_path;
+    variant_path.format("/tmp/%s-%d.flac", sha256sum.to_string().raw(), sample_rate);
+    os_delete(variant_path.raw());
+
+    // the second time the variant comes from the file the first one saved
+    for (int i = 0; i < 2; i += 1) {
+        AssetVariantCache *cache;
+        ok_or_panic(asset_variant_cache_create(context, "/tmp", &cache));
+        ok_or_panic(asset_variant_cache_request(cache, sha256sum, asset_path, sample_rate));
+        AssetVariant *variant = wait_for_asset_variant(cache);
+        assert(variant->audio_file);
+        assert(genesis_audio_file_sample_rate(variant->audio_file) == sample_rate);
+        assert(genesis_audio_file_frame_count(variant->audio_file) == frame_count);
+        assert(variant->from_cache == (i == 1));
+        genesis_audio_file_destroy(variant->audio_file);
+        asset_variant_destroy(variant);
+        asset_variant_cache_destroy(cache);
+
+        FILE *variant_file = fopen(variant_path.raw(), "rb");
+        assert(variant_file);
+        fclose(variant_file);
+    }
+
+    ok_or_panic(os_delete(variant_path.raw()));
+
+    // variants come out in the order they were asked for. An asset that
+    // does not exist fails at once, without saving anything.
+    static const int ORDER_TEST_COUNT = 3;
+    ByteBuffer order_sha256sums[ORDER_TEST_COUNT];
+    AssetVariantCache *cache;
+    ok_or_panic(asset_variant_cache_create(context, "/tmp", &cache));
+    for (int i = 0; i < ORDER_TEST_COUNT; i += 1) {
+        order_sha256sums[i].format("test_asset_variant_cache_order_%d", i);
+        ok_or_panic(asset_variant_cache_request(cache, order_sha256sums[i],
+                    "/tmp/test_genesis_missing_asset.ogg", sample_rate));
+    }
+    for (int i = 0; i < ORDER_TEST_COUNT; i += 1) {
+        AssetVariant *variant = wait_for_asset_variant(cache);
+        assert(ByteBuffer::equal(variant->sha256sum, order_sha256sums[i]));
+        assert(!variant->audio_file);
+        assert(variant->err);
+        asset_variant_destroy(variant);
+    }
+    asset_variant_cache_destroy(cache);
+
+    genesis_context_destroy(context);
+}
+
+static void test_channel_remap(void) {
+    static float matrix[GENESIS_CHANNEL_ID_COUNT][GENESIS_CHANNEL_ID_COUNT];
+    float mono[300];
+    float stereo[600];
+    float out[600];
+    for (int frame = 0; frame < 300; frame += 1) {
+        mono[frame] = frame * 0.25f;
+        stereo[frame * 2] = frame * 0.5f;
+        stereo[frame * 2 + 1] = -frame * 0.25f;
+    }
+    float *mono_ptrs[1] = {mono};
+    float *stereo_ptrs[2] = {stereo, stereo + 1};
+    float *out_ptrs[2] = {out, out + 1};
+    ChannelRemap remap;
+
+    // stereo to stereo is a copy
+    memset(matrix, 0, sizeof(matrix));
+    matrix[0][0] = 1.0f;
+    matrix[1][1] = 1.0f;
+    channel_remap_init(&remap, matrix, 2, 2);
+    assert(remap.kind == ChannelRemapKindIdentity);
+    channel_remap_run(&remap, stereo_ptrs, 2, out_ptrs, 2, 300);
+    assert(memcmp(out, stereo, sizeof(stereo)) == 0);
+
+    // mono to stereo
+    memset(matrix, 0, sizeof(matrix));
+    matrix[0][0] = 1.0f;
+    matrix[1][0] = 0.5f;
+    channel_remap_init(&remap, matrix, 1, 2);
+    assert(remap.kind == ChannelRemapKindDuplicate);
+    channel_remap_run(&remap, mono_ptrs, 1, out_ptrs, 2, 300);
+    for (int frame = 0; frame < 300; frame += 1)
+        assert(out[frame * 2] == mono[frame] && out[frame * 2 + 1] == mono[frame] * 0.5f);
+
+    // stereo to mono
+    memset(matrix, 0, sizeof(matrix));
+    matrix[0][0] = 0.5f;
+    matrix[0][1] = 0.5f;
+    channel_remap_init(&remap, matrix, 2, 1);
+    assert(remap.kind == ChannelRemapKindAverage);
+    channel_remap_run(&remap, stereo_ptrs, 2, out_ptrs, 1, 300);
+    for (int frame = 0; frame < 300; frame += 1)
+        assert(out[frame] == (stereo[frame * 2] + stereo[frame * 2 + 1]) * 0.5f);
+
+    // swapped channels
+    memset(matrix, 0, sizeof(matrix));
+    matrix[0][1] = 1.0f;
+    matrix[1][0] = 1.0f;
+    channel_remap_init(&remap, matrix, 2, 2);
+    assert(remap.kind == ChannelRemapKindSparse);
+    channel_remap_run(&remap, stereo_ptrs, 2, out_ptrs, 2, 300);
+    for (int frame = 0; frame < 300; frame += 1)
+        assert(out[frame * 2] == stereo[frame * 2 + 1] && out[frame * 2 + 1] == stereo[frame * 2]);
+
+    // anything else, more frames than the matrix path does at once
+    memset(matrix, 0, sizeof(matrix));
+    matrix[0][0] = 0.75f;
+    matrix[0][1] = 0.25f;
+    matrix[1][0] = 0.25f;
+    matrix[1][1] = 0.75f;
+    channel_remap_init(&remap, matrix, 2, 2);
+    assert(remap.kind == ChannelRemapKindMatrix);
+    channel_remap_run(&remap, stereo_ptrs, 2, out_ptrs, 2, 300);
+    for (int frame = 0; frame < 300; frame += 1) {
+        float left = stereo[frame * 2];
+        float right = stereo[frame * 2 + 1];
+        assert(out[frame * 2] == left * 0.75f + right * 0.25f);
+        assert(out[frame * 2 + 1] == left * 0.25f + right * 0.75f);
+    }
+}
+
 static void test_path_extension(void) {
     assert(ByteBuffer::compare(os_path_extension("foo"), "") == 0);
     assert(ByteBuffer::compare(os_path_extension("foo.ogg"), ".ogg") == 0);
@@ -476,6 +1733,395 @@ static void test_mirrored_memory(void) {
     os_deinit_mirrored_memory(&mem);
 }
 
+static void test_lock_memory(void) {
+    // locking fails where RLIMIT_MEMLOCK is too low. Then nothing may be
+    // counted as locked, and the rest of the test checks just that.
+    long locked_before = os_locked_memory_size();
+    struct OsMirroredMemory mem;
+    ok_or_panic(os_init_mirrored_memory(&mem, 1024));
+    bool can_lock = !os_lock_mirrored_memory(&mem, false);
+    assert(mem.locked == can_lock);
+    // the two halves are the same memory
+    assert(os_locked_memory_size() == locked_before + (can_lock ? (long)mem.capacity : 0));
+    os_deinit_mirrored_memory(&mem);
+    assert(os_locked_memory_size() == locked_before);
+
+    // two ranges on one page count once, and the page stays locked until
+    // both are unlocked
+    int page_size = os_page_size();
+    char *bytes = ok_mem(allocate_zero<char>(2 * page_size));
+    char *page = (char *)(((uintptr_t)bytes + page_size - 1) & ~(uintptr_t)(page_size - 1));
+    bool first_locked = !os_lock_memory(page, 64, false);
+    bool second_locked = !os_lock_memory(page + 64, 64, false);
+    assert(first_locked == second_locked);
+    long expected_size = locked_before + (first_locked ? page_size : 0);
+    assert(os_locked_memory_size() == expected_size);
+    if (first_locked) {
+        os_unlock_memory(page, 64);
+        assert(os_locked_memory_size() == expected_size);
+        os_unlock_memory(page + 64, 64);
+    }
+    assert(os_locked_memory_size() == locked_before);
+    destroy(bytes, 2 * page_size);
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, 2));
+    ok_or_panic(genesis_pipeline_set_lock_memory(pipeline, true, true));
+
+    OfflineRenderTestSink sink = {0, true};
+    GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+            "planar source", GenesisPortTypeAudioOut, offline_render_test_planar_source_run, false,
+            GenesisAudioPortFormatPlanar);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, offline_render_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, &sink);
+    GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, 2, &mixer_descr));
+
+    GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+    ok_or_panic(genesis_connect_audio_nodes(mixer_node, sink_node));
+    GenesisNode *source_nodes[2];
+    for (int i = 0; i < 2; i += 1) {
+        source_nodes[i] = ok_mem(genesis_node_descriptor_create_node(source_descr));
+        ok_or_panic(genesis_connect_ports(genesis_node_port(source_nodes[i], 0),
+                    genesis_node_port(mixer_node, i + 1)));
+    }
+
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 100000));
+    assert(sink.frame_count >= 100000);
+    assert(sink.samples_correct);
+
+    // the worker stacks went with the workers. What stays locked is at
+    // least the buffers of the three audio out ports, once each.
+    long locked_after_render = genesis_context_locked_memory_size(context);
+    if (can_lock) {
+        GenesisAudioPort *out_ports[] = {
+            reinterpret_cast<GenesisAudioPort*>(genesis_node_port(mixer_node, 0)),
+            reinterpret_cast<GenesisAudioPort*>(genesis_node_port(source_nodes[0], 0)),
+            reinterpret_cast<GenesisAudioPort*>(genesis_node_port(source_nodes[1], 0)),
+        };
+        long buffer_size = 0;
+        for (int i = 0; i < 3; i += 1)
+            buffer_size += out_ports[i]->sample_buffer.capacity;
+        assert(locked_after_render >= locked_before + buffer_size);
+    } else {
+        assert(locked_after_render == locked_before);
+    }
+
+    // the port buffers and the mixer's memory go with the pipeline
+    genesis_pipeline_destroy(pipeline);
+    assert(genesis_context_locked_memory_size(context) == locked_before);
+
+    genesis_context_destroy(context);
+}
+
+// What a new thread ends up with when it asks for policy on core cpu, found
+// on a thread of its own so that the test thread keeps its policy.
+struct ThreadPolicyProbe {
+    const GenesisThreadPolicy *policy;
+    int cpu;
+    int err;
+    GenesisThreadPolicy obtained;
+};
+
+static void thread_policy_probe_run(void *arg) {
+    ThreadPolicyProbe *probe = (ThreadPolicyProbe *)arg;
+    probe->err = os_set_thread_policy(probe->policy, probe->cpu);
+    os_get_thread_policy(&probe->obtained);
+}
+
+static void probe_thread_policy(ThreadPolicyProbe *probe) {
+    OsThread *thread;
+    ok_or_panic(os_thread_create(thread_policy_probe_run, probe, false, &thread));
+    os_thread_destroy(thread);
+}
+
+static bool thread_policies_equal(const GenesisThreadPolicy *a, const GenesisThreadPolicy *b) {
+    if (a->scheduler != b->scheduler || a->cpu_count != b->cpu_count)
+        return false;
+    for (int i = 0; i < a->cpu_count; i += 1) {
+        if (a->cpus[i] != b->cpus[i])
+            return false;
+    }
+    return true;
+}
+
+struct ThreadPolicyTestSink {
+    long frame_count;
+    // what the worker running the sink read back for itself
+    GenesisThreadPolicy observed;
+};
+
+static void thread_policy_test_sink_run(struct GenesisNode *node) {
+    ThreadPolicyTestSink *sink = (ThreadPolicyTestSink *)
+        genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    if (sink->frame_count == 0)
+        os_get_thread_policy(&sink->observed);
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    sink->frame_count += frame_count;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+static void test_thread_policy(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, 2));
+
+    GenesisThreadPolicy policy;
+    memset(&policy, 0, sizeof(policy));
+    policy.scheduler = GenesisThreadSchedulerDeadline;
+    assert(genesis_pipeline_set_thread_policy(pipeline, &policy) == GenesisErrorInvalidParam);
+    // the time sharing scheduler is always available; pinning may not be.
+    // each worker gets a core of its own where there are two.
+    policy.scheduler = GenesisThreadSchedulerOther;
+    policy.cpu_count = (os_concurrency() >= 2) ? 2 : 1;
+    policy.cpus[0] = 0;
+    policy.cpus[1] = 1;
+    ok_or_panic(genesis_pipeline_set_thread_policy(pipeline, &policy));
+
+    ThreadPolicyProbe probes[2];
+    for (int i = 0; i < 2; i += 1) {
+        ThreadPolicyProbe *probe = &probes[i];
+        probe->policy = &policy;
+        probe->cpu = policy.cpus[i % policy.cpu_count];
+        probe_thread_policy(probe);
+        assert(probe->obtained.scheduler == GenesisThreadSchedulerOther);
+        // a thread that may run on every core reads back no cores at all
+        if (!probe->err && os_concurrency() >= 2) {
+            assert(probe->obtained.cpu_count == 1);
+            assert(probe->obtained.cpus[0] == probe->cpu);
+        }
+    }
+
+    GenesisThreadPolicy obtained;
+    assert(genesis_pipeline_get_worker_thread_policy(pipeline, 0, &obtained) == GenesisErrorInvalidState);
+    assert(genesis_pipeline_get_worker_thread_policy(pipeline, 2, &obtained) == GenesisErrorInvalidParam);
+
+    ThreadPolicyTestSink sink;
+    memset(&sink, 0, sizeof(sink));
+    GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+            "source", GenesisPortTypeAudioOut, offline_render_test_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    GenesisNodeDescriptor *sink_descr = create_offline_render_test_descriptor(pipeline,
+            "sink", GenesisPortTypeAudioIn, thread_policy_test_sink_run, true,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(sink_descr, &sink);
+    GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, sink_node));
+
+    genesis_pipeline_seek(pipeline, 0.0);
+    ok_or_panic(genesis_pipeline_render_offline(pipeline, sink_node, 10000));
+    assert(sink.frame_count >= 10000);
+
+    // each worker reports what a thread asking for the same thing gets
+    for (int i = 0; i < 2; i += 1) {
+        ok_or_panic(genesis_pipeline_get_worker_thread_policy(pipeline, i, &obtained));
+        assert(thread_policies_equal(&obtained, &probes[i].obtained));
+    }
+    // and the nodes really run under it
+    assert(thread_policies_equal(&sink.observed, &probes[0].obtained) ||
+           thread_policies_equal(&sink.observed, &probes[1].obtained));
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static void test_timeline_conversion(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+
+    assert(genesis_whole_notes_to_ticks(0.25) == GENESIS_TICKS_PER_WHOLE_NOTE / 4);
+    assert(genesis_ticks_to_whole_notes(GENESIS_TICKS_PER_WHOLE_NOTE * 3) == 3.0);
+
+    // positions far from zero keep their sample accuracy
+    const int frame_rate = 48000;
+    long last_sample_pos = -1;
+    for (long ticks = 0; ticks < 1000000000L; ticks = ticks * 3 + 7) {
+        long sample_pos = genesis_ticks_to_sample_pos(pipeline, ticks, frame_rate);
+        assert(sample_pos >= last_sample_pos);
+        last_sample_pos = sample_pos;
+        long back = genesis_sample_pos_to_ticks(pipeline, sample_pos, frame_rate);
+        assert(back <= ticks);
+        assert(genesis_ticks_to_sample_pos(pipeline, back + 1, frame_rate) > sample_pos ||
+                back == ticks);
+    }
+    assert(genesis_whole_notes_to_sample_pos(pipeline, 7.0, frame_rate) ==
+            genesis_ticks_to_sample_pos(pipeline, 7 * GENESIS_TICKS_PER_WHOLE_NOTE, frame_rate));
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static void test_tempo_map(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    const int frame_rate = 48000;
+
+    // 120 whole notes per minute for 2 whole notes, then twice as fast
+    GenesisTempoChange changes[] = {
+        {0.0, 120.0},
+        {2.0, 240.0},
+    };
+    ok_or_panic(genesis_pipeline_set_tempo_map(pipeline, changes, array_length(changes)));
+    assert(genesis_whole_notes_to_seconds(pipeline, 1.0, frame_rate) == 0.5);
+    assert(genesis_whole_notes_to_seconds(pipeline, 2.0, frame_rate) == 1.0);
+    assert(genesis_whole_notes_to_seconds(pipeline, 4.0, frame_rate) == 1.5);
+    assert(genesis_frames_to_whole_notes(pipeline, frame_rate * 3 / 2, frame_rate) == 4.0);
+    assert(genesis_whole_notes_to_sample_pos(pipeline, 4.0, frame_rate) == frame_rate * 3 / 2);
+
+    long last_sample_pos = -1;
+    for (long ticks = 0; ticks < 8 * GENESIS_TICKS_PER_WHOLE_NOTE; ticks += 1) {
+        long sample_pos = genesis_ticks_to_sample_pos(pipeline, ticks, frame_rate);
+        assert(sample_pos > last_sample_pos);
+        last_sample_pos = sample_pos;
+        assert(genesis_sample_pos_to_ticks(pipeline, sample_pos, frame_rate) == ticks);
+    }
+
+    GenesisTempoSegment segment;
+    genesis_pipeline_get_tempo_segment(pipeline, frame_rate / 2, frame_rate, &segment);
+    assert(segment.start_sample_pos == 0);
+    assert(segment.end_sample_pos == frame_rate);
+    genesis_pipeline_get_tempo_segment(pipeline, frame_rate, frame_rate, &segment);
+    assert(segment.start_sample_pos == frame_rate);
+    assert(segment.end_sample_pos == LONG_MAX);
+    assert(genesis_tempo_segment_ticks_to_sample_pos(&segment, 4 * GENESIS_TICKS_PER_WHOLE_NOTE) ==
+            frame_rate * 3 / 2);
+
+    GenesisTempoChange unsorted_changes[] = {
+        {2.0, 120.0},
+        {1.0, 240.0},
+    };
+    assert(genesis_pipeline_set_tempo_map(pipeline, unsorted_changes, 2) == GenesisErrorInvalidParam);
+    assert(genesis_whole_notes_to_seconds(pipeline, 4.0, frame_rate) == 1.5);
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+// Plays 0.25 until *starve is set, then stops producing.
+static void virtual_device_test_source_run(struct GenesisNode *node) {
+    atomic_int *starve = (atomic_int *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    if (starve->load())
+        return;
+    offline_render_test_source_run(node);
+}
+
+// Polls get_count until it reaches min_count. Fails the test after
+// TEST_TIMEOUT_NS.
+static void wait_for_virtual_device_count(long (*get_count)(struct GenesisNode *),
+        GenesisNode *device_node, long min_count, const char *what)
+{
+    uint64_t deadline = os_get_time_ns() + TEST_TIMEOUT_NS;
+    while (get_count(device_node) < min_count) {
+        uint64_t now = os_get_time_ns();
+        if (now >= deadline)
+            panic("timed out waiting for %s", what);
+        os_sleep_until_ns(now + 1000000);
+    }
+}
+
+// Starts a source playing into a virtual device with the given clock and
+// waits for the first period. Then it either lets it play for duration_ns
+// of wall time or, with starve, stops the source and waits for the device
+// to miss a deadline.
+static void run_virtual_device(GenesisVirtualClock clock, uint64_t duration_ns, bool starve,
+        long *out_period_count, long *out_missed_count)
+{
+    static const int PERIOD_FRAME_COUNT = 256;
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, 2));
+
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    const SoundIoChannelLayout *layout = genesis_pipeline_get_channel_layout(pipeline);
+    GenesisNodeDescriptor *device_descr;
+    assert(genesis_virtual_device_create_node_descriptor(pipeline, clock,
+                sample_rate, layout, 0, &device_descr) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_virtual_device_create_node_descriptor(pipeline, clock,
+                sample_rate, layout, PERIOD_FRAME_COUNT, &device_descr));
+
+    atomic_int source_starve;
+    source_starve.store(0);
+    GenesisNodeDescriptor *source_descr = create_offline_render_test_descriptor(pipeline,
+            "source", GenesisPortTypeAudioOut, virtual_device_test_source_run, false,
+            GenesisAudioPortFormatInterleaved);
+    genesis_node_descriptor_set_userdata(source_descr, &source_starve);
+    GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    GenesisNode *device_node = ok_mem(genesis_node_descriptor_create_node(device_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, device_node));
+    assert(genesis_node_virtual_device_period_count(device_node) == 0);
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    wait_for_virtual_device_count(genesis_node_virtual_device_period_count, device_node, 1,
+            "the first virtual device period");
+    if (starve) {
+        source_starve.store(1);
+        wait_for_virtual_device_count(genesis_node_virtual_device_missed_count, device_node, 1,
+                "a missed virtual device deadline");
+    } else {
+        os_sleep_until_ns(os_get_time_ns() + duration_ns);
+    }
+    genesis_pipeline_stop(pipeline);
+
+    // the device takes whole periods, and each one moves the playback
+    // position on by a period
+    long period_count = genesis_node_virtual_device_period_count(device_node);
+    long offset = genesis_node_playback_offset(device_node);
+    assert(offset % PERIOD_FRAME_COUNT == 0);
+    assert(offset <= period_count * PERIOD_FRAME_COUNT);
+    assert(genesis_node_playback_latency(device_node) == PERIOD_FRAME_COUNT / (double)sample_rate);
+    *out_period_count = period_count;
+    *out_missed_count = genesis_node_virtual_device_missed_count(device_node);
+
+    genesis_pipeline_destroy(pipeline);
+    genesis_context_destroy(context);
+}
+
+static void test_virtual_device(void) {
+    // how fast the wall time clock goes depends on how loaded the machine
+    // is, so only what does not depend on it is checked
+    static const uint64_t DURATION_NS = 300000000;
+    long wall_time_period_count;
+    long wall_time_missed_count;
+    run_virtual_device(GenesisVirtualClockWallTime, DURATION_NS, false,
+            &wall_time_period_count, &wall_time_missed_count);
+    assert(wall_time_period_count >= 1);
+    assert(wall_time_missed_count == 0);
+
+    // a graph that stops producing misses the next deadline
+    long starved_period_count;
+    long starved_missed_count;
+    run_virtual_device(GenesisVirtualClockWallTime, 0, true,
+            &starved_period_count, &starved_missed_count);
+    assert(starved_period_count >= 1);
+    assert(starved_missed_count >= 1);
+
+    // the free running clock never waits for wall time, so it takes at
+    // least as many periods, and it waits for the graph instead of missing
+    long free_running_period_count;
+    long free_running_missed_count;
+    run_virtual_device(GenesisVirtualClockFreeRunning, DURATION_NS, false,
+            &free_running_period_count, &free_running_missed_count);
+    assert(free_running_period_count >= wall_time_period_count);
+    assert(free_running_missed_count == 0);
+}
+
 struct Test {
     const char *name;
     void (*fn)(void);
@@ -491,6 +2137,7 @@ static struct Test tests[] = {
     {"RingBuffer", test_ring_buffer},
     {"euclidean_mod", test_euclidean_mod},
     {"ThreadSafeQueue", test_thread_safe_queue},
+    {"WorkStealingDeque", test_work_stealing_deque},
     {"greatest_common_denominator", test_gcd},
     {"sort keys basic", test_sort_keys_basic},
     {"sort keys count", test_sort_keys_count},
@@ -505,6 +2152,23 @@ static struct Test tests[] = {
     {"basic project editing", test_basic_project_editing},
     {"String::compare", test_string_compare},
     {"basic audio file loading and saving", test_audio_file},
+    {"offline render", test_offline_render},
+    {"node stats", test_node_stats},
+    {"planar ports", test_planar_ports},
+    {"port fan-out", test_port_fan_out},
+    {"live edit", test_live_edit},
+    {"param port", test_param_port},
+    {"latency compensation", test_latency_compensation},
+    {"mixer gain and pan", test_mixer_gain_pan},
+    {"mixer gain ramp", test_mixer_gain_ramp},
+    {"resample", test_resample},
+    {"channel remap", test_channel_remap},
+    {"asset variant cache", test_asset_variant_cache},
+    {"lock memory", test_lock_memory},
+    {"thread policy", test_thread_policy},
+    {"timeline conversion", test_timeline_conversion},
+    {"tempo map", test_tempo_map},
+    {"virtual device", test_virtual_device},
     {"os_path_extension", test_path_extension},
     {"AtomicValue", test_atomic_value},
     {"AtomicDouble", test_atomic_double},
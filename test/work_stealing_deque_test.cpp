@@ -0,0 +1,97 @@
+#include "work_stealing_deque_test.hpp"
+#include "work_stealing_deque.hpp"
+#include "os.hpp"
+
+static const int item_count = 100000;
+static const int thief_count = 3;
+
+static WorkStealingDeque<int *> *deque = nullptr;
+static int *items = nullptr;
+static atomic_int *taken_counts = nullptr;
+static atomic_int total_taken;
+
+static void test_assert(bool expr, const char *explain) {
+    if (!expr)
+        panic("assertion failure: %s", explain);
+}
+
+static void assert_no_err(int err) {
+    if (err)
+        panic("Error: %s", genesis_strerror(err));
+}
+
+static void take_item(int *item) {
+    int index = item - items;
+    test_assert(index >= 0 && index < item_count, "item out of range");
+    taken_counts[index] += 1;
+    total_taken += 1;
+}
+
+static void thief_thread(void *userdata) {
+    while (total_taken.load() < item_count) {
+        int *item = deque->steal();
+        if (item)
+            take_item(item);
+    }
+}
+
+void test_work_stealing_deque(void) {
+    deque = create<WorkStealingDeque<int *>>();
+    items = allocate_zero<int>(item_count);
+    taken_counts = allocate_zero<atomic_int>(item_count);
+    assert_no_err(deque->resize(5));
+
+    // owner end is last-in-first-out, thief end is first-in-first-out
+    test_assert(deque->pop() == nullptr, "pop from empty deque");
+    test_assert(deque->steal() == nullptr, "steal from empty deque");
+    for (int i = 0; i < 8; i += 1)
+        deque->push(&items[i]);
+    test_assert(deque->pop() == &items[7], "pop order");
+    test_assert(deque->steal() == &items[0], "steal order");
+    test_assert(deque->steal() == &items[1], "steal order");
+    test_assert(deque->pop() == &items[6], "pop order");
+    for (int i = 0; i < 4; i += 1)
+        test_assert(deque->pop() == &items[5 - i], "pop order");
+    test_assert(deque->pop() == nullptr, "pop from empty deque");
+    test_assert(deque->empty(), "deque should be empty");
+
+    // every item is taken exactly once while thieves race against the owner
+    assert_no_err(deque->resize(1024));
+    total_taken.store(0);
+    OsThread *threads[thief_count];
+    for (int i = 0; i < thief_count; i += 1)
+        assert_no_err(os_thread_create(thief_thread, nullptr, false, &threads[i]));
+
+    int next_item = 0;
+    while (next_item < item_count) {
+        for (int i = 0; i < 64 && next_item < item_count; i += 1)
+            deque->push(&items[next_item++]);
+        for (int i = 0; i < 16; i += 1) {
+            int *item = deque->pop();
+            if (item)
+                take_item(item);
+        }
+        // don't overflow the deque if the thieves fall behind
+        while (next_item - total_taken.load() > 512) {
+            int *item = deque->pop();
+            if (item)
+                take_item(item);
+        }
+    }
+    for (;;) {
+        int *item = deque->pop();
+        if (!item)
+            break;
+        take_item(item);
+    }
+    for (int i = 0; i < thief_count; i += 1)
+        os_thread_destroy(threads[i]);
+
+    test_assert(total_taken.load() == item_count, "wrong number of items taken");
+    for (int i = 0; i < item_count; i += 1)
+        test_assert(taken_counts[i].load() == 1, "item taken more than once");
+
+    destroy(taken_counts, 0);
+    destroy(items, 0);
+    destroy(deque, 1);
+}